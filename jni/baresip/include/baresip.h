@@ -99,6 +99,7 @@ struct config {
 		int width, height;     /**< Video resolution              */
 		uint32_t bitrate;      /**< Encoder bitrate in [bit/s]    */
 		uint32_t fps;          /**< Video framerate               */
+		uint32_t conv_threads; /**< Pixel conversion threads      */
 	} video;
 
 	/** Audio/Video Transport */
@@ -109,6 +110,8 @@ struct config {
 		bool rtcp_enable;      /**< RTCP is enabled                  */
 		bool rtcp_mux;         /**< RTP/RTCP multiplexing            */
 		struct range jbuf_del; /**< Delay, number of frames          */
+		enum jbuf_type jbtype; /**< Jitter buffer type (audio)       */
+		uint32_t workers;      /**< Number of RTP worker threads     */
 	} avt;
 
 	/* Network */
@@ -137,9 +137,7 @@ USE_SPEEX_RESAMP := $(shell [ -f $(SYSROOT)/include/speex/speex_resampler.h ] \
 	|| [ -f $(SYSROOT)/local/include/speex/speex_resampler.h ] \
 	|| [ -f $(SYSROOT_ALT)/include/speex/speex_resampler.h ] \
 	&& echo "yes")
-USE_SRTP := $(shell [ -f $(SYSROOT)/include/srtp/srtp.h ] || \
-	[ -f $(SYSROOT_ALT)/include/srtp/srtp.h ] || \
-	[ -f $(SYSROOT)/local/include/srtp/srtp.h ] && echo "yes")
+USE_SRTP := $(USE_OPENSSL)
 USE_SYSLOG := $(shell [ -f $(SYSROOT)/include/syslog.h ] || \
 	[ -f $(SYSROOT_ALT)/include/syslog.h ] || \
 	[ -f $(SYSROOT)/local/include/syslog.h ] && echo "yes")
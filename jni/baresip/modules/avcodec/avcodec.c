@@ -221,7 +221,7 @@ static int alloc(struct vidcodec_st **stp, struct vidcodec *vc,
 
 	st->enc.mb  = mbuf_alloc(FF_MIN_BUFFER_SIZE * 20);
 	st->dec.mb  = mbuf_alloc(1024);
-	st->mb_frag = mbuf_alloc(1024);
+	st->mb_frag = mbuf_alloc(RTP_PRESZ + MAX_RTP_SIZE);
 	if (!st->enc.mb || !st->dec.mb || !st->mb_frag) {
 		err = ENOMEM;
 		goto out;
@@ -336,13 +336,15 @@ static int enc(struct vidcodec_st *st, bool update,
 
 	mbuf_rewind(st->enc.mb);
 
+	/* room around the frame, so that packets can be built in place */
 #if LIBAVCODEC_VERSION_INT >= ((54<<16)+(1<<8)+0)
 	do {
 		AVPacket avpkt;
 		int got_packet;
 
-		avpkt.data = st->enc.mb->buf;
-		avpkt.size = (int)st->enc.mb->size;
+		avpkt.data = st->enc.mb->buf + ENC_HEADROOM;
+		avpkt.size = (int)(st->enc.mb->size - ENC_HEADROOM -
+				   ENC_TAILROOM);
 
 		ret = avcodec_encode_video2(st->enc.ctx, &avpkt,
 					    st->enc.pict, &got_packet);
@@ -351,12 +353,15 @@ static int enc(struct vidcodec_st *st, bool update,
 		if (!got_packet)
 			return 0;
 
-		mbuf_set_end(st->enc.mb, avpkt.size);
+		mbuf_set_end(st->enc.mb, ENC_HEADROOM + avpkt.size);
 
 	} while (0);
 #else
-	ret = avcodec_encode_video(st->enc.ctx, st->enc.mb->buf,
-				   (int)st->enc.mb->size, st->enc.pict);
+	ret = avcodec_encode_video(st->enc.ctx,
+				   st->enc.mb->buf + ENC_HEADROOM,
+				   (int)(st->enc.mb->size - ENC_HEADROOM -
+					 ENC_TAILROOM),
+				   st->enc.pict);
 	if (ret < 0 )
 		return EBADMSG;
 
@@ -367,9 +372,11 @@ static int enc(struct vidcodec_st *st, bool update,
 		st->enc.sz_max = ret;
 	}
 
-	mbuf_set_end(st->enc.mb, ret);
+	mbuf_set_end(st->enc.mb, ENC_HEADROOM + ret);
 #endif
 
+	st->enc.mb->pos = ENC_HEADROOM;
+
 	switch (st->codec_id) {
 
 	case CODEC_ID_H263:
@@ -7,7 +7,9 @@
 
 enum {
 	MAX_RTP_SIZE     = 1024,
-	RTP_PRESZ        = 4 + RTP_HEADER_SIZE
+	RTP_PRESZ        = 4 + RTP_HEADER_SIZE,
+	ENC_HEADROOM     = RTP_PRESZ,  /* space before encoded frame */
+	ENC_TAILROOM     = H264_RTP_TAILROOM  /* space after encoded frame */
 };
 
 struct picsz {
@@ -72,47 +72,6 @@ int fu_hdr_decode(struct fu *fu, struct mbuf *mb)
 }
 
 
-/*
- * Find the NAL start sequence in a H.264 byte stream
- *
- * @note: copied from ffmpeg source
- */
-const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
-{
-	const uint8_t *a = p + 4 - ((long)p & 3);
-
-	for (end -= 3; p < a && p < end; p++ ) {
-		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-			return p;
-	}
-
-	for (end -= 3; p < end; p += 4) {
-		uint32_t x = *(const uint32_t*)p;
-		if ( (x - 0x01010101) & (~x) & 0x80808080 ) {
-			if (p[1] == 0 ) {
-				if ( p[0] == 0 && p[2] == 1 )
-					return p;
-				if ( p[2] == 0 && p[3] == 1 )
-					return p+1;
-			}
-			if ( p[3] == 0 ) {
-				if ( p[2] == 0 && p[4] == 1 )
-					return p+2;
-				if ( p[4] == 0 && p[5] == 1 )
-					return p+3;
-			}
-		}
-	}
-
-	for (end += 3; p < end; p++) {
-		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-			return p;
-	}
-
-	return end + 3;
-}
-
-
 int h264_decode_sprop_params(AVCodecContext *codec, struct pl *pl)
 {
 	static const uint8_t start_seq[] = {0, 0, 1};
@@ -301,12 +260,16 @@ int h264_nal_send(struct vidcodec_st *st, bool first, bool last,
 
 int h264_packetize(struct vidcodec_st *st, struct mbuf *mb)
 {
-	const uint8_t *start = mb->buf;
-	const uint8_t *end   = start + mb->end;
+	const uint8_t *end = mb->buf + mb->end;
 	const uint8_t *r;
 	int err = 0;
 
-	r = h264_find_startcode(mb->buf, end);
+	/* the packets are built in place, in the headroom of the frame */
+	if (!st->enqh)
+		return h264_rtp_packetize(mb, MAX_RTP_SIZE, RTP_PRESZ,
+					  st->mb_frag, st->sendh, st->arg);
+
+	r = h264_find_startcode(mbuf_buf(mb), end);
 
 	while (r < end) {
 		const uint8_t *r1;
@@ -317,12 +280,8 @@ int h264_packetize(struct vidcodec_st *st, struct mbuf *mb)
 
 		r1 = h264_find_startcode(r, end);
 
-		if (st->enqh)
-			err |= st->enqh((r1 >= end), r[0], r+1, r1-r-1,
-					st->arg);
-		else
-			err |= h264_nal_send(st, true, true, (r1 >= end), r[0],
-					     r+1, r1-r-1, MAX_RTP_SIZE);
+		err |= st->enqh((r1 >= end), r[0], r+1, r1-r-1, st->arg);
+
 		r = r1;
 	}
 
@@ -144,6 +144,4 @@ struct fu {
 int fu_hdr_encode(const struct fu *fu, struct mbuf *mb);
 int fu_hdr_decode(struct fu *fu, struct mbuf *mb);
 
-const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end);
-
 int h264_decode_sprop_params(AVCodecContext *codec, struct pl *pl);
@@ -8,8 +8,8 @@
 #include <baresip.h>
 
 
-typedef uint8_t (enc_h)(int16_t samp);
-typedef int16_t (dec_h)(uint8_t octet);
+typedef void (enc_h)(uint8_t *dst, const int16_t *src, size_t n);
+typedef void (dec_h)(int16_t *dst, const uint8_t *src, size_t n);
 
 struct aucodec_st {
 	struct aucodec *ac;  /* inheritance */
@@ -47,12 +47,12 @@ static int alloc(struct aucodec_st **stp, struct aucodec *ac,
 	st->ac = mem_ref(ac);
 
 	if (0 == str_casecmp(aucodec_name(ac), "PCMA")) {
-		st->enc = g711_pcm2alaw;
-		st->dec = g711_alaw2pcm;
+		st->enc = g711_pcm2alaw_block;
+		st->dec = g711_alaw2pcm_block;
 	}
 	else if (0 == str_casecmp(aucodec_name(ac), "PCMU")) {
-		st->enc = g711_pcm2ulaw;
-		st->dec = g711_ulaw2pcm;
+		st->enc = g711_pcm2ulaw_block;
+		st->dec = g711_ulaw2pcm_block;
 	}
 	else {
 		err = EINVAL;
@@ -70,7 +70,6 @@ static int alloc(struct aucodec_st **stp, struct aucodec *ac,
 static int encode(struct aucodec_st *st, struct mbuf *dst, struct mbuf *src)
 {
 	size_t nsamp;
-	uint8_t *d;
 
 	nsamp = mbuf_get_left(src) / 2;
 
@@ -80,11 +79,10 @@ static int encode(struct aucodec_st *st, struct mbuf *dst, struct mbuf *src)
 			return err;
 	}
 
-	d = dst->buf + dst->pos;
-	dst->end = dst->pos = (dst->pos + nsamp);
+	st->enc(mbuf_buf(dst), (void *)mbuf_buf(src), nsamp);
 
-	while (nsamp--)
-		*d++ = st->enc(mbuf_read_u16(src));
+	mbuf_advance(src, nsamp * 2);
+	dst->end = dst->pos = (dst->pos + nsamp);
 
 	return 0;
 }
@@ -93,7 +91,6 @@ static int encode(struct aucodec_st *st, struct mbuf *dst, struct mbuf *src)
 static int decode(struct aucodec_st *st, struct mbuf *dst, struct mbuf *src)
 {
 	size_t nsamp;
-	uint8_t *s;
 
 	nsamp = mbuf_get_left(src);
 	if (!nsamp)
@@ -105,11 +102,11 @@ static int decode(struct aucodec_st *st, struct mbuf *dst, struct mbuf *src)
 			return err;
 	}
 
-	s = src->buf + src->pos;
-	src->pos = src->end;
+	st->dec((void *)mbuf_buf(dst), mbuf_buf(src), nsamp);
 
-	while (nsamp--)
-		(void)mbuf_write_u16(dst, st->dec(*s++));
+	src->pos = src->end;
+	dst->pos += 2*nsamp;
+	dst->end  = max(dst->end, dst->pos);
 
 	return 0;
 }
@@ -6,6 +6,5 @@
 
 MOD		:= srtp
 $(MOD)_SRCS	+= srtp.c sdes.c
-$(MOD)_LFLAGS	+= -lsrtp
 
 include mk/mod.mk
@@ -3,10 +3,6 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
-#if defined (__GNUC__) && !defined (asm)
-#define asm __asm__  /* workaround */
-#endif
-#include <srtp/srtp.h>
 #include <re.h>
 #include <baresip.h>
 #include "sdes.h"
@@ -17,14 +13,20 @@
 #include <re_dbg.h>
 
 
+enum {
+	MASTER_KEY_LEN = SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE,
+	SRTP_TAG_MAX   = 10,  /* Largest authentication tag of SRTP */
+	RX_BATCH       = 64,  /* Packets per batched decryption     */
+};
+
+
 struct menc_st {
 	struct menc *me;  /* base class */
 
 	/* one SRTP session per media line */
 	uint8_t key_tx[32];  /* 32 for alignment, only 30 used */
 	uint8_t key_rx[32];
-	srtp_t srtp_tx, srtp_rx;
-	srtp_policy_t policy_tx, policy_rx;
+	struct srtp *srtp_tx, *srtp_rx;
 	bool use_srtp;
 
 	void *rtpsock;
@@ -54,10 +56,8 @@ static void destructor(void *arg)
 	mem_deref(st->rtpsock);
 	mem_deref(st->rtcpsock);
 
-	if (st->srtp_tx)
-		srtp_dealloc(st->srtp_tx);
-	if (st->srtp_rx)
-		srtp_dealloc(st->srtp_rx);
+	mem_deref(st->srtp_tx);
+	mem_deref(st->srtp_rx);
 
 	mem_deref(st->me);
 }
@@ -65,151 +65,111 @@ static void destructor(void *arg)
 
 static int setup_srtp(struct menc_st *st)
 {
-	err_status_t e;
-
-	/* init SRTP */
-	e = crypto_get_random(st->key_tx, SRTP_MASTER_KEY_LEN);
-	if (err_status_ok != e) {
-		DEBUG_WARNING("crypto_get_random() failed %d\n", e);
-		return ENOSYS;
-	}
-
-	/* transmit policy */
-	crypto_policy_set_rtp_default(&st->policy_tx.rtp);
-	crypto_policy_set_rtcp_default(&st->policy_tx.rtcp);
-	st->policy_tx.ssrc.type = ssrc_any_outbound;
-	st->policy_tx.key = st->key_tx;
-	st->policy_tx.next = NULL;
+	/* the transmit key is offered in SDP */
+	rand_bytes(st->key_tx, MASTER_KEY_LEN);
 
-	/* receive policy */
-	crypto_policy_set_rtp_default(&st->policy_rx.rtp);
-	crypto_policy_set_rtcp_default(&st->policy_rx.rtcp);
-	st->policy_rx.ssrc.type = ssrc_any_inbound;
-	st->policy_rx.key = st->key_rx;
-	st->policy_rx.next = NULL;
-
-	/* allocate and initialize the SRTP session */
-	srtp_create(&st->srtp_tx, &st->policy_tx);
-
-	return 0;
+	return srtp_alloc(&st->srtp_tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  st->key_tx, MASTER_KEY_LEN);
 }
 
 
 static int rtp_enc(struct menc_st *st, struct mbuf *mb)
 {
-	uint32_t srtp_len;
-	err_status_t e;
-	int len = (int)mbuf_get_left(mb);
+	int err;
 
 	if (!st->use_srtp)
 		return 0;
 
-	srtp_len = len + SRTP_MAX_TRAILER_LEN;
-	if (srtp_len > mbuf_get_space(mb)) {
-		mbuf_resize(mb, mb->pos + srtp_len);
-	}
-
-	e = srtp_protect(st->srtp_tx, mbuf_buf(mb), &len);
-	if (err_status_ok != e) {
-		DEBUG_WARNING("srtp_protect: err=%d\n", e);
-		return EPROTO;
+	err = srtp_encrypt(st->srtp_tx, mb);
+	if (err) {
+		DEBUG_WARNING("srtp_encrypt: %m\n", err);
 	}
 
-	mbuf_set_end(mb, mb->pos + len);
-
-	return 0;
+	return err;
 }
 
 
-static int rtp_dec(struct menc_st *st, struct mbuf *mb)
+static void rtp_dec_warning(int err)
 {
-	err_status_t r;
-	int len = (int)mbuf_get_left(mb);
+	switch (err) {
 
-	if (!st->use_srtp)
-		return 0;
+	case 0:
+		break;
 
-	r = srtp_unprotect(st->srtp_rx, mbuf_buf(mb), &len);
+	case EAUTH:
+		DEBUG_WARNING("srtp_decrypt: auth check fail\n");
+		break;
 
-	switch (r) {
+	case EALREADY:
+		DEBUG_WARNING("srtp_decrypt: replay error\n");
+		break;
 
-	case err_status_ok:
-		mbuf_set_end(mb, mb->pos + len);
+	default:
+		DEBUG_WARNING("srtp_decrypt: %m\n", err);
 		break;
+	}
+}
 
-	case err_status_auth_fail:
-		DEBUG_WARNING("srtp_unprotect: auth check fail\n");
-		return EINVAL;
 
-	case err_status_replay_fail:
-		DEBUG_WARNING("srtp_unprotect: replay error\n");
-		return ENOENT;
+static int rtp_dec(struct menc_st *st, struct mbuf *mb)
+{
+	int err;
 
-	default:
-		DEBUG_WARNING("srtp_unprotect: unknown err %d\n", r);
-		return ENOSYS;
-	}
+	if (!st->use_srtp)
+		return 0;
 
-	return 0;
+	err = srtp_decrypt(st->srtp_rx, mb);
+	if (err)
+		rtp_dec_warning(err);
+
+	return err;
 }
 
 
 static int rtcp_enc(struct menc_st *st, struct mbuf *mb)
 {
-	uint32_t srtp_len;
-	err_status_t e;
-	int len = (int)mbuf_get_left(mb);
+	int err;
 
 	if (!st->use_srtp)
 		return 0;
 
-	srtp_len = len + SRTP_MAX_TRAILER_LEN;
-	if (srtp_len > mbuf_get_space(mb)) {
-		mbuf_resize(mb, mb->pos + srtp_len);
+	err = srtcp_encrypt(st->srtp_tx, mb);
+	if (err) {
+		DEBUG_WARNING("srtcp_encrypt: %m\n", err);
 	}
 
-	e = srtp_protect_rtcp(st->srtp_tx, mbuf_buf(mb), &len);
-	if (err_status_ok != e) {
-		DEBUG_WARNING("srtp_protect_rtcp: err=%d\n", e);
-		return EPROTO;
-	}
-
-	mbuf_set_end(mb, mb->pos + len);
-
-	return 0;
+	return err;
 }
 
 
 static int rtcp_dec(struct menc_st *st, struct mbuf *mb)
 {
-	err_status_t r;
-	int len = (int)mbuf_get_left(mb);
+	int err;
 
 	if (!st->use_srtp)
 		return 0;
 
-	r = srtp_unprotect_rtcp(st->srtp_rx, mbuf_buf(mb), &len);
+	err = srtcp_decrypt(st->srtp_rx, mb);
 
-	switch (r) {
+	switch (err) {
 
-	case err_status_ok:
-		mbuf_set_end(mb, mb->pos + len);
+	case 0:
 		break;
 
-	case err_status_auth_fail:
-		DEBUG_WARNING("srtp_unprotect_rtcp: auth check fail\n");
-		return EINVAL;
+	case EAUTH:
+		DEBUG_WARNING("srtcp_decrypt: auth check fail\n");
+		break;
 
-	case err_status_replay_fail:
-		DEBUG_WARNING("srtp_unprotect_rtcp: replay error\n");
-		return ENOENT;
+	case EALREADY:
+		DEBUG_WARNING("srtcp_decrypt: replay error\n");
+		break;
 
 	default:
-		DEBUG_WARNING("srtp_unprotect_rtcp: unknown err %d\n", r);
-		return ENOSYS;
+		DEBUG_WARNING("srtcp_decrypt: %m\n", err);
+		break;
 	}
 
-	return 0;
+	return err;
 }
 
 
@@ -240,6 +200,81 @@ static bool menc_recv_handler(struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
+/*
+ * Media Encryption - Encode the queued packets of the socket, e.g. all
+ * packets of a video frame, with one keystream computation per run of
+ * packets to the remote address
+ */
+static int menc_send_batch(const struct sa **dstv, struct mbuf **mbv,
+			   size_t n, void *arg)
+{
+	struct menc_st *st = arg;
+	const struct sa *raddr;
+	size_t i = 0, j;
+	int err;
+
+	if (!st->use_srtp)
+		return 0;
+
+	raddr = sdp_media_raddr(st->sdpm);
+
+	while (i < n) {
+
+		if (!sa_cmp(dstv[i], raddr, SA_ALL)) {
+			++i;
+			continue;
+		}
+
+		for (j=i+1; j<n && sa_cmp(dstv[j], raddr, SA_ALL); j++)
+			;
+
+		err = srtp_encrypt_batch(st->srtp_tx, &mbv[i], j - i);
+		if (err) {
+			DEBUG_WARNING("srtp_encrypt_batch: %m\n", err);
+			return err;
+		}
+
+		i = j;
+	}
+
+	return 0;
+}
+
+
+/** Media Encryption - Decode the packets read in one batch */
+static void menc_recv_batch(struct sa *srcv, struct mbuf **mbv,
+			    bool *hdldv, size_t n, void *arg)
+{
+	struct menc_st *st = arg;
+	int errv[RX_BATCH];
+	size_t i, k, m;
+	int err;
+
+	(void)srcv;
+
+	if (!st->use_srtp)
+		return;
+
+	for (i=0; i<n; i+=m) {
+
+		m = min(n - i, (size_t)RX_BATCH);
+
+		err = srtp_decrypt_batch(st->srtp_rx, &mbv[i], errv, m);
+
+		for (k=0; k<m; k++) {
+
+			if (hdldv[i+k])
+				continue;
+
+			if (err || errv[k]) {
+				rtp_dec_warning(err ? err : errv[k]);
+				hdldv[i+k] = true;  /* error - drop packet */
+			}
+		}
+	}
+}
+
+
 static bool menc_send_rtcp(int *err, struct sa *dst,
 			   struct mbuf *mb, void *arg)
 {
@@ -277,7 +312,7 @@ static int sdp_enc(struct menc_st *st, struct sdp_media *m)
 	int err;
 
 	olen = sizeof(key);
-	err = base64_encode(st->key_tx, SRTP_MASTER_KEY_LEN, key, &olen);
+	err = base64_encode(st->key_tx, MASTER_KEY_LEN, key, &olen);
 	if (err)
 		return err;
 
@@ -307,6 +342,9 @@ static int alloc(struct menc_st **stp, struct menc *me, int proto,
 		err |= udp_register_helper(&st->uh_rtp, rtpsock, layer,
 					   menc_send_handler,
 					   menc_recv_handler, st);
+		err |= udp_helper_batch_set(st->uh_rtp, SRTP_TAG_MAX,
+					    menc_send_batch,
+					    menc_recv_batch);
 	}
 	if (rtcpsock) {
 		st->rtcpsock = mem_ref(rtcpsock);
@@ -335,8 +373,8 @@ static int alloc(struct menc_st **stp, struct menc *me, int proto,
 
 static int decode_crypto(struct menc_st *st, const char *value)
 {
+	enum srtp_suite suite;
 	struct crypto c;
-	err_status_t e;
 	size_t olen;
 	int err;
 
@@ -351,8 +389,9 @@ static int decode_crypto(struct menc_st *st, const char *value)
 	if (err)
 		return err;
 
-	if (SRTP_MASTER_KEY_LEN != olen) {
+	if (MASTER_KEY_LEN != olen) {
 		DEBUG_WARNING("srtp keylen is %u (should be 30)\n", olen);
+		return EINVAL;
 	}
 
 	if (0 != pl_strcmp(&c.key_method, "inline")) {
@@ -361,19 +400,21 @@ static int decode_crypto(struct menc_st *st, const char *value)
 	}
 
 	if (0 == pl_strcasecmp(&c.suite, aes_cm_128_hmac_sha1_32)) {
-		crypto_policy_set_aes_cm_128_hmac_sha1_32(&st->policy_rx.rtp);
+		suite = SRTP_AES_CM_128_HMAC_SHA1_32;
 	}
 	else if (0 == pl_strcasecmp(&c.suite, aes_cm_128_hmac_sha1_80)) {
-		crypto_policy_set_aes_cm_128_hmac_sha1_80(&st->policy_rx.rtp);
+		suite = SRTP_AES_CM_128_HMAC_SHA1_80;
 	}
 	else {
 		DEBUG_WARNING("unknown SRTP crypto suite (%r)\n", &c.suite);
 		return ENOENT;
 	}
 
-	e = srtp_create(&st->srtp_rx, &st->policy_rx);
-	if (err_status_ok != e) {
-		DEBUG_WARNING("srtp_create rx failed: %d\n", e);
+	st->srtp_rx = mem_deref(st->srtp_rx);
+	err = srtp_alloc(&st->srtp_rx, suite, st->key_rx, MASTER_KEY_LEN);
+	if (err) {
+		DEBUG_WARNING("srtp_alloc rx failed: %m\n", err);
+		return err;
 	}
 
 	/* use SRTP for this stream/session */
@@ -402,11 +443,6 @@ static int mod_srtp_init(void)
 {
 	int err;
 
-	if (err_status_ok != srtp_init()) {
-		DEBUG_WARNING("srtp_init() failed\n");
-		return ENOSYS;
-	}
-
 	err  = menc_register(&menc_srtp_opt, "srtp", alloc, update);
 	err |= menc_register(&menc_srtp_mand, "srtp-mand", alloc, update);
 
@@ -419,8 +455,6 @@ static int mod_srtp_close(void)
 	menc_srtp_opt = mem_deref(menc_srtp_opt);
 	menc_srtp_mand = mem_deref(menc_srtp_mand);
 
-	crypto_kernel_shutdown();
-
 	return 0;
 }
 
@@ -62,6 +62,9 @@ struct autx {
 	struct aucodec_st *enc;       /**< Current audio encoder           */
 	struct aubuf *ab;             /**< Packetize outgoing stream       */
 	struct mbuf *mb;              /**< Buffer for outgoing RTP packets */
+	struct mbuf *mb_pcm;          /**< Buffer for one packet of PCM    */
+	uint8_t *silence;             /**< Silence samples for muted mode  */
+	size_t silence_sz;            /**< Size of silence buffer in bytes */
 	uint32_t ptime;               /**< Packet time for sending         */
 	uint32_t ts;                  /**< Timestamp for outgoing RTP      */
 	uint32_t ts_tel;              /**< Timestamp for Telephony Events  */
@@ -71,6 +74,11 @@ struct autx {
 	bool muted;                   /**< Audio source is muted           */
 	int cur_key;                  /**< Currently transmitted event     */
 
+	struct {
+		uint64_t frames;      /**< Number of frames encoded        */
+		uint32_t allocs;      /**< Allocations when sending, by mem */
+	} stats;
+
 	enum audio_mode mode;         /**< Audio mode for sending packets  */
 	union {
 		struct tmr tmr;       /**< Timer for sending RTP packets   */
@@ -91,8 +99,10 @@ struct aurx {
 	struct aucodec_st *dec;       /**< Current audio decoder           */
 	struct aubuf *ab;             /**< Incoming audio buffer           */
 	struct mbuf *mb;              /**< Buffer for decoded audio        */
+	struct lock *lock;            /**< Lock for decoder, filters, ab   */
 	uint32_t ptime;               /**< Packet time for receiving       */
 	int pt;                       /**< Payload type for incoming RTP   */
+	int pt_req;                   /**< Payload type change requested   */
 	int pt_tel;                   /**< Event payload type - receive    */
 };
 
@@ -115,14 +125,19 @@ static void audio_destructor(void *arg)
 {
 	struct audio *a = arg;
 
+	/* no RTP handlers from a worker thread after this */
+	stream_stop(a->strm);
 	audio_stop(a);
 
 	mem_deref(a->tx.enc);
 	mem_deref(a->rx.dec);
 	mem_deref(a->tx.ab);
 	mem_deref(a->tx.mb);
+	mem_deref(a->tx.mb_pcm);
+	mem_deref(a->tx.silence);
 	mem_deref(a->rx.mb);
 	mem_deref(a->rx.ab);
+	mem_deref(a->rx.lock);
 	mem_deref(a->strm);
 	mem_deref(a->telev);
 }
@@ -200,6 +215,8 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 	if (!tx->enc)
 		return;
 
+	++tx->stats.frames;
+
 	tx->mb->pos = tx->mb->end = STREAM_PRESZ;
 
 	err = aucodec_get(tx->enc)->ench(tx->enc, tx->mb, mb);
@@ -233,31 +250,46 @@ static void process_audio_encode(struct audio *a, struct mbuf *mb)
 	if (!mb)
 		return;
 
-	/* Audio filters */
+	/* Audio filters, shared with the receiver */
+	lock_write_get(a->rx.lock);
 	if (a->fc) {
 		(void)aufilt_chain_encode(a->fc, mb);
 	}
+	lock_rel(a->rx.lock);
 
 	/* Encode and send */
 	encode_rtp_send(a, &a->tx, mb, a->tx.is_g722 ? mb->end/4 : mb->end/2);
 }
 
 
+/**
+ * Read one packet of PCM from the audio buffer and send it
+ *
+ * @note This function has REAL-TIME properties
+ */
 static void poll_aubuf_tx(struct audio *a)
 {
-	struct mbuf *mb = mbuf_alloc(a->tx.psize);
+	struct autx *tx = &a->tx;
+	struct mbuf *mb = tx->mb_pcm;
+	uint64_t nallocs;
 	int err;
-	if (!mb)
+
+	if (!mb || mb->size < tx->psize)
 		return;
 
+	/* the filters may have moved pos and end of the last packet */
+	mb->pos = 0;
+	mb->end = tx->psize;
+
+	/* counted per thread, and only one thread sends */
+	nallocs = mem_nallocs();
+
 	/* timed read from audio-buffer */
-	err = aubuf_get(a->tx.ab, a->tx.ptime, mb->buf, mb->size);
-	if (0 == err) {
-		mb->end = mb->size;
+	err = aubuf_get(tx->ab, tx->ptime, mb->buf, tx->psize);
+	if (0 == err)
 		process_audio_encode(a, mb);
-	}
 
-	mem_deref(mb);
+	tx->stats.allocs += (uint32_t)(mem_nallocs() - nallocs);
 }
 
 
@@ -319,7 +351,6 @@ static void ausrc_read_handler(const uint8_t *buf, size_t sz, void *arg)
 {
 	struct audio *a = arg;
 	struct autx *tx = &a->tx;
-	uint8_t *silence = NULL;
 	const uint8_t *txbuf = buf;
 
 	/* NOTE:
@@ -327,8 +358,19 @@ static void ausrc_read_handler(const uint8_t *buf, size_t sz, void *arg)
 	 * so we send silence when muted
 	 */
 	if (tx->muted) {
-		silence = mem_zalloc(sizeof(*silence) * sz, NULL);
-		txbuf = silence;
+
+		/* only if the source delivers more than one packet */
+		if (sz > tx->silence_sz) {
+			uint8_t *silence = mem_zalloc(sz, NULL);
+			if (!silence)
+				goto out;
+
+			mem_deref(tx->silence);
+			tx->silence    = silence;
+			tx->silence_sz = sz;
+		}
+
+		txbuf = tx->silence;
 	}
 
 	if (tx->ab) {
@@ -347,7 +389,6 @@ static void ausrc_read_handler(const uint8_t *buf, size_t sz, void *arg)
  out:
 	/* Exact timing: send Telephony-Events from here */
 	check_telev(a, tx);
-	mem_deref(silence);
 }
 
 
@@ -361,7 +402,7 @@ static void ausrc_error_handler(int err, const char *str, void *arg)
 }
 
 
-static int pt_handler(struct audio *a, uint8_t pt_old, uint8_t pt_new)
+static int pt_handler(struct audio *a, int pt_old, int pt_new)
 {
 	const struct sdp_format *lc;
 
@@ -369,13 +410,36 @@ static int pt_handler(struct audio *a, uint8_t pt_old, uint8_t pt_new)
 	if (!lc)
 		return ENOENT;
 
-	(void)re_fprintf(stderr, "Audio decoder changed payload %u -> %u\n",
+	(void)re_fprintf(stderr, "Audio decoder changed payload %d -> %d\n",
 			 pt_old, pt_new);
 
 	return audio_decoder_set(a, lc->data, lc->pt, lc->params);
 }
 
 
+/*
+ * Called from the main thread, id is the new payload type. The decoder
+ * and the audio player are replaced here, not in the RTP worker thread.
+ */
+static void pt_event_handler(int id, void *arg)
+{
+	struct audio *a = arg;
+
+	if (id != a->rx.pt)
+		(void)pt_handler(a, a->rx.pt, id);
+}
+
+
+/* Called from the main thread, id is the digit and the end flag */
+static void telev_event_handler(int id, void *arg)
+{
+	struct audio *a = arg;
+
+	if (a->eventh)
+		a->eventh(id >> 1, id & 1, a->arg);
+}
+
+
 static void handle_telev(struct audio *a, struct mbuf *mb)
 {
 	int event, digit;
@@ -385,8 +449,9 @@ static void handle_telev(struct audio *a, struct mbuf *mb)
 		return;
 
 	digit = telev_code2digit(event);
-	if (digit >= 0 && a->eventh)
-		a->eventh(digit, end, a->arg);
+	if (digit >= 0)
+		(void)stream_event(a->strm, telev_event_handler,
+				   digit << 1 | end);
 }
 
 
@@ -394,6 +459,8 @@ static void handle_telev(struct audio *a, struct mbuf *mb)
  * Decode incoming packets using the Audio decoder
  *
  * NOTE: mb=NULL if no packet received
+ *
+ * @note Called with the receive lock held
  */
 static int audio_stream_decode(struct audio *a, struct aurx *rx,
 			       struct mbuf *mb)
@@ -439,13 +506,16 @@ static int audio_stream_decode(struct audio *a, struct aurx *rx,
 }
 
 
-/* Handle incoming stream data from the network */
+/*
+ * Handle incoming stream data from the network. This may be called from
+ * an RTP worker thread, while the main thread changes the decoder.
+ */
 static void stream_recv_handler(const struct rtp_header *hdr,
 				struct mbuf *mb, void *arg)
 {
 	struct audio *a = arg;
 	struct aurx *rx = &a->rx;
-	int err;
+	int pt_new = -1;
 
 	if (!mb)
 		goto out;
@@ -460,17 +530,30 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	if (PT_CN == hdr->pt)
 		return;
 
-	/* Audio payload-type changed? */
+ out:
+	lock_write_get(rx->lock);
+
+	/* Audio payload-type changed? Drop packets until it is done */
 	/* XXX: this logic should be moved to stream.c */
-	if (hdr->pt != rx->pt) {
+	if (mb && hdr->pt != rx->pt) {
 
-		err = pt_handler(a, rx->pt, hdr->pt);
-		if (err)
-			return;
+		if (hdr->pt != rx->pt_req) {
+			rx->pt_req = hdr->pt;
+			pt_new = hdr->pt;
+		}
+	}
+	else {
+		(void)audio_stream_decode(a, rx, mb);
 	}
 
- out:
-	(void)audio_stream_decode(a, &a->rx, mb);
+	lock_rel(rx->lock);
+
+	if (pt_new >= 0 && stream_event(a->strm, pt_event_handler, pt_new)) {
+
+		lock_write_get(rx->lock);
+		rx->pt_req = -1;
+		lock_rel(rx->lock);
+	}
 }
 
 
@@ -519,6 +602,14 @@ int audio_alloc(struct audio **ap, struct call *call,
 	tx = &a->tx;
 	rx = &a->rx;
 
+	/* the stream may receive in a worker thread from here on */
+	err = lock_alloc(&rx->lock);
+	if (err)
+		goto out;
+
+	rx->pt     = -1;
+	rx->pt_req = -1;
+
 	err = stream_alloc(&a->strm, call, sdp_sess, "audio", label,
 			   mnat, mnat_sess, menc,
 			   stream_recv_handler, NULL, a);
@@ -557,7 +648,6 @@ int audio_alloc(struct audio **ap, struct call *call,
 	tx->marker = true;
 	tx->mode   = mode;
 
-	rx->pt     = -1;
 	rx->ptime  = ptime;
 
 	a->eventh    = eventh;
@@ -673,7 +763,7 @@ static int aufilt_setup(struct audio *a, uint32_t *srate_enc,
 static int start_player(struct audio *a, uint32_t srate_dec)
 {
 	struct aurx *rx = &a->rx;
-	int err;
+	int err = 0;
 
 	/* Start Audio Player */
 	if (!rx->auplay && auplay_find(NULL) && rx->dec) {
@@ -686,14 +776,20 @@ static int start_player(struct audio *a, uint32_t srate_dec)
 		prm.ch         = ac->ch;
 		prm.frame_size = calc_nsamp(prm.srate, prm.ch, rx->ptime);
 
+		lock_write_get(rx->lock);
+
 		if (!rx->ab) {
 			const size_t psize = 2 * prm.frame_size;
 
-			err = aubuf_alloc(&rx->ab, psize * 1, psize * 8);
-			if (err)
-				return err;
+			err = aubuf_alloc_ring(&rx->ab, psize * 1,
+					       psize * 8);
 		}
 
+		lock_rel(rx->lock);
+
+		if (err)
+			return err;
+
 		err = auplay_alloc(&rx->auplay, config.audio.play_mod,
 				   &prm, config.audio.play_dev,
 				   auplay_write_handler, a);
@@ -707,6 +803,45 @@ static int start_player(struct audio *a, uint32_t srate_dec)
 }
 
 
+/*
+ * Size the send buffers so that no packet needs to allocate memory.
+ * The source and the send thread or timer must be stopped.
+ */
+static int alloc_txbufs(struct autx *tx)
+{
+	int err;
+
+	if (!tx->mb_pcm || tx->mb_pcm->size < tx->psize) {
+
+		mem_deref(tx->mb_pcm);
+		tx->mb_pcm = mbuf_alloc(tx->psize);
+		if (!tx->mb_pcm)
+			return ENOMEM;
+	}
+
+	if (tx->silence_sz < tx->psize) {
+
+		mem_deref(tx->silence);
+		tx->silence_sz = 0;
+		tx->silence = mem_zalloc(tx->psize, NULL);
+		if (!tx->silence)
+			return ENOMEM;
+
+		tx->silence_sz = tx->psize;
+	}
+
+	/* worst case is an uncompressed codec */
+	if (tx->mb->size < STREAM_PRESZ + tx->psize) {
+
+		err = mbuf_resize(tx->mb, STREAM_PRESZ + tx->psize);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
 static int start_source(struct audio *a, uint32_t srate_enc)
 {
 	struct autx *tx = &a->tx;
@@ -725,9 +860,13 @@ static int start_source(struct audio *a, uint32_t srate_enc)
 
 		tx->psize = 2 * prm.frame_size;
 
+		err = alloc_txbufs(tx);
+		if (err)
+			return err;
+
 		if (!tx->ab) {
-			err = aubuf_alloc(&tx->ab, tx->psize * 2,
-					  tx->psize * 30);
+			err = aubuf_alloc_ring(&tx->ab, tx->psize * 2,
+					       tx->psize * 30);
 			if (err)
 				return err;
 		}
@@ -789,11 +928,12 @@ int audio_start(struct audio *a)
 		return err;
 
 	/* Audio filter */
-	if (!a->fc && !list_isempty(aufilt_list())) {
+	lock_write_get(a->rx.lock);
+	if (!a->fc && !list_isempty(aufilt_list()))
 		err = aufilt_setup(a, &srate_enc, &srate_dec);
-		if (err)
-			return err;
-	}
+	lock_rel(a->rx.lock);
+	if (err)
+		return err;
 
 	/* configurable order of play/src start */
 	if (config.audio.src_first) {
@@ -809,22 +949,9 @@ int audio_start(struct audio *a)
 }
 
 
-/**
- * Stop the audio playback and recording
- *
- * @param a Audio object
- */
-void audio_stop(struct audio *a)
+/* Stop the thread or timer which sends from the audio buffer */
+static void stop_tx(struct autx *tx)
 {
-	struct autx *tx;
-	struct aurx *rx;
-
-	if (!a)
-		return;
-
-	tx = &a->tx;
-	rx = &a->rx;
-
 	switch (tx->mode) {
 
 #ifdef HAVE_PTHREAD
@@ -843,14 +970,36 @@ void audio_stop(struct audio *a)
 	default:
 		break;
 	}
+}
+
+
+/**
+ * Stop the audio playback and recording
+ *
+ * @param a Audio object
+ */
+void audio_stop(struct audio *a)
+{
+	struct autx *tx;
+	struct aurx *rx;
+
+	if (!a)
+		return;
+
+	tx = &a->tx;
+	rx = &a->rx;
+
+	stop_tx(tx);
 
 	/* audio device must be stopped first */
 	tx->ausrc  = mem_deref(tx->ausrc);
 	rx->auplay = mem_deref(rx->auplay);
 
+	lock_write_get(rx->lock);
 	a->fc  = mem_deref(a->fc);
 	tx->ab = mem_deref(tx->ab);
 	rx->ab = mem_deref(rx->ab);
+	lock_rel(rx->lock);
 }
 
 
@@ -874,8 +1023,10 @@ int audio_encoder_set(struct audio *a, struct aucodec *ac,
 
 	reset = ac_old && !aucodec_equal(ac_old, ac);
 
-	/* Audio source must be stopped first */
+	/* Audio source must be stopped first, and the sender too, as the
+	 * send buffers are resized when the source is started again */
 	if (reset) {
+		stop_tx(tx);
 		tx->ausrc = mem_deref(tx->ausrc);
 	}
 
@@ -918,6 +1069,7 @@ int audio_decoder_set(struct audio *a, struct aucodec *ac,
 {
 	struct aucodec *ac_old;
 	struct aurx *rx;
+	bool reset;
 	int err = 0;
 
 	if (!a || !ac)
@@ -928,8 +1080,13 @@ int audio_decoder_set(struct audio *a, struct aucodec *ac,
 	(void)re_fprintf(stderr, "Set audio decoder: %s %uHz %dch\n",
 			 ac->name, get_srate(ac), ac->ch);
 
+	/* the decoder may be in use by an RTP worker thread */
+	lock_write_get(rx->lock);
+
 	ac_old = aucodec_get(rx->dec);
+	reset  = ac_old && !aucodec_equal(ac_old, ac);
 	rx->pt = pt_rx;
+	rx->pt_req = -1;
 	rx->dec = mem_deref(rx->dec);
 
 	if (aucodec_cmp(ac, aucodec_get(a->tx.enc))) {
@@ -940,19 +1097,25 @@ int audio_decoder_set(struct audio *a, struct aucodec *ac,
 		err = ac->alloch(&rx->dec, ac, NULL, NULL, params);
 		if (err) {
 			DEBUG_WARNING("alloc decoder: %m\n", err);
-			return err;
+			reset = false;
 		}
 	}
 
+	/* Reset audio filter chain */
+	if (reset)
+		a->fc = mem_deref(a->fc);
+
+	lock_rel(rx->lock);
+
+	if (err)
+		return err;
+
 	stream_set_srate(a->strm, get_srate(ac), get_srate(ac));
 
-	if (ac_old && !aucodec_equal(ac_old, ac)) {
+	if (reset) {
 
 		rx->auplay = mem_deref(rx->auplay);
 
-		/* Reset audio filter chain */
-		a->fc = mem_deref(a->fc);
-
 		err |= audio_start(a);
 	}
 
@@ -1067,6 +1230,9 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aubuf_debug, tx->ab,
 			  tx->ptime);
 
+	err |= re_hprintf(pf, "       frames=%llu allocs=%u\n",
+			  tx->stats.frames, tx->stats.allocs);
+
 	err |= re_hprintf(pf, " rx:   %H %H ptime=%ums pt=%d\n",
 			  aucodec_print, rx->dec,
 			  aubuf_debug, rx->ab,
@@ -73,6 +73,7 @@ struct config config = {
 		352, 288,
 		384000,
 		25,
+		0,
 	},
 
 	/** Audio/Video Transport */
@@ -82,7 +83,9 @@ struct config config = {
 		{512000, 1024000},
 		true,
 		false,
-		{5, 10}
+		{5, 10},
+		JBUF_FIXED,
+		0
 	},
 
 	{
@@ -294,6 +297,7 @@ static int conf_write_config_template(const char *file)
 			 config.video.height);
 	(void)re_fprintf(f, "video_bitrate\t\t%u\n", config.video.bitrate);
 	(void)re_fprintf(f, "video_fps\t\t%u\n", config.video.fps);
+	(void)re_fprintf(f, "#video_conv_threads\t4\t\t# for HD frames\n");
 	(void)re_fprintf(f, "#video_selfview\t\twindow # {window,pip}\n");
 #endif
 
@@ -305,6 +309,9 @@ static int conf_write_config_template(const char *file)
 	(void)re_fprintf(f, "rtcp_mux\t\t\tno\n");
 	(void)re_fprintf(f, "jitter_buffer_delay\t%u-%u\t\t# frames\n",
 			 config.avt.jbuf_del.min, config.avt.jbuf_del.max);
+	(void)re_fprintf(f, "jitter_buffer_type\tfixed\t\t"
+			 "# fixed,adaptive\n");
+	(void)re_fprintf(f, "#rtp_workers\t\t2\t\t# RTP threads (0=off)\n");
 
 	(void)re_fprintf(f, "\n# Network\n");
 	(void)re_fprintf(f, "#dns_server\t\t10.0.0.1:53\n");
@@ -657,7 +664,7 @@ static int dns_server_handler(const struct pl *pl, void *arg)
 
 static int config_parse(struct conf *conf)
 {
-	struct pl pollm, as, ap;
+	struct pl pollm, as, ap, jbt;
 	enum poll_method method;
 	struct vidsz size = {0, 0};
 	uint32_t v;
@@ -723,6 +730,8 @@ static int config_parse(struct conf *conf)
 	}
 	(void)conf_get_u32(conf, "video_bitrate", &config.video.bitrate);
 	(void)conf_get_u32(conf, "video_fps", &config.video.fps);
+	(void)conf_get_u32(conf, "video_conv_threads",
+			   &config.video.conv_threads);
 
 	/* AVT - Audio/Video Transport */
 	if (0 == conf_get_u32(conf, "rtp_tos", &v))
@@ -737,6 +746,17 @@ static int config_parse(struct conf *conf)
 	(void)conf_get_bool(conf, "rtcp_mux", &config.avt.rtcp_mux);
 	(void)conf_get_range(conf, "jitter_buffer_delay",
 			     &config.avt.jbuf_del);
+	if (0 == conf_get(conf, "jitter_buffer_type", &jbt)) {
+		if (0 == pl_strcasecmp(&jbt, "adaptive"))
+			config.avt.jbtype = JBUF_ADAPTIVE;
+		else if (0 == pl_strcasecmp(&jbt, "fixed"))
+			config.avt.jbtype = JBUF_FIXED;
+		else {
+			DEBUG_WARNING("unknown jitter buffer type (%r)\n",
+				      &jbt);
+		}
+	}
+	(void)conf_get_u32(conf, "rtp_workers", &config.avt.workers);
 
 	if (err) {
 		DEBUG_WARNING("configure parse error (%m)\n", err);
@@ -246,6 +246,7 @@ enum {STREAM_PRESZ = 4+12}; /* same as RTP_HEADER_SIZE */
 typedef void (stream_rtp_h)(const struct rtp_header *hdr, struct mbuf *mb,
 			    void *arg);
 typedef void (stream_rtcp_h)(struct rtcp_msg *msg, void *arg);
+typedef void (stream_event_h)(int id, void *arg);
 
 int  stream_alloc(struct stream **sp, struct call *call,
 		  struct sdp_session *sdp_sess,
@@ -255,9 +256,13 @@ int  stream_alloc(struct stream **sp, struct call *call,
 		  stream_rtp_h *rtph, stream_rtcp_h *rtcph, void *arg);
 struct sdp_media *stream_sdpmedia(const struct stream *s);
 int  stream_start(struct stream *s);
+void stream_stop(struct stream *s);
 void stream_start_keepalive(struct stream *s);
 int  stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 		 struct mbuf *mb);
+int  stream_flush(struct stream *s);
+int  stream_txbatch_set(struct stream *s, unsigned n);
+int  stream_event(struct stream *s, stream_event_h *h, int id);
 void stream_update(struct stream *s, const char *cname);
 void stream_update_encoder(struct stream *s, int pt_enc);
 int  stream_jbuf_stat(struct re_printf *pf, const struct stream *s);
@@ -361,3 +366,13 @@ void video_update_picture(struct video *v);
 void video_sdp_attr_decode(struct video *v);
 int  video_debug(struct re_printf *pf, const struct video *v);
 int  video_print(struct re_printf *pf, const struct video *v);
+
+
+/*
+ * Media worker threads
+ */
+
+int  worker_init(unsigned n);
+void worker_close(void);
+struct re_worker *worker_get(void);
+int  worker_main_call(mqueue_h *h, int id, void *data);
@@ -55,7 +55,7 @@ int main(int argc, char *argv[])
 
 #ifdef HAVE_GETOPT
 	for (;;) {
-		const int c = getopt(argc, argv, "6de:f:h");
+		const int c = getopt(argc, argv, "6de:f:hm");
 		if (0 > c)
 			break;
 
@@ -70,7 +70,9 @@ int main(int argc, char *argv[])
 					 "\t-d               Daemon\n"
 					 "\t-e <commands>    Exec commands\n"
 					 "\t-f <path>        Config path\n"
-					 "\t-h -?            Help\n");
+					 "\t-h -?            Help\n"
+					 "\t-m               Use slab memory"
+					 " allocator\n");
 			return -2;
 
 		case '6':
@@ -89,6 +91,10 @@ int main(int argc, char *argv[])
 			conf_path_set(optarg);
 			break;
 
+		case 'm':
+			mem_slab_set(true);
+			break;
+
 		default:
 			break;
 		}
@@ -295,6 +295,8 @@ static int dns_debug(struct re_printf *pf, void *unused)
 	for (i=0; i<net.nsn; i++)
 		err |= re_hprintf(pf, "   %u: %J\n", nsn+i, &net.nsv[i]);
 
+	err |= dnsc_debug(pf, net.dnsc);
+
 	return err;
 }
 
@@ -29,6 +29,7 @@ SRCS	+= vidcodec.c
 SRCS	+= vidfilt.c
 SRCS	+= vidisp.c
 SRCS	+= vidsrc.c
+SRCS	+= worker.c
 
 ifneq ($(USE_VIDEO),)
 SRCS	+= video.c
@@ -20,6 +20,7 @@
 
 enum {
 	RTP_RECV_SIZE    = 8192,  /**< Receive buffer for incoming RTP     */
+	RTP_RECV_BATCH   = 8,     /**< Max RTP packets per receive event   */
 	RTP_KEEPALIVE_Tr = 15,    /**< RTP keepalive interval in [seconds] */
 };
 
@@ -31,6 +32,27 @@ enum stream_type {
 };
 
 
+/** Weak reference to a stream, cleared when the stream is destroyed */
+struct stream_ref {
+	struct stream *s;
+};
+
+/** Event handed over from a worker thread to the main thread */
+struct stream_ev {
+	struct stream_ref *ref;  /**< Stream, if it still exists          */
+	stream_event_h *h;       /**< Event handler, or NULL for RTCP      */
+	struct rtcp_msg *msg;    /**< RTCP message                         */
+	int id;                  /**< Event identifier                     */
+};
+
+
+/** Request to attach the RTP socket to a worker thread */
+struct attach_req {
+	struct stream *s;
+	int err;
+};
+
+
 /** Defines a generic media stream */
 struct stream {
 	MAGIC_DECL
@@ -51,6 +73,8 @@ struct stream {
 	stream_rtp_h *rtph;      /**< Stream RTP handler                    */
 	stream_rtcp_h *rtcph;    /**< Stream RTCP handler                   */
 	void *arg;               /**< Handler argument                      */
+	struct re_worker *worker;/**< Worker thread for RTP, or NULL        */
+	struct stream_ref *ref;  /**< Weak reference for worker events      */
 
 	int pt_enc;
 	/*int pt_dec; todo: enable this */
@@ -90,10 +114,32 @@ static inline int lostcalc(struct stream *s, uint16_t seq)
 }
 
 
+static void detach_handler(int id, void *data)
+{
+	struct stream *s = data;
+
+	(void)id;
+
+	udp_thread_detach(rtp_sock(s->rtp));
+}
+
+
+static void attach_handler(int id, void *data)
+{
+	struct attach_req *req = data;
+
+	(void)id;
+
+	req->err = udp_thread_attach(rtp_sock(req->s->rtp));
+}
+
+
 static void stream_destructor(void *arg)
 {
 	struct stream *s = arg;
 
+	stream_stop(s);
+
 	list_unlink(&s->le);
 	tmr_cancel(&s->tmr_stats);
 	mem_deref(s->rtpkeep);
@@ -152,7 +198,9 @@ static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 		if (jbuf_get(s->jbuf, &hdr2, &mb2))
 			memset(&hdr2, 0, sizeof(hdr2));
 
-		if (lostcalc(s, hdr2.seq) > 0)
+		/* the jitter buffer may skip frames before a talk spurt,
+		 * where the sender was silent: nothing to conceal */
+		if (lostcalc(s, hdr2.seq) > 0 && !hdr2.m)
 			s->rtph(hdr, NULL, s->arg);
 
 		s->rtph(&hdr2, mb2, s->arg);
@@ -168,18 +216,117 @@ static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 }
 
 
+static void ev_destructor(void *data)
+{
+	struct stream_ev *ev = data;
+
+	mem_deref(ev->ref);
+	mem_deref(ev->msg);
+}
+
+
+static void ev_handler(int id, void *data)
+{
+	struct stream_ev *ev = data;
+	struct stream *s = ev->ref->s;
+
+	(void)id;
+
+	if (!s)
+		goto out;
+
+	if (ev->h)
+		ev->h(ev->id, s->arg);
+	else if (s->rtcph)
+		s->rtcph(ev->msg, s->arg);
+
+ out:
+	mem_deref(ev);
+}
+
+
+/* Hand over an event to the main thread */
+static int ev_push(struct stream *s, stream_event_h *h, int id,
+		   struct rtcp_msg *msg)
+{
+	struct stream_ev *ev;
+	int err;
+
+	ev = mem_zalloc(sizeof(*ev), ev_destructor);
+	if (!ev)
+		return ENOMEM;
+
+	ev->ref = mem_ref(s->ref);
+	ev->h   = h;
+	ev->msg = mem_ref(msg);
+	ev->id  = id;
+
+	err = worker_main_call(ev_handler, 0, ev);
+	if (err)
+		mem_deref(ev);
+
+	return err;
+}
+
+
 static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg, void *arg)
 {
 	struct stream *s = arg;
 
 	(void)src;
-	(void)s;
 
-	if (s->rtcph)
+	if (!s->rtcph)
+		return;
+
+	if (s->worker)
+		(void)ev_push(s, NULL, 0, msg);
+	else
 		s->rtcph(msg, s->arg);
 }
 
 
+/* Move the RTP socket from the main thread to a worker thread */
+static int stream_worker_attach(struct stream *s)
+{
+	struct attach_req req;
+	struct re_worker *w;
+	int err;
+
+	w = worker_get();
+	if (!w)
+		return 0;
+
+	s->ref = mem_zalloc(sizeof(*s->ref), NULL);
+	if (!s->ref) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	s->ref->s = s;
+
+	udp_thread_detach(rtp_sock(s->rtp));
+
+	req.s   = s;
+	req.err = 0;
+
+	err = re_worker_sync(w, attach_handler, 0, &req);
+	if (!err)
+		err = req.err;
+	if (err)
+		goto out;
+
+	s->worker = w;
+
+ out:
+	if (err) {
+		(void)udp_thread_attach(rtp_sock(s->rtp));
+		mem_deref(w);
+	}
+
+	return err;
+}
+
+
 static int stream_sock_alloc(struct stream *s, int af)
 {
 	struct sa laddr;
@@ -204,6 +351,7 @@ static int stream_sock_alloc(struct stream *s, int af)
 			     &tos, sizeof(tos));
 
 	udp_rxsz_set(rtp_sock(s->rtp), RTP_RECV_SIZE);
+	(void)udp_rxbatch_set(rtp_sock(s->rtp), RTP_RECV_BATCH);
 
 	return 0;
 }
@@ -280,6 +428,13 @@ int stream_alloc(struct stream **sp, struct call *call,
 				 config.avt.jbuf_del.max);
 		if (err)
 			goto out;
+
+		/* video frames span several packets, keep those fixed */
+		if (s->type == STREAM_AUDIO) {
+			err = jbuf_set_type(s->jbuf, config.avt.jbtype);
+			if (err)
+				goto out;
+		}
 	}
 
 	err = sdp_media_add(&s->sdp, sdp_sess, name,
@@ -315,6 +470,16 @@ int stream_alloc(struct stream **sp, struct call *call,
 	if (err)
 		goto out;
 
+	/* NAT traversal, encryption and keepalive keep state and timers
+	   in the main thread, so those streams are not moved */
+	if (!mnat && !menc && !ua_param(call_get_ua(call), "rtpkeep")) {
+		int werr = stream_worker_attach(s);
+		if (werr) {
+			DEBUG_WARNING("%s: using main thread (%m)\n",
+				      name, werr);
+		}
+	}
+
 	s->pt_enc = -1;
 
 	list_append(call_streaml(call), &s->le, s);
@@ -329,6 +494,31 @@ int stream_alloc(struct stream **sp, struct call *call,
 }
 
 
+/**
+ * Stop receiving RTP on a stream. The RTP socket is detached from its
+ * worker thread and pending worker events are dropped, so that no stream
+ * handlers are called after this function returns. Must be called from
+ * the main thread, before the handler argument is freed.
+ *
+ * @param s Stream
+ */
+void stream_stop(struct stream *s)
+{
+	if (!s)
+		return;
+
+	if (s->worker) {
+		(void)re_worker_sync(s->worker, detach_handler, 0, s);
+		s->worker = mem_deref(s->worker);
+	}
+
+	if (s->ref) {
+		s->ref->s = NULL;
+		s->ref = mem_deref(s->ref);
+	}
+}
+
+
 struct sdp_media *stream_sdpmedia(const struct stream *s)
 {
 	return s ? s->sdp : NULL;
@@ -387,8 +577,8 @@ int stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 		pt = s->pt_enc;
 
 	if (pt >= 0) {
-		err = rtp_send(s->rtp, sdp_media_raddr(s->sdp),
-			       marker, pt, ts, mb);
+		err = rtp_send_queue(s->rtp, sdp_media_raddr(s->sdp),
+				     marker, pt, ts, mb);
 	}
 
 	rtpkeep_refresh(s->rtpkeep, ts);
@@ -399,6 +589,64 @@ int stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 }
 
 
+/**
+ * Send all RTP packets queued by stream_send()
+ *
+ * @param s Stream object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_flush(struct stream *s)
+{
+	if (!s)
+		return EINVAL;
+
+	return rtp_flush(s->rtp);
+}
+
+
+/**
+ * Set the maximum number of RTP packets queued by stream_send(). The
+ * packets are sent together with stream_flush().
+ *
+ * @param s Stream object
+ * @param n Maximum number of packets, 0 or 1 to send immediately
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_txbatch_set(struct stream *s, unsigned n)
+{
+	if (!s)
+		return EINVAL;
+
+	return udp_txbatch_set(rtp_sock(s->rtp), n);
+}
+
+
+/**
+ * Call an event handler from the main thread. If the stream is received
+ * in a worker thread, the event is handed over to the main thread.
+ *
+ * @param s  Stream object
+ * @param h  Event handler, called with the stream handler argument
+ * @param id Event identifier
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_event(struct stream *s, stream_event_h *h, int id)
+{
+	if (!s || !h)
+		return EINVAL;
+
+	if (s->worker)
+		return ev_push(s, h, id, NULL);
+
+	h(id, s->arg);
+
+	return 0;
+}
+
+
 static void stream_remote_set(struct stream *s, const char *cname)
 {
 	struct sa rtcp;
@@ -469,9 +717,13 @@ int stream_jbuf_stat(struct re_printf *pf, const struct stream *s)
 		err = re_hprintf(pf, "Jbuf stat: (not available)");
 	}
 	else {
-		err = re_hprintf(pf, "Jbuf stat: put=%u get=%u or=%u ur=%u",
+		err = re_hprintf(pf, "Jbuf stat: put=%u get=%u or=%u ur=%u"
+				  " skip=%u delay=%u/%ums jitter=%ums",
 				  stat.n_put, stat.n_get,
-				  stat.n_overflow, stat.n_underflow);
+				  stat.n_overflow, stat.n_underflow,
+				  stat.n_skip,
+				  stat.delay_target, stat.delay_actual,
+				  stat.jitter);
 	}
 
 	return err;
@@ -493,6 +745,7 @@ void stream_set_srate(struct stream *s, uint32_t srate_tx, uint32_t srate_rx)
 		return;
 
 	rtcp_set_srate(s->rtp, srate_tx, srate_rx);
+	jbuf_set_srate(s->jbuf, srate_rx);
 }
 
 
@@ -2073,6 +2073,10 @@ int ua_init(const char *software, bool udp, bool tcp, bool tls,
 	if (err)
 		goto out;
 
+	err = worker_init(config.avt.workers);
+	if (err)
+		goto out;
+
 	net_change(60, net_change_handler, NULL);
 
  out:
@@ -2129,6 +2133,8 @@ void ua_close(void)
 #endif
 
 	list_flush(&uag.ual);
+
+	worker_close();
 }
 
 
@@ -31,6 +31,9 @@
 enum {
 	SRATE = 90000,
 	MAX_MUTED_FRAMES = 3,
+	MAX_TX_BATCH = 32,   /**< Max RTP packets sent per system call */
+	MAX_RX_FRAMES = 3,   /**< Max incomplete frames kept for reorder */
+	FIR_INTERVAL = 1000, /**< Min time between keyframe requests [ms] */
 };
 
 
@@ -71,6 +74,8 @@ struct vtx {
 	struct vidsrc_st *vsrc;            /**< Video source              */
 	struct lock *lock;                 /**< Lock for encoder          */
 	struct vidframe *frame;            /**< Source frame              */
+	struct vidconv_pool *convp;        /**< Pixel conversion threads  */
+	struct vidconv_ctx *convctx;       /**< Scaler and its tables     */
 	struct vidframe *mute_frame;       /**< Frame with muted video    */
 	int muted_frames;                  /**< # of muted frames sent    */
 	uint32_t ts_tx;                    /**< Outgoing RTP timestamp    */
@@ -87,7 +92,9 @@ struct vrx {
 	struct vidcodec_st *dec;           /**< Current video decoder     */
 	struct vidisp_prm vidisp_prm;      /**< Video display parameters  */
 	struct vidisp_st *vidisp;          /**< Video display             */
+	struct vidasm *vasm;               /**< Frame assembler           */
 	struct lock *lock;                 /**< Lock for decoder          */
+	uint64_t fir_ts;                   /**< Time of last FIR sent     */
 	enum vidorient orient;             /**< Display orientation       */
 	bool fullscreen;                   /**< Fullscreen flag           */
 	int pt_rx;                         /**< Incoming RTP payload type */
@@ -116,17 +123,23 @@ static void video_destructor(void *arg)
 	struct vtx *vtx = &v->vtx;
 	struct vrx *vrx = &v->vrx;
 
+	/* no RTP handlers from a worker thread after this */
+	stream_stop(v->strm);
+
 	/* transmit */
 	mem_deref(vtx->vsrc);
 	lock_write_get(vtx->lock);
 	mem_deref(vtx->frame);
 	mem_deref(vtx->mute_frame);
 	mem_deref(vtx->enc);
+	mem_deref(vtx->convctx);
+	mem_deref(vtx->convp);
 	lock_rel(vtx->lock);
 	mem_deref(vtx->lock);
 
 	/* receive */
 	lock_write_get(vrx->lock);
+	mem_deref(vrx->vasm);
 	mem_deref(vrx->dec);
 	mem_deref(vrx->vidisp);
 	lock_rel(vrx->lock);
@@ -183,7 +196,10 @@ static void encode_rtp_send(struct vtx *vtx, const struct vidframe *frame)
 				goto unlock;
 		}
 
-		vidconv(vtx->frame, frame, 0);
+		err = vidconv_ctx(vtx->convctx, vtx->frame, frame, 0);
+		if (err)
+			goto unlock;
+
 		frame = vtx->frame;
 	}
 
@@ -202,8 +218,9 @@ static void encode_rtp_send(struct vtx *vtx, const struct vidframe *frame)
 	if (err)
 		return;
 
-	/* Encode the whole picture frame */
+	/* Encode the whole picture frame, and send all its packets */
 	err = vidcodec_get(vtx->enc)->ench(vtx->enc, vtx->picup, frame);
+	(void)stream_flush(vtx->video->strm);
 	if (err) {
 		DEBUG_WARNING("encode: %m\n", err);
 		return;
@@ -260,11 +277,57 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	vtx->video = video;
 	vtx->ts_tx = 160;
 
+	if (config.video.conv_threads > 1) {
+		err = vidconv_pool_alloc(&vtx->convp,
+					 config.video.conv_threads);
+		if (err) {
+			DEBUG_WARNING("conversion threads: %m\n", err);
+			err = 0;
+		}
+	}
+
+	err = vidconv_ctx_alloc(&vtx->convctx, VIDCONV_AREA);
+	if (err)
+		goto out;
+
+	vidconv_ctx_set_pool(vtx->convctx, vtx->convp);
+
  out:
 	return err;
 }
 
 
+static void vrx_packet_handler(const struct rtp_header *hdr,
+			       struct mbuf *mb, void *arg);
+static void vrx_loss_handler(void *arg);
+
+
+/*
+ * Check if an RTP packet may start a frame, from the payload format.
+ * The assembler drops a frame which has lost its first packets.
+ */
+static bool vrx_start_handler(const struct rtp_header *hdr,
+			      const struct mbuf *mb, void *arg)
+{
+	const struct vrx *vrx = arg;
+	const struct vidcodec *vc = vidcodec_get(vrx->dec);
+	(void)hdr;
+
+	if (!vc)
+		return true;
+
+	if (0 == str_casecmp(vidcodec_name(vc), "H264"))
+		return h264_rtp_is_start(mb);
+
+	/* VP8 payload descriptor, as sent by the vpx module: B bit */
+	if (0 == str_casecmp(vidcodec_name(vc), "VP8"))
+		return mbuf_get_left(mb) && (mbuf_buf(mb)[0] & 0x01);
+
+	/* H.263 and MPEG-4 packets are not told apart */
+	return true;
+}
+
+
 static int vrx_alloc(struct vrx *vrx, struct video *video)
 {
 	int err;
@@ -273,6 +336,11 @@ static int vrx_alloc(struct vrx *vrx, struct video *video)
 	if (err)
 		goto out;
 
+	err = vidasm_alloc(&vrx->vasm, MAX_RX_FRAMES, vrx_start_handler,
+			   vrx_packet_handler, vrx_loss_handler, vrx);
+	if (err)
+		goto out;
+
 	vrx->video  = video;
 	vrx->pt_rx  = -1;
 	vrx->orient = VIDORIENT_PORTRAIT;
@@ -283,43 +351,52 @@ static int vrx_alloc(struct vrx *vrx, struct video *video)
 
 
 #if ENABLE_DECODER
-/**
- * Decode incoming RTP packets using the Video decoder
- *
- * NOTE: mb=NULL if no packet received
- */
-static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
-			       struct mbuf *mb)
+/* Ask the peer for a new keyframe, at most once per FIR_INTERVAL */
+static void request_keyframe(struct vrx *vrx)
 {
+	struct video *v = vrx->video;
+	const uint64_t now = tmr_jiffies();
+
+	if (vrx->fir_ts && now < vrx->fir_ts + FIR_INTERVAL)
+		return;
+
+	vrx->fir_ts = now;
+
+	/* send RTCP FIR to peer */
+	stream_send_fir(v->strm, v->nack_pli);
+
+	/* XXX: if RTCP is not enabled, send XML in SIP INFO ? */
+}
+
+
+/* A frame was lost, the decoder needs a new keyframe to recover */
+static void vrx_loss_handler(void *arg)
+{
+	request_keyframe(arg);
+}
+
+
+/* Decode one RTP packet of a complete frame, in sequence order */
+static void vrx_packet_handler(const struct rtp_header *hdr,
+			       struct mbuf *mb, void *arg)
+{
+	struct vrx *vrx = arg;
 	struct video *v = vrx->video;
 	struct vidframe frame;
 	struct le *le;
 	int err = 0;
 
-	lock_write_get(vrx->lock);
-
-	/* No decoder set */
-	if (!vrx->dec) {
-		DEBUG_WARNING("No video decoder!\n");
-		goto out;
-	}
-
 	frame.data[0] = NULL;
 	err = vidcodec_get(vrx->dec)->dech(vrx->dec, &frame, hdr->m, mb);
 	if (err) {
 		DEBUG_WARNING("decode error: %m\n", err);
-
-		/* send RTCP FIR to peer */
-		stream_send_fir(v->strm, v->nack_pli);
-
-		/* XXX: if RTCP is not enabled, send XML in SIP INFO ? */
-
-		goto out;
+		request_keyframe(vrx);
+		return;
 	}
 
 	/* Got a full picture-frame? */
 	if (!vidframe_isvalid(&frame))
-		goto out;
+		return;
 
 	/* Process video frame through all Video Filters */
 	for (le = v->filtl.head; le; le = le->next) {
@@ -333,6 +410,34 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	err = vidisp_display(vrx->vidisp, v->peer, &frame);
 
 	++vrx->frames;
+}
+
+
+/**
+ * Decode incoming RTP packets using the Video decoder. The packets are
+ * reordered and assembled into frames first, and only complete frames
+ * are decoded.
+ *
+ * NOTE: mb=NULL if no packet received
+ */
+static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
+			       struct mbuf *mb)
+{
+	int err = 0;
+
+	/* Lost packets are detected by the frame assembler */
+	if (!mb)
+		return 0;
+
+	lock_write_get(vrx->lock);
+
+	/* No decoder set */
+	if (!vrx->dec) {
+		DEBUG_WARNING("No video decoder!\n");
+		goto out;
+	}
+
+	err = vidasm_put(vrx->vasm, hdr, mb);
 
 out:
 	lock_rel(vrx->lock);
@@ -340,6 +445,21 @@ out:
 	return err;
 }
 #else
+static void vrx_packet_handler(const struct rtp_header *hdr,
+			       struct mbuf *mb, void *arg)
+{
+	(void)hdr;
+	(void)mb;
+	(void)arg;
+}
+
+
+static void vrx_loss_handler(void *arg)
+{
+	(void)arg;
+}
+
+
 static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 			       struct mbuf *mb)
 {
@@ -437,6 +557,8 @@ int video_alloc(struct video **vp, struct call *call,
 	if (err)
 		goto out;
 
+	(void)stream_txbatch_set(v->strm, MAX_TX_BATCH);
+
 	err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), true,
 				   "framerate", "%d", config.video.fps);
 
@@ -810,9 +932,14 @@ int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx)
 	vrx = &v->vrx;
 
 #if ENABLE_DECODER
+	lock_write_get(vrx->lock);
+
 	vrx->pt_rx = pt_rx;
 	vrx->dec = mem_deref(vrx->dec);
 
+	/* frames of the old payload type can not be decoded */
+	vidasm_flush(vrx->vasm);
+
 	if (!vidcodec_cmp(vc, vidcodec_get(v->vtx.enc))) {
 
 		err = vc_alloc(&vrx->dec, vc, v, NULL);
@@ -826,6 +953,8 @@ int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx)
 	}
 #endif
 
+	lock_rel(vrx->lock);
+
 #else
 	(void)vc;
 	(void)pt_rx;
@@ -915,6 +1044,7 @@ int video_debug(struct re_printf *pf, const struct video *v)
 			  vtx->vsrc_size.w,
 			  vtx->vsrc_size.h, vtx->vsrc_prm.fps);
 	err |= re_hprintf(pf, " rx: pt=%d\n", vrx->pt_rx);
+	err |= vidasm_debug(pf, vrx->vasm);
 
 	err |= stream_debug(pf, v->strm);
 
@@ -0,0 +1,131 @@
+/**
+ * @file worker.c  Media worker threads
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+#define DEBUG_MODULE "worker"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/*
+ * RTP sockets can be attached to a pool of worker threads, each running
+ * its own main loop, so that media receive, jitter buffering and decoding
+ * are spread over several cores. Events which must be handled by the
+ * main (SIP) thread are handed back through a message queue.
+ */
+
+
+static struct {
+	struct re_worker **workerv;  /**< Worker threads               */
+	unsigned n;                  /**< Number of worker threads     */
+	unsigned next;               /**< Next worker to hand out      */
+	struct mqueue *mq;           /**< Message queue to main thread */
+} workers;
+
+
+static void workerv_destructor(void *data)
+{
+	struct re_worker **workerv = data;
+	unsigned i;
+
+	for (i=0; i<workers.n; i++)
+		mem_deref(workerv[i]);
+}
+
+
+/**
+ * Start the media worker threads. Must be called from the main thread.
+ *
+ * @param n Number of worker threads, 0 to run all media in main thread
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int worker_init(unsigned n)
+{
+	int err;
+
+	if (!n)
+		return 0;
+
+	err = mqueue_alloc(&workers.mq);
+	if (err)
+		goto out;
+
+	workers.workerv = mem_zalloc(n * sizeof(*workers.workerv),
+				     workerv_destructor);
+	if (!workers.workerv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (workers.n=0; workers.n<n; workers.n++) {
+
+		err = re_worker_alloc(&workers.workerv[workers.n]);
+		if (err)
+			goto out;
+	}
+
+	(void)re_printf("media: %u worker threads\n", n);
+
+ out:
+	if (err) {
+		DEBUG_WARNING("init: %m\n", err);
+		worker_close();
+	}
+
+	return err;
+}
+
+
+/**
+ * Stop the media worker threads
+ */
+void worker_close(void)
+{
+	workers.workerv = mem_deref(workers.workerv);
+	workers.mq = mem_deref(workers.mq);
+	workers.n = 0;
+	workers.next = 0;
+}
+
+
+/**
+ * Get a media worker thread, in round-robin order
+ *
+ * @return Referenced worker, or NULL if there are no workers
+ */
+struct re_worker *worker_get(void)
+{
+	struct re_worker *w;
+
+	if (!workers.n)
+		return NULL;
+
+	w = workers.workerv[workers.next++ % workers.n];
+
+	return mem_ref(w);
+}
+
+
+/**
+ * Hand over a call to the main thread
+ *
+ * @param h    Handler, called from the main thread
+ * @param id   General purpose identifier
+ * @param data Handler data
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int worker_main_call(mqueue_h *h, int id, void *data)
+{
+	if (!workers.mq)
+		return ENOENT;
+
+	return mqueue_push(workers.mq, h, id, data);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file test.c  Selftest for baresip
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "tests/test.h"
+
+
+#define DEBUG_MODULE "test"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+struct test {
+	int (*exec)(void);
+	const char *name;
+};
+
+#define TEST(a) {a, #a}
+
+static const struct test tests[] = {
+	TEST(test_audio_tx_alloc),
+#ifdef HAVE_PTHREAD
+	TEST(test_audio_worker),
+#endif
+};
+
+
+static int run(const struct test *testv, size_t testc, const char *name)
+{
+	size_t i, n = 0;
+	int err = 0;
+
+	for (i=0; i<testc; i++) {
+
+		int e;
+
+		if (name && !strstr(testv[i].name, name))
+			continue;
+
+		e = testv[i].exec();
+		if (e) {
+			DEBUG_WARNING("%s: failed (%m)\n", testv[i].name, e);
+			err = e;
+		}
+
+		++n;
+	}
+
+	(void)re_printf("%zu test%s run, %s\n", n, n == 1 ? "" : "s",
+			err ? "FAILED" : "OK");
+
+	return err;
+}
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr, "usage: test [name]\n"
+			 "\tname    Only run tests matching name\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *name = NULL;
+	int i, err;
+
+	for (i=1; i<argc; i++) {
+
+		if (argv[i][0] == '-') {
+			usage();
+			return 2;
+		}
+
+		name = argv[i];
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	err = run(tests, ARRAY_SIZE(tests), name);
+
+	libre_close();
+
+	tmr_debug();
+	mem_debug();
+
+	return err ? 1 : 0;
+}
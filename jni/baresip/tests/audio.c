@@ -0,0 +1,589 @@
+/**
+ * @file tests/audio.c  Audio stream -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re.h>
+#include <baresip.h>
+#include "src/core.h"
+#include "test.h"
+
+
+enum {
+	PT_A        = 96,
+	PT_B        = 97,
+	NUM_PKTS    = 1000,   /* Packets sent, one per millisecond      */
+	SWITCH_PKTS = 50,     /* Packets between payload type changes   */
+	SET_PERIOD  = 7,      /* Packets between decoder changes        */
+	TAIL_PKTS   = 20,     /* Packets with no decoder changes at end */
+	MAGIC_ST    = 0x5eed,
+	MAX_FRAME   = 640,    /* 20 ms at 16 kHz                        */
+	TX_FRAMES   = 25,     /* Frames sent by the audio source        */
+};
+
+
+static const uint8_t silence[MAX_FRAME];
+
+
+/* The handlers of codecs, filters and players have no argument */
+static struct {
+#ifdef HAVE_PTHREAD
+	pthread_t tid_main;
+#endif
+	struct aucodec *acv[2];
+	struct audio *a;
+	struct rtp_sock *rtp;
+	struct sa dst;
+	struct tmr tmr;
+	unsigned n_sent;
+	uint32_t n_dec;         /* Packets decoded                         */
+	uint32_t n_dec_worker;  /* Packets decoded in a worker thread      */
+	uint32_t n_bad_state;   /* Decoder or filter used after its free   */
+	uint32_t n_bad_thread;  /* Decoder, filter or player allocated in
+				   a worker thread                         */
+} tw;
+
+
+/* The audio source, which is driven by the test */
+static struct {
+	ausrc_read_h *rh;
+	void *arg;
+	size_t psize;         /* Bytes per frame                         */
+	uint32_t ptime;
+} tsrc;
+
+
+struct aucodec_st {
+	struct aucodec *ac;  /* inheritance */
+	uint32_t magic;
+};
+
+struct aufilt_st {
+	struct aufilt *af;   /* inheritance */
+	uint32_t magic;
+};
+
+struct auplay_st {
+	struct auplay *ap;   /* inheritance */
+};
+
+struct ausrc_st {
+	struct ausrc *as;    /* inheritance */
+};
+
+
+static bool in_main(void)
+{
+#ifdef HAVE_PTHREAD
+	return pthread_equal(pthread_self(), tw.tid_main);
+#else
+	return true;
+#endif
+}
+
+
+static void codec_destructor(void *arg)
+{
+	struct aucodec_st *st = arg;
+
+	st->magic = 0;
+	mem_deref(st->ac);
+}
+
+
+static int codec_alloc(struct aucodec_st **stp, struct aucodec *ac,
+		       struct aucodec_prm *encp, struct aucodec_prm *decp,
+		       const char *fmtp)
+{
+	struct aucodec_st *st;
+	(void)encp;
+	(void)decp;
+	(void)fmtp;
+
+	if (!in_main())
+		++tw.n_bad_thread;
+
+	st = mem_zalloc(sizeof(*st), codec_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->ac    = mem_ref(ac);
+	st->magic = MAGIC_ST;
+
+	*stp = st;
+
+	return 0;
+}
+
+
+/* As an uncompressed codec, the worst case for the packet size */
+static int codec_encode(struct aucodec_st *st, struct mbuf *dst,
+			struct mbuf *src)
+{
+	if (st->magic != MAGIC_ST)
+		++tw.n_bad_state;
+
+	return mbuf_write_mem(dst, mbuf_buf(src), mbuf_get_left(src));
+}
+
+
+/* 20 ms of silence for each packet */
+static int codec_decode(struct aucodec_st *st, struct mbuf *dst,
+			struct mbuf *src)
+{
+	if (st->magic != MAGIC_ST)
+		++tw.n_bad_state;
+
+	if (!in_main())
+		++tw.n_dec_worker;
+
+	++tw.n_dec;
+
+	if (src)
+		src->pos = src->end;
+
+	return mbuf_write_mem(dst, silence, aucodec_srate(st->ac) / 50 * 2);
+}
+
+
+static void filt_destructor(void *arg)
+{
+	struct aufilt_st *st = arg;
+
+	st->magic = 0;
+	mem_deref(st->af);
+}
+
+
+static int filt_alloc(struct aufilt_st **stp, struct aufilt *af,
+		      const struct aufilt_prm *encprm,
+		      const struct aufilt_prm *decprm)
+{
+	struct aufilt_st *st;
+	(void)encprm;
+	(void)decprm;
+
+	if (!in_main())
+		++tw.n_bad_thread;
+
+	st = mem_zalloc(sizeof(*st), filt_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->af    = mem_ref(af);
+	st->magic = MAGIC_ST;
+
+	*stp = st;
+
+	return 0;
+}
+
+
+static int filt_decode(struct aufilt_st *st, struct mbuf *mb)
+{
+	(void)mb;
+
+	if (st->magic != MAGIC_ST)
+		++tw.n_bad_state;
+
+	return 0;
+}
+
+
+static void play_destructor(void *arg)
+{
+	struct auplay_st *st = arg;
+
+	mem_deref(st->ap);
+}
+
+
+static int play_alloc(struct auplay_st **stp, struct auplay *ap,
+		      struct auplay_prm *prm, const char *device,
+		      auplay_write_h *wh, void *arg)
+{
+	struct auplay_st *st;
+	(void)prm;
+	(void)device;
+	(void)wh;
+	(void)arg;
+
+	if (!in_main())
+		++tw.n_bad_thread;
+
+	st = mem_zalloc(sizeof(*st), play_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->ap = mem_ref(ap);
+
+	*stp = st;
+
+	return 0;
+}
+
+
+static void src_destructor(void *arg)
+{
+	struct ausrc_st *st = arg;
+
+	memset(&tsrc, 0, sizeof(tsrc));
+	mem_deref(st->as);
+}
+
+
+static int src_alloc(struct ausrc_st **stp, struct ausrc *as,
+		     struct media_ctx **ctx, struct ausrc_prm *prm,
+		     const char *device, ausrc_read_h *rh,
+		     ausrc_error_h *errh, void *arg)
+{
+	struct ausrc_st *st;
+	(void)ctx;
+	(void)device;
+	(void)errh;
+
+	st = mem_zalloc(sizeof(*st), src_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->as = mem_ref(as);
+
+	tsrc.rh    = rh;
+	tsrc.arg   = arg;
+	tsrc.psize = 2 * prm->frame_size;
+	tsrc.ptime = prm->frame_size * 1000 / (prm->srate * prm->ch);
+
+	*stp = st;
+
+	return 0;
+}
+
+
+static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
+			struct mbuf *mb, void *arg)
+{
+	(void)src;
+	(void)hdr;
+	(void)mb;
+	(void)arg;
+}
+
+
+/*
+ * One packet per tick, with the payload type changing every SWITCH_PKTS
+ * packets. Meanwhile the decoder is also set from the main thread, as
+ * done by a re-INVITE.
+ */
+static void tmr_handler(void *arg)
+{
+	const unsigned n = tw.n_sent;
+	const unsigned i = (n / SWITCH_PKTS) % 2;
+	struct mbuf *mb;
+	int err;
+	(void)arg;
+
+	if (n >= NUM_PKTS) {
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&tw.tmr, 1, tmr_handler, NULL);
+
+	if (n % SET_PERIOD == 0 && n + TAIL_PKTS < NUM_PKTS) {
+
+		const unsigned j = (n / SET_PERIOD) % 2;
+
+		(void)audio_decoder_set(tw.a, tw.acv[j], j ? PT_B : PT_A,
+					NULL);
+	}
+
+	mb = mbuf_alloc(RTP_HEADER_SIZE + 160);
+	if (!mb)
+		return;
+
+	mb->pos = mb->end = RTP_HEADER_SIZE;
+	err = mbuf_write_mem(mb, silence, 160);
+	mb->pos = RTP_HEADER_SIZE;
+
+	if (!err)
+		err = rtp_send(tw.rtp, &tw.dst, false, i ? PT_B : PT_A,
+			       n * 160, mb);
+	if (!err)
+		++tw.n_sent;
+
+	mem_deref(mb);
+}
+
+
+static void tmr_cancel_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+/* The local RTP port of the audio stream, from the SDP offer */
+static int rtp_port_get(const struct call *call, uint16_t *port)
+{
+	struct mbuf *mb = NULL;
+	struct pl pl_port;
+	int err;
+
+	err = call_sdp_get(call, &mb, true);
+	if (err)
+		return err;
+
+	err = re_regex((char *)mb->buf, mb->end, "m=audio [0-9]+",
+		       &pl_port);
+	if (!err)
+		*port = pl_u32(&pl_port);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/* The payload type of the decoder, from the debug output */
+static int rx_pt_get(const struct audio *a, uint32_t *pt)
+{
+	struct pl pl_pt;
+	char *str = NULL;
+	int err;
+
+	err = re_sdprintf(&str, "%H", audio_debug, a);
+	if (err)
+		return err;
+
+	err = re_regex(str, strlen(str), " pt=[0-9]+", &pl_pt);
+	if (!err)
+		*pt = pl_u32(&pl_pt);
+
+	mem_deref(str);
+
+	return err;
+}
+
+
+/* The frames and allocations of the sender, from the debug output */
+static int tx_stats_get(const struct audio *a, uint32_t *frames,
+			uint32_t *allocs)
+{
+	struct pl pl_frames, pl_allocs;
+	char *str = NULL;
+	int err;
+
+	err = re_sdprintf(&str, "%H", audio_debug, a);
+	if (err)
+		return err;
+
+	err = re_regex(str, strlen(str), "frames=[0-9]+ allocs=[0-9]+",
+		       &pl_frames, &pl_allocs);
+	if (!err) {
+		*frames = pl_u32(&pl_frames);
+		*allocs = pl_u32(&pl_allocs);
+	}
+
+	mem_deref(str);
+
+	return err;
+}
+
+
+/*
+ * Audio is received in a worker thread, while the main thread changes
+ * the decoder, and the payload type of the incoming RTP also changes.
+ * Decoders, filters and players must only be allocated in the main
+ * thread, and must not be used by the worker after they are freed.
+ */
+int test_audio_worker(void)
+{
+	struct aucodec *aca = NULL, *acb = NULL;
+	struct aufilt *af = NULL;
+	struct auplay *ap = NULL;
+	struct list calls = LIST_INIT;
+	struct call *call = NULL;
+	struct ua *ua = NULL;
+	const uint32_t workers = config.avt.workers;
+	struct sa laddr;
+	uint16_t port = 0;
+	uint32_t pt = 0;
+	int err;
+
+	memset(&tw, 0, sizeof(tw));
+#ifdef HAVE_PTHREAD
+	tw.tid_main = pthread_self();
+#endif
+
+	config.avt.workers = 1;
+
+	err = ua_init("test", true, false, false, false);
+	TEST_ERR(err);
+
+	err  = aucodec_register(&aca, "96", "TESTA", 8000, 1, NULL,
+				codec_alloc, NULL, codec_decode, NULL);
+	err |= aucodec_register(&acb, "97", "TESTB", 16000, 1, NULL,
+				codec_alloc, NULL, codec_decode, NULL);
+	err |= aufilt_register(&af, "test", filt_alloc, NULL,
+			       filt_decode, NULL);
+	err |= auplay_register(&ap, "test", play_alloc);
+	TEST_ERR(err);
+
+	tw.acv[0] = aca;
+	tw.acv[1] = acb;
+
+	err = ua_alloc(&ua, "Test <sip:test:test@127.0.0.1>;regint=0",
+		       NULL, NULL, NULL);
+	TEST_ERR(err);
+
+	err = call_alloc(&call, &calls, ua, NULL, NULL, NULL, NULL, NULL, 0,
+			 NULL, "test", "sip:test@127.0.0.1", NULL, NULL,
+			 NULL, NULL);
+	TEST_ERR(err);
+
+	tw.a = call_audio(call);
+
+	err = audio_decoder_set(tw.a, aca, PT_A, NULL);
+	TEST_ERR(err);
+
+	err = audio_start(tw.a);
+	TEST_ERR(err);
+
+	sa_set_str(&laddr, "127.0.0.1", 0);
+	err = rtp_listen(&tw.rtp, IPPROTO_UDP, &laddr, 10000, 60000, false,
+			 rtp_handler, NULL, NULL);
+	TEST_ERR(err);
+
+	err = rtp_port_get(call, &port);
+	TEST_ERR(err);
+
+	tw.dst = laddr;
+	sa_set_port(&tw.dst, port);
+
+	tmr_start(&tw.tmr, 1, tmr_handler, NULL);
+
+	err = re_main(NULL);
+	TEST_ERR(err);
+
+	/* the last payload type change is handed over by the worker */
+	tmr_start(&tw.tmr, 100, tmr_cancel_handler, NULL);
+
+	err = re_main(NULL);
+	TEST_ERR(err);
+
+	err = rx_pt_get(tw.a, &pt);
+	TEST_ERR(err);
+
+	TEST_EQUALS(NUM_PKTS, tw.n_sent);
+	TEST_ASSERT(tw.n_dec > NUM_PKTS / 2);
+	TEST_ASSERT(tw.n_dec_worker > 0);
+	TEST_EQUALS(0, tw.n_bad_state);
+	TEST_EQUALS(0, tw.n_bad_thread);
+	TEST_EQUALS(((NUM_PKTS - 1) / SWITCH_PKTS) % 2 ? PT_B : PT_A, pt);
+
+ out:
+	tmr_cancel(&tw.tmr);
+	mem_deref(call);
+	mem_deref(tw.rtp);
+	ua_close();
+	mem_deref(ap);
+	mem_deref(af);
+	mem_deref(acb);
+	mem_deref(aca);
+
+	config.avt.workers = workers;
+
+	return err;
+}
+
+
+/*
+ * Sending a frame, from the audio source to the stream, must not allocate
+ * memory. The source is polled, so the frames are encoded from its read
+ * handler, and the first half is sent muted. The stream has no peer, so
+ * stream_send() returns before the RTP socket.
+ */
+int test_audio_tx_alloc(void)
+{
+	struct aucodec *aca = NULL;
+	struct ausrc *as = NULL;
+	struct list calls = LIST_INIT;
+	struct call *call = NULL;
+	struct ua *ua = NULL;
+	uint32_t frames = 0, allocs = 0;
+	uint64_t nallocs = 0, n;
+	unsigned i;
+	int err;
+
+	memset(&tw, 0, sizeof(tw));
+	memset(&tsrc, 0, sizeof(tsrc));
+#ifdef HAVE_PTHREAD
+	tw.tid_main = pthread_self();
+#endif
+
+	err = ua_init("test", true, false, false, false);
+	TEST_ERR(err);
+
+	err  = aucodec_register(&aca, "96", "TESTA", 8000, 1, NULL,
+				codec_alloc, codec_encode, codec_decode, NULL);
+	err |= ausrc_register(&as, "test", src_alloc);
+	TEST_ERR(err);
+
+	err = ua_alloc(&ua, "Test <sip:test:test@127.0.0.1>;regint=0",
+		       NULL, NULL, NULL);
+	TEST_ERR(err);
+
+	err = call_alloc(&call, &calls, ua, NULL, NULL, NULL, NULL, NULL, 0,
+			 NULL, "test", "sip:test@127.0.0.1", NULL, NULL,
+			 NULL, NULL);
+	TEST_ERR(err);
+
+	tw.a = call_audio(call);
+
+	err = audio_encoder_set(tw.a, aca, PT_A, NULL);
+	TEST_ERR(err);
+
+	err = audio_start(tw.a);
+	TEST_ERR(err);
+
+	TEST_ASSERT(tsrc.rh != NULL);
+	TEST_ASSERT(tsrc.psize <= sizeof(silence));
+	TEST_ASSERT(tsrc.ptime > 0);
+
+	audio_mute(tw.a, true);
+
+	/* one frame per packet time, as the send buffer is read timed */
+	for (i=0; i<TX_FRAMES; i++) {
+
+		if (i == TX_FRAMES / 2)
+			audio_mute(tw.a, false);
+
+		n = mem_nallocs();
+		tsrc.rh(silence, tsrc.psize, tsrc.arg);
+		nallocs += mem_nallocs() - n;
+
+		sys_msleep(tsrc.ptime);
+	}
+
+	err = tx_stats_get(tw.a, &frames, &allocs);
+	TEST_ERR(err);
+
+	TEST_EQUALS(TX_FRAMES, frames);
+	TEST_EQUALS(0, allocs);
+	TEST_EQUALS(0, nallocs);
+	TEST_EQUALS(0, tw.n_bad_state);
+	TEST_EQUALS(0, tw.n_bad_thread);
+
+ out:
+	mem_deref(call);
+	ua_close();
+	mem_deref(as);
+	mem_deref(aca);
+
+	return err;
+}
@@ -0,0 +1,7 @@
+#
+# srcs.mk All selftest source files.
+#
+# Copyright (C) 2010 Creytiv.com
+#
+
+TEST_SRCS	+= audio.c
@@ -0,0 +1,39 @@
+/**
+ * @file test.h  Selftest for baresip -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/** Fail the current test if the expression is false */
+#define TEST_ASSERT(expr)						\
+	if (!(expr)) {							\
+		(void)re_fprintf(stderr, "%s:%u: assertion failed: %s\n",\
+				 __FILE__, __LINE__, #expr);		\
+		err = EINVAL;						\
+		goto out;						\
+	}
+
+/** Fail the current test if two integers differ */
+#define TEST_EQUALS(expected, actual)					\
+	if ((expected) != (actual)) {					\
+		(void)re_fprintf(stderr, "%s:%u: expected %lld, got %lld\n",\
+				 __FILE__, __LINE__,			\
+				 (long long)(expected),			\
+				 (long long)(actual));			\
+		err = EINVAL;						\
+		goto out;						\
+	}
+
+/** Fail the current test on an error code */
+#define TEST_ERR(e)							\
+	if (e) {							\
+		(void)re_fprintf(stderr, "%s:%u: error: %m\n",		\
+				 __FILE__, __LINE__, (e));		\
+		goto out;						\
+	}
+
+
+/* Tests */
+int test_audio_tx_alloc(void);
+int test_audio_worker(void);
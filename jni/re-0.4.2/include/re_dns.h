@@ -170,6 +170,7 @@ struct dnsc_conf {
 	uint32_t conn_timeout;  /* in [ms] */
 	uint32_t idle_timeout;  /* in [ms] */
 	bool udp_conn;
+	uint32_t cache_size;    /* max cached replies, 0 to disable */
 };
 
 int  dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
@@ -186,6 +187,8 @@ int  dnsc_notify(struct dns_query **qp, struct dnsc *dnsc, const char *name,
 		 uint16_t type, uint16_t dnsclass, const struct dnsrr *ans_rr,
 		 int proto, const struct sa *srvv, const uint32_t *srvc,
 		 dns_query_h *qh, void *arg);
+void dnsc_cache_flush(struct dnsc *dnsc);
+int  dnsc_debug(struct re_printf *pf, const struct dnsc *dnsc);
 
 
 /* DNS System functions */
@@ -11,3 +11,12 @@ void hmac_sha1(const uint8_t *k,   /* secret key */
 	       size_t         ld,  /* length of data in bytes */
 	       uint8_t*       out, /* output buffer, at least "t" bytes */
 	       size_t         t);
+
+
+/** HMAC-SHA1 with the keyed pad states computed once */
+struct hmac_sha1_ctx;
+
+int  hmac_sha1_ctx_alloc(struct hmac_sha1_ctx **ctxp, const uint8_t *key,
+			 size_t key_len);
+void hmac_sha1_ctx_digest(const struct hmac_sha1_ctx *ctx, const uint8_t *d,
+			  size_t ld, uint8_t *out, size_t t);
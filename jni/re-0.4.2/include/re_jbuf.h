@@ -6,6 +6,12 @@
 struct jbuf;
 struct rtp_header;
 
+/** Jitter buffer type */
+enum jbuf_type {
+	JBUF_FIXED = 0,  /**< Fixed number of frames               */
+	JBUF_ADAPTIVE    /**< Number of frames follows the jitter  */
+};
+
 /** Jitter buffer statistics */
 struct jbuf_stat {
 	uint32_t n_put;        /**< Number of frames put into jitter buffer */
@@ -15,12 +21,18 @@ struct jbuf_stat {
 	uint32_t n_late;       /**< Number of frames arriving too late      */
 	uint32_t n_lost;       /**< Number of lost frames                   */
 	uint32_t n_overflow;   /**< Number of overflows                     */
+	uint32_t n_skip;       /**< Number of frames skipped to shrink      */
 	uint32_t n_underflow;  /**< Number of underflows                    */
 	uint32_t n_flush;      /**< Number of times jitter buffer flushed   */
+	uint32_t delay_target; /**< Target delay in [ms]                    */
+	uint32_t delay_actual; /**< Current delay in [ms]                   */
+	uint32_t jitter;       /**< Interarrival jitter in [ms]             */
 };
 
 
 int  jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max);
+int  jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype);
+void jbuf_set_srate(struct jbuf *jb, uint32_t srate);
 int  jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem);
 int  jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem);
 void jbuf_flush(struct jbuf *jb);
@@ -50,6 +50,22 @@ void re_thread_enter(void);
 void re_thread_leave(void);
 
 
+/* Worker threads */
+struct re_worker;
+
+/**
+ * Worker handler, called from the worker thread
+ *
+ * @param id   General purpose identifier
+ * @param data Handler data
+ */
+typedef void (re_worker_h)(int id, void *data);
+
+int re_worker_alloc(struct re_worker **wp);
+int re_worker_call(struct re_worker *w, re_worker_h *h, int id, void *data);
+int re_worker_sync(struct re_worker *w, re_worker_h *h, int id, void *data);
+
+
 /** Polling methods */
 enum poll_method {
 	METHOD_NULL = 0,
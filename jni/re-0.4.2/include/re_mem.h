@@ -32,6 +32,8 @@ uint32_t mem_nrefs(const void *data);
 
 void     mem_debug(void);
 void     mem_threshold_set(ssize_t n);
+void     mem_slab_set(bool enable);
 struct re_printf;
 int      mem_status(struct re_printf *pf, void *unused);
 int      mem_get_stat(struct memstat *mstat);
+uint64_t mem_nallocs(void);
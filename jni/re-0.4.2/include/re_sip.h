@@ -191,6 +191,7 @@ struct sip_msg {
 	uint16_t scode;
 	struct pl reason;
 	struct list hdrl;
+	struct list hdrvl;
 	struct sip_via via;
 	struct sip_taddr to;
 	struct sip_taddr from;
@@ -200,7 +201,6 @@ struct sip_msg {
 	struct pl expires;
 	struct pl ctype;
 	struct pl clen;
-	struct hash *hdrht;
 	struct mbuf *mb;
 	void *sock;
 	uint64_t tag;
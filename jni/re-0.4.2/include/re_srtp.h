@@ -0,0 +1,31 @@
+/**
+ * @file re_srtp.h  Secure Real-time Transport Protocol (SRTP)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/** SRTP Crypto Suites */
+enum srtp_suite {
+	SRTP_AES_CM_128_HMAC_SHA1_32,
+	SRTP_AES_CM_128_HMAC_SHA1_80,
+};
+
+enum {
+	SRTP_MASTER_KEY_SIZE  = 16,  /**< Master key size in bytes    */
+	SRTP_MASTER_SALT_SIZE = 14,  /**< Master salt size in bytes   */
+	SRTP_TRAILER_MAX      = 14,  /**< Maximum bytes added to SRTCP */
+};
+
+struct srtp;
+
+int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
+	       const uint8_t *key, size_t key_bytes);
+int srtp_encrypt(struct srtp *srtp, struct mbuf *mb);
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf **mbv, size_t n);
+int srtp_decrypt(struct srtp *srtp, struct mbuf *mb);
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf **mbv, int *errv,
+		       size_t n);
+int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb);
+int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb);
+const char *srtp_suite_name(enum srtp_suite suite);
@@ -174,6 +174,8 @@ int  stun_ctrans_recv(struct stun *stun, const struct stun_msg *msg,
 struct re_printf;
 int  stun_debug(struct re_printf *pf, const struct stun *stun);
 
+struct hmac_sha1_ctx;
+
 int  stun_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 		  void *sock, const struct sa *dst, size_t presz,
 		  uint16_t method, const uint8_t *key, size_t keylen, bool fp,
@@ -185,6 +187,20 @@ int  stun_ereply(int proto, void *sock, const struct sa *dst, size_t presz,
 		 const struct stun_msg *req, uint16_t scode,
 		 const char *reason, const uint8_t *key, size_t keylen,
 		 bool fp, uint32_t attrc, ...);
+int  stun_request_hmac(struct stun_ctrans **ctp, struct stun *stun, int proto,
+		       void *sock, const struct sa *dst, size_t presz,
+		       uint16_t method, const struct hmac_sha1_ctx *hmac,
+		       bool fp, stun_resp_h *resph, void *arg,
+		       uint32_t attrc, ...);
+int  stun_reply_hmac(int proto, void *sock, const struct sa *dst,
+		     size_t presz, const struct stun_msg *req,
+		     const struct hmac_sha1_ctx *hmac, bool fp,
+		     uint32_t attrc, ...);
+int  stun_ereply_hmac(int proto, void *sock, const struct sa *dst,
+		      size_t presz, const struct stun_msg *req,
+		      uint16_t scode, const char *reason,
+		      const struct hmac_sha1_ctx *hmac, bool fp,
+		      uint32_t attrc, ...);
 int  stun_indication(int proto, void *sock, const struct sa *dst, size_t presz,
 		     uint16_t method, const uint8_t *key, size_t keylen,
 		     bool fp, uint32_t attrc, ...);
@@ -205,6 +221,8 @@ struct stun_attr *stun_msg_attr_apply(const struct stun_msg *msg,
 				      stun_attr_h *h, void *arg);
 int  stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		     size_t keylen);
+int  stun_msg_chk_mi_hmac(const struct stun_msg *msg,
+			  const struct hmac_sha1_ctx *hmac);
 int  stun_msg_chk_fingerprint(const struct stun_msg *msg);
 void stun_msg_dump(const struct stun_msg *msg);
 
@@ -65,6 +65,7 @@ int  tcp_conn_alloc(struct tcp_conn **tcp, const struct sa *peer,
 int  tcp_conn_bind(struct tcp_conn *tc, const struct sa *local);
 int  tcp_conn_connect(struct tcp_conn *tc, const struct sa *peer);
 int  tcp_send(struct tcp_conn *tc, struct mbuf *mb);
+int  tcp_send_ref(struct tcp_conn *tc, struct mbuf *mb);
 int  tcp_set_send(struct tcp_conn *tc, tcp_send_h *sendh);
 void tcp_set_handlers(struct tcp_conn *tc, tcp_estab_h *eh, tcp_recv_h *rh,
 		      tcp_close_h *ch, void *arg);
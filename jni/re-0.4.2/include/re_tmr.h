@@ -12,18 +12,37 @@
  */
 typedef void (tmr_h)(void *arg);
 
+struct tmrl;
+
 /** Defines a timer */
 struct tmr {
 	struct le le;       /**< Linked list element */
 	tmr_h *th;          /**< Timeout handler     */
 	void *arg;          /**< Handler argument    */
 	uint64_t jfs;       /**< Jiffies for timeout */
+	struct tmrl *tmrl;  /**< Owning timer wheel  */
+};
+
+/** Timer wheel geometry */
+enum {
+	TMR_WHEEL_BITS   = 8,
+	TMR_WHEEL_SIZE   = 1 << TMR_WHEEL_BITS,
+	TMR_WHEEL_LEVELS = 4,
 };
 
+/** Defines a timer list, a hierarchical timing wheel with 1 ms ticks */
+struct tmrl {
+	struct list wheel[TMR_WHEEL_LEVELS][TMR_WHEEL_SIZE];  /**< Slots  */
+	uint32_t cnt[TMR_WHEEL_LEVELS];  /**< Number of timers per level  */
+	uint64_t jfs;                    /**< Next tick to be processed   */
+};
+
+#define TMRL_INIT {{{LIST_INIT}}, {0}, 0}
+
 
-void     tmr_poll(struct list *tmrl);
+void     tmr_poll(struct tmrl *tmrl);
 uint64_t tmr_jiffies(void);
-uint64_t tmr_next_timeout(struct list *tmrl);
+uint64_t tmr_next_timeout(struct tmrl *tmrl);
 void     tmr_debug(void);
 int      tmr_status(struct re_printf *pf, void *unused);
 
@@ -18,22 +18,45 @@ struct udp_sock;
  */
 typedef void (udp_recv_h)(const struct sa *src, struct mbuf *mb, void *arg);
 
+/** Batched receive statistics */
+struct udp_rxstat {
+	uint32_t n_copy;   /**< Datagrams copied to a buffer of their size */
+	uint32_t n_pass;   /**< Large datagrams passed in the rx buffer    */
+	uint32_t n_reuse;  /**< Receive buffers reused                     */
+	uint32_t n_alloc;  /**< Receive buffers allocated                  */
+};
+
+/** Batched send statistics */
+struct udp_txstat {
+	uint32_t n_dgram;   /**< Datagrams sent from the queue            */
+	uint32_t n_msg;     /**< Messages sent, one per GSO segment group */
+	uint32_t n_syscall; /**< Calls to sendmmsg()                      */
+};
+
 
 int  udp_listen(struct udp_sock **usp, const struct sa *local,
 		udp_recv_h *rh, void *arg);
 void udp_connect(struct udp_sock *us, bool conn);
 int  udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb);
+int  udp_send_queue(struct udp_sock *us, const struct sa *dst,
+		    struct mbuf *mb);
+int  udp_flush(struct udp_sock *us);
 int  udp_send_anon(const struct sa *dst, struct mbuf *mb);
 int  udp_local_get(const struct udp_sock *us, struct sa *local);
 int  udp_setsockopt(struct udp_sock *us, int level, int optname,
 		    const void *optval, uint32_t optlen);
 int  udp_sockbuf_set(struct udp_sock *us, int size);
 void udp_rxsz_set(struct udp_sock *us, size_t rxsz);
+int  udp_rxbatch_set(struct udp_sock *us, unsigned n);
+int  udp_rxbatch_stat(const struct udp_sock *us, struct udp_rxstat *st);
+int  udp_txbatch_set(struct udp_sock *us, unsigned n);
+int  udp_txbatch_stat(const struct udp_sock *us, struct udp_txstat *st);
 void udp_rxbuf_presz_set(struct udp_sock *us, size_t rx_presz);
 void udp_handler_set(struct udp_sock *us, udp_recv_h *rh, void *arg);
 int  udp_thread_attach(struct udp_sock *us);
 void udp_thread_detach(struct udp_sock *us);
 int  udp_sock_fd(const struct udp_sock *us, int af);
+uint64_t udp_rx_jiffies(const struct udp_sock *us);
 
 
 /* Helper API */
@@ -41,6 +64,11 @@ typedef bool (udp_helper_send_h)(int *err, struct sa *dst,
 				 struct mbuf *mb, void *arg);
 typedef bool (udp_helper_recv_h)(struct sa *src,
 				 struct mbuf *mb, void *arg);
+typedef int  (udp_helper_send_batch_h)(const struct sa **dstv,
+				       struct mbuf **mbv, size_t n,
+				       void *arg);
+typedef void (udp_helper_recv_batch_h)(struct sa *srcv, struct mbuf **mbv,
+				       bool *hdldv, size_t n, void *arg);
 
 struct udp_helper;
 
@@ -51,6 +79,9 @@ int udp_register_helper(struct udp_helper **uhp, struct udp_sock *us,
 			void *arg);
 int udp_send_helper(struct udp_sock *us, const struct sa *dst,
 		    struct mbuf *mb, struct udp_helper *uh);
+int udp_helper_batch_set(struct udp_helper *uh, size_t tailroom,
+			 udp_helper_send_batch_h *sbh,
+			 udp_helper_recv_batch_h *rbh);
 
 
 #ifdef __SYMBIAN32__
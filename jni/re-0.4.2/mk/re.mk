@@ -509,6 +509,16 @@ CFLAGS  += -DHAVE_SYS_TIME_H
 ifneq ($(HAVE_EPOLL),)
 CFLAGS  += -DHAVE_EPOLL
 endif
+ifeq ($(OS),linux)
+HAVE_RECVMMSG := 1
+HAVE_SENDMMSG := 1
+endif
+ifneq ($(HAVE_RECVMMSG),)
+CFLAGS  += -DHAVE_RECVMMSG
+endif
+ifneq ($(HAVE_SENDMMSG),)
+CFLAGS  += -DHAVE_SENDMMSG
+endif
 CFLAGS  += -DHAVE_UNAME
 CFLAGS  += -DHAVE_UNISTD_H
 ifneq ($(OS),cygwin)
@@ -16,6 +16,7 @@
 #include <re_tcp.h>
 #include <re_sys.h>
 #include <re_dns.h>
+#include "dns.h"
 
 
 #define DEBUG_MODULE "dnsc"
@@ -30,6 +31,9 @@ enum {
 	CONN_TIMEOUT = 10 * 1000,
 	IDLE_TIMEOUT = 30 * 1000,
 	SRVC_MAX = 32,
+	CACHE_SIZE = 256,
+	CACHE_HASH_SIZE = 32,
+	CACHE_TTL_MAX = 86400,
 };
 
 
@@ -56,6 +60,7 @@ struct dns_query {
 	const struct sa *srvv;
 	const uint32_t *srvc;
 	struct tcpconn *tc;
+	struct dnshdr hdr;     /* cached reply header */
 	struct dnsc *dnsc;     /* parent  */
 	struct dns_query **qp; /* app ref */
 	uint32_t ntx;
@@ -76,13 +81,46 @@ struct dnsquery {
 };
 
 
+/*
+ * Cached reply to a recursive query. While the reply is being fetched,
+ * the entry holds the network query and the application queries which
+ * are waiting for it, so identical queries are sent only once.
+ */
+struct dns_cache_ent {
+	struct le he;           /* ht_cache           */
+	struct le le;           /* cachel LRU or pendl  */
+	struct list waitl;      /* waiting queries    */
+	struct list rrlv[3];
+	struct dnshdr hdr;
+	struct dns_query *q;    /* network query      */
+	struct dnsc *dnsc;      /* parent             */
+	char *name;
+	uint64_t ts;            /* time of reply      */
+	uint64_t expires;       /* 0 if not valid     */
+	uint16_t type;
+	uint16_t dnsclass;
+};
+
+
 struct dnsc {
 	struct dnsc_conf conf;
 	struct hash *ht_query;
 	struct hash *ht_tcpconn;
+	struct hash *ht_cache;
+	struct list cachel;     /* valid, least recently used first */
+	struct list pendl;      /* being fetched                    */
+	uint32_t cachec;        /* entries on cachel and pendl      */
 	struct udp_sock *us;
 	struct sa srvv[SRVC_MAX];
 	uint32_t srvc;
+	struct {
+		uint32_t hits;
+		uint32_t neg_hits;
+		uint32_t misses;
+		uint32_t coalesced;
+		uint32_t evicted;
+		uint32_t uncached;
+	} stat;
 };
 
 
@@ -91,7 +129,8 @@ static const struct dnsc_conf default_conf = {
 	TCP_HASH_SIZE,
 	CONN_TIMEOUT,
 	IDLE_TIMEOUT,
-	false
+	false,
+	CACHE_SIZE
 };
 
 
@@ -732,13 +771,444 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 }
 
 
+static void cache_abort_waiting(struct list *waitl, int err)
+{
+	struct le *le;
+
+	while ((le = list_head(waitl))) {
+
+		struct dns_query *q = le->data;
+
+		list_unlink(le);
+
+		query_handler(q, err, NULL, NULL, NULL, NULL);
+		mem_deref(q);
+	}
+}
+
+
+/* Remove an entry from the cache, it is freed when the last ref goes */
+static void cache_ent_unlink(struct dns_cache_ent *ent)
+{
+	if (!ent->he.list)
+		return;
+
+	hash_unlink(&ent->he);
+	list_unlink(&ent->le);
+	--ent->dnsc->cachec;
+}
+
+
+static void cache_ent_destructor(void *data)
+{
+	struct dns_cache_ent *ent = data;
+	uint32_t i;
+
+	cache_ent_unlink(ent);
+
+	cache_abort_waiting(&ent->waitl, ECONNABORTED);
+
+	mem_deref(ent->q);
+	mem_deref(ent->name);
+
+	for (i=0; i<ARRAY_SIZE(ent->rrlv); i++)
+		(void)list_apply(&ent->rrlv[i], true, rr_unlink_handler, NULL);
+}
+
+
+struct cache_key {
+	const char *name;
+	uint16_t type;
+	uint16_t dnsclass;
+};
+
+
+static bool cache_cmp_handler(struct le *le, void *arg)
+{
+	const struct dns_cache_ent *ent = le->data;
+	const struct cache_key *key = arg;
+
+	return ent->type == key->type && ent->dnsclass == key->dnsclass &&
+		0 == str_casecmp(ent->name, key->name);
+}
+
+
+static void cache_ent_clear(struct dns_cache_ent *ent)
+{
+	uint32_t i;
+
+	for (i=0; i<ARRAY_SIZE(ent->rrlv); i++)
+		(void)list_apply(&ent->rrlv[i], true, rr_unlink_handler, NULL);
+
+	ent->expires = 0;
+}
+
+
+/* Copy the cached records, with the TTL counting down since the reply */
+static int cache_copy(struct dns_query *q, const struct dns_cache_ent *ent,
+		      uint64_t now)
+{
+	const int64_t age = (int64_t)((now - ent->ts) / 1000);
+	uint32_t i;
+
+	q->hdr = ent->hdr;
+
+	for (i=0; i<ARRAY_SIZE(ent->rrlv); i++) {
+
+		struct le *le;
+
+		for (le = ent->rrlv[i].head; le; le = le->next) {
+
+			struct dnsrr *rr = dns_rr_dup(le->data);
+			if (!rr)
+				return ENOMEM;
+
+			rr->ttl = max(rr->ttl - age, (int64_t)0);
+
+			list_append(&q->rrlv[i], &rr->le_priv, rr);
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * TTL of a reply in [s], from the lowest TTL of the records. Negative
+ * replies are cached according to the SOA record in the authority
+ * section (RFC 2308). Zero means the reply must not be cached.
+ */
+static int64_t reply_ttl(const struct dnshdr *hdr, struct list *ansl,
+			 struct list *authl, struct list *addl)
+{
+	struct list *lstv[3];
+	int64_t ttl = CACHE_TTL_MAX;
+	struct le *le;
+	uint32_t i;
+
+	if (hdr->tc)
+		return 0;
+
+	if (hdr->rcode == DNS_RCODE_NAME_ERR ||
+	    (hdr->rcode == DNS_RCODE_OK && !list_head(ansl))) {
+
+		for (le = list_head(authl); le; le = le->next) {
+
+			const struct dnsrr *rr = le->data;
+
+			if (rr->type != DNS_TYPE_SOA)
+				continue;
+
+			return min(min(rr->ttl, (int64_t)rr->rdata.soa.ttlmin),
+				   ttl);
+		}
+
+		return 0;
+	}
+
+	if (hdr->rcode != DNS_RCODE_OK)
+		return 0;
+
+	lstv[0] = ansl;
+	lstv[1] = authl;
+	lstv[2] = addl;
+
+	for (i=0; i<ARRAY_SIZE(lstv); i++) {
+
+		for (le = list_head(lstv[i]); le; le = le->next) {
+
+			const struct dnsrr *rr = le->data;
+
+			ttl = min(ttl, rr->ttl);
+		}
+	}
+
+	return max(ttl, (int64_t)0);
+}
+
+
+static void cache_reply_handler(int err, const struct dnshdr *hdr,
+				struct list *ansl, struct list *authl,
+				struct list *addl, void *arg)
+{
+	struct dns_cache_ent *ent = arg;
+	struct list *lstv[3];
+	struct list waitl;
+	struct le *le;
+	uint64_t now;
+	int64_t ttl = 0;
+	uint32_t i;
+
+	now = tmr_jiffies();
+
+	cache_ent_clear(ent);
+
+	if (!err) {
+
+		ttl = reply_ttl(hdr, ansl, authl, addl);
+
+		lstv[0] = ansl;
+		lstv[1] = authl;
+		lstv[2] = addl;
+
+		ent->hdr = *hdr;
+		ent->ts  = now;
+
+		for (i=0; i<ARRAY_SIZE(lstv); i++) {
+
+			for (le = list_head(lstv[i]); le; le = le->next) {
+
+				struct dnsrr *rr = dns_rr_dup(le->data);
+				if (!rr) {
+					err = ENOMEM;
+					break;
+				}
+
+				list_append(&ent->rrlv[i], &rr->le_priv, rr);
+			}
+		}
+	}
+
+	/*
+	 * The handlers of the waiting queries may start new queries or
+	 * cancel other queries, so the entry is settled before they run
+	 */
+	if (!err && ttl > 0) {
+		ent->expires = now + (uint64_t)ttl * 1000;
+		mem_ref(ent);
+		list_unlink(&ent->le);
+		list_append(&ent->dnsc->cachel, &ent->le, ent);
+	}
+	else {
+		cache_ent_unlink(ent);
+	}
+
+	waitl = ent->waitl;
+	list_init(&ent->waitl);
+
+	for (le = waitl.head; le; le = le->next)
+		le->list = &waitl;
+
+	if (err) {
+		cache_abort_waiting(&waitl, err);
+	}
+	else {
+		while ((le = list_head(&waitl))) {
+
+			struct dns_query *q = le->data;
+
+			list_unlink(le);
+
+			if (cache_copy(q, ent, now)) {
+				query_handler(q, ENOMEM, NULL,
+					      NULL, NULL, NULL);
+			}
+			else {
+				query_handler(q, 0, &q->hdr, &q->rrlv[0],
+					      &q->rrlv[1], &q->rrlv[2]);
+			}
+
+			mem_deref(q);
+		}
+	}
+
+	mem_deref(ent);
+}
+
+
+static void cache_hit_handler(void *arg)
+{
+	struct dns_query *q = arg;
+
+	query_handler(q, 0, &q->hdr, &q->rrlv[0], &q->rrlv[1], &q->rrlv[2]);
+	mem_deref(q);
+}
+
+
+/*
+ * Make room for one entry, removing the least recently used valid
+ * entries. Entries being fetched count against the limit but cannot be
+ * removed, false is returned if they fill the cache.
+ */
+static bool cache_evict(struct dnsc *dnsc)
+{
+	struct dns_cache_ent *ent;
+
+	while (dnsc->cachec >= dnsc->conf.cache_size) {
+
+		ent = list_ledata(list_head(&dnsc->cachel));
+		if (!ent)
+			return false;
+
+		cache_ent_unlink(ent);
+		mem_deref(ent);
+		++dnsc->stat.evicted;
+	}
+
+	return true;
+}
+
+
+static int cache_query(struct dns_query **qp, struct dnsc *dnsc,
+		       const char *name, uint16_t type, uint16_t dnsclass,
+		       dns_query_h *qh, void *arg)
+{
+	struct dns_cache_ent *ent;
+	struct dns_query *q;
+	struct cache_key key;
+	uint64_t now;
+	uint32_t i;
+	int err;
+
+	q = mem_zalloc(sizeof(*q), query_destructor);
+	if (!q)
+		return ENOMEM;
+
+	tmr_init(&q->tmr);
+	mbuf_init(&q->mb);
+
+	for (i=0; i<ARRAY_SIZE(q->rrlv); i++)
+		list_init(&q->rrlv[i]);
+
+	err = str_dup(&q->name, name);
+	if (err)
+		goto out;
+
+	q->srvv     = dnsc->srvv;
+	q->srvc     = &dnsc->srvc;
+	q->type     = type;
+	q->opcode   = DNS_OPCODE_QUERY;
+	q->dnsclass = dnsclass;
+	q->dnsc     = dnsc;
+	q->qh       = qh;
+	q->arg      = arg;
+
+	key.name     = name;
+	key.type     = type;
+	key.dnsclass = dnsclass;
+
+	now = tmr_jiffies();
+
+	ent = list_ledata(hash_lookup(dnsc->ht_cache, hash_joaat_str_ci(name),
+				      cache_cmp_handler, &key));
+
+	if (ent && ent->expires > now) {
+
+		err = cache_copy(q, ent, now);
+		if (err)
+			goto out;
+
+		if (ent->hdr.rcode == DNS_RCODE_OK && ent->hdr.nans)
+			++dnsc->stat.hits;
+		else
+			++dnsc->stat.neg_hits;
+
+		/* most recently used last */
+		list_unlink(&ent->le);
+		list_append(&dnsc->cachel, &ent->le, ent);
+
+		/* the handler is never called from within the query */
+		tmr_start(&q->tmr, 0, cache_hit_handler, q);
+		goto out;
+	}
+
+	if (ent && ent->q) {
+		++dnsc->stat.coalesced;
+		list_append(&ent->waitl, &q->le, q);
+		goto out;
+	}
+
+	++dnsc->stat.misses;
+
+	if (!ent) {
+
+		/* the cache is full of queries in progress */
+		if (!cache_evict(dnsc)) {
+			++dnsc->stat.uncached;
+			mem_deref(q);
+			return query(qp, dnsc, DNS_OPCODE_QUERY, name, type,
+				     dnsclass, NULL, IPPROTO_UDP, dnsc->srvv,
+				     &dnsc->srvc, false, true, qh, arg);
+		}
+
+		ent = mem_zalloc(sizeof(*ent), cache_ent_destructor);
+		if (!ent) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		ent->dnsc     = dnsc;
+		ent->type     = type;
+		ent->dnsclass = dnsclass;
+
+		err = str_dup(&ent->name, name);
+		if (err) {
+			mem_deref(ent);
+			goto out;
+		}
+
+		hash_append(dnsc->ht_cache, hash_joaat_str_ci(name),
+			    &ent->he, ent);
+		++dnsc->cachec;
+	}
+	else {
+		list_unlink(&ent->le);
+		cache_ent_clear(ent);
+	}
+
+	list_append(&dnsc->pendl, &ent->le, ent);
+
+	err = query(&ent->q, dnsc, DNS_OPCODE_QUERY, name, type, dnsclass,
+		    NULL, IPPROTO_UDP, dnsc->srvv, &dnsc->srvc, false, true,
+		    cache_reply_handler, ent);
+	if (err) {
+		mem_deref(ent);
+		goto out;
+	}
+
+	list_append(&ent->waitl, &q->le, q);
+
+ out:
+	if (err) {
+		mem_deref(q);
+	}
+	else if (qp) {
+		q->qp = qp;
+		*qp = q;
+	}
+
+	return err;
+}
+
+
+/**
+ * Query a DNS name, using the configured DNS servers
+ *
+ * Recursive queries are answered from the cache while the TTL of the
+ * reply lasts, and identical queries share one network query.
+ *
+ * @param qp       Pointer to allocated DNS query (optional)
+ * @param dnsc     DNS Client
+ * @param name     Domain name
+ * @param type     Query type
+ * @param dnsclass Query class
+ * @param rd       Recursion desired
+ * @param qh       Query handler
+ * @param arg      Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
 int dnsc_query(struct dns_query **qp, struct dnsc *dnsc, const char *name,
 	       uint16_t type, uint16_t dnsclass,
 	       bool rd, dns_query_h *qh, void *arg)
 {
-	if (!dnsc)
+	if (!dnsc || !name)
 		return EINVAL;
 
+	if (dnsc->ht_cache && rd && dnsc->srvc &&
+	    type != DNS_QTYPE_AXFR && type != DNS_QTYPE_ANY)
+		return cache_query(qp, dnsc, name, type, dnsclass, qh, arg);
+
 	return query(qp, dnsc, DNS_OPCODE_QUERY, name, type, dnsclass, NULL,
 		     IPPROTO_UDP, dnsc->srvv, &dnsc->srvc, false, rd, qh, arg);
 }
@@ -770,7 +1240,10 @@ static void dnsc_destructor(void *data)
 
 	(void)hash_apply(dnsc->ht_query, query_close_handler, NULL);
 	hash_flush(dnsc->ht_tcpconn);
+	list_flush(&dnsc->pendl);
+	list_flush(&dnsc->cachel);
 
+	mem_deref(dnsc->ht_cache);
 	mem_deref(dnsc->ht_tcpconn);
 	mem_deref(dnsc->ht_query);
 	mem_deref(dnsc->us);
@@ -819,6 +1292,12 @@ int dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 	if (err)
 		goto out;
 
+	if (dnsc->conf.cache_size) {
+		err = hash_alloc(&dnsc->ht_cache, CACHE_HASH_SIZE);
+		if (err)
+			goto out;
+	}
+
  out:
 	if (err)
 		mem_deref(dnsc);
@@ -843,5 +1322,64 @@ int dnsc_srv_set(struct dnsc *dnsc, const struct sa *srvv, uint32_t srvc)
 			dnsc->srvv[i] = srvv[i];
 	}
 
+	/* replies from the old servers are not used any more */
+	dnsc_cache_flush(dnsc);
+
 	return 0;
 }
+
+
+/**
+ * Remove all cached replies from the DNS Client. Queries in progress
+ * are not affected.
+ *
+ * @param dnsc DNS Client
+ */
+void dnsc_cache_flush(struct dnsc *dnsc)
+{
+	struct le *le;
+
+	if (!dnsc)
+		return;
+
+	while ((le = list_head(&dnsc->cachel))) {
+		struct dns_cache_ent *ent = le->data;
+
+		cache_ent_unlink(ent);
+		mem_deref(ent);
+	}
+}
+
+
+/**
+ * Print the DNS Client status and cache statistics
+ *
+ * @param pf   Print function
+ * @param dnsc DNS Client
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dnsc_debug(struct re_printf *pf, const struct dnsc *dnsc)
+{
+	uint32_t i;
+	int err;
+
+	if (!dnsc)
+		return 0;
+
+	err = re_hprintf(pf, "--- DNS Client ---\n");
+
+	for (i=0; i<dnsc->srvc; i++)
+		err |= re_hprintf(pf, " server %u: %J\n", i, &dnsc->srvv[i]);
+
+	err |= re_hprintf(pf, " cache: %u/%u entries (%u pending)\n",
+			  dnsc->cachec, dnsc->conf.cache_size,
+			  list_count(&dnsc->pendl));
+	err |= re_hprintf(pf, " hits=%u neg_hits=%u misses=%u coalesced=%u"
+			  " evicted=%u uncached=%u\n",
+			  dnsc->stat.hits, dnsc->stat.neg_hits,
+			  dnsc->stat.misses, dnsc->stat.coalesced,
+			  dnsc->stat.evicted, dnsc->stat.uncached);
+
+	return err;
+}
@@ -5,6 +5,8 @@
  */
 
 
+struct dnsrr *dns_rr_dup(const struct dnsrr *rr);
+
 #ifdef HAVE_LIBRESOLV
 int get_resolv_dns(char *domain, size_t dsize, struct sa *nsv, uint32_t *n);
 #endif
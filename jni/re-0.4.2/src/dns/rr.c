@@ -12,6 +12,7 @@
 #include <re_net.h>
 #include <re_sa.h>
 #include <re_dns.h>
+#include "dns.h"
 
 
 static void rr_destructor(void *data)
@@ -63,6 +64,67 @@ struct dnsrr *dns_rr_alloc(void)
 }
 
 
+/*
+ * Copy a resource record. The strings are not copied, but shared with
+ * the original record.
+ */
+struct dnsrr *dns_rr_dup(const struct dnsrr *rr)
+{
+	struct dnsrr *cp;
+
+	if (!rr)
+		return NULL;
+
+	cp = dns_rr_alloc();
+	if (!cp)
+		return NULL;
+
+	cp->name     = mem_ref(rr->name);
+	cp->type     = rr->type;
+	cp->dnsclass = rr->dnsclass;
+	cp->ttl      = rr->ttl;
+	cp->rdlen    = rr->rdlen;
+	cp->rdata    = rr->rdata;
+
+	switch (rr->type) {
+
+	case DNS_TYPE_NS:
+		mem_ref(cp->rdata.ns.nsdname);
+		break;
+
+	case DNS_TYPE_CNAME:
+		mem_ref(cp->rdata.cname.cname);
+		break;
+
+	case DNS_TYPE_SOA:
+		mem_ref(cp->rdata.soa.mname);
+		mem_ref(cp->rdata.soa.rname);
+		break;
+
+	case DNS_TYPE_PTR:
+		mem_ref(cp->rdata.ptr.ptrdname);
+		break;
+
+	case DNS_TYPE_MX:
+		mem_ref(cp->rdata.mx.exchange);
+		break;
+
+	case DNS_TYPE_SRV:
+		mem_ref(cp->rdata.srv.target);
+		break;
+
+	case DNS_TYPE_NAPTR:
+		mem_ref(cp->rdata.naptr.flags);
+		mem_ref(cp->rdata.naptr.services);
+		mem_ref(cp->rdata.naptr.regexp);
+		mem_ref(cp->rdata.naptr.replace);
+		break;
+	}
+
+	return cp;
+}
+
+
 int dns_rr_encode(struct mbuf *mb, const struct dnsrr *rr, int64_t ttl_offs,
 		  struct hash *ht_dname, size_t start)
 {
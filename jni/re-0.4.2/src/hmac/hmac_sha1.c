@@ -5,12 +5,12 @@
  */
 #include <string.h>
 #include <re_types.h>
+#include <re_mem.h>
 #ifdef USE_OPENSSL
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <openssl/hmac.h>
-#else
-#include <re_sha.h>
 #endif
+#include <re_sha.h>
 #include <re_hmac.h>
 
 
@@ -20,77 +20,294 @@
 #endif
 
 
-/**
- * Function to compute the digest
- *
- * @param k   Secret key
- * @param lk  Length of the key in bytes
- * @param d   Data
- * @param ld  Length of data in bytes
- * @param out Digest output
- * @param t   Size of digest output
+#if defined (USE_OPENSSL) && OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new  EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+
+/** HMAC-SHA1 context */
+struct hmac_sha1_ctx {
+#ifdef USE_OPENSSL
+	EVP_MD_CTX *ictx;  /**< SHA-1 state after the inner padded key */
+	EVP_MD_CTX *octx;  /**< SHA-1 state after the outer padded key */
+#else
+	SHA_CTX ictx;      /**< SHA-1 state after the inner padded key */
+	SHA_CTX octx;      /**< SHA-1 state after the outer padded key */
+#endif
+};
+
+
+/*
+ * With OpenSSL the states are EVP digest contexts, since the SHA1_*
+ * functions are deprecated in OpenSSL 3. A digest starts from a copy
+ * of them.
  */
-void hmac_sha1(const uint8_t *k,  /* secret key */
-	       size_t   lk,       /* length of the key in bytes */
-	       const uint8_t *d,  /* data */
-	       size_t   ld,       /* length of data in bytes */
-	       uint8_t *out,      /* output buffer, at least "t" bytes */
-	       size_t   t)
-{
 #ifdef USE_OPENSSL
-	(void)HMAC(EVP_sha1(), k, (int)lk, d, ld, out, NULL);
-	(void)t;
+
+static int key_hash(uint8_t *md, const uint8_t *k, size_t lk)
+{
+	return EVP_Digest(k, lk, md, NULL, EVP_sha1(), NULL) ? 0 : EPROTO;
+}
+
+
+static int state_alloc(struct hmac_sha1_ctx *ctx)
+{
+	ctx->ictx = EVP_MD_CTX_new();
+	ctx->octx = EVP_MD_CTX_new();
+
+	return (ctx->ictx && ctx->octx) ? 0 : ENOMEM;
+}
+
+
+static int pads_hash(struct hmac_sha1_ctx *ctx, const uint8_t *ipad,
+		     const uint8_t *opad)
+{
+	if (!EVP_DigestInit_ex(ctx->ictx, EVP_sha1(), NULL) ||
+	    !EVP_DigestUpdate(ctx->ictx, ipad, SHA_BLOCKSIZE) ||
+	    !EVP_DigestInit_ex(ctx->octx, EVP_sha1(), NULL) ||
+	    !EVP_DigestUpdate(ctx->octx, opad, SHA_BLOCKSIZE))
+		return EPROTO;
+
+	return 0;
+}
+
+
+static int state_hash(uint8_t *md, EVP_MD_CTX *tmp, const EVP_MD_CTX *ctx,
+		      const uint8_t *d, size_t ld)
+{
+	if (!EVP_MD_CTX_copy_ex(tmp, ctx) ||
+	    !EVP_DigestUpdate(tmp, d, ld) ||
+	    !EVP_DigestFinal_ex(tmp, md, NULL))
+		return EPROTO;
+
+	return 0;
+}
+
 #else
-	SHA_CTX ictx, octx;
-	uint8_t isha[SHA_DIGEST_LENGTH], osha[SHA_DIGEST_LENGTH];
+
+static int key_hash(uint8_t *md, const uint8_t *k, size_t lk)
+{
+	SHA_CTX tctx;
+
+	SHA1_Init(&tctx);
+	SHA1_Update(&tctx, k, lk);
+	SHA1_Final(md, &tctx);
+
+	return 0;
+}
+
+
+static int state_alloc(struct hmac_sha1_ctx *ctx)
+{
+	(void)ctx;
+
+	return 0;
+}
+
+
+static int pads_hash(struct hmac_sha1_ctx *ctx, const uint8_t *ipad,
+		     const uint8_t *opad)
+{
+	SHA1_Init(&ctx->ictx);
+	SHA1_Update(&ctx->ictx, ipad, SHA_BLOCKSIZE);
+
+	SHA1_Init(&ctx->octx);
+	SHA1_Update(&ctx->octx, opad, SHA_BLOCKSIZE);
+
+	return 0;
+}
+
+#endif
+
+
+/*
+ * The padded key is exactly one SHA-1 block, so the state after hashing
+ * it depends on the key alone. Keeping the two states saves two of the
+ * four block transforms of a short message like a STUN request.
+ */
+static int pads_init(struct hmac_sha1_ctx *ctx, const uint8_t *k,
+		     size_t lk)
+{
 	uint8_t key[SHA_DIGEST_LENGTH];
-	uint8_t buf[SHA_BLOCKSIZE];
+	uint8_t ipad[SHA_BLOCKSIZE];
+	uint8_t opad[SHA_BLOCKSIZE];
 	size_t  i;
+	int err;
 
 	if (lk > SHA_BLOCKSIZE) {
-		SHA_CTX tctx;
 
-		SHA1_Init(&tctx);
-		SHA1_Update(&tctx, k, lk);
-		SHA1_Final(key, &tctx);
+		err = key_hash(key, k, lk);
+		if (err)
+			goto out;
 
 		k = key;
 		lk = SHA_DIGEST_LENGTH;
 	}
 
-	/**** Inner Digest ****/
-
-	SHA1_Init(&ictx);
-
 	/* Pad the key for inner digest */
 	for (i = 0 ; i < lk ; ++i)
-		buf[i] = k[i] ^ 0x36;
+		ipad[i] = k[i] ^ 0x36;
 	for (i = lk ; i < SHA_BLOCKSIZE ; ++i)
-		buf[i] = 0x36;
+		ipad[i] = 0x36;
 
-	SHA1_Update(&ictx, buf, SHA_BLOCKSIZE);
-	SHA1_Update(&ictx, d, ld);
+	/* Pad the key for outter digest */
+	for (i = 0 ; i < lk ; ++i)
+		opad[i] = k[i] ^ 0x5c;
+	for (i = lk ; i < SHA_BLOCKSIZE ; ++i)
+		opad[i] = 0x5c;
 
-	SHA1_Final(isha, &ictx);
+	err = pads_hash(ctx, ipad, opad);
 
-	/**** Outer Digest ****/
+	memset(ipad, 0, sizeof(ipad));
+	memset(opad, 0, sizeof(opad));
 
-	SHA1_Init(&octx);
+ out:
+	memset(key, 0, sizeof(key));
 
-	/* Pad the key for outter digest */
+	return err;
+}
 
-	for (i = 0 ; i < lk ; ++i)
-		buf[i] = k[i] ^ 0x5c;
-	for (i = lk ; i < SHA_BLOCKSIZE ; ++i)
-		buf[i] = 0x5c;
 
-	SHA1_Update(&octx, buf, SHA_BLOCKSIZE);
-	SHA1_Update(&octx, isha, SHA_DIGEST_LENGTH);
+static void destructor(void *arg)
+{
+	struct hmac_sha1_ctx *ctx = arg;
+
+#ifdef USE_OPENSSL
+	if (ctx->ictx)
+		EVP_MD_CTX_free(ctx->ictx);
+	if (ctx->octx)
+		EVP_MD_CTX_free(ctx->octx);
+#endif
 
-	SHA1_Final(osha, &octx);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+
+/**
+ * Allocate an HMAC-SHA1 context for a secret key
+ *
+ * @param ctxp    Pointer to allocated HMAC-SHA1 context
+ * @param key     Secret key
+ * @param key_len Length of the key in bytes
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hmac_sha1_ctx_alloc(struct hmac_sha1_ctx **ctxp, const uint8_t *key,
+			size_t key_len)
+{
+	struct hmac_sha1_ctx *ctx;
+	int err;
+
+	if (!ctxp || (!key && key_len))
+		return EINVAL;
+
+	ctx = mem_zalloc(sizeof(*ctx), destructor);
+	if (!ctx)
+		return ENOMEM;
+
+	err = state_alloc(ctx);
+	if (err)
+		goto out;
+
+	err = pads_init(ctx, key, key_len);
+
+ out:
+	if (err)
+		mem_deref(ctx);
+	else
+		*ctxp = ctx;
+
+	return err;
+}
+
+
+/**
+ * Compute the digest with a precomputed key. The context is not
+ * changed, so it may be used from several threads.
+ *
+ * @param ctx HMAC-SHA1 context
+ * @param d   Data
+ * @param ld  Length of data in bytes
+ * @param out Digest output
+ * @param t   Size of digest output
+ */
+void hmac_sha1_ctx_digest(const struct hmac_sha1_ctx *ctx, const uint8_t *d,
+			  size_t ld, uint8_t *out, size_t t)
+{
+	uint8_t md[SHA_DIGEST_LENGTH];
+#ifdef USE_OPENSSL
+	EVP_MD_CTX *tmp;
+	int err;
+#else
+	SHA_CTX sctx;
+#endif
+
+	if (!ctx || !out)
+		return;
 
-	/* truncate and print the results */
 	t = t > SHA_DIGEST_LENGTH ? SHA_DIGEST_LENGTH : t;
-	memcpy(out, osha, t);
+
+#ifdef USE_OPENSSL
+	tmp = EVP_MD_CTX_new();
+	if (!tmp) {
+		memset(out, 0, t);
+		return;
+	}
+
+	err  = state_hash(md, tmp, ctx->ictx, d, ld);
+	err |= state_hash(md, tmp, ctx->octx, md, SHA_DIGEST_LENGTH);
+
+	EVP_MD_CTX_free(tmp);
+
+	/* a digest which does not match */
+	if (err)
+		memset(md, 0, sizeof(md));
+#else
+	/**** Inner Digest ****/
+
+	sctx = ctx->ictx;
+	SHA1_Update(&sctx, d, ld);
+	SHA1_Final(md, &sctx);
+
+	/**** Outer Digest ****/
+
+	sctx = ctx->octx;
+	SHA1_Update(&sctx, md, SHA_DIGEST_LENGTH);
+	SHA1_Final(md, &sctx);
+#endif
+
+	/* truncate and print the results */
+	memcpy(out, md, t);
+}
+
+
+/**
+ * Function to compute the digest
+ *
+ * @param k   Secret key
+ * @param lk  Length of the key in bytes
+ * @param d   Data
+ * @param ld  Length of data in bytes
+ * @param out Digest output
+ * @param t   Size of digest output
+ */
+void hmac_sha1(const uint8_t *k,  /* secret key */
+	       size_t   lk,       /* length of the key in bytes */
+	       const uint8_t *d,  /* data */
+	       size_t   ld,       /* length of data in bytes */
+	       uint8_t *out,      /* output buffer, at least "t" bytes */
+	       size_t   t)
+{
+#ifdef USE_OPENSSL
+	(void)HMAC(EVP_sha1(), k, (int)lk, d, ld, out, NULL);
+	(void)t;
+#else
+	struct hmac_sha1_ctx ctx;
+
+	(void)pads_init(&ctx, k, lk);
+	hmac_sha1_ctx_digest(&ctx, d, ld, out, t);
+
+	memset(&ctx, 0, sizeof(ctx));
 #endif
 }
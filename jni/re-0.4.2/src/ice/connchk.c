@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
@@ -10,6 +11,7 @@
 #include <re_list.h>
 #include <re_tmr.h>
 #include <re_sa.h>
+#include <re_hmac.h>
 #include <re_stun.h>
 #include <re_turn.h>
 #include <re_ice.h>
@@ -250,6 +252,12 @@ int icem_conncheck_send(struct candpair *cp, bool use_cand, bool trigged)
 	if (!icem->rpwd) {
 		DEBUG_WARNING("no remote password!\n");
 	}
+	else if (!icem->rhmac) {
+		err = hmac_sha1_ctx_alloc(&icem->rhmac, (uint8_t *)icem->rpwd,
+					  strlen(icem->rpwd));
+		if (err)
+			return err;
+	}
 
 	cp->usec_sent = ice_get_usec();
 
@@ -275,16 +283,16 @@ int icem_conncheck_send(struct candpair *cp, bool use_cand, bool trigged)
 	case CAND_TYPE_SRFLX:
 	case CAND_TYPE_PRFLX:
 		cp->ct_conn = mem_deref(cp->ct_conn);
-		err = stun_request(&cp->ct_conn, icem->stun, icem->proto,
-				   cp->comp->sock, &cp->rcand->addr, presz,
-				   STUN_METHOD_BINDING,
-				   (uint8_t *)icem->rpwd, str_len(icem->rpwd),
-				   true, stunc_resp_handler, cp,
-				   4,
-				   STUN_ATTR_USERNAME, username_buf,
-				   STUN_ATTR_PRIORITY, &prio_prflx,
-				   ctrl_attr, &ice->tiebrk,
-				   STUN_ATTR_USE_CAND, use_cand);
+		err = stun_request_hmac(&cp->ct_conn, icem->stun, icem->proto,
+					cp->comp->sock, &cp->rcand->addr,
+					presz, STUN_METHOD_BINDING,
+					icem->rhmac, true,
+					stunc_resp_handler, cp,
+					4,
+					STUN_ATTR_USERNAME, username_buf,
+					STUN_ATTR_PRIORITY, &prio_prflx,
+					ctrl_attr, &ice->tiebrk,
+					STUN_ATTR_USE_CAND, use_cand);
 		break;
 
 	default:
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
@@ -11,6 +12,7 @@
 #include <re_tmr.h>
 #include <re_sa.h>
 #include <re_sys.h>
+#include <re_hmac.h>
 #include <re_stun.h>
 #include <re_turn.h>
 #include <re_ice.h>
@@ -50,6 +52,7 @@ static void ice_destructor(void *arg)
 	struct ice *ice = arg;
 
 	list_flush(&ice->ml);
+	mem_deref(ice->lhmac);
 }
 
 
@@ -65,6 +68,7 @@ static void ice_destructor(void *arg)
 int ice_alloc(struct ice **icep, enum ice_mode mode, bool offerer)
 {
 	struct ice *ice;
+	int err;
 
 	if (!icep)
 		return EINVAL;
@@ -82,6 +86,14 @@ int ice_alloc(struct ice **icep, enum ice_mode mode, bool offerer)
 	rand_str(ice->lufrag, sizeof(ice->lufrag));
 	rand_str(ice->lpwd, sizeof(ice->lpwd));
 
+	/* every check and response is signed with the local password */
+	err = hmac_sha1_ctx_alloc(&ice->lhmac, (uint8_t *)ice->lpwd,
+				  strlen(ice->lpwd));
+	if (err) {
+		mem_deref(ice);
+		return err;
+	}
+
 	ice_determine_role(ice, offerer);
 
 	*icep = ice;
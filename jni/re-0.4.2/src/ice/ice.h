@@ -61,6 +61,7 @@ struct ice {
 	enum role lrole;              /**< Local role                       */
 	char lufrag[5];               /**< Local Username fragment          */
 	char lpwd[23];                /**< Local Password                   */
+	struct hmac_sha1_ctx *lhmac;  /**< HMAC-SHA1 of the Local Password  */
 	struct list ml;               /**< Media list (struct icem)         */
 	uint64_t tiebrk;              /**< Tie-break value for roleconflict */
 	struct ice_conf conf;         /**< ICE Configuration                */
@@ -102,6 +103,7 @@ struct icem {
 	struct list compl;           /**< ICE media components               */
 	char *rufrag;                /**< Remote Username fragment           */
 	char *rpwd;                  /**< Remote Password                    */
+	struct hmac_sha1_ctx *rhmac; /**< HMAC-SHA1 of the Remote Password   */
 	ice_gather_h *gh;            /**< Gather handler                     */
 	ice_connchk_h *chkh;         /**< Connectivity check handler         */
 	void *arg;                   /**< Handler argument                   */
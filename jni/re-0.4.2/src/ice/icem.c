@@ -35,6 +35,7 @@ static void icem_destructor(void *data)
 	mem_deref(icem->stun);
 	mem_deref(icem->rufrag);
 	mem_deref(icem->rpwd);
+	mem_deref(icem->rhmac);
 }
 
 
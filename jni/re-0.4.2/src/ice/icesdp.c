@@ -173,6 +173,7 @@ static int pwd_decode(struct ice *ice, const char *value)
 
 		mem_deref(icem->rpwd);
 		icem->rpwd = mem_ref(pwd);
+		icem->rhmac = mem_deref(icem->rhmac);
 	}
 
 	mem_deref(pwd);
@@ -192,6 +193,7 @@ static int media_ufrag_decode(struct icem *icem, const char *value)
 static int media_pwd_decode(struct icem *icem, const char *value)
 {
 	icem->rpwd = mem_deref(icem->rpwd);
+	icem->rhmac = mem_deref(icem->rhmac);
 
 	return str_dup(&icem->rpwd, value);
 }
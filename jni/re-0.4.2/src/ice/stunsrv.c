@@ -244,7 +244,7 @@ int icem_stund_recv(struct icem_comp *comp, const struct sa *src,
 	if (err)
 		return err;
 
-	err = stun_msg_chk_mi(req, (uint8_t *)ice->lpwd, strlen(ice->lpwd));
+	err = stun_msg_chk_mi_hmac(req, ice->lhmac);
 	if (err) {
 		if (err == EBADMSG)
 			goto unauth;
@@ -299,26 +299,23 @@ int icem_stund_recv(struct icem_comp *comp, const struct sa *src,
 
 	handle_stun(ice, icem, comp, src, prio_prflx, use_cand, presz > 0);
 
-	return stun_reply(icem->proto, comp->sock, src, presz, req,
-			  (uint8_t *)ice->lpwd, strlen(ice->lpwd), true, 2,
-			  STUN_ATTR_XOR_MAPPED_ADDR, src,
-			  STUN_ATTR_SOFTWARE, sw);
+	return stun_reply_hmac(icem->proto, comp->sock, src, presz, req,
+			       ice->lhmac, true, 2,
+			       STUN_ATTR_XOR_MAPPED_ADDR, src,
+			       STUN_ATTR_SOFTWARE, sw);
 
  badmsg:
-	return stun_ereply(icem->proto, comp->sock, src, presz, req,
-			   400, "Bad Request",
-			   (uint8_t *)ice->lpwd, strlen(ice->lpwd), true, 1,
-			   STUN_ATTR_SOFTWARE, sw);
+	return stun_ereply_hmac(icem->proto, comp->sock, src, presz, req,
+				400, "Bad Request", ice->lhmac, true, 1,
+				STUN_ATTR_SOFTWARE, sw);
 
  unauth:
-	return stun_ereply(icem->proto, comp->sock, src, presz, req,
-			   401, "Unauthorized",
-			   (uint8_t *)ice->lpwd, strlen(ice->lpwd), true, 1,
-			   STUN_ATTR_SOFTWARE, sw);
+	return stun_ereply_hmac(icem->proto, comp->sock, src, presz, req,
+				401, "Unauthorized", ice->lhmac, true, 1,
+				STUN_ATTR_SOFTWARE, sw);
 
  conflict:
-	return stun_ereply(icem->proto, comp->sock, src, presz, req,
-			   487, "Role Conflict",
-			   (uint8_t *)ice->lpwd, strlen(ice->lpwd), true, 1,
-			   STUN_ATTR_SOFTWARE, sw);
+	return stun_ereply_hmac(icem->proto, comp->sock, src, presz, req,
+				487, "Role Conflict", ice->lhmac, true, 1,
+				STUN_ATTR_SOFTWARE, sw);
 }
@@ -3,11 +3,14 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_list.h>
 #include <re_mbuf.h>
 #include <re_mem.h>
+#include <re_lock.h>
+#include <re_tmr.h>
 #include <re_rtp.h>
 #include <re_jbuf.h>
 
@@ -31,31 +34,66 @@
 #endif
 
 
+enum {
+	JBUF_SRATE_DEFAULT = 8000,  /**< Default sampling rate           */
+	JBUF_RING_MAX      = 32768, /**< Max ring size (half seq space)  */
+	JBUF_JITTER_MULT   = 4,     /**< Target delay in units of jitter */
+};
+
+
 /** Defines a packet frame */
 struct frame {
-	struct le le;           /**< Linked list element       */
 	struct rtp_header hdr;  /**< RTP Header                */
 	void *mem;              /**< Reference counted pointer */
+	bool valid;             /**< Frame slot is in use      */
 };
 
 
 /**
  * Defines a jitter buffer
  *
- * The jitter buffer is for incoming RTP packets, which are sorted by
- * sequence number.
+ * The jitter buffer is for incoming RTP packets, which are stored in a
+ * ring indexed by sequence number. It may be used from more than one
+ * thread.
+ *
+ * In fixed mode frames are played when more than min frames are
+ * buffered, and at most max frames are kept. In adaptive mode the
+ * interarrival jitter is estimated as in RFC 3550, and the number of
+ * buffered frames follows the jitter. The target changes only at the
+ * start of a talk spurt. The buffer grows by waiting for more frames,
+ * and shrinks by skipping the last frames before the talk spurt, where
+ * the sender was silent. Playing them out instead would only move the
+ * delay to the audio buffer after the decoder.
+ *
+ * A sequence number jump of more than the ring size (a sender restart
+ * or a long loss burst) does not discard the buffered frames; they are
+ * played first, and then the head moves on to the frames after the jump.
  */
 struct jbuf {
-	struct list pooll;   /**< List of free frames in pool               */
-	struct list framel;  /**< List of buffered frames                   */
+	struct lock *lock;   /**< Protects the frame ring and state         */
+	struct frame *ring;  /**< Frames, indexed by sequence number        */
+	uint32_t mask;       /**< Ring size minus one                       */
+	enum jbuf_type jbtype; /**< Fixed or adaptive mode                  */
 	uint32_t n;          /**< [# frames] Current # of frames in buffer  */
 	uint32_t min;        /**< [# frames] Minimum # of frames to buffer  */
 	uint32_t max;        /**< [# frames] Maximum # of frames to buffer  */
-	uint16_t seq_put;    /**< Sequence number for last jbuf_put()       */
+	uint32_t wish;       /**< [# frames] Current target # of frames     */
+	uint16_t seq_put;    /**< Newest sequence number put                */
+	uint16_t seq_last;   /**< Sequence number for last jbuf_put()       */
+	uint16_t head;       /**< Sequence number of next frame to get      */
 	bool running;        /**< Jitter buffer is running                  */
+	bool playing;        /**< Frames were got since start               */
+
+	/* delay estimation */
+	uint32_t srate;      /**< Sampling rate of RTP timestamps           */
+	uint32_t ts_put;     /**< RTP timestamp of newest frame             */
+	uint32_t ptime;      /**< Frame duration in timestamp units         */
+	uint32_t transit;    /**< Relative transit time of last frame       */
+	uint32_t jitter;     /**< Interarrival jitter in timestamp units Q4 */
 
 #if JBUF_STAT
 	uint16_t seq_get;      /**< Timestamp of last played frame */
+	uint32_t skip_gap;     /**< Skipped frames, not yet played */
 	struct jbuf_stat stat; /**< Jitter buffer Statistics       */
 #endif
 };
@@ -68,46 +106,114 @@ static inline bool seq_less(uint16_t x, uint16_t y)
 }
 
 
+static inline struct frame *frame_slot(const struct jbuf *jb, uint16_t seq)
+{
+	return &jb->ring[seq & jb->mask];
+}
+
+
 /**
- * Get a frame from the pool
+ * Release a frame, give the slot back
  */
-static void frame_alloc(struct jbuf *jb, struct frame **f)
+static void frame_deref(struct jbuf *jb, struct frame *f)
 {
-	struct le *le;
+	f->mem = mem_deref(f->mem);
+	f->valid = false;
+	--jb->n;
+}
 
-	le = jb->pooll.head;
-	if (le) {
-		list_unlink(le);
-		++jb->n;
+
+/**
+ * Find the next frame to play, and move the head to it. Lost frames
+ * leave empty slots. After a sequence jump the next frame may be more
+ * than the ring size away, then the ring is searched for the nearest one.
+ */
+static struct frame *frame_head(struct jbuf *jb)
+{
+	struct frame *f = NULL;
+	uint32_t i;
+
+	if (!jb->n)
+		return NULL;
+
+	for (i=0; i<=jb->mask; i++) {
+
+		f = frame_slot(jb, jb->head);
+		if (f->valid && f->hdr.seq == jb->head)
+			return f;
+
+		++jb->head;
 	}
-	else {
-		struct frame *f0;
 
-		/* Steal an old frame */
-		le = jb->framel.head;
-		f0 = le->data;
+	DEBUG_INFO("resync: no frame near seq=%u\n", jb->head);
 
-		STAT_INC(n_overflow);
-		DEBUG_INFO("drop 1 old frame seq=%u (total dropped %u)\n",
-			   f0->hdr.seq, jb->stat.n_overflow);
+	f = NULL;
+	for (i=0; i<=jb->mask; i++) {
 
-		f0->mem = mem_deref(f0->mem);
-		list_unlink(le);
+		struct frame *f2 = &jb->ring[i];
+
+		if (!f2->valid)
+			continue;
+
+		if (!f || (uint16_t)(f2->hdr.seq - jb->head) <
+			  (uint16_t)(f->hdr.seq - jb->head))
+			f = f2;
 	}
 
-	*f = le->data;
+	jb->head = f->hdr.seq;
+
+	return f;
 }
 
 
 /**
- * Release a frame, put it back in the pool
+ * Drop the oldest frame in the buffer
  */
-static void frame_deref(struct jbuf *jb, struct frame *f)
+static void frame_drop_oldest(struct jbuf *jb)
 {
-	f->mem = mem_deref(f->mem);
-	list_unlink(&f->le);
-	list_append(&jb->pooll, &f->le, f);
-	--jb->n;
+	struct frame *f = frame_head(jb);
+
+	if (!f)
+		return;
+
+	DEBUG_INFO("drop 1 old frame seq=%u\n", f->hdr.seq);
+
+#if JBUF_STAT
+	jb->seq_get = f->hdr.seq;
+#endif
+	frame_deref(jb, f);
+	++jb->head;
+	jb->playing = true;
+}
+
+
+/**
+ * Shrink to the target at the start of a talk spurt, by skipping the
+ * newest frames before it
+ */
+static void frame_skip(struct jbuf *jb, uint16_t seq)
+{
+	uint16_t s = seq - 1;
+	uint32_t i;
+
+	for (i=0; i<jb->mask && jb->n > jb->wish; i++, s--) {
+
+		struct frame *f = frame_slot(jb, s);
+
+		if (seq_less(s, jb->head))
+			break;
+
+		if (!f->valid || f->hdr.seq != s)
+			continue;
+
+		DEBUG_INFO("skip frame seq=%u\n", s);
+
+		frame_deref(jb, f);
+		STAT_INC(n_skip);
+#if JBUF_STAT
+		++jb->skip_gap;
+#endif
+	}
 }
 
 
@@ -115,10 +221,11 @@ static void jbuf_destructor(void *data)
 {
 	struct jbuf *jb = data;
 
-	jbuf_flush(jb);
+	if (jb->lock)
+		jbuf_flush(jb);
 
-	/* Free all frames in the pool list */
-	list_flush(&jb->pooll);
+	mem_deref(jb->ring);
+	mem_deref(jb->lock);
 }
 
 
@@ -134,7 +241,7 @@ static void jbuf_destructor(void *data)
 int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 {
 	struct jbuf *jb;
-	uint32_t i;
+	uint32_t sz;
 	int err = 0;
 
 	if (!jbp || ( min > max))
@@ -148,28 +255,35 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 		return ENOSYS;
 	}
 
+	/* room for reordering and gaps of lost frames */
+	for (sz = 16; sz < 2*max && sz < JBUF_RING_MAX; sz *= 2)
+		;
+
+	if (max > sz)
+		return EINVAL;
+
 	jb = mem_zalloc(sizeof(*jb), jbuf_destructor);
 	if (!jb)
 		return ENOMEM;
 
-	list_init(&jb->pooll);
-	list_init(&jb->framel);
+	jb->min   = min;
+	jb->max   = max;
+	jb->wish  = min;
+	jb->mask  = sz - 1;
+	jb->srate = JBUF_SRATE_DEFAULT;
 
-	jb->min  = min;
-	jb->max  = max;
+	err = lock_alloc(&jb->lock);
+	if (err)
+		goto out;
 
 	/* Allocate all frames now */
-	for (i=0; i<jb->max; i++) {
-		struct frame *f = mem_zalloc(sizeof(*f), NULL);
-		if (!f) {
-			err = ENOMEM;
-			break;
-		}
-
-		list_append(&jb->pooll, &f->le, f);
-		DEBUG_INFO("alloc: adding to pool list %u\n", i);
+	jb->ring = mem_zalloc(sz * sizeof(*jb->ring), NULL);
+	if (!jb->ring) {
+		err = ENOMEM;
+		goto out;
 	}
 
+ out:
 	if (err)
 		mem_deref(jb);
 	else
@@ -179,6 +293,132 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 }
 
 
+/**
+ * Set the jitter buffer mode
+ *
+ * @param jb     Jitter buffer
+ * @param jbtype Jitter buffer type
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype)
+{
+	if (!jb)
+		return EINVAL;
+
+	switch (jbtype) {
+
+	case JBUF_FIXED:
+	case JBUF_ADAPTIVE:
+		break;
+
+	default:
+		return EINVAL;
+	}
+
+	lock_write_get(jb->lock);
+	jb->jbtype = jbtype;
+	jb->wish   = jb->min;
+	lock_rel(jb->lock);
+
+	return 0;
+}
+
+
+/**
+ * Set the sampling rate of the RTP timestamps, used for delay estimation
+ *
+ * @param jb    Jitter buffer
+ * @param srate Sampling rate in [Hz]
+ */
+void jbuf_set_srate(struct jbuf *jb, uint32_t srate)
+{
+	if (!jb || !srate)
+		return;
+
+	lock_write_get(jb->lock);
+
+	if (srate != jb->srate) {
+		jb->srate  = srate;
+		jb->ptime  = 0;
+		jb->jitter = 0;
+	}
+
+	lock_rel(jb->lock);
+}
+
+
+/* Calculate the target number of frames from the jitter estimate */
+static uint32_t calc_wish(const struct jbuf *jb)
+{
+	const uint32_t hi = max(jb->min, jb->max - 1);
+	uint32_t wish;
+
+	if (!jb->ptime)
+		return jb->wish;
+
+	wish = (JBUF_JITTER_MULT * (jb->jitter >> 4) + jb->ptime - 1)
+		/ jb->ptime;
+
+	return min(max(wish, jb->min), hi);
+}
+
+
+/*
+ * Update the jitter estimate with a new frame, and adjust the target
+ * number of frames at the start of a talk spurt.
+ */
+static void delay_update(struct jbuf *jb, const struct rtp_header *hdr)
+{
+	const uint32_t arrival =
+		(uint32_t)(tmr_jiffies() * jb->srate / 1000);
+	const uint32_t transit = arrival - hdr->ts;
+	bool spurt = hdr->m;
+
+	if (jb->running) {
+
+		int32_t d = (int32_t)(transit - jb->transit);
+
+		if (d < 0)
+			d = -d;
+
+		/* RFC 3550, A.8 */
+		jb->jitter += d - ((jb->jitter + 8) >> 4);
+
+		if (hdr->seq == (uint16_t)(jb->seq_put + 1)) {
+
+			const uint32_t delta = hdr->ts - jb->ts_put;
+
+			/* a longer gap is a silence period */
+			if (jb->ptime && delta >= 2*jb->ptime)
+				spurt = true;
+			else if (delta && delta < jb->srate)
+				jb->ptime = delta;
+		}
+	}
+
+	jb->transit = transit;
+
+	if (!spurt || jb->jbtype != JBUF_ADAPTIVE)
+		return;
+
+	jb->wish = calc_wish(jb);
+
+	frame_skip(jb, hdr->seq);
+}
+
+
+/* Is the frame, which is behind the head, too late to be played? */
+static bool frame_late(const struct jbuf *jb, uint16_t seq)
+{
+	/* as with a sorted list: late if n frames before the last put */
+	if (jb->jbtype == JBUF_FIXED)
+		return seq_less(seq + jb->n, jb->seq_last);
+
+	return jb->playing;
+}
+
+
 /**
  * Put one frame into the jitter buffer
  *
@@ -191,7 +431,6 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 {
 	struct frame *f;
-	struct le *le, *tail;
 	uint16_t seq;
 	int err = 0;
 
@@ -200,76 +439,113 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 
 	seq = hdr->seq;
 
+	lock_write_get(jb->lock);
+
 	STAT_INC(n_put);
 
-	if (jb->running) {
+	if (!jb->running) {
+		jb->head = seq;
+	}
+	else if (seq_less(seq, jb->head) &&
+		 (uint16_t)(jb->head - seq) <= jb->mask) {
 
 		/* Packet arrived too late to be put into buffer */
-		if (seq_less((seq + jb->n), jb->seq_put)) {
+		if (frame_late(jb, seq)) {
 			STAT_INC(n_late);
-			DEBUG_INFO("packet too late: seq=%u (seq_put=%u)\n",
-				   seq, jb->seq_put);
-			return ETIMEDOUT;
+			DEBUG_INFO("packet too late: seq=%u (head=%u)\n",
+				   seq, jb->head);
+			err = ETIMEDOUT;
+			goto out;
 		}
-	}
 
-	frame_alloc(jb, &f);
-
-	tail = jb->framel.tail;
+		/* play it next */
+		jb->head = seq;
+	}
 
-	/* If buffer is empty -> append to tail
-	   Frame is later than tail -> append to tail
-	*/
-	if (!tail || seq_less(((struct frame *)tail->data)->hdr.seq, seq)) {
-		list_append(&jb->framel, &f->le, f);
+	f = frame_slot(jb, seq);
+	if (f->valid && f->hdr.seq == seq) {
+		DEBUG_INFO("duplicate: seq=%u\n", seq);
+		STAT_INC(n_dups);
+		err = EALREADY;
 		goto out;
 	}
 
-	/* Out-of-sequence, find right position */
-	for (le = tail; le; le = le->prev) {
-		const uint16_t seq_le = ((struct frame *)le->data)->hdr.seq;
+	delay_update(jb, hdr);
 
-		if (seq_less(seq_le, seq)) { /* most likely */
-			DEBUG_INFO("put: out-of-sequence"
-				   " - inserting after seq=%u (seq=%u)\n",
-				   seq_le, seq);
-			list_insert_after(&jb->framel, le, &f->le, f);
-			break;
-		}
-		else if (seq == seq_le) { /* less likely */
-			/* Detect duplicates */
-			DEBUG_INFO("duplicate: seq=%u\n", seq);
-			STAT_INC(n_dups);
-			list_insert_after(&jb->framel, le, &f->le, f);
-			frame_deref(jb, f);
-			return EALREADY;
-		}
-
-		/* sequence number less than current seq, continue */
+	/* after a sequence jump, the slot may hold a frame a ring away */
+	if (f->valid) {
+		DEBUG_INFO("slot of seq=%u taken by seq=%u\n",
+			   seq, f->hdr.seq);
+		STAT_INC(n_overflow);
+		frame_deref(jb, f);
 	}
 
-	/* no earlier timestamps found, put in head */
-	if (!le) {
-		DEBUG_INFO("put: out-of-sequence"
-			   " - put in head (seq=%u)\n", seq);
-		list_prepend(&jb->framel, &f->le, f);
+	if (jb->n >= jb->max) {
+		STAT_INC(n_overflow);
+		frame_drop_oldest(jb);
 	}
 
-	STAT_INC(n_oos);
+	if (jb->running && seq_less(seq, jb->seq_put))
+		STAT_INC(n_oos);
 
- out:
-	/* Update last timestamp */
-	jb->running = true;
-	jb->seq_put = seq;
+	if (!jb->running || seq_less(jb->seq_put, seq) ||
+	    (uint16_t)(jb->seq_put - seq) > jb->mask) {
+		jb->seq_put = seq;
+		jb->ts_put  = hdr->ts;
+	}
+
+	jb->seq_last = seq;
+	jb->running  = true;
 
 	/* Success */
-	f->hdr = *hdr;
-	f->mem = mem_ref(mem);
+	f = frame_slot(jb, seq);
+	f->hdr   = *hdr;
+	f->mem   = mem_ref(mem);
+	f->valid = true;
+	++jb->n;
+
+ out:
+	lock_rel(jb->lock);
 
 	return err;
 }
 
 
+/* Take the next frame from the buffer */
+static void frame_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
+{
+	struct frame *f = frame_head(jb);
+
+#if JBUF_STAT
+	/* Check timestamp of previously played frame */
+	if (jb->playing) {
+		const int16_t seq_diff = f->hdr.seq - jb->seq_get;
+		if (seq_diff > 1) {
+			/* the skipped frames are not lost */
+			const uint32_t skip = min(jb->skip_gap,
+						  (uint32_t)seq_diff - 1);
+
+			STAT_ADD(n_lost, seq_diff - 1 - skip);
+			jb->skip_gap = 0;
+			DEBUG_INFO("get: n_lost: diff=%d,seq=%u,seq_get=%u\n",
+				   seq_diff, f->hdr.seq, jb->seq_get);
+		}
+	}
+
+	/* Update sequence number for 'get' */
+	jb->seq_get = f->hdr.seq;
+#endif
+
+	*hdr = f->hdr;
+	*mem = mem_ref(f->mem);
+
+	frame_deref(jb, f);
+
+	++jb->head;
+	jb->playing = true;
+}
+
+
 /**
  * Get one frame from the jitter buffer
  *
@@ -281,50 +557,29 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
  */
 int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 {
-	struct frame *f;
+	int err = 0;
 
 	if (!jb || !hdr || !mem)
 		return EINVAL;
 
+	lock_write_get(jb->lock);
+
 	STAT_INC(n_get);
 
-	if (jb->n <= jb->min || !jb->framel.head) {
-		DEBUG_INFO("not enough buffer frames - wait.. (n=%u min=%u)\n",
-			   jb->n, jb->min);
+	if (jb->n <= jb->wish) {
+		DEBUG_INFO("not enough buffer frames - wait.. (n=%u wish=%u)\n",
+			   jb->n, jb->wish);
 		STAT_INC(n_underflow);
-		return ENOENT;
-	}
-
-	/* When we get one frame F[i], check that the next frame F[i+1]
-	   is present and have a seq no. of seq[i] + 1 !
-	   if not, we should consider that packet lost */
-
-	f = jb->framel.head->data;
-
-#if JBUF_STAT
-	/* Check timestamp of previously played frame */
-	if (jb->seq_get) {
-		const int16_t seq_diff = f->hdr.seq - jb->seq_get;
-		if (seq_less(f->hdr.seq, jb->seq_get)) {
-			DEBUG_WARNING("get: seq=%u too late\n", f->hdr.seq);
-		}
-		else if (seq_diff > 1) {
-			STAT_ADD(n_lost, 1);
-			DEBUG_INFO("get: n_lost: diff=%d,seq=%u,seq_get=%u\n",
-				   seq_diff, f->hdr.seq, jb->seq_get);
-		}
+		err = ENOENT;
+		goto out;
 	}
 
-	/* Update sequence number for 'get' */
-	jb->seq_get = f->hdr.seq;
-#endif
-
-	*hdr = f->hdr;
-	*mem = mem_ref(f->mem);
+	frame_get(jb, hdr, mem);
 
-	frame_deref(jb, f);
+ out:
+	lock_rel(jb->lock);
 
-	return 0;
+	return err;
 }
 
 
@@ -335,27 +590,34 @@ int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
  */
 void jbuf_flush(struct jbuf *jb)
 {
-	struct le *le;
+	uint32_t i;
 
 	if (!jb)
 		return;
 
-	if (jb->framel.head) {
+	lock_write_get(jb->lock);
+
+	if (jb->n) {
 		DEBUG_INFO("flush: %u frames\n", jb->n);
 	}
 
-	/* put all buffered frames back in free list */
-	for (le = jb->framel.head; le; le = jb->framel.head) {
-		DEBUG_INFO(" flush frame: seq=%u\n",
-			   ((struct frame *)(le->data))->hdr.seq);
+	/* give all slots back */
+	for (i=0; i<=jb->mask && jb->n; i++) {
 
-		frame_deref(jb, le->data);
+		if (jb->ring[i].valid)
+			frame_deref(jb, &jb->ring[i]);
 	}
 
 	jb->n       = 0;
 	jb->running = false;
+	jb->playing = false;
+#if JBUF_STAT
+	jb->skip_gap = 0;
+#endif
 
 	STAT_INC(n_flush);
+
+	lock_rel(jb->lock);
 }
 
 
@@ -369,16 +631,28 @@ void jbuf_flush(struct jbuf *jb)
  */
 int jbuf_stats(const struct jbuf *jb, struct jbuf_stat *jstat)
 {
+	uint32_t ptime_ms;
+
 	if (!jb || !jstat)
 		return EINVAL;
 
+	lock_read_get(jb->lock);
+
 #if JBUF_STAT
 	*jstat = jb->stat;
-
-	return 0;
 #else
-	return ENOSYS;
+	memset(jstat, 0, sizeof(*jstat));
 #endif
+
+	ptime_ms = jb->ptime * 1000 / jb->srate;
+
+	jstat->delay_target = jb->wish * ptime_ms;
+	jstat->delay_actual = jb->n * ptime_ms;
+	jstat->jitter       = (jb->jitter >> 4) * 1000 / jb->srate;
+
+	lock_rel(jb->lock);
+
+	return 0;
 }
 
 
@@ -392,17 +666,25 @@ int jbuf_stats(const struct jbuf *jb, struct jbuf_stat *jstat)
  */
 int jbuf_debug(struct re_printf *pf, const struct jbuf *jb)
 {
+	struct jbuf_stat stat;
 	int err = 0;
 
 	if (!jb)
 		return 0;
 
+	(void)jbuf_stats(jb, &stat);
+
 	err |= re_hprintf(pf, "--- jitter buffer debug---\n");
 
 	err |= re_hprintf(pf, " running=%d", jb->running);
 	err |= re_hprintf(pf, " min=%u cur=%u max=%u [frames]\n",
 			  jb->min, jb->n, jb->max);
 	err |= re_hprintf(pf, " seq_put=%u\n", jb->seq_put);
+	err |= re_hprintf(pf, " %s: wish=%u [frames] delay=%u/%u [ms]"
+			  " jitter=%u [ms]\n",
+			  jb->jbtype == JBUF_ADAPTIVE ? "adaptive" : "fixed",
+			  jb->wish, stat.delay_target, stat.delay_actual,
+			  stat.jitter);
 
 #if JBUF_STAT
 	err |= re_hprintf(pf, " Stat: put=%u", jb->stat.n_put);
@@ -411,6 +693,7 @@ int jbuf_debug(struct re_printf *pf, const struct jbuf *jb)
 	err |= re_hprintf(pf, " dup=%u", jb->stat.n_dups);
 	err |= re_hprintf(pf, " late=%u", jb->stat.n_late);
 	err |= re_hprintf(pf, " or=%u", jb->stat.n_overflow);
+	err |= re_hprintf(pf, " skip=%u", jb->stat.n_skip);
 	err |= re_hprintf(pf, " ur=%u", jb->stat.n_underflow);
 	err |= re_hprintf(pf, " flush=%u", jb->stat.n_flush);
 	err |= re_hprintf(pf, "       put/get_ratio=%u%%", jb->stat.n_get ?
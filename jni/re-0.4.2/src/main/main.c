@@ -92,7 +92,7 @@ struct re {
 	bool update;                 /**< File descriptor set need updating */
 	bool polling;                /**< Is polling flag                   */
 	int sig;                     /**< Last caught signal                */
-	struct list tmrl;            /**< List of timers                    */
+	struct tmrl tmrl;            /**< Timer wheel                       */
 
 #ifdef HAVE_POLL
 	struct pollfd *fds;          /**< Event set for poll()              */
@@ -116,7 +116,7 @@ static struct re global_re = {
 	false,
 	false,
 	0,
-	LIST_INIT,
+	TMRL_INIT,
 #ifdef HAVE_POLL
 	NULL,
 #endif
@@ -1002,6 +1002,7 @@ void re_thread_close(void)
 
 	re = pthread_getspecific(pt_key);
 	if (re) {
+		poll_close(re);
 		free(re);
 		pthread_setspecific(pt_key, NULL);
 	}
@@ -1038,8 +1039,8 @@ void re_thread_leave(void)
  *
  * @note only used by tmr module
  */
-struct list *tmrl_get(void);
-struct list *tmrl_get(void)
+struct tmrl *tmrl_get(void);
+struct tmrl *tmrl_get(void)
 {
 	return &re_get()->tmrl;
 }
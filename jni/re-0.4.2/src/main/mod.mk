@@ -7,6 +7,7 @@
 SRCS	+= main/init.c
 SRCS	+= main/main.c
 SRCS	+= main/method.c
+SRCS	+= main/worker.c
 
 ifneq ($(HAVE_EPOLL),)
 SRCS	+= main/epoll.c
@@ -0,0 +1,294 @@
+/**
+ * @file worker.c  Worker threads with their own polling loop
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_main.h>
+#include <re_mqueue.h>
+
+
+#define DEBUG_MODULE "worker"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/*
+ * A worker is a thread which runs its own re_main() loop. File
+ * descriptors, timers and message queues which are set up from the
+ * worker thread are polled by that thread only. Other threads talk to
+ * the worker through a message queue.
+ */
+
+
+#ifdef HAVE_PTHREAD
+
+/** Defines a worker thread */
+struct re_worker {
+	pthread_t tid;           /**< Thread identifier                */
+	pthread_mutex_t mutex;   /**< Mutex for startup and sync calls */
+	pthread_cond_t cond;     /**< Condition for startup and sync   */
+	struct mqueue *mq;       /**< Message queue to the worker      */
+	unsigned npush;          /**< Pushes to the queue in progress  */
+	bool ready;              /**< Thread startup is complete       */
+	bool run;                /**< Main loop accepts messages       */
+	bool joinable;           /**< Thread must be joined            */
+	int err;                 /**< Thread startup error             */
+};
+
+/** A call which the caller waits for */
+struct sync_call {
+	struct re_worker *w;
+	re_worker_h *h;
+	int id;
+	void *data;
+	bool done;
+};
+
+
+static void stop_handler(int id, void *data)
+{
+	(void)id;
+	(void)data;
+
+	re_cancel();
+}
+
+
+static void sync_handler(int id, void *data)
+{
+	struct sync_call *sc = data;
+	struct re_worker *w = sc->w;
+
+	(void)id;
+
+	sc->h(sc->id, sc->data);
+
+	pthread_mutex_lock(&w->mutex);
+	sc->done = true;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+
+/*
+ * Push a message to the worker, if its main loop is running. The queue
+ * is kept until all pushes are done, since the worker frees it on exit.
+ */
+static int worker_push(struct re_worker *w, mqueue_h *h, int id, void *data)
+{
+	int err;
+
+	pthread_mutex_lock(&w->mutex);
+	if (!w->run) {
+		pthread_mutex_unlock(&w->mutex);
+		return ESHUTDOWN;
+	}
+	++w->npush;
+	pthread_mutex_unlock(&w->mutex);
+
+	err = mqueue_push(w->mq, h, id, data);
+
+	pthread_mutex_lock(&w->mutex);
+	if (--w->npush == 0)
+		pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	return err;
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct re_worker *w = arg;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	err = mqueue_alloc(&w->mq);
+
+ out:
+	pthread_mutex_lock(&w->mutex);
+	w->err   = err;
+	w->ready = true;
+	w->run   = !err;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	if (!err) {
+		err = re_main(NULL);
+		if (err) {
+			DEBUG_WARNING("main loop: %m\n", err);
+		}
+	}
+
+	/* refuse new messages, and wake up callers waiting for a sync call */
+	pthread_mutex_lock(&w->mutex);
+	w->run = false;
+	while (w->npush)
+		pthread_cond_wait(&w->cond, &w->mutex);
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	w->mq = mem_deref(w->mq);
+	re_thread_close();
+
+	return NULL;
+}
+
+
+static void worker_destructor(void *data)
+{
+	struct re_worker *w = data;
+
+	if (w->joinable) {
+		(void)worker_push(w, stop_handler, 0, NULL);
+		pthread_join(w->tid, NULL);
+	}
+
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->mutex);
+}
+
+#endif
+
+
+/**
+ * Allocate a worker thread with its own polling loop
+ *
+ * @param wp Pointer to allocated worker
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_worker_alloc(struct re_worker **wp)
+{
+#ifdef HAVE_PTHREAD
+	struct re_worker *w;
+	int err;
+
+	if (!wp)
+		return EINVAL;
+
+	w = mem_zalloc(sizeof(*w), worker_destructor);
+	if (!w)
+		return ENOMEM;
+
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->cond, NULL);
+
+	err = pthread_create(&w->tid, NULL, worker_thread, w);
+	if (err)
+		goto out;
+
+	pthread_mutex_lock(&w->mutex);
+	while (!w->ready)
+		pthread_cond_wait(&w->cond, &w->mutex);
+	err = w->err;
+	pthread_mutex_unlock(&w->mutex);
+
+	if (err)
+		pthread_join(w->tid, NULL);
+	else
+		w->joinable = true;
+
+ out:
+	if (err)
+		mem_deref(w);
+	else
+		*wp = w;
+
+	return err;
+#else
+	(void)wp;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Run a handler in a worker thread. The call returns at once.
+ *
+ * @param w    Worker
+ * @param h    Handler, called from the worker thread
+ * @param id   General purpose identifier
+ * @param data Handler data
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_worker_call(struct re_worker *w, re_worker_h *h, int id, void *data)
+{
+#ifdef HAVE_PTHREAD
+	if (!w || !h)
+		return EINVAL;
+
+	return worker_push(w, h, id, data);
+#else
+	(void)w;
+	(void)h;
+	(void)id;
+	(void)data;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Run a handler in a worker thread, and wait for it to complete. If the
+ * calling thread is the worker thread, the handler is called directly.
+ *
+ * @param w    Worker
+ * @param h    Handler, called from the worker thread
+ * @param id   General purpose identifier
+ * @param data Handler data
+ *
+ * @return 0 if success, ESHUTDOWN if the worker main loop has stopped
+ * before the handler was called, otherwise errorcode
+ */
+int re_worker_sync(struct re_worker *w, re_worker_h *h, int id, void *data)
+{
+#ifdef HAVE_PTHREAD
+	struct sync_call sc;
+	int err;
+
+	if (!w || !h)
+		return EINVAL;
+
+	if (pthread_equal(pthread_self(), w->tid)) {
+		h(id, data);
+		return 0;
+	}
+
+	sc.w    = w;
+	sc.h    = h;
+	sc.id   = id;
+	sc.data = data;
+	sc.done = false;
+
+	err = worker_push(w, sync_handler, 0, &sc);
+	if (err)
+		return err;
+
+	/* the worker may exit before it gets to the call */
+	pthread_mutex_lock(&w->mutex);
+	while (!sc.done && w->run)
+		pthread_cond_wait(&w->cond, &w->mutex);
+	if (!sc.done)
+		err = ESHUTDOWN;
+	pthread_mutex_unlock(&w->mutex);
+
+	return err;
+#else
+	(void)w;
+	(void)h;
+	(void)id;
+	(void)data;
+	return ENOSYS;
+#endif
+}
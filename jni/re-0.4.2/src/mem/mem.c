@@ -14,6 +14,7 @@
 #include <re_fmt.h>
 #include <re_mbuf.h>
 #include <re_mem.h>
+#include "mem.h"
 
 
 #define DEBUG_MODULE "mem"
@@ -26,17 +27,56 @@
 #endif
 
 
-/** Defines a reference-counting memory object */
+/** Types with the strictest alignment, as returned by malloc() */
+union mem_align {
+	uint64_t u;
+	double d;
+	long double ld;
+	void *p;
+};
+
+/**
+ * Defines a reference-counting memory object. The header is padded to
+ * the alignment of malloc(), so that the object which follows it is
+ * aligned on all targets (e.g. 8 bytes on 32-bit ARM).
+ */
 struct mem {
 	uint32_t nrefs;     /**< Number of references  */
+	uint32_t cls;       /**< Slab size class or 0  */
 	mem_destroy_h *dh;  /**< Destroy handler       */
 #if MEM_DEBUG
 	struct le le;       /**< Linked list element   */
 	uint32_t magic;     /**< Magic number          */
 	size_t size;        /**< Size of memory object */
 #endif
+	union mem_align data[];  /**< The memory object  */
 };
 
+/*
+ * With threads, objects may be referenced from one thread and released
+ * from another (e.g. when handed over through a message queue), so the
+ * reference count is updated atomically.
+ */
+#ifdef HAVE_PTHREAD
+#define nrefs_inc(m) __atomic_add_fetch(&(m)->nrefs, 1, __ATOMIC_RELAXED)
+#define nrefs_dec(m) __atomic_sub_fetch(&(m)->nrefs, 1, __ATOMIC_ACQ_REL)
+#define nrefs_get(m) __atomic_load_n(&(m)->nrefs, __ATOMIC_ACQUIRE)
+#else
+#define nrefs_inc(m) (++(m)->nrefs)
+#define nrefs_dec(m) (--(m)->nrefs)
+#define nrefs_get(m) ((m)->nrefs)
+#endif
+
+/*
+ * Allocations made by each thread, in release builds too, so that code
+ * with real-time properties can check that it does not allocate
+ */
+#if defined(HAVE_PTHREAD) && defined(__GNUC__)
+static __thread uint64_t nallocs;
+#else
+static uint64_t nallocs;
+#endif
+
 #if MEM_DEBUG
 /* Memory debugging */
 static struct list meml = LIST_INIT;
@@ -126,6 +166,7 @@ static inline void mem_unlock(void)
 void *mem_alloc(size_t size, mem_destroy_h *dh)
 {
 	struct mem *m;
+	uint32_t cls;
 
 #if MEM_DEBUG
 	mem_lock();
@@ -136,9 +177,15 @@ void *mem_alloc(size_t size, mem_destroy_h *dh)
 	mem_unlock();
 #endif
 
-	m = malloc(sizeof(*m) + size);
-	if (!m)
-		return NULL;
+	if (!mem_slab_enabled() ||
+	    !(m = mem_slab_alloc(sizeof(*m) + size, &cls))) {
+
+		m = malloc(sizeof(*m) + size);
+		if (!m)
+			return NULL;
+
+		cls = 0;
+	}
 
 #if MEM_DEBUG
 	memset(&m->le, 0, sizeof(struct le));
@@ -148,9 +195,11 @@ void *mem_alloc(size_t size, mem_destroy_h *dh)
 #endif
 
 	m->nrefs = 1;
+	m->cls   = cls;
 	m->dh    = dh;
 
 	STAT_ALLOC(m, size);
+	++nallocs;
 
 	return (void *)(m + 1);
 }
@@ -178,6 +227,32 @@ void *mem_zalloc(size_t size, mem_destroy_h *dh)
 }
 
 
+/* Re-allocate a memory object from the slab allocator */
+static struct mem *slab_realloc(struct mem *m, size_t size)
+{
+	const size_t bsize = mem_slab_size(m->cls);
+	struct mem *m2;
+	uint32_t cls = 0;
+
+	if (sizeof(*m2) + size <= bsize)
+		return m;
+
+	if (!mem_slab_enabled() ||
+	    !(m2 = mem_slab_alloc(sizeof(*m2) + size, &cls))) {
+
+		m2 = malloc(sizeof(*m2) + size);
+		if (!m2)
+			return NULL;
+	}
+
+	memcpy(m2, m, bsize);
+	mem_slab_free(m, m->cls);
+	m2->cls = cls;
+
+	return m2;
+}
+
+
 /**
  * Re-allocate a reference-counted memory object
  *
@@ -214,7 +289,10 @@ void *mem_realloc(void *data, size_t size)
 	mem_unlock();
 #endif
 
-	m2 = realloc(m, sizeof(*m2) + size);
+	if (m->cls)
+		m2 = slab_realloc(m, size);
+	else
+		m2 = realloc(m, sizeof(*m2) + size);
 
 #if MEM_DEBUG
 	mem_lock();
@@ -227,6 +305,7 @@ void *mem_realloc(void *data, size_t size)
 	}
 
 	STAT_REALLOC(m2, size);
+	++nallocs;
 
 	return (void *)(m2 + 1);
 }
@@ -250,7 +329,7 @@ void *mem_ref(void *data)
 
 	MAGIC_CHECK(m);
 
-	++m->nrefs;
+	nrefs_inc(m);
 
 	return data;
 }
@@ -268,6 +347,7 @@ void *mem_ref(void *data)
 void *mem_deref(void *data)
 {
 	struct mem *m;
+	uint32_t cls;
 
 	if (!data)
 		return NULL;
@@ -276,15 +356,17 @@ void *mem_deref(void *data)
 
 	MAGIC_CHECK(m);
 
-	if (--m->nrefs > 0)
+	if (nrefs_dec(m) > 0)
 		return NULL;
 
 	if (m->dh)
 		m->dh(data);
 
-	if (m->nrefs > 0)
+	if (nrefs_get(m) > 0)
 		return NULL;
 
+	cls = m->cls;
+
 #if MEM_DEBUG
 	mem_lock();
 	list_unlink(&m->le);
@@ -293,7 +375,10 @@ void *mem_deref(void *data)
 
 	STAT_DEREF(m);
 
-	free(m);
+	if (cls)
+		mem_slab_free(m, cls);
+	else
+		free(m);
 
 	return NULL;
 }
@@ -317,7 +402,7 @@ uint32_t mem_nrefs(const void *data)
 
 	MAGIC_CHECK(m);
 
-	return m->nrefs;
+	return nrefs_get(m);
 }
 
 
@@ -441,6 +526,7 @@ int mem_status(struct re_printf *pf, void *unused)
 	err |= re_hprintf(pf, " Block size: min=%u, max=%u\n",
 			  stat.size_min, stat.size_max);
 	err |= re_hprintf(pf, " Total %u blocks allocated\n", c);
+	err |= mem_slab_status(pf);
 
 	return err;
 #else
@@ -451,6 +537,20 @@ int mem_status(struct re_printf *pf, void *unused)
 }
 
 
+/**
+ * Get the number of allocations made by the calling thread, counting
+ * both mem_alloc() and mem_realloc()
+ *
+ * @return Number of allocations
+ *
+ * @note Allocations made with malloc() directly are not counted
+ */
+uint64_t mem_nallocs(void)
+{
+	return nallocs;
+}
+
+
 /**
  * Get memory statistics
  *
@@ -0,0 +1,13 @@
+/**
+ * @file mem.h  Internal interface to memory management
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/* Slab allocator */
+bool   mem_slab_enabled(void);
+void  *mem_slab_alloc(size_t size, uint32_t *cls);
+void   mem_slab_free(void *p, uint32_t cls);
+size_t mem_slab_size(uint32_t cls);
+int    mem_slab_status(struct re_printf *pf);
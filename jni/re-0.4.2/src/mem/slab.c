@@ -0,0 +1,341 @@
+/**
+ * @file slab.c  Size-class slab allocator with per-thread caches
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include "mem.h"
+
+
+/*
+ * Small memory blocks are carved out of large chunks, grouped in size
+ * classes. Each thread keeps a cache of free blocks per size class, which
+ * is refilled from and drained to a global depot in batches. The depot is
+ * the only place where a lock is taken. Chunks are never returned to the
+ * system.
+ */
+
+
+enum {
+	SLAB_CHUNK_SIZE = 65536,  /**< Size of memory chunks           */
+	SLAB_BATCH      = 32,     /**< Blocks moved to/from the depot  */
+	SLAB_CACHE_MAX  = 128,    /**< Max free blocks per thread/class */
+	SLAB_ALIGN      = 16,     /**< Alignment of block sizes        */
+	SLAB_MAX_SIZE   = 4096,   /**< Largest block size              */
+};
+
+/** Block sizes for each size class (including memory header) */
+static const size_t slab_sizes[] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+	1536, 2048, 3072, 4096
+};
+
+#define SLAB_CLASSES ARRAY_SIZE(slab_sizes)
+
+/** Free memory block */
+struct slab_blk {
+	struct slab_blk *next;
+};
+
+/** Cache of free blocks */
+struct slab_cache {
+	struct slab_blk *freel[SLAB_CLASSES];
+	uint32_t n[SLAB_CLASSES];
+};
+
+/** Global depot of free blocks and the current chunk */
+static struct {
+	struct slab_cache free;
+	uint8_t *chunk;
+	size_t chunk_left;
+	uint32_t chunks;
+} depot;
+
+/** Size class index for each multiple of SLAB_ALIGN */
+static uint8_t slab_index[SLAB_MAX_SIZE / SLAB_ALIGN + 1];
+static bool slab_enabled = false;
+
+
+#ifdef HAVE_PTHREAD
+
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slab_key;
+
+static inline void slab_lock(void)
+{
+	pthread_mutex_lock(&slab_mutex);
+}
+
+
+static inline void slab_unlock(void)
+{
+	pthread_mutex_unlock(&slab_mutex);
+}
+
+#else
+
+static struct slab_cache slab_global_cache;
+
+#define slab_lock()    /**< Stub */
+#define slab_unlock()  /**< Stub */
+
+#endif
+
+
+/* Move up to n blocks of one size class from one cache to another */
+static uint32_t cache_move(struct slab_cache *dst, struct slab_cache *src,
+			   size_t i, uint32_t n)
+{
+	uint32_t moved = 0;
+
+	while (moved < n && src->freel[i]) {
+
+		struct slab_blk *blk = src->freel[i];
+
+		src->freel[i] = blk->next;
+		blk->next = dst->freel[i];
+		dst->freel[i] = blk;
+		++moved;
+	}
+
+	src->n[i] -= moved;
+	dst->n[i] += moved;
+
+	return moved;
+}
+
+
+/* Carve new blocks from the current chunk, depot must be locked */
+static void depot_carve(size_t i, uint32_t n)
+{
+	const size_t sz = slab_sizes[i];
+
+	while (n--) {
+
+		struct slab_blk *blk;
+
+		if (depot.chunk_left < sz) {
+
+			uint8_t *chunk = malloc(SLAB_CHUNK_SIZE);
+			if (!chunk)
+				return;
+
+			depot.chunk      = chunk;
+			depot.chunk_left = SLAB_CHUNK_SIZE;
+			++depot.chunks;
+		}
+
+		blk = (void *)depot.chunk;
+		depot.chunk      += sz;
+		depot.chunk_left -= sz;
+
+		blk->next = depot.free.freel[i];
+		depot.free.freel[i] = blk;
+		++depot.free.n[i];
+	}
+}
+
+
+#ifdef HAVE_PTHREAD
+static void cache_destructor(void *arg)
+{
+	struct slab_cache *cache = arg;
+	size_t i;
+
+	slab_lock();
+
+	for (i=0; i<SLAB_CLASSES; i++)
+		(void)cache_move(&depot.free, cache, i, cache->n[i]);
+
+	slab_unlock();
+
+	free(cache);
+}
+
+
+static void slab_init_key(void)
+{
+	(void)pthread_key_create(&slab_key, cache_destructor);
+}
+#endif
+
+
+static struct slab_cache *cache_get(void)
+{
+#ifdef HAVE_PTHREAD
+	struct slab_cache *cache;
+
+	cache = pthread_getspecific(slab_key);
+	if (cache)
+		return cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	if (pthread_setspecific(slab_key, cache)) {
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+#else
+	return &slab_global_cache;
+#endif
+}
+
+
+/**
+ * Enable or disable the slab allocator for small memory objects. This
+ * should be called at startup, before any threads are created. Objects
+ * which are already allocated are released to the allocator they came
+ * from.
+ *
+ * @param enable True to enable, false to disable
+ */
+void mem_slab_set(bool enable)
+{
+	size_t i, sz;
+
+	if (enable) {
+#ifdef HAVE_PTHREAD
+		(void)pthread_once(&slab_once, slab_init_key);
+#endif
+		for (i=0, sz=0; sz <= SLAB_MAX_SIZE; sz += SLAB_ALIGN) {
+
+			while (slab_sizes[i] < sz)
+				++i;
+
+			slab_index[sz / SLAB_ALIGN] = (uint8_t)i;
+		}
+	}
+
+	slab_enabled = enable;
+}
+
+
+bool mem_slab_enabled(void)
+{
+	return slab_enabled;
+}
+
+
+/**
+ * Allocate a memory block from the slab allocator
+ *
+ * @param size Number of bytes needed
+ * @param cls  Returned size class (1-based)
+ *
+ * @return Pointer to memory block, or NULL if size is too large
+ */
+void *mem_slab_alloc(size_t size, uint32_t *cls)
+{
+	struct slab_cache *cache;
+	struct slab_blk *blk;
+	size_t i;
+
+	if (size > SLAB_MAX_SIZE)
+		return NULL;
+
+	i = slab_index[(size + SLAB_ALIGN - 1) / SLAB_ALIGN];
+
+	cache = cache_get();
+	if (!cache)
+		return NULL;
+
+	if (!cache->freel[i]) {
+
+		slab_lock();
+
+		if (depot.free.n[i] < SLAB_BATCH)
+			depot_carve(i, SLAB_BATCH - depot.free.n[i]);
+
+		(void)cache_move(cache, &depot.free, i, SLAB_BATCH);
+
+		slab_unlock();
+
+		if (!cache->freel[i])
+			return NULL;
+	}
+
+	blk = cache->freel[i];
+	cache->freel[i] = blk->next;
+	--cache->n[i];
+
+	*cls = (uint32_t)i + 1;
+
+	return blk;
+}
+
+
+/**
+ * Release a memory block to the slab allocator
+ *
+ * @param p   Memory block
+ * @param cls Size class of the block (1-based)
+ */
+void mem_slab_free(void *p, uint32_t cls)
+{
+	struct slab_cache *cache;
+	struct slab_blk *blk = p;
+	const size_t i = cls - 1;
+
+	cache = cache_get();
+	if (!cache) {
+		slab_lock();
+		blk->next = depot.free.freel[i];
+		depot.free.freel[i] = blk;
+		++depot.free.n[i];
+		slab_unlock();
+		return;
+	}
+
+	blk->next = cache->freel[i];
+	cache->freel[i] = blk;
+	++cache->n[i];
+
+	if (cache->n[i] > SLAB_CACHE_MAX) {
+		slab_lock();
+		(void)cache_move(&depot.free, cache, i, SLAB_BATCH);
+		slab_unlock();
+	}
+}
+
+
+/**
+ * Get the block size of a size class
+ *
+ * @param cls Size class (1-based)
+ *
+ * @return Block size in bytes
+ */
+size_t mem_slab_size(uint32_t cls)
+{
+	return slab_sizes[cls - 1];
+}
+
+
+int mem_slab_status(struct re_printf *pf)
+{
+	uint32_t chunks, nfree = 0;
+	size_t i;
+
+	slab_lock();
+	chunks = depot.chunks;
+	for (i=0; i<SLAB_CLASSES; i++)
+		nfree += depot.free.n[i];
+	slab_unlock();
+
+	return re_hprintf(pf, " Slab: %s, %u chunks of %u bytes,"
+			  " %u free blocks in depot\n",
+			  slab_enabled ? "enabled" : "disabled",
+			  chunks, SLAB_CHUNK_SIZE, nfree);
+}
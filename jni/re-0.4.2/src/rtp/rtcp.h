@@ -116,4 +116,4 @@ void rtcp_sess_tx_rtp(struct rtcp_sess *sess, uint32_t ts,
 		      size_t payload_size);
 void rtcp_sess_rx_rtp(struct rtcp_sess *sess, uint16_t seq, uint32_t ts,
 		      uint32_t src, size_t payload_size,
-		      const struct sa *peer);
+		      const struct sa *peer, uint64_t jfs);
@@ -207,7 +207,8 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 
 	if (rs->rtcp) {
 		rtcp_sess_rx_rtp(rs->rtcp, hdr.seq, hdr.ts,
-				 hdr.ssrc, mbuf_get_left(mb), src);
+				 hdr.ssrc, mbuf_get_left(mb), src,
+				 udp_rx_jiffies(rs->sock_rtp));
 	}
 
 	if (rs->recvh)
@@ -409,20 +410,9 @@ int rtp_decode(struct rtp_sock *rs, struct mbuf *mb,
 }
 
 
-/**
- * Send an RTP packet to a peer
- *
- * @param rs     RTP Socket
- * @param dst    Destination address
- * @param marker Marker bit
- * @param pt     Payload type
- * @param ts     Timestamp
- * @param mb     Payload buffer
- *
- * @return 0 for success, otherwise errorcode
- */
-int rtp_send(struct rtp_sock *rs, const struct sa *dst,
-	     bool marker, uint8_t pt, uint32_t ts, struct mbuf *mb)
+static int rtp_send_internal(struct rtp_sock *rs, const struct sa *dst,
+			     bool marker, uint8_t pt, uint32_t ts,
+			     struct mbuf *mb, bool queue)
 {
 	size_t pos;
 	int err;
@@ -450,7 +440,68 @@ int rtp_send(struct rtp_sock *rs, const struct sa *dst,
 
 	mb->pos = pos;
 
-	return udp_send(rs->sock_rtp, dst, mb);
+	if (queue)
+		return udp_send_queue(rs->sock_rtp, dst, mb);
+	else
+		return udp_send(rs->sock_rtp, dst, mb);
+}
+
+
+/**
+ * Send an RTP packet to a peer
+ *
+ * @param rs     RTP Socket
+ * @param dst    Destination address
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_send(struct rtp_sock *rs, const struct sa *dst,
+	     bool marker, uint8_t pt, uint32_t ts, struct mbuf *mb)
+{
+	return rtp_send_internal(rs, dst, marker, pt, ts, mb, false);
+}
+
+
+/**
+ * Queue an RTP packet for sending to a peer. Queued packets are sent
+ * with rtp_flush(), e.g. after all packets of a video frame.
+ *
+ * @param rs     RTP Socket
+ * @param dst    Destination address
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer
+ *
+ * @return 0 for success, otherwise errorcode
+ *
+ * @note Batched sending must be enabled on the RTP transport socket with
+ *       udp_txbatch_set(), otherwise the packet is sent immediately
+ */
+int rtp_send_queue(struct rtp_sock *rs, const struct sa *dst,
+		   bool marker, uint8_t pt, uint32_t ts, struct mbuf *mb)
+{
+	return rtp_send_internal(rs, dst, marker, pt, ts, mb, true);
+}
+
+
+/**
+ * Send all queued RTP packets
+ *
+ * @param rs RTP Socket
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_flush(struct rtp_sock *rs)
+{
+	if (!rs)
+		return EINVAL;
+
+	return udp_flush(rs->sock_rtp);
 }
 
 
@@ -30,8 +30,9 @@
 
 
 enum {
-	RTCP_INTERVAL = 5000,  /**< Interval in [ms] between sending reports */
-	MAX_MEMBERS   = 8,
+	RTCP_INTERVAL   = 5000,  /**< Interval in [ms] between sending reports */
+	MEMBERS_DEFAULT = 64,    /**< Default maximum number of members      */
+	MEMBERS_BSIZE   = 4096,  /**< Maximum size of member hash-table      */
 };
 
 /** RTP Transmit stats */
@@ -46,15 +47,22 @@ struct txstat {
 struct rtcp_sess {
 	struct rtp_sock *rs;        /**< RTP Socket                          */
 	struct hash *members;       /**< Member table                        */
+	struct rtp_member *mbr_last;/**< Member of the last RTP packet       */
 	struct tmr tmr;             /**< Event sender timer                  */
 	char *cname;                /**< Canonical Name                      */
 	uint32_t memberc;           /**< Number of members                   */
+	uint32_t members_max;       /**< Maximum number of members           */
 	uint32_t senderc;           /**< Number of senders                   */
 	uint32_t srate_tx;          /**< Transmit sampling rate              */
 	uint32_t srate_rx;          /**< Receive sampling rate               */
 
+	/* arrival time, converted once per received batch */
+	uint64_t rx_jfs;            /**< Arrival time in [ms]                */
+	uint32_t rx_srate;          /**< Sampling rate of rx_ts              */
+	uint32_t rx_ts;             /**< Arrival time in timestamp units     */
+
 	/* stats */
-	struct lock *lock;          /**< Lock for txstat                     */
+	struct lock *lock;          /**< Lock for members and txstat         */
 	struct txstat txstat;       /**< Local transmit statistics           */
 };
 
@@ -82,25 +90,37 @@ static void sess_destructor(void *data)
 
 static struct rtp_member *get_member(struct rtcp_sess *sess, uint32_t src)
 {
-	struct rtp_member *mbr;
+	struct rtp_member *mbr = sess->mbr_last;
 
-	mbr = member_find(sess->members, src);
-	if (mbr)
+	/* most packets are from the same source as the previous one */
+	if (mbr && mbr->src == src)
 		return mbr;
 
-	if (sess->memberc >= MAX_MEMBERS)
-		return NULL;
+	mbr = member_find(sess->members, src);
+	if (!mbr) {
 
-	mbr = member_add(sess->members, src);
-	if (!mbr)
-		return NULL;
+		if (sess->memberc >= sess->members_max)
+			return NULL;
 
-	++sess->memberc;
+		mbr = member_add(sess->members, src);
+		if (!mbr)
+			return NULL;
+
+		++sess->memberc;
+	}
+
+	sess->mbr_last = mbr;
 
 	return mbr;
 }
 
 
+static uint32_t members_bsize(uint32_t n)
+{
+	return hash_valid_size(min(n, (uint32_t)MEMBERS_BSIZE));
+}
+
+
 /** Calculate Round-Trip Time in [microseconds] */
 static void calc_rtt(uint32_t *rtt, uint32_t lsr, uint32_t dlsr)
 {
@@ -199,6 +219,9 @@ static void handle_incoming_bye(struct rtcp_sess *sess,
 			if (mbr->s)
 				--sess->senderc;
 
+			if (mbr == sess->mbr_last)
+				sess->mbr_last = NULL;
+
 			--sess->memberc;
 			mem_deref(mbr);
 		}
@@ -211,6 +234,8 @@ void rtcp_handler(struct rtcp_sess *sess, struct rtcp_msg *msg)
 	if (!sess || !msg)
 		return;
 
+	lock_write_get(sess->lock);
+
 	switch (msg->hdr.pt) {
 
 	case RTCP_SR:
@@ -228,6 +253,8 @@ void rtcp_handler(struct rtcp_sess *sess, struct rtcp_msg *msg)
 	default:
 		break;
 	}
+
+	lock_rel(sess->lock);
 }
 
 
@@ -250,7 +277,9 @@ int rtcp_sess_alloc(struct rtcp_sess **sessp, struct rtp_sock *rs)
 	if (err)
 		goto out;
 
-	err  = hash_alloc(&sess->members, MAX_MEMBERS);
+	sess->members_max = MEMBERS_DEFAULT;
+
+	err  = hash_alloc(&sess->members, members_bsize(sess->members_max));
 	if (err)
 		goto out;
 
@@ -314,6 +343,60 @@ void rtcp_set_srate_rx(struct rtp_sock *rs, uint32_t srate_rx)
 }
 
 
+static bool rehash_handler(struct le *le, void *arg)
+{
+	struct rtp_member *mbr = le->data;
+	struct hash *ht = arg;
+
+	hash_unlink(&mbr->le);
+	hash_append(ht, mbr->src, &mbr->le, mbr);
+
+	return false;
+}
+
+
+/**
+ * Set the maximum number of members in an RTCP Session. The member
+ * table is resized to keep the lookup fast. Existing members are kept
+ * even if there are more than the new maximum.
+ *
+ * @param rs RTP Socket
+ * @param n  Maximum number of members
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtcp_set_maxmembers(struct rtp_sock *rs, uint32_t n)
+{
+	struct rtcp_sess *sess = rtp_rtcp_sess(rs);
+	struct hash *ht;
+	int err = 0;
+
+	if (!sess || !n)
+		return EINVAL;
+
+	lock_write_get(sess->lock);
+
+	if (members_bsize(n) != hash_bsize(sess->members)) {
+
+		err = hash_alloc(&ht, members_bsize(n));
+		if (err)
+			goto out;
+
+		hash_apply(sess->members, rehash_handler, ht);
+
+		mem_deref(sess->members);
+		sess->members = ht;
+	}
+
+	sess->members_max = n;
+
+ out:
+	lock_rel(sess->lock);
+
+	return err;
+}
+
+
 int rtcp_enable(struct rtcp_sess *sess, bool enabled, const char *cname)
 {
 	int err;
@@ -401,9 +484,10 @@ static int mk_sr(struct rtcp_sess *sess, struct mbuf *mb)
 	if (err)
 		return err;
 
-	lock_read_get(sess->lock);
+	/* the report blocks update the member statistics */
+	lock_write_get(sess->lock);
+
 	txstat = sess->txstat;
-	lock_rel(sess->lock);
 
 	if (txstat.start) {
 		dur = (uint32_t)(time(NULL) - txstat.start);
@@ -413,8 +497,8 @@ static int mk_sr(struct rtcp_sess *sess, struct mbuf *mb)
 	err = rtcp_encode(mb, RTCP_SR, sess->senderc, rtp_sess_ssrc(sess->rs),
 			  ntp.hi, ntp.lo, rtp_ts, txstat.psent, txstat.osent,
 			  encode_handler, sess->members);
-	if (err)
-		return err;
+
+	lock_rel(sess->lock);
 
 	return err;
 }
@@ -529,24 +613,26 @@ void rtcp_sess_tx_rtp(struct rtcp_sess *sess, uint32_t ts, size_t payload_size)
 
 void rtcp_sess_rx_rtp(struct rtcp_sess *sess, uint16_t seq, uint32_t ts,
 		      uint32_t ssrc, size_t payload_size,
-		      const struct sa *peer)
+		      const struct sa *peer, uint64_t jfs)
 {
 	struct rtp_member *mbr;
 
 	if (!sess)
 		return;
 
+	lock_write_get(sess->lock);
+
 	mbr = get_member(sess, ssrc);
 	if (!mbr) {
 		DEBUG_NOTICE("could not add member: 0x%08x\n", ssrc);
-		return;
+		goto out;
 	}
 
 	if (!mbr->s) {
 		mbr->s = mem_zalloc(sizeof(*mbr->s), NULL);
 		if (!mbr->s) {
 			DEBUG_NOTICE("could not add sender: 0x%08x\n", ssrc);
-			return;
+			goto out;
 		}
 
 		/* first packet - init sequence number */
@@ -563,15 +649,21 @@ void rtcp_sess_rx_rtp(struct rtcp_sess *sess, uint16_t seq, uint32_t ts,
 
 	if (sess->srate_rx) {
 
-		uint32_t ts_arrive;
-
 		/* Convert from wall-clock time to timestamp units */
-		ts_arrive = (uint32_t)(tmr_jiffies()) * sess->srate_rx / 1000;
+		if (jfs != sess->rx_jfs || sess->srate_rx != sess->rx_srate) {
+
+			sess->rx_jfs   = jfs;
+			sess->rx_srate = sess->srate_rx;
+			sess->rx_ts    = (uint32_t)(jfs * sess->srate_rx / 1000);
+		}
 
-		source_calc_jitter(mbr->s, ts, ts_arrive);
+		source_calc_jitter(mbr->s, ts, sess->rx_ts);
 	}
 
 	mbr->s->rtp_rx_bytes += payload_size;
+
+ out:
+	lock_rel(sess->lock);
 }
 
 
@@ -592,26 +684,30 @@ int rtcp_stats(struct rtp_sock *rs, uint32_t ssrc, struct rtcp_stats *stats)
 	if (!sess || !stats)
 		return EINVAL;
 
+	lock_read_get(sess->lock);
+
 	mbr = member_find(sess->members, ssrc);
-	if (!mbr)
+	if (!mbr) {
+		lock_rel(sess->lock);
 		return ENOENT;
+	}
 
-	lock_read_get(sess->lock);
 	stats->tx.sent = sess->txstat.psent;
-	lock_rel(sess->lock);
 
 	stats->tx.lost = mbr->cum_lost;
 	stats->tx.jit  = mbr->jit;
 
 	if (!mbr->s) {
 		memset(&stats->rx, 0, sizeof(stats->rx));
-		return 0;
+	}
+	else {
+		stats->rx.sent = mbr->s->received;
+		stats->rx.lost = source_calc_lost(mbr->s);
+		stats->rx.jit  = sess->srate_rx ?
+			1000000 * (mbr->s->jitter>>4) / sess->srate_rx : 0;
 	}
 
-	stats->rx.sent = mbr->s->received;
-	stats->rx.lost = source_calc_lost(mbr->s);
-	stats->rx.jit  = sess->srate_rx ?
-		1000000 * (mbr->s->jitter>>4) / sess->srate_rx : 0;
+	lock_rel(sess->lock);
 
 	return 0;
 }
@@ -659,11 +755,13 @@ int rtcp_debug(struct re_printf *pf, const struct rtp_sock *rs)
 			  rtp_sess_ssrc(sess->rs), rtp_sess_ssrc(sess->rs),
 			  sess->srate_rx);
 
+	lock_read_get(sess->lock);
+
 	hash_apply(sess->members, debug_handler, pf);
 
-	lock_read_get(sess->lock);
 	err |= re_hprintf(pf, "  TX: packets=%u, octets=%u\n",
 			  sess->txstat.psent, sess->txstat.osent);
+
 	lock_rel(sess->lock);
 
 	return err;
@@ -87,9 +87,21 @@ A million repetitions of "a"
 
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <re_types.h>
 #include <re_sha.h>
 
+#if defined (HAVE_NEON) && defined (__aarch64__) && \
+	defined (__ARM_FEATURE_CRYPTO)
+#include <arm_neon.h>
+#define SHA1_NEON 1
+#elif defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define SHA1_SHANI 1
+#endif
+
 void SHA1_Transform(uint32_t state[5], const uint8_t buffer[64]);
 
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
@@ -186,6 +198,252 @@ void SHA1_Transform(uint32_t state[5], const uint8_t buffer[64])
 }
 
 
+/*
+ * The block transform is selected at runtime. SHA1_Update() hands it all
+ * complete blocks of the input in one call, so the accelerated kernels
+ * keep the state in registers across blocks.
+ */
+
+
+typedef void (sha1_transform_h)(uint32_t state[5], const uint8_t *data,
+				size_t nblk);
+
+
+static void transform_generic(uint32_t state[5], const uint8_t *data,
+			      size_t nblk)
+{
+	while (nblk--) {
+		SHA1_Transform(state, data);
+		data += 64;
+	}
+}
+
+
+#ifdef SHA1_SHANI
+/* Rounds 4i..4i+3 of the steady state, scheduling the message 12 ahead */
+#define SHANI_R4(ea, eb, m0, m1, m2, m3, f)			\
+	ea   = _mm_sha1nexte_epu32(ea, m0);				\
+	eb   = abcd;						\
+	m1   = _mm_sha1msg2_epu32(m1, m0);			\
+	abcd = _mm_sha1rnds4_epu32(abcd, ea, f);		\
+	m3   = _mm_sha1msg1_epu32(m3, m0);			\
+	m2   = _mm_xor_si128(m2, m0)
+
+
+__attribute__((target("sha,sse4.1")))
+static void transform_shani(uint32_t state[5], const uint8_t *data,
+			    size_t nblk)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+					    0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_loadu_si128((const __m128i *)(void *)state);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0   = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (nblk--) {
+
+		abcd_save = abcd;
+		e0_save   = e0;
+
+		/* Rounds 0-3 */
+		msg0 = _mm_loadu_si128((const __m128i *)(data + 0));
+		msg0 = _mm_shuffle_epi8(msg0, mask);
+		e0   = _mm_add_epi32(e0, msg0);
+		e1   = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		/* Rounds 4-7 */
+		msg1 = _mm_loadu_si128((const __m128i *)(data + 16));
+		msg1 = _mm_shuffle_epi8(msg1, mask);
+		e1   = _mm_sha1nexte_epu32(e1, msg1);
+		e0   = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+		/* Rounds 8-11 */
+		msg2 = _mm_loadu_si128((const __m128i *)(data + 32));
+		msg2 = _mm_shuffle_epi8(msg2, mask);
+		e0   = _mm_sha1nexte_epu32(e0, msg2);
+		e1   = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+		msg0 = _mm_xor_si128(msg0, msg2);
+
+		msg3 = _mm_loadu_si128((const __m128i *)(data + 48));
+		msg3 = _mm_shuffle_epi8(msg3, mask);
+
+		SHANI_R4(e1, e0, msg3, msg0, msg1, msg2, 0); /* 12-15 */
+		SHANI_R4(e0, e1, msg0, msg1, msg2, msg3, 0); /* 16-19 */
+		SHANI_R4(e1, e0, msg1, msg2, msg3, msg0, 1); /* 20-23 */
+		SHANI_R4(e0, e1, msg2, msg3, msg0, msg1, 1); /* 24-27 */
+		SHANI_R4(e1, e0, msg3, msg0, msg1, msg2, 1); /* 28-31 */
+		SHANI_R4(e0, e1, msg0, msg1, msg2, msg3, 1); /* 32-35 */
+		SHANI_R4(e1, e0, msg1, msg2, msg3, msg0, 1); /* 36-39 */
+		SHANI_R4(e0, e1, msg2, msg3, msg0, msg1, 2); /* 40-43 */
+		SHANI_R4(e1, e0, msg3, msg0, msg1, msg2, 2); /* 44-47 */
+		SHANI_R4(e0, e1, msg0, msg1, msg2, msg3, 2); /* 48-51 */
+		SHANI_R4(e1, e0, msg1, msg2, msg3, msg0, 2); /* 52-55 */
+		SHANI_R4(e0, e1, msg2, msg3, msg0, msg1, 2); /* 56-59 */
+		SHANI_R4(e1, e0, msg3, msg0, msg1, msg2, 3); /* 60-63 */
+		SHANI_R4(e0, e1, msg0, msg1, msg2, msg3, 3); /* 64-67 */
+
+		/* Rounds 68-71 */
+		e1   = _mm_sha1nexte_epu32(e1, msg1);
+		e0   = abcd;
+		msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+		msg3 = _mm_xor_si128(msg3, msg1);
+
+		/* Rounds 72-75 */
+		e0   = _mm_sha1nexte_epu32(e0, msg2);
+		e1   = abcd;
+		msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+		/* Rounds 76-79 */
+		e1   = _mm_sha1nexte_epu32(e1, msg3);
+		e0   = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+		e0   = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+
+		data += 64;
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i *)(void *)state, abcd);
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+#endif
+
+
+#ifdef SHA1_NEON
+/* Rounds 4i..4i+3: hash with one message vector, schedule the next */
+#define NEON_R4(op, ea, eb, tmp, k, m0, m1, m2, m3)			\
+	eb   = vsha1h_u32(vgetq_lane_u32(abcd, 0));			\
+	abcd = op(abcd, ea, tmp);					\
+	tmp  = vaddq_u32(m0, vdupq_n_u32(k));				\
+	m1   = vsha1su1q_u32(m1, m0);					\
+	m2   = vsha1su0q_u32(m2, m3, m0)
+
+
+static void transform_neon(uint32_t state[5], const uint8_t *data,
+			   size_t nblk)
+{
+	const uint32_t k0 = 0x5a827999, k1 = 0x6ed9eba1;
+	const uint32_t k2 = 0x8f1bbcdc, k3 = 0xca62c1d6;
+	uint32x4_t abcd, abcd_save, tmp0, tmp1;
+	uint32x4_t msg0, msg1, msg2, msg3;
+	uint32_t e0, e0_save, e1;
+
+	abcd = vld1q_u32(state);
+	e0   = state[4];
+
+	while (nblk--) {
+
+		abcd_save = abcd;
+		e0_save   = e0;
+
+		msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+		msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		tmp0 = vaddq_u32(msg0, vdupq_n_u32(k0));
+		tmp1 = vaddq_u32(msg1, vdupq_n_u32(k0));
+
+		/* Rounds 0-3 */
+		e1   = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e0, tmp0);
+		tmp0 = vaddq_u32(msg2, vdupq_n_u32(k0));
+		msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+		/* Rounds 4-7 */
+		e0   = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1cq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(k0));
+		msg0 = vsha1su1q_u32(msg0, msg3);
+		msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+		NEON_R4(vsha1cq_u32, e0, e1, tmp0, k0, msg0, msg1, msg2, msg3);
+		NEON_R4(vsha1cq_u32, e1, e0, tmp1, k1, msg1, msg2, msg3, msg0);
+		NEON_R4(vsha1cq_u32, e0, e1, tmp0, k1, msg2, msg3, msg0, msg1);
+		NEON_R4(vsha1pq_u32, e1, e0, tmp1, k1, msg3, msg0, msg1, msg2);
+		NEON_R4(vsha1pq_u32, e0, e1, tmp0, k1, msg0, msg1, msg2, msg3);
+		NEON_R4(vsha1pq_u32, e1, e0, tmp1, k1, msg1, msg2, msg3, msg0);
+		NEON_R4(vsha1pq_u32, e0, e1, tmp0, k2, msg2, msg3, msg0, msg1);
+		NEON_R4(vsha1pq_u32, e1, e0, tmp1, k2, msg3, msg0, msg1, msg2);
+		NEON_R4(vsha1mq_u32, e0, e1, tmp0, k2, msg0, msg1, msg2, msg3);
+		NEON_R4(vsha1mq_u32, e1, e0, tmp1, k2, msg1, msg2, msg3, msg0);
+		NEON_R4(vsha1mq_u32, e0, e1, tmp0, k2, msg2, msg3, msg0, msg1);
+		NEON_R4(vsha1mq_u32, e1, e0, tmp1, k3, msg3, msg0, msg1, msg2);
+		NEON_R4(vsha1mq_u32, e0, e1, tmp0, k3, msg0, msg1, msg2, msg3);
+		NEON_R4(vsha1pq_u32, e1, e0, tmp1, k3, msg1, msg2, msg3, msg0);
+		NEON_R4(vsha1pq_u32, e0, e1, tmp0, k3, msg2, msg3, msg0, msg1);
+
+		/* Rounds 68-71 */
+		e0   = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+		tmp1 = vaddq_u32(msg3, vdupq_n_u32(k3));
+		msg0 = vsha1su1q_u32(msg0, msg3);
+
+		/* Rounds 72-75 */
+		e1   = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e0, tmp0);
+
+		/* Rounds 76-79 */
+		e0   = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+		abcd = vsha1pq_u32(abcd, e1, tmp1);
+
+		e0  += e0_save;
+		abcd = vaddq_u32(abcd_save, abcd);
+
+		data += 64;
+	}
+
+	vst1q_u32(state, abcd);
+	state[4] = e0;
+}
+#endif
+
+
+static sha1_transform_h *transform_select(void)
+{
+#if defined (SHA1_NEON)
+	return transform_neon;
+#elif defined (SHA1_SHANI)
+	if (__builtin_cpu_supports("sha") &&
+	    __builtin_cpu_supports("sse4.1"))
+		return transform_shani;
+	return transform_generic;
+#else
+	return transform_generic;
+#endif
+}
+
+
+/*
+ * The transform is selected once, before the first context is used.
+ * With threads, pthread_once() makes the selection visible to all of
+ * them; contexts handed to another thread are published with it.
+ */
+static sha1_transform_h *sha1_transform;
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t transform_once = PTHREAD_ONCE_INIT;
+#endif
+
+
+static void transform_init(void)
+{
+	sha1_transform = transform_select();
+}
+
+
 /**
  * Initialize new context
  *
@@ -200,6 +458,13 @@ void SHA1_Init(SHA1_CTX* context)
 	context->state[3] = 0x10325476;
 	context->state[4] = 0xc3d2e1f0;
 	context->count[0] = context->count[1] = 0;
+
+#ifdef HAVE_PTHREAD
+	(void)pthread_once(&transform_once, transform_init);
+#else
+	if (!sha1_transform)
+		transform_init();
+#endif
 }
 
 
@@ -220,9 +485,12 @@ void SHA1_Update(SHA1_CTX* context, const uint8_t* data, const size_t len)
 	context->count[1] += (uint32_t)(len >> 29);
 	if ((j + len) > 63) {
 		memcpy(&context->buffer[j], data, (i = 64-j));
-		SHA1_Transform(context->state, context->buffer);
-		for ( ; i + 63 < len; i += 64) {
-			SHA1_Transform(context->state, data + i);
+		sha1_transform(context->state, context->buffer, 1);
+		if (len - i >= 64) {
+			const size_t nblk = (len - i) / 64;
+
+			sha1_transform(context->state, data + i, nblk);
+			i += nblk * 64;
 		}
 		j = 0;
 	}
@@ -239,17 +507,18 @@ void SHA1_Update(SHA1_CTX* context, const uint8_t* data, const size_t len)
  */
 void SHA1_Final(uint8_t digest[SHA1_DIGEST_SIZE], SHA1_CTX* context)
 {
-	uint32_t i;
+	static const uint8_t pad[64] = {0x80};
+	uint32_t i, j;
 	uint8_t  finalcount[8];
 
 	for (i = 0; i < 8; i++) {
 		finalcount[i] = (uint8_t)((context->count[(i >= 4 ? 0 : 1)]
 					   >> ((3-(i & 3)) * 8) ) & 255);
 	}
-	SHA1_Update(context, (uint8_t *)"\200", 1);
-	while ((context->count[0] & 504) != 448) {
-		SHA1_Update(context, (uint8_t *)"\0", 1);
-	}
+
+	/* pad to 56 mod 64 in one go rather than a byte at a time */
+	j = (context->count[0] >> 3) & 63;
+	SHA1_Update(context, pad, j < 56 ? 56 - j : 120 - j);
 	SHA1_Update(context, finalcount, 8); /* Should cause SHA1_Transform */
 	for (i = 0; i < SHA1_DIGEST_SIZE; i++) {
 		digest[i] = (uint8_t)
@@ -262,8 +531,4 @@ void SHA1_Final(uint8_t digest[SHA1_DIGEST_SIZE], SHA1_CTX* context)
 	memset(context->state, 0, 20);
 	memset(context->count, 0, 8);
 	memset(finalcount, 0, 8);	/* SWR */
-
-#ifdef SHA1HANDSOFF  /* make SHA1Transform overwrite its own static vars */
-	SHA1_Transform(context->state, context->buffer);
-#endif
 }
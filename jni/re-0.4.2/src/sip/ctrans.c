@@ -204,7 +204,7 @@ static void retransmit_handler(void *arg)
 	tmr_start(&ct->tmre, timeout, retransmit_handler, ct);
 
 	err = sip_transp_send(&ct->qent, ct->sip, NULL, ct->tp, &ct->dst,
-			      ct->mb, transport_handler, ct);
+			      ct->mb, true, transport_handler, ct);
 	if (err) {
 		terminate(ct, err);
 		mem_deref(ct);
@@ -233,8 +233,9 @@ static void invite_response(struct sip_ctrans *ct, const struct sip_msg *msg)
 			ct->state = COMPLETED;
 
 			(void)request_copy(&ct->mb_ack, ct, "ACK", msg);
-			(void)sip_send(ct->sip, NULL, ct->tp, &ct->dst,
-				       ct->mb_ack);
+			(void)sip_transp_send(NULL, ct->sip, NULL, ct->tp,
+					      &ct->dst, ct->mb_ack, true,
+					      NULL, NULL);
 
 			ct->resph(0, msg, ct->arg);
 
@@ -251,7 +252,8 @@ static void invite_response(struct sip_ctrans *ct, const struct sip_msg *msg)
 		if (msg->scode < 300)
 			break;
 
-		(void)sip_send(ct->sip, NULL, ct->tp, &ct->dst, ct->mb_ack);
+		(void)sip_transp_send(NULL, ct->sip, NULL, ct->tp, &ct->dst,
+				      ct->mb_ack, true, NULL, NULL);
 		break;
 
 	default:
@@ -334,7 +336,7 @@ int sip_ctrans_request(struct sip_ctrans **ctp, struct sip *sip,
 	ct->resph  = resph ? resph : dummy_handler;
 	ct->arg    = arg;
 
-	err = sip_transp_send(&ct->qent, sip, NULL, tp, dst, mb,
+	err = sip_transp_send(&ct->qent, sip, NULL, tp, dst, mb, true,
 			      transport_handler, ct);
 	if (err)
 		goto out;
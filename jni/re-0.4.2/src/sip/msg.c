@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_sys.h>
@@ -19,53 +20,217 @@
 
 
 enum {
-	HDR_HASH_SIZE = 32,
+	HDR_INLINE    = 24,
 	STARTLINE_MAX = 8192,
 };
 
 
+/*
+ * The headers of a message are kept in two lists. The line list has one
+ * entry per header line, and the value list has one entry per value of
+ * comma separated headers. The first HDR_INLINE headers are stored in
+ * the message allocation, the rest are allocated one by one.
+ */
+struct sip_msg_hdrs {
+	struct sip_msg msg;                /* must be first */
+	struct sip_hdr hdrv[HDR_INLINE];
+	uint32_t hdrc;
+};
+
+
+/* Known header names, by length and then name */
+static const struct hdr_name {
+	const char *name;
+	enum sip_hdrid id;
+} hdr_namev[] = {
+	{"To",                             SIP_HDR_TO},
+	{"Via",                            SIP_HDR_VIA},
+	{"CSeq",                           SIP_HDR_CSEQ},
+	{"Date",                           SIP_HDR_DATE},
+	{"From",                           SIP_HDR_FROM},
+	{"Hide",                           SIP_HDR_HIDE},
+	{"Join",                           SIP_HDR_JOIN},
+	{"Path",                           SIP_HDR_PATH},
+	{"RAck",                           SIP_HDR_RACK},
+	{"RSeq",                           SIP_HDR_RSEQ},
+	{"Allow",                          SIP_HDR_ALLOW},
+	{"Event",                          SIP_HDR_EVENT},
+	{"Route",                          SIP_HDR_ROUTE},
+	{"Accept",                         SIP_HDR_ACCEPT},
+	{"Min-SE",                         SIP_HDR_MIN_SE},
+	{"Reason",                         SIP_HDR_REASON},
+	{"Server",                         SIP_HDR_SERVER},
+	{"Call-ID",                        SIP_HDR_CALL_ID},
+	{"Contact",                        SIP_HDR_CONTACT},
+	{"Expires",                        SIP_HDR_EXPIRES},
+	{"Privacy",                        SIP_HDR_PRIVACY},
+	{"Require",                        SIP_HDR_REQUIRE},
+	{"Subject",                        SIP_HDR_SUBJECT},
+	{"Warning",                        SIP_HDR_WARNING},
+	{"Identity",                       SIP_HDR_IDENTITY},
+	{"Priority",                       SIP_HDR_PRIORITY},
+	{"Refer-To",                       SIP_HDR_REFER_TO},
+	{"Replaces",                       SIP_HDR_REPLACES},
+	{"Reply-To",                       SIP_HDR_REPLY_TO},
+	{"SIP-ETag",                       SIP_HDR_SIP_ETAG},
+	{"Call-Info",                      SIP_HDR_CALL_INFO},
+	{"Refer-Sub",                      SIP_HDR_REFER_SUB},
+	{"Supported",                      SIP_HDR_SUPPORTED},
+	{"Timestamp",                      SIP_HDR_TIMESTAMP},
+	{"Alert-Info",                     SIP_HDR_ALERT_INFO},
+	{"Encryption",                     SIP_HDR_ENCRYPTION},
+	{"Error-Info",                     SIP_HDR_ERROR_INFO},
+	{"Flow-Timer",                     SIP_HDR_FLOW_TIMER},
+	{"P-DCS-LAES",                     SIP_HDR_P_DCS_LAES},
+	{"P-DCS-OSPS",                     SIP_HDR_P_DCS_OSPS},
+	{"User-Agent",                     SIP_HDR_USER_AGENT},
+	{"Answer-Mode",                    SIP_HDR_ANSWER_MODE},
+	{"In-Reply-To",                    SIP_HDR_IN_REPLY_TO},
+	{"Max-Breadth",                    SIP_HDR_MAX_BREADTH},
+	{"Min-Expires",                    SIP_HDR_MIN_EXPIRES},
+	{"Referred-By",                    SIP_HDR_REFERRED_BY},
+	{"Retry-After",                    SIP_HDR_RETRY_AFTER},
+	{"Unsupported",                    SIP_HDR_UNSUPPORTED},
+	{"Allow-Events",                   SIP_HDR_ALLOW_EVENTS},
+	{"Content-Type",                   SIP_HDR_CONTENT_TYPE},
+	{"History-Info",                   SIP_HDR_HISTORY_INFO},
+	{"Max-Forwards",                   SIP_HDR_MAX_FORWARDS},
+	{"MIME-Version",                   SIP_HDR_MIME_VERSION},
+	{"Organization",                   SIP_HDR_ORGANIZATION},
+	{"Record-Route",                   SIP_HDR_RECORD_ROUTE},
+	{"Response-Key",                   SIP_HDR_RESPONSE_KEY},
+	{"SIP-If-Match",                   SIP_HDR_SIP_IF_MATCH},
+	{"Authorization",                  SIP_HDR_AUTHORIZATION},
+	{"Identity-Info",                  SIP_HDR_IDENTITY_INFO},
+	{"P-Early-Media",                  SIP_HDR_P_EARLY_MEDIA},
+	{"P-Profile-Key",                  SIP_HDR_P_PROFILE_KEY},
+	{"P-Served-User",                  SIP_HDR_P_SERVED_USER},
+	{"Proxy-Require",                  SIP_HDR_PROXY_REQUIRE},
+	{"Service-Route",                  SIP_HDR_SERVICE_ROUTE},
+	{"Target-Dialog",                  SIP_HDR_TARGET_DIALOG},
+	{"Accept-Contact",                 SIP_HDR_ACCEPT_CONTACT},
+	{"Content-Length",                 SIP_HDR_CONTENT_LENGTH},
+	{"P-Answer-State",                 SIP_HDR_P_ANSWER_STATE},
+	{"P-DCS-Redirect",                 SIP_HDR_P_DCS_REDIRECT},
+	{"Reject-Contact",                 SIP_HDR_REJECT_CONTACT},
+	{"Accept-Encoding",                SIP_HDR_ACCEPT_ENCODING},
+	{"Accept-Language",                SIP_HDR_ACCEPT_LANGUAGE},
+	{"P-User-Database",                SIP_HDR_P_USER_DATABASE},
+	{"Security-Client",                SIP_HDR_SECURITY_CLIENT},
+	{"Security-Server",                SIP_HDR_SECURITY_SERVER},
+	{"Security-Verify",                SIP_HDR_SECURITY_VERIFY},
+	{"Session-Expires",                SIP_HDR_SESSION_EXPIRES},
+	{"Trigger-Consent",                SIP_HDR_TRIGGER_CONSENT},
+	{"Content-Encoding",               SIP_HDR_CONTENT_ENCODING},
+	{"Content-Language",               SIP_HDR_CONTENT_LANGUAGE},
+	{"P-Associated-URI",               SIP_HDR_P_ASSOCIATED_URI},
+	{"Priv-Answer-Mode",               SIP_HDR_PRIV_ANSWER_MODE},
+	{"WWW-Authenticate",               SIP_HDR_WWW_AUTHENTICATE},
+	{"P-Called-Party-ID",              SIP_HDR_P_CALLED_PARTY_ID},
+	{"P-Charging-Vector",              SIP_HDR_P_CHARGING_VECTOR},
+	{"Resource-Priority",              SIP_HDR_RESOURCE_PRIORITY},
+	{"P-DCS-Billing-Info",             SIP_HDR_P_DCS_BILLING_INFO},
+	{"P-Refused-URI-List",             SIP_HDR_P_REFUSED_URI_LIST},
+	{"Permission-Missing",             SIP_HDR_PERMISSION_MISSING},
+	{"Proxy-Authenticate",             SIP_HDR_PROXY_AUTHENTICATE},
+	{"Subscription-State",             SIP_HDR_SUBSCRIPTION_STATE},
+	{"Authentication-Info",            SIP_HDR_AUTHENTICATION_INFO},
+	{"Content-Disposition",            SIP_HDR_CONTENT_DISPOSITION},
+	{"P-Asserted-Identity",            SIP_HDR_P_ASSERTED_IDENTITY},
+	{"Proxy-Authorization",            SIP_HDR_PROXY_AUTHORIZATION},
+	{"Request-Disposition",            SIP_HDR_REQUEST_DISPOSITION},
+	{"P-DCS-Trace-Party-ID",           SIP_HDR_P_DCS_TRACE_PARTY_ID},
+	{"P-Preferred-Identity",           SIP_HDR_P_PREFERRED_IDENTITY},
+	{"P-Visited-Network-ID",           SIP_HDR_P_VISITED_NETWORK_ID},
+	{"P-Access-Network-Info",          SIP_HDR_P_ACCESS_NETWORK_INFO},
+	{"P-Media-Authorization",          SIP_HDR_P_MEDIA_AUTHORIZATION},
+	{"Accept-Resource-Priority",       SIP_HDR_ACCEPT_RESOURCE_PRIORITY},
+	{"P-Charging-Function-Addresses",  SIP_HDR_P_CHARGING_FUNCTION_ADDRESSES},
+};
+
+/* Index of the first name of each length in hdr_namev */
+static const uint8_t hdr_lenv[] = {
+	0, 0, 0, 1, 2, 10, 13, 17, 24, 30, 34, 41, 48, 57, 65, 70, 78,
+	83, 86, 91, 96, 99, 101, 101, 101, 102, 102, 102, 102, 102,
+	103,
+};
+
+
+static inline bool hdr_isinline(const struct sip_msg_hdrs *mh,
+				const struct sip_hdr *hdr)
+{
+	return hdr >= mh->hdrv && hdr < &mh->hdrv[HDR_INLINE];
+}
+
+
 static void hdr_destructor(void *arg)
 {
 	struct sip_hdr *hdr = arg;
 
 	list_unlink(&hdr->le);
-	hash_unlink(&hdr->he);
+	list_unlink(&hdr->he);
+}
+
+
+static void hdr_list_flush(struct sip_msg_hdrs *mh, struct list *lst,
+			   bool line)
+{
+	struct le *le = list_head(lst);
+
+	while (le) {
+		struct sip_hdr *hdr = le->data;
+
+		le = le->next;
+
+		list_unlink(line ? &hdr->le : &hdr->he);
+
+		if (!hdr_isinline(mh, hdr))
+			mem_deref(hdr);
+	}
 }
 
 
 static void destructor(void *arg)
 {
-	struct sip_msg *msg = arg;
+	struct sip_msg_hdrs *mh = arg;
+	struct sip_msg *msg = &mh->msg;
 
-	list_flush(&msg->hdrl);
-	hash_flush(msg->hdrht);
-	mem_deref(msg->hdrht);
+	hdr_list_flush(mh, &msg->hdrl, true);
+	hdr_list_flush(mh, &msg->hdrvl, false);
 	mem_deref(msg->sock);
 	mem_deref(msg->mb);
 }
 
 
-static enum sip_hdrid hdr_hash(const struct pl *name)
+static enum sip_hdrid hdr_id(const struct pl *name)
 {
-	if (!name->l)
-		return SIP_HDR_NONE;
+	unsigned i;
+	size_t k;
 
 	if (name->l > 1) {
-		switch (name->p[0]) {
 
-		case 'x':
-		case 'X':
-			if (name->p[1] == '-')
-				return SIP_HDR_NONE;
+		if (name->l + 1 >= ARRAY_SIZE(hdr_lenv))
+			return SIP_HDR_NONE;
 
-			/*@fallthrough@*/
+		for (i = hdr_lenv[name->l]; i < hdr_lenv[name->l + 1]; i++) {
 
-		default:
-			return (enum sip_hdrid)
-				(hash_joaat_ci(name->p, name->l) & 0xfff);
+			const char *str = hdr_namev[i].name;
+
+			for (k=0; k<name->l; k++) {
+				if (tolower(name->p[k]) != tolower(str[k]))
+					break;
+			}
+
+			if (k == name->l)
+				return hdr_namev[i].id;
 		}
+
+		return SIP_HDR_NONE;
 	}
 
+	if (!name->l)
+		return SIP_HDR_NONE;
+
 	/* compact headers */
 	switch (tolower(name->p[0])) {
 
@@ -148,39 +313,56 @@ static inline bool hdr_comma_separated(enum sip_hdrid id)
 }
 
 
-static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
+static inline int hdr_add(struct sip_msg_hdrs *mh, const struct pl *name,
 			  enum sip_hdrid id, const char *p, ssize_t l,
 			  bool atomic, bool line)
 {
-	struct sip_hdr *hdr;
+	struct sip_msg *msg = &mh->msg;
+	struct sip_hdr *hdr, tmp;
 	int err = 0;
 
-	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
-	if (!hdr)
-		return ENOMEM;
+	switch (id) {
+
+	case SIP_HDR_VIA:
+	case SIP_HDR_ROUTE:
+		line = atomic;
+		break;
+
+	default:
+		break;
+	}
+
+	if (!atomic && !line) {
+		hdr = &tmp;
+	}
+	else if (mh->hdrc < HDR_INLINE) {
+		hdr = &mh->hdrv[mh->hdrc++];
+		memset(hdr, 0, sizeof(*hdr));
+	}
+	else {
+		hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
+		if (!hdr)
+			return ENOMEM;
+	}
 
 	hdr->name  = *name;
 	hdr->val.p = p;
 	hdr->val.l = MAX(l, 0);
 	hdr->id    = id;
 
-	switch (id) {
-
-	case SIP_HDR_VIA:
-	case SIP_HDR_ROUTE:
-		if (!atomic)
-			break;
+	if (hdr != &tmp) {
 
-		hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
-		list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
-		break;
+		const bool heap = !hdr_isinline(mh, hdr);
 
-	default:
 		if (atomic)
-			hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
+			list_append(&msg->hdrvl, &hdr->he,
+				    heap ? mem_ref(hdr) : hdr);
 		if (line)
-			list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
-		break;
+			list_append(&msg->hdrl, &hdr->le,
+				    heap ? mem_ref(hdr) : hdr);
+
+		if (heap)
+			mem_deref(hdr);
 	}
 
 	/* parse common headers */
@@ -242,12 +424,54 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 	}
 
-	mem_deref(hdr);
-
 	return err;
 }
 
 
+/* Start line, "<x> <y> <z>" followed by the end of line */
+static bool startline_decode(struct pl *x, struct pl *y, struct pl *z,
+			     const char **eolp, const char *p, size_t l)
+{
+	const char *end = p + l;
+	struct pl *tokv[2];
+	int i;
+
+	tokv[0] = x;
+	tokv[1] = y;
+
+	for (i=0; i<2; i++) {
+
+		tokv[i]->p = p;
+
+		while (p < end && *p != ' ' && *p != '\t' &&
+		       *p != '\r' && *p != '\n')
+			++p;
+
+		tokv[i]->l = p - tokv[i]->p;
+
+		if (!tokv[i]->l || p == end || *p++ != ' ')
+			return false;
+	}
+
+	z->p = p;
+
+	while (p < end && *p != '\r' && *p != '\n')
+		++p;
+
+	z->l = p - z->p;
+
+	while (p < end && *p == '\r')
+		++p;
+
+	if (p == end || *p++ != '\n')
+		return false;
+
+	*eolp = p;
+
+	return true;
+}
+
+
 /**
  * Decode a SIP message
  *
@@ -258,8 +482,9 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
  */
 int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 {
-	struct pl x, y, z, e, name;
-	const char *p, *v, *cv;
+	struct pl x, y, z, name;
+	const char *p, *v, *cv, *eol;
+	struct sip_msg_hdrs *mh;
 	struct sip_msg *msg;
 	bool comsep, quote;
 	enum sip_hdrid id = SIP_HDR_NONE;
@@ -273,17 +498,18 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 	p = (const char *)mbuf_buf(mb);
 	l = mbuf_get_left(mb);
 
-	if (re_regex(p, l, "[^ \t\r\n]+ [^ \t\r\n]+ [^\r\n]*[\r]*[\n]1",
-		     &x, &y, &z, NULL, &e) || x.p != (char *)mbuf_buf(mb))
+	if (!startline_decode(&x, &y, &z, &eol, p, l))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
-	msg = mem_zalloc(sizeof(*msg), destructor);
-	if (!msg)
+	/* the inline headers are cleared when they are taken */
+	mh = mem_alloc(sizeof(*mh), destructor);
+	if (!mh)
 		return ENOMEM;
 
-	err = hash_alloc(&msg->hdrht, HDR_HASH_SIZE);
-	if (err)
-		goto out;
+	memset(&mh->msg, 0, sizeof(mh->msg));
+	mh->hdrc = 0;
+
+	msg = &mh->msg;
 
 	msg->tag = rand_u64();
 	msg->mb  = mem_ref(mb);
@@ -311,8 +537,8 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 		}
 	}
 
-	l -= e.p + e.l - p;
-	p = e.p + e.l;
+	l -= eol - p;
+	p = eol;
 
 	name.p = v = cv = NULL;
 	name.l = ws = lf = 0;
@@ -351,7 +577,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 					goto out;
 				}
 
-				err = hdr_add(msg, &name, id, cv ? cv : p,
+				err = hdr_add(mh, &name, id, cv ? cv : p,
 					      cv ? p - cv - ws : 0,
 					      true, cv == v && lf);
 				if (err)
@@ -363,7 +589,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 				}
 
 				if (cv != v) {
-					err = hdr_add(msg, &name, id,
+					err = hdr_add(mh, &name, id,
 						      v ? v : p,
 						      v ? p - v - ws : 0,
 						      false, true);
@@ -400,7 +626,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 					goto out;
 				}
 
-				id = hdr_hash(&name);
+				id = hdr_id(&name);
 				comsep = hdr_comma_separated(id);
 				break;
 			}
@@ -465,15 +691,12 @@ const struct sip_hdr *sip_msg_hdr_apply(const struct sip_msg *msg,
 					bool fwd, enum sip_hdrid id,
 					sip_hdr_h *h, void *arg)
 {
-	struct list *lst;
 	struct le *le;
 
 	if (!msg)
 		return NULL;
 
-	lst = hash_list(msg->hdrht, id);
-
-	le = fwd ? list_head(lst) : list_tail(lst);
+	le = fwd ? list_head(&msg->hdrvl) : list_tail(&msg->hdrvl);
 
 	while (le) {
 		const struct sip_hdr *hdr = le->data;
@@ -520,7 +743,6 @@ const struct sip_hdr *sip_msg_xhdr_apply(const struct sip_msg *msg,
 					 bool fwd, const char *name,
 					 sip_hdr_h *h, void *arg)
 {
-	struct list *lst;
 	struct le *le;
 	struct pl pl;
 
@@ -529,9 +751,7 @@ const struct sip_hdr *sip_msg_xhdr_apply(const struct sip_msg *msg,
 
 	pl_set_str(&pl, name);
 
-	lst = hash_list(msg->hdrht, hdr_hash(&pl));
-
-	le = fwd ? list_head(lst) : list_tail(lst);
+	le = fwd ? list_head(&msg->hdrvl) : list_tail(&msg->hdrvl);
 
 	while (le) {
 		const struct sip_hdr *hdr = le->data;
@@ -649,23 +869,19 @@ bool sip_msg_xhdr_has_value(const struct sip_msg *msg, const char *name,
 void sip_msg_dump(const struct sip_msg *msg)
 {
 	struct le *le;
-	uint32_t i;
 
 	if (!msg)
 		return;
 
-	for (i=0; i<HDR_HASH_SIZE; i++) {
-
-		le = list_head(hash_list(msg->hdrht, i));
+	le = list_head(&msg->hdrvl);
 
-		while (le) {
-			const struct sip_hdr *hdr = le->data;
+	while (le) {
+		const struct sip_hdr *hdr = le->data;
 
-			le = le->next;
+		le = le->next;
 
-			(void)re_printf("%02u '%r'='%r'\n", i, &hdr->name,
-					&hdr->val);
-		}
+		(void)re_printf("%02u '%r'='%r'\n", hdr->id, &hdr->name,
+				&hdr->val);
 	}
 
 	le = list_head(&msg->hdrl);
@@ -189,7 +189,8 @@ static int request(struct sip_request *req, enum sip_transp tp,
 	mb->pos = 0;
 
 	if (!req->stateful)
-		err = sip_send(req->sip, NULL, tp, dst, mb);
+		err = sip_transp_send(NULL, req->sip, NULL, tp, dst, mb, true,
+				      NULL, NULL);
 	else
 		err = sip_ctrans_request(&req->ct, req->sip, tp, dst, req->met,
 					 branch, mb, response_handler, req);
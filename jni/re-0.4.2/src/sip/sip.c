@@ -159,7 +159,8 @@ void sip_close(struct sip *sip, bool force)
 
 
 /**
- * Send a SIP message
+ * Send a SIP message. The buffer is copied if it must be queued, so it
+ * may be changed after this call.
  *
  * @param sip  SIP stack instance
  * @param sock Optional socket to send from
@@ -172,7 +173,7 @@ void sip_close(struct sip *sip, bool force)
 int sip_send(struct sip *sip, void *sock, enum sip_transp tp,
 	     const struct sa *dst, struct mbuf *mb)
 {
-	return sip_transp_send(NULL, sip, sock, tp, dst, mb, NULL, NULL);
+	return sip_transp_send(NULL, sip, sock, tp, dst, mb, false, NULL, NULL);
 }
 
 
@@ -64,17 +64,24 @@ int  sip_strans_debug(struct re_printf *pf, const struct sip *sip);
 /* transp */
 struct sip_connqent;
 
+/** Framing state of a SIP message stream */
+struct sip_frame {
+	size_t scan;      /**< Bytes scanned without end of headers */
+	size_t msglen;    /**< Length of next message, 0 if unknown */
+};
+
 typedef void(sip_transp_h)(int err, void *arg);
 
 int  sip_transp_init(struct sip *sip, uint32_t sz);
 int  sip_transp_send(struct sip_connqent **qentp, struct sip *sip, void *sock,
 		     enum sip_transp tp, const struct sa *dst, struct mbuf *mb,
-		     sip_transp_h *transph, void *arg);
+		     bool ref, sip_transp_h *transph, void *arg);
 int  sip_transp_laddr(struct sip *sip, struct sa *laddr, enum sip_transp tp,
 		      const struct sa *dst);
 bool sip_transp_supported(struct sip *sip, enum sip_transp tp, int af);
 const char *sip_transp_srvid(enum sip_transp tp);
 bool sip_transp_reliable(enum sip_transp tp);
+int  sip_frame(struct sip_frame *fr, const struct mbuf *mb);
 int  sip_transp_debug(struct re_printf *pf, const struct sip *sip);
 
 
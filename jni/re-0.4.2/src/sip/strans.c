@@ -156,8 +156,8 @@ static void retransmit_handler(void *arg)
 {
 	struct sip_strans *st = arg;
 
-	(void)sip_send(st->sip, st->msg->sock, st->msg->tp, &st->dst,
-		       st->mb);
+	(void)sip_transp_send(NULL, st->sip, st->msg->sock, st->msg->tp,
+			      &st->dst, st->mb, true, NULL, NULL);
 
 	st->txc++;
 	tmr_start(&st->tmrg, MIN(SIP_T1<<st->txc, SIP_T2), retransmit_handler,
@@ -245,8 +245,9 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 
 		case PROCEEDING:
 		case COMPLETED:
-			(void)sip_send(st->sip, st->msg->sock, st->msg->tp,
-				       &st->dst, st->mb);
+			(void)sip_transp_send(NULL, st->sip, st->msg->sock,
+					      st->msg->tp, &st->dst, st->mb,
+					      true, NULL, NULL);
 			break;
 
 		default:
@@ -351,7 +352,8 @@ int sip_strans_reply(struct sip_strans **stp, struct sip *sip,
 	st->mb = mem_ref(mb);
 	st->dst = *dst;
 
-	err = sip_send(sip, st->msg->sock, st->msg->tp, dst, mb);
+	err = sip_transp_send(NULL, sip, st->msg->sock, st->msg->tp, dst, mb,
+			      true, NULL, NULL);
 
 	if (stp)
 		*stp = (err || scode >= 200) ? NULL : st;
@@ -52,6 +52,7 @@ struct sip_conn {
 	struct tcp_conn *tc;
 	struct mbuf *mb;
 	struct sip *sip;
+	struct sip_frame frame;
 	uint32_t ka_interval;
 	bool established;
 };
@@ -320,6 +321,117 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
+/* Content-Length of a complete header block, the start line is skipped */
+static int hdr_clen(const char *p, size_t l, uint32_t *clenp)
+{
+	const char *eol;
+
+	while ((eol = memchr(p, '\n', l))) {
+
+		struct pl name, val;
+		const char *q;
+
+		l -= eol + 1 - p;
+		p  = eol + 1;
+
+		name.p = p;
+
+		for (q = p; q < p + l && *q != ':' && *q != ' ' &&
+			     *q != '\t' && *q != '\r' && *q != '\n'; q++)
+			;
+
+		name.l = q - p;
+
+		if (pl_strcasecmp(&name, "Content-Length") &&
+		    pl_strcasecmp(&name, "l"))
+			continue;
+
+		while (q < p + l && (*q == ' ' || *q == '\t'))
+			++q;
+
+		if (q == p + l || *q++ != ':')
+			continue;
+
+		while (q < p + l && (*q == ' ' || *q == '\t'))
+			++q;
+
+		for (val.p = q; q < p + l && *q >= '0' && *q <= '9'; q++)
+			;
+
+		val.l = q - val.p;
+		if (!val.l)
+			return EBADMSG;
+
+		*clenp = pl_u32(&val);
+
+		return 0;
+	}
+
+	return EBADMSG;
+}
+
+
+/**
+ * Find the length of the next message in a SIP stream. The search for
+ * the end of the header block resumes where the previous call stopped,
+ * so each byte of the header is scanned once, however it was split up.
+ *
+ * @param fr Framing state, zeroed for each new message
+ * @param mb Buffer with the start of the stream at the current position
+ *
+ * @return 0 if the message length is known, ENODATA if more data is
+ *         needed, otherwise errorcode
+ */
+int sip_frame(struct sip_frame *fr, const struct mbuf *mb)
+{
+	const char *p = (const char *)mbuf_buf(mb);
+	const size_t l = mbuf_get_left(mb);
+	const char *lf;
+	uint32_t clen;
+	size_t hlen;
+	int err;
+
+	if (fr->msglen)
+		return 0;
+
+	while (fr->scan < l) {
+
+		lf = memchr(p + fr->scan, '\n', l - fr->scan);
+		if (!lf) {
+			fr->scan = l;
+			break;
+		}
+
+		hlen = lf + 1 - p;
+
+		while (hlen < l && p[hlen] == '\r')
+			++hlen;
+
+		if (hlen == l) {
+			fr->scan = lf - p;
+			break;
+		}
+
+		if (p[hlen] != '\n') {
+			fr->scan = hlen;
+			continue;
+		}
+
+		++hlen;
+
+		err = hdr_clen(p, hlen, &clen);
+		if (err)
+			return err;
+
+		fr->msglen = hlen + clen;
+
+		return 0;
+	}
+
+	return ENODATA;
+}
+
+
 static void tcp_recv_handler(struct mbuf *mb, void *arg)
 {
 	struct sip_conn *conn = arg;
@@ -351,7 +463,6 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 
 	for (;;) {
 		struct sip_msg *msg;
-		uint32_t clen;
 		size_t end;
 
 		if (mbuf_get_left(conn->mb) < 2)
@@ -385,32 +496,30 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 			break;
 		}
 
-		pos = conn->mb->pos;
-
-		err = sip_msg_decode(&msg, conn->mb);
+		err = sip_frame(&conn->frame, conn->mb);
 		if (err) {
 			if (err == ENODATA)
 				err = 0;
 			break;
 		}
 
-		if (!msg->clen.p) {
-			mem_deref(msg);
-			err = EBADMSG;
+		if (mbuf_get_left(conn->mb) < conn->frame.msglen)
 			break;
-		}
 
-		clen = pl_u32(&msg->clen);
+		/* the decoder sees exactly one complete message */
+		end = conn->mb->end;
+
+		conn->mb->end = conn->mb->pos + conn->frame.msglen;
+		conn->frame.msglen = 0;
+		conn->frame.scan   = 0;
 
-		if (mbuf_get_left(conn->mb) < clen) {
-			conn->mb->pos = pos;
-			mem_deref(msg);
+		err = sip_msg_decode(&msg, conn->mb);
+		if (err) {
+			if (err == ENODATA)
+				err = EBADMSG;
 			break;
 		}
 
-		end = conn->mb->end;
-
-		msg->mb->end = msg->mb->pos + clen;
 		msg->sock = mem_ref(conn);
 		msg->src = conn->paddr;
 		msg->dst = conn->laddr;
@@ -467,7 +576,7 @@ static void tcp_estab_handler(void *arg)
 			qent->qentp = NULL;
 		}
 
-		err = tcp_send(conn->tc, qent->mb);
+		err = tcp_send_ref(conn->tc, qent->mb);
 		if (err)
 			qent->transph(err, qent->arg);
 
@@ -533,7 +642,7 @@ static void tcp_connect_handler(const struct sa *paddr, void *arg)
 
 
 static int conn_send(struct sip_connqent **qentp, struct sip *sip, bool secure,
-		     const struct sa *dst, struct mbuf *mb,
+		     const struct sa *dst, struct mbuf *mb, bool ref,
 		     sip_transp_h *transph, void *arg)
 {
 	struct sip_conn *conn, *new_conn = NULL;
@@ -545,6 +654,9 @@ static int conn_send(struct sip_connqent **qentp, struct sip *sip, bool secure,
 		if (!conn->established)
 			goto enqueue;
 
+		if (ref)
+			return tcp_send_ref(conn->tc, mb);
+
 		return tcp_send(conn->tc, mb);
 	}
 
@@ -590,7 +702,23 @@ static int conn_send(struct sip_connqent **qentp, struct sip *sip, bool secure,
 	}
 
 	list_append(&conn->ql, &qent->le, qent);
-	qent->mb = mem_ref(mb);
+
+	/* the queue owns its buffers, they are sent without a copy */
+	if (ref) {
+		qent->mb = mem_ref(mb);
+	}
+	else {
+		qent->mb = mbuf_alloc(mbuf_get_left(mb));
+		if (!qent->mb) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		(void)mbuf_write_mem(qent->mb, mbuf_buf(mb),
+				     mbuf_get_left(mb));
+		qent->mb->pos = 0;
+	}
+
 	qent->transph = transph ? transph : internal_transport_handler;
 	qent->arg = arg;
 
@@ -704,9 +832,14 @@ void sip_transp_flush(struct sip *sip)
 }
 
 
+/*
+ * Send a SIP message. With ref, the message is a heap buffer of the stack
+ * which is not changed after sending, and TCP may queue a reference to it
+ * instead of a copy. Buffers of the application are always copied.
+ */
 int sip_transp_send(struct sip_connqent **qentp, struct sip *sip, void *sock,
 		    enum sip_transp tp, const struct sa *dst, struct mbuf *mb,
-		    sip_transp_h *transph, void *arg)
+		    bool ref, sip_transp_h *transph, void *arg)
 {
 	const struct sip_transport *transp;
 	struct sip_conn *conn;
@@ -737,10 +870,12 @@ int sip_transp_send(struct sip_connqent **qentp, struct sip *sip, void *sock,
 	case SIP_TRANSP_TCP:
 		conn = sock;
 
-		if (conn && conn->tc)
+		if (conn && conn->tc && ref)
+			err = tcp_send_ref(conn->tc, mb);
+		else if (conn && conn->tc)
 			err = tcp_send(conn->tc, mb);
 		else
-			err = conn_send(qentp, sip, secure, dst, mb,
+			err = conn_send(qentp, sip, secure, dst, mb, ref,
 					transph, arg);
 		break;
 
@@ -0,0 +1,480 @@
+/**
+ * @file srtp/misc.c  SRTP -- session keys, keystream and streams
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <openssl/evp.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_sha.h>
+#include <re_srtp.h>
+#include "srtp.h"
+
+
+enum {
+	SHA1_BLOCK_SIZE = 64,
+};
+
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new  EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+
+/*
+ * AES Counter Mode (RFC 3711 section 4.1.1)
+ *
+ * The counter blocks of one or more packets are written back to back
+ * into a scratch buffer and encrypted with AES-ECB in one call, which
+ * gives the keystream for all of them. A batch of packets then costs
+ * one cipher call instead of one per packet.
+ */
+
+
+/**
+ * Get the keystream scratch buffer, grown to hold a number of blocks
+ *
+ * @param comp Session keys
+ * @param nblk Number of blocks
+ *
+ * @return Scratch buffer, NULL if out of memory
+ */
+uint8_t *srtp_ks_get(struct srtp_comp *comp, size_t nblk)
+{
+	const size_t size = nblk * SRTP_BLOCK_SIZE;
+
+	if (size > comp->ks_size) {
+
+		uint8_t *ks;
+
+		if (comp->ks)
+			ks = mem_realloc(comp->ks, size);
+		else
+			ks = mem_alloc(size, NULL);
+		if (!ks)
+			return NULL;
+
+		comp->ks      = ks;
+		comp->ks_size = size;
+	}
+
+	return comp->ks;
+}
+
+
+/**
+ * Write the counter blocks of one packet
+ *
+ * IV = (k_s * 2^16) XOR (SSRC * 2^64) XOR (i * 2^16)
+ *
+ * @param blk  Counter blocks
+ * @param nblk Number of blocks
+ * @param k_s  Session salt, shifted 16 bits
+ * @param ssrc Synchronization source
+ * @param ix   Packet index, 48 bits
+ */
+void srtp_ks_counter(uint8_t *blk, size_t nblk, const uint8_t *k_s,
+		     uint32_t ssrc, uint64_t ix)
+{
+	uint8_t iv[SRTP_BLOCK_SIZE];
+	size_t i;
+
+	memcpy(iv, k_s, sizeof(iv));
+
+	iv[4]  ^= ssrc >> 24;
+	iv[5]  ^= ssrc >> 16;
+	iv[6]  ^= ssrc >> 8;
+	iv[7]  ^= ssrc;
+	iv[8]  ^= (uint8_t)(ix >> 40);
+	iv[9]  ^= (uint8_t)(ix >> 32);
+	iv[10] ^= (uint8_t)(ix >> 24);
+	iv[11] ^= (uint8_t)(ix >> 16);
+	iv[12] ^= (uint8_t)(ix >> 8);
+	iv[13] ^= (uint8_t)ix;
+
+	for (i=0; i<nblk; i++) {
+
+		iv[14] = (uint8_t)(i >> 8);
+		iv[15] = (uint8_t)i;
+
+		memcpy(blk, iv, sizeof(iv));
+		blk += SRTP_BLOCK_SIZE;
+	}
+}
+
+
+static int ecb_encrypt(EVP_CIPHER_CTX *ctx, uint8_t *blk, size_t nblk)
+{
+	int len = 0;
+
+	if (!nblk)
+		return 0;
+
+	if (!EVP_EncryptUpdate(ctx, blk, &len, blk,
+			       (int)(nblk * SRTP_BLOCK_SIZE)))
+		return EPROTO;
+
+	return 0;
+}
+
+
+/**
+ * Encrypt counter blocks in place, giving the keystream
+ *
+ * @param comp Session keys
+ * @param ks   Counter blocks
+ * @param nblk Number of blocks
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_ks_encrypt(const struct srtp_comp *comp, uint8_t *ks, size_t nblk)
+{
+	return ecb_encrypt(comp->ctx, ks, nblk);
+}
+
+
+void srtp_ks_xor(uint8_t *p, const uint8_t *ks, size_t n)
+{
+	size_t i = 0;
+
+	/* word at a time where the compiler can vectorise it */
+	for (; i + 8 <= n; i += 8) {
+		uint64_t a, b;
+
+		memcpy(&a, p + i, 8);
+		memcpy(&b, ks + i, 8);
+		a ^= b;
+		memcpy(p + i, &a, 8);
+	}
+
+	for (; i < n; i++)
+		p[i] ^= ks[i];
+}
+
+
+/*
+ * Key derivation (RFC 3711 section 4.3), with a key derivation rate of
+ * zero. The session key for label l is the AES-CM keystream of the
+ * master key, with the IV set to the master salt XOR (l * 2^48).
+ */
+static int derive(EVP_CIPHER_CTX *ctx, uint8_t *out, size_t len,
+		  const uint8_t *master_salt, uint8_t label)
+{
+	uint8_t blk[2 * SRTP_BLOCK_SIZE];
+	uint8_t salt[SRTP_BLOCK_SIZE];
+	const size_t nblk = (len + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+	int err;
+
+	if (nblk * SRTP_BLOCK_SIZE > sizeof(blk))
+		return EINVAL;
+
+	memset(salt, 0, sizeof(salt));
+	memcpy(salt, master_salt, SRTP_MASTER_SALT_SIZE);
+	salt[7] ^= label;
+
+	srtp_ks_counter(blk, nblk, salt, 0, 0);
+
+	err = ecb_encrypt(ctx, blk, nblk);
+	if (!err)
+		memcpy(out, blk, len);
+
+	memset(blk, 0, sizeof(blk));
+
+	return err;
+}
+
+
+static int md_init(EVP_MD_CTX *ctx, const uint8_t *pad, size_t n)
+{
+	if (!EVP_DigestInit_ex(ctx, EVP_sha1(), NULL) ||
+	    !EVP_DigestUpdate(ctx, pad, n))
+		return EPROTO;
+
+	return 0;
+}
+
+
+static EVP_CIPHER_CTX *aes_alloc(const uint8_t *key)
+{
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	if (!ctx)
+		return NULL;
+
+	if (!EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL)) {
+		EVP_CIPHER_CTX_free(ctx);
+		return NULL;
+	}
+
+	(void)EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+	return ctx;
+}
+
+
+/**
+ * Derive the session keys for SRTP or SRTCP
+ *
+ * @param comp        Session keys
+ * @param label       Label of the encryption key, 0 for SRTP, 3 for SRTCP
+ * @param master_key  Master key
+ * @param master_salt Master salt
+ * @param tag_len     Authentication tag length
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_comp_init(struct srtp_comp *comp, uint8_t label,
+		   const uint8_t *master_key, const uint8_t *master_salt,
+		   size_t tag_len)
+{
+	uint8_t k_e[SRTP_MASTER_KEY_SIZE], k_a[SRTP_AUTH_KEY_SIZE];
+	uint8_t pad[SHA1_BLOCK_SIZE];
+	EVP_CIPHER_CTX *mctx;
+	size_t i;
+	int err;
+
+	mctx = aes_alloc(master_key);
+	if (!mctx)
+		return ENOMEM;
+
+	memset(comp->k_s, 0, sizeof(comp->k_s));
+
+	err  = derive(mctx, k_e, sizeof(k_e), master_salt, label);
+	err |= derive(mctx, k_a, sizeof(k_a), master_salt, label + 1);
+	err |= derive(mctx, comp->k_s, SRTP_MASTER_SALT_SIZE,
+		      master_salt, label + 2);
+
+	EVP_CIPHER_CTX_free(mctx);
+
+	if (err)
+		goto out;
+
+	comp->ctx = aes_alloc(k_e);
+	if (!comp->ctx) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	comp->ictx = EVP_MD_CTX_new();
+	comp->octx = EVP_MD_CTX_new();
+	comp->mctx = EVP_MD_CTX_new();
+	if (!comp->ictx || !comp->octx || !comp->mctx) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* HMAC-SHA1, with the padded keys hashed once up front */
+	memset(pad, 0x36, sizeof(pad));
+	for (i=0; i<sizeof(k_a); i++)
+		pad[i] ^= k_a[i];
+
+	err = md_init(comp->ictx, pad, sizeof(pad));
+	if (err)
+		goto out;
+
+	memset(pad, 0x5c, sizeof(pad));
+	for (i=0; i<sizeof(k_a); i++)
+		pad[i] ^= k_a[i];
+
+	err = md_init(comp->octx, pad, sizeof(pad));
+	if (err)
+		goto out;
+
+	comp->tag_len = tag_len;
+
+ out:
+	memset(k_e, 0, sizeof(k_e));
+	memset(k_a, 0, sizeof(k_a));
+	memset(pad, 0, sizeof(pad));
+
+	return err;
+}
+
+
+void srtp_comp_close(struct srtp_comp *comp)
+{
+	if (comp->ctx)
+		EVP_CIPHER_CTX_free(comp->ctx);
+	if (comp->ictx)
+		EVP_MD_CTX_free(comp->ictx);
+	if (comp->octx)
+		EVP_MD_CTX_free(comp->octx);
+	if (comp->mctx)
+		EVP_MD_CTX_free(comp->mctx);
+
+	mem_deref(comp->ks);
+
+	memset(comp, 0, sizeof(*comp));
+}
+
+
+/**
+ * Compute the authentication tag of a packet. The HMAC starts from a
+ * copy of the precomputed inner and outer states.
+ *
+ * @param comp Session keys
+ * @param tag  Authentication tag, comp->tag_len bytes
+ * @param p    Authenticated portion of the packet
+ * @param n    Length of authenticated portion
+ * @param roc  Rollover counter in network byte order, NULL for SRTCP
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_comp_auth(struct srtp_comp *comp, uint8_t *tag,
+		   const uint8_t *p, size_t n, const uint8_t *roc)
+{
+	uint8_t md[SHA_DIGEST_LENGTH];
+	EVP_MD_CTX *ctx = comp->mctx;
+
+	if (!EVP_MD_CTX_copy_ex(ctx, comp->ictx) ||
+	    !EVP_DigestUpdate(ctx, p, n) ||
+	    (roc && !EVP_DigestUpdate(ctx, roc, 4)) ||
+	    !EVP_DigestFinal_ex(ctx, md, NULL))
+		return EPROTO;
+
+	if (!EVP_MD_CTX_copy_ex(ctx, comp->octx) ||
+	    !EVP_DigestUpdate(ctx, md, sizeof(md)) ||
+	    !EVP_DigestFinal_ex(ctx, md, NULL))
+		return EPROTO;
+
+	memcpy(tag, md, comp->tag_len);
+
+	return 0;
+}
+
+
+/** Compare two authentication tags in constant time */
+bool srtp_tag_equal(const uint8_t *a, const uint8_t *b, size_t n)
+{
+	uint8_t d = 0;
+	size_t i;
+
+	for (i=0; i<n; i++)
+		d |= a[i] ^ b[i];
+
+	return d == 0;
+}
+
+
+/*
+ * The streams of a session are shared by SRTP and SRTCP, which may run
+ * on different threads. The list is locked, the fields of a stream are
+ * not: SRTP and SRTCP use separate fields of it.
+ */
+#ifdef HAVE_PTHREAD
+
+static inline void streams_lock(struct srtp *srtp)
+{
+	pthread_mutex_lock(&srtp->mutex);
+}
+
+
+static inline void streams_unlock(struct srtp *srtp)
+{
+	pthread_mutex_unlock(&srtp->mutex);
+}
+
+#else
+
+#define streams_lock(srtp)    /**< Stub */
+#define streams_unlock(srtp)  /**< Stub */
+
+#endif
+
+
+void srtp_streams_init(struct srtp *srtp)
+{
+	list_init(&srtp->streaml);
+
+#ifdef HAVE_PTHREAD
+	(void)pthread_mutex_init(&srtp->mutex, NULL);
+#endif
+}
+
+
+void srtp_streams_close(struct srtp *srtp)
+{
+	/* the streams are only removed here, they are not referenced */
+	list_flush(&srtp->streaml);
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&srtp->mutex);
+#endif
+}
+
+
+static struct srtp_stream *stream_lookup(const struct srtp *srtp,
+					 uint32_t ssrc)
+{
+	struct le *le;
+
+	for (le = srtp->streaml.head; le; le = le->next) {
+
+		struct srtp_stream *strm = le->data;
+
+		if (strm->ssrc == ssrc)
+			return strm;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Find the stream of an SSRC
+ *
+ * @param srtp SRTP Session
+ * @param ssrc Synchronization source
+ *
+ * @return Stream, NULL if not found
+ */
+struct srtp_stream *srtp_stream_find(struct srtp *srtp, uint32_t ssrc)
+{
+	struct srtp_stream *strm;
+
+	streams_lock(srtp);
+	strm = stream_lookup(srtp, ssrc);
+	streams_unlock(srtp);
+
+	return strm;
+}
+
+
+/**
+ * Get the stream of an SSRC, adding it if not found
+ *
+ * @param srtp SRTP Session
+ * @param ssrc Synchronization source
+ *
+ * @return Stream, NULL if out of memory
+ */
+struct srtp_stream *srtp_stream_get(struct srtp *srtp, uint32_t ssrc)
+{
+	struct srtp_stream *strm;
+
+	streams_lock(srtp);
+
+	strm = stream_lookup(srtp, ssrc);
+	if (strm)
+		goto out;
+
+	strm = mem_zalloc(sizeof(*strm), NULL);
+	if (!strm)
+		goto out;
+
+	strm->ssrc = ssrc;
+
+	/* new streams first, they are usually the busy ones */
+	list_prepend(&srtp->streaml, &strm->le, strm);
+
+ out:
+	streams_unlock(srtp);
+
+	return strm;
+}
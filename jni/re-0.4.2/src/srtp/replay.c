@@ -0,0 +1,82 @@
+/**
+ * @file srtp/replay.c  SRTP -- replay protection
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <openssl/evp.h>
+#include <re_types.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_sha.h>
+#include <re_srtp.h>
+#include "srtp.h"
+
+
+/*
+ * Replay protection with a sliding window of 64 packet indices
+ * (RFC 3711 section 3.3.2). Bit n of the bitmap is set when the packet
+ * with index (lix - n) has been received.
+ */
+
+
+enum {
+	REPLAY_WINDOW = 64,
+};
+
+
+/**
+ * Check if a packet index is new, before the packet is authenticated
+ *
+ * @param replay Replay window
+ * @param ix     Packet index
+ *
+ * @return True if the packet is new, false if it is a replay or too old
+ */
+bool srtp_replay_check(const struct srtp_replay *replay, uint64_t ix)
+{
+	uint64_t d;
+
+	if (!replay->init || ix > replay->lix)
+		return true;
+
+	d = replay->lix - ix;
+	if (d >= REPLAY_WINDOW)
+		return false;
+
+	return !(replay->bitmap & ((uint64_t)1 << d));
+}
+
+
+/**
+ * Add a packet index to the window, after the packet is authenticated
+ *
+ * @param replay Replay window
+ * @param ix     Packet index
+ */
+void srtp_replay_update(struct srtp_replay *replay, uint64_t ix)
+{
+	if (!replay->init) {
+		replay->init   = true;
+		replay->lix    = ix;
+		replay->bitmap = 1;
+		return;
+	}
+
+	if (ix > replay->lix) {
+
+		const uint64_t d = ix - replay->lix;
+
+		if (d < REPLAY_WINDOW)
+			replay->bitmap = (replay->bitmap << d) | 1;
+		else
+			replay->bitmap = 1;
+
+		replay->lix = ix;
+	}
+	else {
+		replay->bitmap |= (uint64_t)1 << (replay->lix - ix);
+	}
+}
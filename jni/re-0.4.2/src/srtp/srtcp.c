@@ -0,0 +1,207 @@
+/**
+ * @file srtp/srtcp.c  Secure Real-time Transport Control Protocol
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <openssl/evp.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_sha.h>
+#include <re_srtp.h>
+#include "srtp.h"
+
+
+/*
+ * An SRTCP packet is the RTCP compound packet with everything after the
+ * first SSRC encrypted, followed by the E-flag and 31-bit SRTCP index,
+ * and the authentication tag (RFC 3711 section 3.4).
+ */
+
+
+#define SRTCP_E_FLAG 0x80000000u  /**< Packet is encrypted   */
+#define SRTCP_INDEX  0x7fffffffu  /**< Mask of SRTCP index   */
+
+
+enum {
+	RTCP_HDR_SIZE = 8,
+};
+
+
+static inline uint32_t rtcp_ssrc(const uint8_t *p)
+{
+	return (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+}
+
+
+/* Get the keystream and XOR it with the encrypted portion */
+static int rtcp_crypt(struct srtp *srtp, uint8_t *p, size_t len,
+		      uint32_t ssrc, uint32_t ix)
+{
+	const size_t n = len - RTCP_HDR_SIZE;
+	const size_t nblk = (n + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+	uint8_t *ks;
+	int err;
+
+	if (!nblk)
+		return 0;
+
+	ks = srtp_ks_get(&srtp->rtcp, nblk);
+	if (!ks)
+		return ENOMEM;
+
+	srtp_ks_counter(ks, nblk, srtp->rtcp.k_s, ssrc, ix);
+
+	err = srtp_ks_encrypt(&srtp->rtcp, ks, nblk);
+	if (err)
+		return err;
+
+	srtp_ks_xor(p + RTCP_HDR_SIZE, ks, n);
+
+	return 0;
+}
+
+
+/**
+ * Encrypt an RTCP packet in place, from the current position to the
+ * end of the buffer, and append the SRTCP index and authentication tag
+ *
+ * @param srtp SRTP Session
+ * @param mb   RTCP packet
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	struct srtp_stream *strm;
+	size_t len, start;
+	uint32_t ssrc, ix;
+	uint8_t *p;
+	int err;
+
+	if (!srtp || !mb)
+		return EINVAL;
+
+	start = mb->pos;
+	len   = mbuf_get_left(mb);
+
+	if (len < RTCP_HDR_SIZE)
+		return EBADMSG;
+
+	ssrc = rtcp_ssrc(mbuf_buf(mb));
+
+	strm = srtp_stream_get(srtp, ssrc);
+	if (!strm)
+		return ENOMEM;
+
+	ix = strm->rtcp_index;
+	strm->rtcp_index = (strm->rtcp_index + 1) & SRTCP_INDEX;
+
+	if (mbuf_get_space(mb) < len + 4 + srtp->rtcp.tag_len) {
+		err = mbuf_resize(mb, start + len + 4 + srtp->rtcp.tag_len);
+		if (err)
+			return err;
+	}
+
+	p = mb->buf + start;
+
+	err = rtcp_crypt(srtp, p, len, ssrc, ix);
+	if (err)
+		return err;
+
+	ix |= SRTCP_E_FLAG;
+
+	p[len]   = ix >> 24;
+	p[len+1] = ix >> 16;
+	p[len+2] = ix >> 8;
+	p[len+3] = ix;
+
+	err = srtp_comp_auth(&srtp->rtcp, p + len + 4, p, len + 4, NULL);
+	if (err)
+		return err;
+
+	mb->pos = start;
+	mb->end = start + len + 4 + srtp->rtcp.tag_len;
+
+	return 0;
+}
+
+
+/**
+ * Authenticate and decrypt an SRTCP packet in place, from the current
+ * position to the end of the buffer. The SRTCP index and authentication
+ * tag are removed.
+ *
+ * @param srtp SRTP Session
+ * @param mb   SRTCP packet
+ *
+ * @return 0 if success, EAUTH if authentication failed, EALREADY if the
+ *         packet is a replay, otherwise errorcode
+ */
+int srtcp_decrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	uint8_t tag[SHA_DIGEST_LENGTH];
+	struct srtp_stream *strm, tmp;
+	size_t len, tag_len;
+	uint32_t ssrc, v, ix;
+	uint8_t *p;
+	int err;
+
+	if (!srtp || !mb)
+		return EINVAL;
+
+	tag_len = srtp->rtcp.tag_len;
+
+	if (mbuf_get_left(mb) < RTCP_HDR_SIZE + 4 + tag_len)
+		return EBADMSG;
+
+	p   = mbuf_buf(mb);
+	len = mbuf_get_left(mb) - 4 - tag_len;
+
+	v  = (uint32_t)p[len] << 24 | p[len+1] << 16 | p[len+2] << 8 |
+		p[len+3];
+	ix = v & SRTCP_INDEX;
+
+	ssrc = rtcp_ssrc(p);
+
+	/* a stream is only added when it has authenticated a packet */
+	strm = srtp_stream_find(srtp, ssrc);
+	if (!strm) {
+		memset(&tmp, 0, sizeof(tmp));
+		strm = &tmp;
+	}
+
+	if (!srtp_replay_check(&strm->replay_rtcp, ix))
+		return EALREADY;
+
+	err = srtp_comp_auth(&srtp->rtcp, tag, p, len + 4, NULL);
+	if (err)
+		return err;
+
+	if (!srtp_tag_equal(tag, p + len + 4, tag_len))
+		return EAUTH;
+
+	if (v & SRTCP_E_FLAG) {
+		err = rtcp_crypt(srtp, p, len, ssrc, ix);
+		if (err)
+			return err;
+	}
+
+	if (strm == &tmp) {
+		strm = srtp_stream_get(srtp, ssrc);
+		if (!strm)
+			return ENOMEM;
+	}
+
+	srtp_replay_update(&strm->replay_rtcp, ix);
+
+	mb->end = mb->pos + len;
+
+	return 0;
+}
@@ -0,0 +1,543 @@
+/**
+ * @file srtp/srtp.c  Secure Real-time Transport Protocol (RFC 3711)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <openssl/evp.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_sha.h>
+#include <re_srtp.h>
+#include "srtp.h"
+
+
+/*
+ * Supported crypto suites are AES_CM_128_HMAC_SHA1_80 and
+ * AES_CM_128_HMAC_SHA1_32, with a key derivation rate of zero and no
+ * MKI. One SRTP Session holds the keys of one direction, and the state
+ * of each SSRC seen in that direction.
+ */
+
+
+enum {
+	RTP_HDR_SIZE = 12,
+};
+
+
+/** Position of the payload in one RTP packet of a batch */
+struct pkt {
+	struct mbuf *mb;
+	size_t start;             /**< Offset of RTP header in buffer     */
+	size_t hdr_len;           /**< Length of RTP header               */
+	size_t len;               /**< Length of RTP packet               */
+	size_t blk;               /**< First keystream block              */
+	size_t nblk;              /**< Number of keystream blocks         */
+	uint32_t roc;             /**< Rollover counter                   */
+};
+
+
+static void destructor(void *data)
+{
+	struct srtp *srtp = data;
+
+	srtp_streams_close(srtp);
+	srtp_comp_close(&srtp->rtp);
+	srtp_comp_close(&srtp->rtcp);
+}
+
+
+/**
+ * Allocate a new SRTP Session
+ *
+ * @param srtpp     Pointer to allocated SRTP Session
+ * @param suite     SRTP Crypto suite
+ * @param key       Master key followed by master salt
+ * @param key_bytes Length of key, must be 30 bytes
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
+	       const uint8_t *key, size_t key_bytes)
+{
+	const uint8_t *salt = key + SRTP_MASTER_KEY_SIZE;
+	struct srtp *srtp;
+	size_t tag_len;
+	int err;
+
+	if (!srtpp || !key ||
+	    key_bytes != SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE)
+		return EINVAL;
+
+	switch (suite) {
+
+	case SRTP_AES_CM_128_HMAC_SHA1_32: tag_len = 4;  break;
+	case SRTP_AES_CM_128_HMAC_SHA1_80: tag_len = 10; break;
+	default: return ENOTSUP;
+	}
+
+	srtp = mem_zalloc(sizeof(*srtp), destructor);
+	if (!srtp)
+		return ENOMEM;
+
+	srtp_streams_init(srtp);
+
+	err = srtp_comp_init(&srtp->rtp, 0, key, salt, tag_len);
+	if (err)
+		goto out;
+
+	err = srtp_comp_init(&srtp->rtcp, 3, key, salt, SRTP_RTCP_TAG_SIZE);
+	if (err)
+		goto out;
+
+ out:
+	if (err)
+		mem_deref(srtp);
+	else
+		*srtpp = srtp;
+
+	return err;
+}
+
+
+/* Get the length of the RTP header, including CSRCs and extension */
+static int rtp_hdr_len(size_t *hdr_len, const uint8_t *p, size_t n)
+{
+	size_t len;
+
+	if (n < RTP_HDR_SIZE || (p[0] >> 6) != 2)
+		return EBADMSG;
+
+	len = RTP_HDR_SIZE + 4 * (p[0] & 0x0f);
+
+	if (p[0] & 0x10) {
+
+		if (n < len + 4)
+			return EBADMSG;
+
+		len += 4 + 4 * (size_t)(p[len+2] << 8 | p[len+3]);
+	}
+
+	if (n < len)
+		return EBADMSG;
+
+	*hdr_len = len;
+
+	return 0;
+}
+
+
+static inline uint32_t rtp_ssrc(const uint8_t *p)
+{
+	return (uint32_t)p[8] << 24 | p[9] << 16 | p[10] << 8 | p[11];
+}
+
+
+static inline uint16_t rtp_seq(const uint8_t *p)
+{
+	return (uint16_t)(p[2] << 8 | p[3]);
+}
+
+
+static inline void roc_encode(uint8_t *b, uint32_t roc)
+{
+	b[0] = roc >> 24;
+	b[1] = roc >> 16;
+	b[2] = roc >> 8;
+	b[3] = roc;
+}
+
+
+/* Sender side: the rollover counter follows the sequence number */
+static uint32_t tx_roc(struct srtp_stream *strm, uint16_t seq)
+{
+	if (strm->s_l_set && seq < strm->s_l && strm->s_l - seq > 0x8000)
+		++strm->roc;
+
+	if (!strm->s_l_set || (uint16_t)(seq - strm->s_l) < 0x8000) {
+		strm->s_l     = seq;
+		strm->s_l_set = true;
+	}
+
+	return strm->roc;
+}
+
+
+/* Prepare one packet, and write its counter blocks */
+static int tx_prepare(struct srtp *srtp, struct pkt *pkt, size_t blk)
+{
+	struct mbuf *mb = pkt->mb;
+	struct srtp_stream *strm;
+	const uint8_t *p;
+	uint8_t *ks;
+	uint32_t ssrc;
+	int err;
+
+	if (!mb)
+		return EINVAL;
+
+	pkt->start = mb->pos;
+	pkt->len   = mbuf_get_left(mb);
+
+	err = rtp_hdr_len(&pkt->hdr_len, mbuf_buf(mb), pkt->len);
+	if (err)
+		return err;
+
+	/* room for the authentication tag */
+	if (mbuf_get_space(mb) < pkt->len + srtp->rtp.tag_len) {
+		err = mbuf_resize(mb, mb->pos + pkt->len + srtp->rtp.tag_len);
+		if (err)
+			return err;
+	}
+
+	p    = mbuf_buf(mb);
+	ssrc = rtp_ssrc(p);
+
+	strm = srtp_stream_get(srtp, ssrc);
+	if (!strm)
+		return ENOMEM;
+
+	pkt->roc  = tx_roc(strm, rtp_seq(p));
+	pkt->blk  = blk;
+	pkt->nblk = (pkt->len - pkt->hdr_len + SRTP_BLOCK_SIZE - 1) /
+		SRTP_BLOCK_SIZE;
+
+	if (!pkt->nblk)
+		return 0;
+
+	ks = srtp_ks_get(&srtp->rtp, blk + pkt->nblk);
+	if (!ks)
+		return ENOMEM;
+
+	srtp_ks_counter(ks + blk * SRTP_BLOCK_SIZE, pkt->nblk, srtp->rtp.k_s,
+			ssrc, (uint64_t)pkt->roc << 16 | rtp_seq(p));
+
+	return 0;
+}
+
+
+/* Encrypt the payload and append the authentication tag */
+static int tx_finish(struct srtp *srtp, const struct pkt *pkt)
+{
+	struct mbuf *mb = pkt->mb;
+	uint8_t *p = mb->buf + pkt->start;
+	uint8_t roc[4];
+	int err;
+
+	if (pkt->nblk) {
+		srtp_ks_xor(p + pkt->hdr_len,
+			    srtp->rtp.ks + pkt->blk * SRTP_BLOCK_SIZE,
+			    pkt->len - pkt->hdr_len);
+	}
+
+	roc_encode(roc, pkt->roc);
+	err = srtp_comp_auth(&srtp->rtp, p + pkt->len, p, pkt->len, roc);
+	if (err)
+		return err;
+
+	mb->end = pkt->start + pkt->len + srtp->rtp.tag_len;
+
+	return 0;
+}
+
+
+/**
+ * Encrypt a batch of RTP packets, for example all packets of one video
+ * frame. The keystream of all packets is computed with one cipher call.
+ * Each packet is encrypted in place, from the current position to the
+ * end of its buffer, and the authentication tag is appended.
+ *
+ * @param srtp SRTP Session
+ * @param mbv  Array of RTP packets
+ * @param n    Number of packets
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_encrypt_batch(struct srtp *srtp, struct mbuf **mbv, size_t n)
+{
+	struct pkt pktv[SRTP_BATCH_MAX];
+	size_t i, k;
+	int err;
+
+	if (!srtp || !mbv)
+		return EINVAL;
+
+	for (i=0; i<n; i+=k) {
+
+		const size_t m = min(n - i, (size_t)SRTP_BATCH_MAX);
+		size_t blk = 0;
+
+		for (k=0; k<m; k++) {
+
+			struct pkt *pkt = &pktv[k];
+
+			pkt->mb = mbv[i+k];
+
+			err = tx_prepare(srtp, pkt, blk);
+			if (err)
+				return err;
+
+			blk += pkt->nblk;
+		}
+
+		err = srtp_ks_encrypt(&srtp->rtp, srtp->rtp.ks, blk);
+		if (err)
+			return err;
+
+		for (k=0; k<m; k++) {
+			err = tx_finish(srtp, &pktv[k]);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Encrypt an RTP packet in place, from the current position to the end
+ * of the buffer, and append the authentication tag
+ *
+ * @param srtp SRTP Session
+ * @param mb   RTP packet
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	return srtp_encrypt_batch(srtp, &mb, 1);
+}
+
+
+/* Receiver side: guess the rollover counter (RFC 3711 appendix A) */
+static uint32_t rx_roc(const struct srtp_stream *strm, uint16_t seq)
+{
+	if (!strm->s_l_set)
+		return strm->roc;
+
+	if (strm->s_l < 0x8000) {
+		if (seq > strm->s_l && seq - strm->s_l > 0x8000)
+			return strm->roc - 1;
+	}
+	else {
+		if (seq < strm->s_l - 0x8000)
+			return strm->roc + 1;
+	}
+
+	return strm->roc;
+}
+
+
+/* The packet is authentic, update the stream state */
+static void rx_update(struct srtp_stream *strm, uint32_t roc, uint16_t seq)
+{
+	srtp_replay_update(&strm->replay_rtp, (uint64_t)roc << 16 | seq);
+
+	if (!strm->s_l_set || roc == strm->roc + 1) {
+		strm->roc     = roc;
+		strm->s_l     = seq;
+		strm->s_l_set = true;
+	}
+	else if (roc == strm->roc && seq > strm->s_l) {
+		strm->s_l = seq;
+	}
+}
+
+
+/*
+ * Authenticate one packet, update its stream and write its counter
+ * blocks. The stream state is updated before the packet is decrypted,
+ * so that the next packet of a batch sees it.
+ */
+static int rx_prepare(struct srtp *srtp, struct pkt *pkt, size_t blk)
+{
+	const size_t tag_len = srtp->rtp.tag_len;
+	uint8_t tag[SHA_DIGEST_LENGTH], roc_b[4];
+	struct srtp_stream *strm, tmp;
+	struct mbuf *mb = pkt->mb;
+	uint8_t *p, *ks = NULL;
+	uint32_t ssrc;
+	uint16_t seq;
+	uint64_t ix;
+	int err;
+
+	if (!mb)
+		return EINVAL;
+
+	if (mbuf_get_left(mb) < RTP_HDR_SIZE + tag_len)
+		return EBADMSG;
+
+	p = mbuf_buf(mb);
+
+	pkt->start = mb->pos;
+	pkt->len   = mbuf_get_left(mb) - tag_len;
+
+	err = rtp_hdr_len(&pkt->hdr_len, p, pkt->len);
+	if (err)
+		return err;
+
+	ssrc = rtp_ssrc(p);
+	seq  = rtp_seq(p);
+
+	/* a stream is only added when it has authenticated a packet */
+	strm = srtp_stream_find(srtp, ssrc);
+	if (!strm) {
+		memset(&tmp, 0, sizeof(tmp));
+		strm = &tmp;
+	}
+
+	pkt->roc = rx_roc(strm, seq);
+	ix = (uint64_t)pkt->roc << 16 | seq;
+
+	if (!srtp_replay_check(&strm->replay_rtp, ix))
+		return EALREADY;
+
+	roc_encode(roc_b, pkt->roc);
+	err = srtp_comp_auth(&srtp->rtp, tag, p, pkt->len, roc_b);
+	if (err)
+		return err;
+
+	if (!srtp_tag_equal(tag, p + pkt->len, tag_len))
+		return EAUTH;
+
+	pkt->blk  = blk;
+	pkt->nblk = (pkt->len - pkt->hdr_len + SRTP_BLOCK_SIZE - 1) /
+		SRTP_BLOCK_SIZE;
+
+	if (pkt->nblk) {
+		ks = srtp_ks_get(&srtp->rtp, blk + pkt->nblk);
+		if (!ks)
+			return ENOMEM;
+	}
+
+	if (strm == &tmp) {
+		strm = srtp_stream_get(srtp, ssrc);
+		if (!strm)
+			return ENOMEM;
+	}
+
+	rx_update(strm, pkt->roc, seq);
+
+	if (ks) {
+		srtp_ks_counter(ks + blk * SRTP_BLOCK_SIZE, pkt->nblk,
+				srtp->rtp.k_s, ssrc, ix);
+	}
+
+	return 0;
+}
+
+
+/* Decrypt the payload and remove the authentication tag */
+static void rx_finish(struct srtp *srtp, const struct pkt *pkt)
+{
+	struct mbuf *mb = pkt->mb;
+
+	if (pkt->nblk) {
+		srtp_ks_xor(mb->buf + pkt->start + pkt->hdr_len,
+			    srtp->rtp.ks + pkt->blk * SRTP_BLOCK_SIZE,
+			    pkt->len - pkt->hdr_len);
+	}
+
+	mb->end = pkt->start + pkt->len;
+}
+
+
+/**
+ * Authenticate and decrypt a batch of SRTP packets, for example all
+ * packets read from a socket in one call. The keystream of all authentic
+ * packets is computed with one cipher call. Each packet is decrypted in
+ * place, from the current position to the end of its buffer, and the
+ * authentication tag is removed.
+ *
+ * @param srtp SRTP Session
+ * @param mbv  Array of SRTP packets
+ * @param errv Result of each packet: 0 if success, EAUTH if
+ *             authentication failed, EALREADY if the packet is a replay,
+ *             otherwise errorcode
+ * @param n    Number of packets
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_decrypt_batch(struct srtp *srtp, struct mbuf **mbv, int *errv,
+		       size_t n)
+{
+	struct pkt pktv[SRTP_BATCH_MAX];
+	size_t i, k;
+	int err;
+
+	if (!srtp || !mbv || !errv)
+		return EINVAL;
+
+	for (i=0; i<n; i+=k) {
+
+		const size_t m = min(n - i, (size_t)SRTP_BATCH_MAX);
+		size_t blk = 0;
+
+		for (k=0; k<m; k++) {
+
+			struct pkt *pkt = &pktv[k];
+
+			pkt->mb = mbv[i+k];
+
+			errv[i+k] = rx_prepare(srtp, pkt, blk);
+			if (!errv[i+k])
+				blk += pkt->nblk;
+		}
+
+		err = srtp_ks_encrypt(&srtp->rtp, srtp->rtp.ks, blk);
+		if (err)
+			return err;
+
+		for (k=0; k<m; k++) {
+			if (!errv[i+k])
+				rx_finish(srtp, &pktv[k]);
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Authenticate and decrypt an SRTP packet in place, from the current
+ * position to the end of the buffer. The authentication tag is removed.
+ *
+ * @param srtp SRTP Session
+ * @param mb   SRTP packet
+ *
+ * @return 0 if success, EAUTH if authentication failed, EALREADY if the
+ *         packet is a replay, otherwise errorcode
+ */
+int srtp_decrypt(struct srtp *srtp, struct mbuf *mb)
+{
+	int err, perr = 0;
+
+	err = srtp_decrypt_batch(srtp, &mb, &perr, 1);
+
+	return err ? err : perr;
+}
+
+
+/**
+ * Get the name of an SRTP Crypto suite, as used in SDP
+ *
+ * @param suite SRTP Crypto suite
+ *
+ * @return Name of the crypto suite
+ */
+const char *srtp_suite_name(enum srtp_suite suite)
+{
+	switch (suite) {
+
+	case SRTP_AES_CM_128_HMAC_SHA1_32: return "AES_CM_128_HMAC_SHA1_32";
+	case SRTP_AES_CM_128_HMAC_SHA1_80: return "AES_CM_128_HMAC_SHA1_80";
+	default:                           return "?";
+	}
+}
@@ -0,0 +1,87 @@
+/**
+ * @file srtp/srtp.h  Secure Real-time Transport Protocol -- internal
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+enum {
+	SRTP_BLOCK_SIZE    = 16,  /**< AES block size                     */
+	SRTP_AUTH_KEY_SIZE = 20,  /**< HMAC-SHA1 session key size         */
+	SRTP_RTCP_TAG_SIZE = 10,  /**< SRTCP always uses 80-bit tags      */
+	SRTP_BATCH_MAX     = 64,  /**< Packets per keystream computation  */
+};
+
+/** Replay protection window of 64 packets */
+struct srtp_replay {
+	uint64_t bitmap;  /**< Received packets below the highest index */
+	uint64_t lix;     /**< Highest index received                   */
+	bool init;        /**< Set when a packet has been received      */
+};
+
+/**
+ * Session keys for one of RTP or RTCP, with their own scratch state.
+ * RTP and RTCP may be protected from different threads, but each of
+ * them by one thread at a time.
+ */
+struct srtp_comp {
+	EVP_CIPHER_CTX *ctx;      /**< AES-ECB with the session key       */
+	EVP_MD_CTX *ictx;         /**< HMAC state after the inner pad     */
+	EVP_MD_CTX *octx;         /**< HMAC state after the outer pad     */
+	EVP_MD_CTX *mctx;         /**< HMAC scratch state                 */
+	uint8_t k_s[SRTP_BLOCK_SIZE]; /**< Session salt, shifted 16 bits  */
+	size_t tag_len;           /**< Authentication tag length          */
+	uint8_t *ks;              /**< Keystream scratch buffer           */
+	size_t ks_size;           /**< Size of keystream buffer           */
+};
+
+/** Cryptographic context of one SSRC */
+struct srtp_stream {
+	struct le le;
+	uint32_t ssrc;            /**< Synchronization source             */
+	uint32_t roc;             /**< Rollover counter                   */
+	uint16_t s_l;             /**< Highest sequence number            */
+	bool s_l_set;             /**< Set when s_l is valid              */
+	struct srtp_replay replay_rtp;
+	struct srtp_replay replay_rtcp;
+	uint32_t rtcp_index;      /**< Next SRTCP index to send           */
+};
+
+/** SRTP Session */
+struct srtp {
+	struct srtp_comp rtp;     /**< Keys for SRTP                      */
+	struct srtp_comp rtcp;    /**< Keys for SRTCP                     */
+	struct list streaml;      /**< SRTP streams                       */
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t mutex;    /**< Protects the list of streams       */
+#endif
+};
+
+
+/* Session keys */
+int  srtp_comp_init(struct srtp_comp *comp, uint8_t label,
+		    const uint8_t *master_key, const uint8_t *master_salt,
+		    size_t tag_len);
+void srtp_comp_close(struct srtp_comp *comp);
+int  srtp_comp_auth(struct srtp_comp *comp, uint8_t *tag,
+		    const uint8_t *p, size_t n, const uint8_t *roc);
+
+/* Keystream */
+uint8_t *srtp_ks_get(struct srtp_comp *comp, size_t nblk);
+void srtp_ks_counter(uint8_t *blk, size_t nblk, const uint8_t *k_s,
+		     uint32_t ssrc, uint64_t ix);
+int  srtp_ks_encrypt(const struct srtp_comp *comp, uint8_t *ks,
+		     size_t nblk);
+void srtp_ks_xor(uint8_t *p, const uint8_t *ks, size_t n);
+
+/* Streams */
+void srtp_streams_init(struct srtp *srtp);
+void srtp_streams_close(struct srtp *srtp);
+struct srtp_stream *srtp_stream_find(struct srtp *srtp, uint32_t ssrc);
+struct srtp_stream *srtp_stream_get(struct srtp *srtp, uint32_t ssrc);
+
+/* Replay protection */
+bool srtp_replay_check(const struct srtp_replay *replay, uint64_t ix);
+void srtp_replay_update(struct srtp_replay *replay, uint64_t ix);
+
+bool srtp_tag_equal(const uint8_t *a, const uint8_t *b, size_t n);
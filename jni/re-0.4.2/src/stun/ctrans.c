@@ -12,8 +12,10 @@
 #include <re_udp.h>
 #include <re_tcp.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_tmr.h>
 #include <re_md5.h>
+#include <re_hmac.h>
 #include <re_stun.h>
 #include "stun.h"
 
@@ -24,8 +26,7 @@ struct stun_ctrans {
 	struct sa dst;
 	uint8_t tid[STUN_TID_SIZE];
 	struct stun_ctrans **ctp;
-	uint8_t *key;
-	size_t keylen;
+	struct hmac_sha1_ctx *hmac;
 	void *sock;
 	struct mbuf *mb;
 	size_t pos;
@@ -45,7 +46,7 @@ static void completed(struct stun_ctrans *ct, int err, uint16_t scode,
 	stun_resp_h *resph = ct->resph;
 	void *arg = ct->arg;
 
-	list_unlink(&ct->le);
+	hash_unlink(&ct->le);
 	tmr_cancel(&ct->tmr);
 
 	if (ct->ctp) {
@@ -67,9 +68,9 @@ static void destructor(void *arg)
 {
 	struct stun_ctrans *ct = arg;
 
-	list_unlink(&ct->le);
+	hash_unlink(&ct->le);
 	tmr_cancel(&ct->tmr);
-	mem_deref(ct->key);
+	mem_deref(ct->hmac);
 	mem_deref(ct->sock);
 	mem_deref(ct->mb);
 }
@@ -174,8 +175,10 @@ int stun_ctrans_recv(struct stun *stun, const struct stun_msg *msg,
 		/*@fallthrough@*/
 
 	case STUN_CLASS_SUCCESS_RESP:
-		ct = list_ledata(list_apply(&stun->ctl, true,
-					    match_handler, (void *)msg));
+		ct = list_ledata(hash_lookup(stun->ht_ctrans,
+					     hash_joaat(stun_msg_tid(msg),
+							STUN_TID_SIZE),
+					     match_handler, (void *)msg));
 		if (!ct) {
 			err = ENOENT;
 			break;
@@ -188,10 +191,10 @@ int stun_ctrans_recv(struct stun *stun, const struct stun_msg *msg,
 			break;
 
 		default:
-			if (!ct->key)
+			if (!ct->hmac)
 				break;
 
-			err = stun_msg_chk_mi(msg, ct->key, ct->keylen);
+			err = stun_msg_chk_mi_hmac(msg, ct->hmac);
 			break;
 		}
 
@@ -214,8 +217,9 @@ int stun_ctrans_recv(struct stun *stun, const struct stun_msg *msg,
 
 int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 			void *sock, const struct sa *dst, struct mbuf *mb,
-			const uint8_t tid[], uint16_t met, const uint8_t *key,
-			size_t keylen, stun_resp_h *resph, void *arg)
+			const uint8_t tid[], uint16_t met,
+			const struct hmac_sha1_ctx *hmac,
+			stun_resp_h *resph, void *arg)
 {
 	struct stun_ctrans *ct;
 	int err = 0;
@@ -227,7 +231,8 @@ int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 	if (!ct)
 		return ENOMEM;
 
-	list_append(&stun->ctl, &ct->le, ct);
+	hash_append(stun->ht_ctrans, hash_joaat(tid, STUN_TID_SIZE),
+		    &ct->le, ct);
 	memcpy(ct->tid, tid, STUN_TID_SIZE);
 	ct->proto = proto;
 	ct->sock  = mem_ref(sock);
@@ -235,17 +240,7 @@ int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 	ct->pos   = mb->pos;
 	ct->stun  = stun;
 	ct->met   = met;
-
-	if (key) {
-		ct->key = mem_alloc(keylen, NULL);
-		if (!ct->key) {
-			err = ENOMEM;
-			goto out;
-		}
-
-		memcpy(ct->key, key, keylen);
-		ct->keylen = keylen;
-	}
+	ct->hmac  = mem_ref((void *)hmac);
 
 	switch (proto) {
 
@@ -288,7 +283,6 @@ int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 		break;
 	}
 
- out:
 	if (!err) {
 		if (ctp) {
 			ct->ctp = ctp;
@@ -321,7 +315,7 @@ void stun_ctrans_close(struct stun *stun)
 	if (!stun)
 		return;
 
-	(void)list_apply(&stun->ctl, true, close_handler, NULL);
+	(void)hash_apply(stun->ht_ctrans, close_handler, NULL);
 }
 
 
@@ -345,15 +339,18 @@ static bool debug_handler(struct le *le, void *arg)
 
 int stun_ctrans_debug(struct re_printf *pf, const struct stun *stun)
 {
+	uint32_t i, n = 0;
 	int err;
 
 	if (!stun)
 		return 0;
 
-	err = re_hprintf(pf, "STUN client transactions: (%u)\n",
-			 list_count(&stun->ctl));
+	for (i=0; i<hash_bsize(stun->ht_ctrans); i++)
+		n += list_count(hash_list(stun->ht_ctrans, i));
+
+	err = re_hprintf(pf, "STUN client transactions: (%u)\n", n);
 
-	(void)list_apply(&stun->ctl, true, debug_handler, pf);
+	(void)hash_apply(stun->ht_ctrans, debug_handler, pf);
 
 	return err;
 }
@@ -192,11 +192,25 @@ struct stun_attr *stun_msg_attr_apply(const struct stun_msg *msg,
 }
 
 
-int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
-		     const uint8_t *tid, const struct stun_errcode *ec,
-		     const uint8_t *key, size_t keylen, bool fp,
-		     uint8_t padding, uint32_t attrc, va_list ap)
+/* MESSAGE-INTEGRITY with a precomputed key, or the key itself */
+static void mi_digest(const uint8_t *key, size_t keylen,
+		      const struct hmac_sha1_ctx *hmac,
+		      const uint8_t *d, size_t ld, uint8_t *mi)
+{
+	if (hmac)
+		hmac_sha1_ctx_digest(hmac, d, ld, mi, SHA_DIGEST_LENGTH);
+	else
+		hmac_sha1(key, keylen, d, ld, mi, SHA_DIGEST_LENGTH);
+}
+
+
+static int vencode(struct mbuf *mb, uint16_t method, uint8_t class,
+		   const uint8_t *tid, const struct stun_errcode *ec,
+		   const uint8_t *key, size_t keylen,
+		   const struct hmac_sha1_ctx *hmac, bool fp,
+		   uint8_t padding, uint32_t attrc, va_list ap)
 {
+	const bool mi = key || hmac;
 	struct stun_hdr hdr;
 	size_t start;
 	int err = 0;
@@ -228,20 +242,20 @@ int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
 	}
 
 	/* header */
-	hdr.len = mb->pos - start - STUN_HEADER_SIZE + (key ? MI_SIZE : 0);
+	hdr.len = mb->pos - start - STUN_HEADER_SIZE + (mi ? MI_SIZE : 0);
 	mb->pos = start;
 	err |= stun_hdr_encode(mb, &hdr);
-	mb->pos += hdr.len - (key ? MI_SIZE : 0);
+	mb->pos += hdr.len - (mi ? MI_SIZE : 0);
 
-	if (key) {
-		uint8_t mi[20];
+	if (mi) {
+		uint8_t md[SHA_DIGEST_LENGTH];
 
 		mb->pos = start;
-		hmac_sha1(key, keylen, mbuf_buf(mb), mbuf_get_left(mb),
-			  mi, sizeof(mi));
+		mi_digest(key, keylen, hmac, mbuf_buf(mb), mbuf_get_left(mb),
+			  md);
 
 		mb->pos += STUN_HEADER_SIZE + hdr.len - MI_SIZE;
-		err |= stun_attr_encode(mb, STUN_ATTR_MSG_INTEGRITY, mi,
+		err |= stun_attr_encode(mb, STUN_ATTR_MSG_INTEGRITY, md,
 					NULL, padding);
 	}
 
@@ -265,6 +279,26 @@ int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
 }
 
 
+int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
+		     const uint8_t *tid, const struct stun_errcode *ec,
+		     const uint8_t *key, size_t keylen, bool fp,
+		     uint8_t padding, uint32_t attrc, va_list ap)
+{
+	return vencode(mb, method, class, tid, ec, key, keylen, NULL, fp,
+		       padding, attrc, ap);
+}
+
+
+int stun_msg_vencode_hmac(struct mbuf *mb, uint16_t method, uint8_t class,
+			  const uint8_t *tid, const struct stun_errcode *ec,
+			  const struct hmac_sha1_ctx *hmac, bool fp,
+			  uint8_t padding, uint32_t attrc, va_list ap)
+{
+	return vencode(mb, method, class, tid, ec, NULL, 0, hmac, fp,
+		       padding, attrc, ap);
+}
+
+
 int stun_msg_encode(struct mbuf *mb, uint16_t method, uint8_t class,
 		    const uint8_t *tid, const struct stun_errcode *ec,
 		    const uint8_t *key, size_t keylen, bool fp,
@@ -282,10 +316,10 @@ int stun_msg_encode(struct mbuf *mb, uint16_t method, uint8_t class,
 }
 
 
-int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
-		    size_t keylen)
+static int chk_mi(const struct stun_msg *msg, const uint8_t *key,
+		  size_t keylen, const struct hmac_sha1_ctx *hmac)
 {
-	uint8_t hmac[SHA_DIGEST_LENGTH];
+	uint8_t md[SHA_DIGEST_LENGTH];
 	struct stun_attr *mi, *fp;
 
 	if (!msg)
@@ -304,9 +338,8 @@ int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		msg->mb->pos -= STUN_HEADER_SIZE;
 	}
 
-	hmac_sha1(key, keylen, mbuf_buf(msg->mb),
-		  STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE,
-		  hmac, sizeof(hmac));
+	mi_digest(key, keylen, hmac, mbuf_buf(msg->mb),
+		  STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE, md);
 
 	if (fp) {
 		((struct stun_msg *)msg)->hdr.len += FP_SIZE;
@@ -314,13 +347,38 @@ int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		msg->mb->pos -= STUN_HEADER_SIZE;
 	}
 
-	if (memcmp(mi->v.msg_integrity, hmac, SHA_DIGEST_LENGTH))
+	if (memcmp(mi->v.msg_integrity, md, SHA_DIGEST_LENGTH))
 		return EBADMSG;
 
 	return 0;
 }
 
 
+int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
+		    size_t keylen)
+{
+	return chk_mi(msg, key, keylen, NULL);
+}
+
+
+/**
+ * Check the MESSAGE-INTEGRITY of a STUN message with a precomputed key
+ *
+ * @param msg  STUN message
+ * @param hmac HMAC-SHA1 context of the key
+ *
+ * @return 0 if valid, EBADMSG if not, otherwise errorcode
+ */
+int stun_msg_chk_mi_hmac(const struct stun_msg *msg,
+			 const struct hmac_sha1_ctx *hmac)
+{
+	if (!hmac)
+		return EINVAL;
+
+	return chk_mi(msg, NULL, 0, hmac);
+}
+
+
 int stun_msg_chk_fingerprint(const struct stun_msg *msg)
 {
 	struct stun_attr *fp;
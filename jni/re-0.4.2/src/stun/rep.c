@@ -12,27 +12,28 @@
 #include "stun.h"
 
 
-int stun_reply(int proto, void *sock, const struct sa *dst, size_t presz,
-	       const struct stun_msg *req, const uint8_t *key,
-	       size_t keylen, bool fp, uint32_t attrc, ...)
+static int vreply(int proto, void *sock, const struct sa *dst, size_t presz,
+		  const struct stun_msg *req, uint16_t class,
+		  const struct stun_errcode *ec, const uint8_t *key,
+		  size_t keylen, const struct hmac_sha1_ctx *hmac, bool fp,
+		  uint32_t attrc, va_list ap)
 {
 	struct mbuf *mb = NULL;
 	int err = ENOMEM;
-	va_list ap;
-
-	if (!sock || !req)
-		return EINVAL;
 
 	mb = mbuf_alloc(256);
 	if (!mb)
 		goto out;
 
-	va_start(ap, attrc);
 	mb->pos = presz;
-	err = stun_msg_vencode(mb, stun_msg_method(req),
-			       STUN_CLASS_SUCCESS_RESP, stun_msg_tid(req),
-			       NULL, key, keylen, fp, 0x00, attrc, ap);
-	va_end(ap);
+	if (hmac)
+		err = stun_msg_vencode_hmac(mb, stun_msg_method(req), class,
+					    stun_msg_tid(req), ec, hmac, fp,
+					    0x00, attrc, ap);
+	else
+		err = stun_msg_vencode(mb, stun_msg_method(req), class,
+				       stun_msg_tid(req), ec, key, keylen,
+				       fp, 0x00, attrc, ap);
 	if (err)
 		goto out;
 
@@ -46,40 +47,123 @@ int stun_reply(int proto, void *sock, const struct sa *dst, size_t presz,
 }
 
 
+int stun_reply(int proto, void *sock, const struct sa *dst, size_t presz,
+	       const struct stun_msg *req, const uint8_t *key,
+	       size_t keylen, bool fp, uint32_t attrc, ...)
+{
+	va_list ap;
+	int err;
+
+	if (!sock || !req)
+		return EINVAL;
+
+	va_start(ap, attrc);
+	err = vreply(proto, sock, dst, presz, req, STUN_CLASS_SUCCESS_RESP,
+		     NULL, key, keylen, NULL, fp, attrc, ap);
+	va_end(ap);
+
+	return err;
+}
+
+
+/**
+ * Send a STUN success response, with MESSAGE-INTEGRITY computed from a
+ * precomputed key
+ *
+ * @param proto Transport protocol
+ * @param sock  Socket
+ * @param dst   Destination address
+ * @param presz Number of bytes in preamble, if sending over TURN
+ * @param req   STUN request
+ * @param hmac  HMAC-SHA1 context of the key, NULL for none
+ * @param fp    Use STUN Fingerprint attribute
+ * @param attrc Number of attributes to encode (variable arguments)
+ * @param ...   Variable list of attribute-tuples
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_reply_hmac(int proto, void *sock, const struct sa *dst,
+		    size_t presz, const struct stun_msg *req,
+		    const struct hmac_sha1_ctx *hmac, bool fp,
+		    uint32_t attrc, ...)
+{
+	va_list ap;
+	int err;
+
+	if (!sock || !req)
+		return EINVAL;
+
+	va_start(ap, attrc);
+	err = vreply(proto, sock, dst, presz, req, STUN_CLASS_SUCCESS_RESP,
+		     NULL, NULL, 0, hmac, fp, attrc, ap);
+	va_end(ap);
+
+	return err;
+}
+
+
 int stun_ereply(int proto, void *sock, const struct sa *dst, size_t presz,
 		const struct stun_msg *req, uint16_t scode,
 		const char *reason, const uint8_t *key, size_t keylen,
 		bool fp, uint32_t attrc, ...)
 {
 	struct stun_errcode ec;
-	struct mbuf *mb = NULL;
-	int err = ENOMEM;
 	va_list ap;
+	int err;
 
 	if (!sock || !req || !scode || !reason)
 		return EINVAL;
 
-	mb = mbuf_alloc(256);
-	if (!mb)
-		goto out;
-
 	ec.code = scode;
 	ec.reason = (char *)reason;
 
 	va_start(ap, attrc);
-	mb->pos = presz;
-	err = stun_msg_vencode(mb, stun_msg_method(req), STUN_CLASS_ERROR_RESP,
-			       stun_msg_tid(req), &ec, key, keylen,
-			       fp, 0x00, attrc, ap);
+	err = vreply(proto, sock, dst, presz, req, STUN_CLASS_ERROR_RESP,
+		     &ec, key, keylen, NULL, fp, attrc, ap);
 	va_end(ap);
-	if (err)
-		goto out;
 
-	mb->pos = presz;
-	err = stun_send(proto, sock, dst, mb);
+	return err;
+}
 
- out:
-	mem_deref(mb);
+
+/**
+ * Send a STUN error response, with MESSAGE-INTEGRITY computed from a
+ * precomputed key
+ *
+ * @param proto  Transport protocol
+ * @param sock   Socket
+ * @param dst    Destination address
+ * @param presz  Number of bytes in preamble, if sending over TURN
+ * @param req    STUN request
+ * @param scode  Status code
+ * @param reason Reason phrase
+ * @param hmac   HMAC-SHA1 context of the key, NULL for none
+ * @param fp     Use STUN Fingerprint attribute
+ * @param attrc  Number of attributes to encode (variable arguments)
+ * @param ...    Variable list of attribute-tuples
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_ereply_hmac(int proto, void *sock, const struct sa *dst,
+		     size_t presz, const struct stun_msg *req,
+		     uint16_t scode, const char *reason,
+		     const struct hmac_sha1_ctx *hmac, bool fp,
+		     uint32_t attrc, ...)
+{
+	struct stun_errcode ec;
+	va_list ap;
+	int err;
+
+	if (!sock || !req || !scode || !reason)
+		return EINVAL;
+
+	ec.code = scode;
+	ec.reason = (char *)reason;
+
+	va_start(ap, attrc);
+	err = vreply(proto, sock, dst, presz, req, STUN_CLASS_ERROR_RESP,
+		     &ec, NULL, 0, hmac, fp, attrc, ap);
+	va_end(ap);
 
 	return err;
 }
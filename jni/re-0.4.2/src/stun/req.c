@@ -9,24 +9,22 @@
 #include <re_mbuf.h>
 #include <re_sa.h>
 #include <re_list.h>
+#include <re_hmac.h>
 #include <re_stun.h>
 #include "stun.h"
 
 
-int stun_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
-		 void *sock, const struct sa *dst, size_t presz,
-		 uint16_t method, const uint8_t *key, size_t keylen, bool fp,
-		 stun_resp_h *resph, void *arg, uint32_t attrc, ...)
+static int vrequest(struct stun_ctrans **ctp, struct stun *stun, int proto,
+		    void *sock, const struct sa *dst, size_t presz,
+		    uint16_t method, const struct hmac_sha1_ctx *hmac,
+		    bool fp, stun_resp_h *resph, void *arg,
+		    uint32_t attrc, va_list ap)
 {
 	uint8_t tid[STUN_TID_SIZE];
 	struct mbuf *mb;
 	uint32_t i;
-	va_list ap;
 	int err;
 
-	if (!stun)
-		return EINVAL;
-
 	mb = mbuf_alloc(512);
 	if (!mb)
 		return ENOMEM;
@@ -34,17 +32,15 @@ int stun_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 	for (i=0; i<STUN_TID_SIZE; i++)
 		tid[i] = rand_u32();
 
-	va_start(ap, attrc);
 	mb->pos = presz;
-	err = stun_msg_vencode(mb, method, STUN_CLASS_REQUEST,
-			       tid, NULL, key, keylen, fp, 0x00, attrc, ap);
-	va_end(ap);
+	err = stun_msg_vencode_hmac(mb, method, STUN_CLASS_REQUEST,
+				    tid, NULL, hmac, fp, 0x00, attrc, ap);
 	if (err)
 		goto out;
 
 	mb->pos = presz;
 	err = stun_ctrans_request(ctp, stun, proto, sock, dst, mb, tid, method,
-				  key, keylen, resph, arg);
+				  hmac, resph, arg);
 	if (err)
 		goto out;
 
@@ -53,3 +49,74 @@ int stun_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 
 	return err;
 }
+
+
+int stun_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
+		 void *sock, const struct sa *dst, size_t presz,
+		 uint16_t method, const uint8_t *key, size_t keylen, bool fp,
+		 stun_resp_h *resph, void *arg, uint32_t attrc, ...)
+{
+	struct hmac_sha1_ctx *hmac = NULL;
+	va_list ap;
+	int err;
+
+	if (!stun)
+		return EINVAL;
+
+	/* the key also checks the response, so only pad it once */
+	if (key) {
+		err = hmac_sha1_ctx_alloc(&hmac, key, keylen);
+		if (err)
+			return err;
+	}
+
+	va_start(ap, attrc);
+	err = vrequest(ctp, stun, proto, sock, dst, presz, method, hmac, fp,
+		       resph, arg, attrc, ap);
+	va_end(ap);
+
+	mem_deref(hmac);
+
+	return err;
+}
+
+
+/**
+ * Send a STUN request, with MESSAGE-INTEGRITY computed from a
+ * precomputed key. The response is checked with the same key.
+ *
+ * @param ctp    Pointer to allocated client transaction (optional)
+ * @param stun   STUN Instance
+ * @param proto  Transport protocol
+ * @param sock   Socket
+ * @param dst    Destination address
+ * @param presz  Number of bytes in preamble, if sending over TURN
+ * @param method STUN method
+ * @param hmac   HMAC-SHA1 context of the key, NULL for none
+ * @param fp     Use STUN Fingerprint attribute
+ * @param resph  Response handler
+ * @param arg    Response handler argument
+ * @param attrc  Number of attributes to encode (variable arguments)
+ * @param ...    Variable list of attribute-tuples
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_request_hmac(struct stun_ctrans **ctp, struct stun *stun, int proto,
+		      void *sock, const struct sa *dst, size_t presz,
+		      uint16_t method, const struct hmac_sha1_ctx *hmac,
+		      bool fp, stun_resp_h *resph, void *arg,
+		      uint32_t attrc, ...)
+{
+	va_list ap;
+	int err;
+
+	if (!stun)
+		return EINVAL;
+
+	va_start(ap, attrc);
+	err = vrequest(ctp, stun, proto, sock, dst, presz, method, hmac, fp,
+		       resph, arg, attrc, ap);
+	va_end(ap);
+
+	return err;
+}
@@ -12,6 +12,7 @@
 #include <re_tcp.h>
 #include <re_sys.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_stun.h>
 #include "stun.h"
 
@@ -33,6 +34,7 @@ static void destructor(void *arg)
 	struct stun *stun = arg;
 
 	stun_ctrans_close(stun);
+	mem_deref(stun->ht_ctrans);
 }
 
 
@@ -40,6 +42,7 @@ int stun_alloc(struct stun **stunp, const struct stun_conf *conf,
 	       stun_ind_h *indh, void *arg)
 {
 	struct stun *stun;
+	int err;
 
 	if (!stunp)
 		return EINVAL;
@@ -48,6 +51,12 @@ int stun_alloc(struct stun **stunp, const struct stun_conf *conf,
 	if (!stun)
 		return ENOMEM;
 
+	err = hash_alloc(&stun->ht_ctrans, STUN_CTRANS_HASH_SIZE);
+	if (err) {
+		mem_deref(stun);
+		return err;
+	}
+
 	stun->conf = conf ? *conf : conf_default;
 	stun->indh = indh;
 	stun->arg  = arg;
@@ -6,7 +6,8 @@
 
 
 enum {
-	STUN_MAGIC_COOKIE = 0x2112a442 /**< Magic Cookie for 3489bis        */
+	STUN_MAGIC_COOKIE = 0x2112a442, /**< Magic Cookie for 3489bis       */
+	STUN_CTRANS_HASH_SIZE = 256,    /**< Buckets of client transactions */
 };
 
 
@@ -36,7 +37,7 @@ struct stun_hdr {
 
 
 struct stun {
-	struct list ctl;
+	struct hash *ht_ctrans;
 	struct stun_conf conf;
 	stun_ind_h *indh;
 	void *arg;
@@ -46,6 +47,10 @@ int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
 		     const uint8_t *tid, const struct stun_errcode *ec,
 		     const uint8_t *key, size_t keylen, bool fp,
 		     uint8_t padding, uint32_t attrc, va_list ap);
+int stun_msg_vencode_hmac(struct mbuf *mb, uint16_t method, uint8_t class,
+			  const uint8_t *tid, const struct stun_errcode *ec,
+			  const struct hmac_sha1_ctx *hmac, bool fp,
+			  uint8_t padding, uint32_t attrc, va_list ap);
 
 int stun_hdr_encode(struct mbuf *mb, const struct stun_hdr *hdr);
 int stun_hdr_decode(struct mbuf *mb, struct stun_hdr *hdr);
@@ -62,7 +67,8 @@ int  stun_addr_decode(struct mbuf *mb, struct sa *addr, const uint8_t *tid);
 
 int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 			void *sock, const struct sa *dst, struct mbuf *mb,
-			const uint8_t tid[], uint16_t met, const uint8_t *key,
-			size_t keylen, stun_resp_h *resph, void *arg);
+			const uint8_t tid[], uint16_t met,
+			const struct hmac_sha1_ctx *hmac,
+			stun_resp_h *resph, void *arg);
 void stun_ctrans_close(struct stun *stun);
 int  stun_ctrans_debug(struct re_printf *pf, const struct stun *stun);
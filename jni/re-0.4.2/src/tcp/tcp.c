@@ -14,6 +14,7 @@
 #define __USE_POSIX 1  /**< Use POSIX flag */
 #define __USE_MISC 1
 #include <netdb.h>
+#include <sys/uio.h>
 #endif
 #ifdef __APPLE__
 #include "TargetConditionals.h"
@@ -54,7 +55,9 @@
 
 enum {
 	TCP_TXQSZ_DEFAULT = 524288,
-	TCP_RXSZ_DEFAULT  = 8192
+	TCP_RXSZ_DEFAULT  = 8192,
+	TCP_QBUF_SIZE     = 4096,  /**< Smallest buffer for queued copies */
+	TCP_IOV_MAX       = 16,    /**< Queue entries sent per call      */
 };
 
 
@@ -78,8 +81,8 @@ struct tcp_conn {
 	tcp_close_h *closeh;  /**< Connection close handler          */
 	void *arg;            /**< Handler argument                  */
 	size_t rxsz;          /**< Maximum receive chunk size        */
-	size_t txqsz;
-	size_t txqsz_max;
+	size_t txqsz;         /**< Bytes in the sending queue        */
+	size_t txqsz_max;     /**< Maximum bytes in sending queue    */
 	bool active;          /**< We are connecting flag            */
 	bool connected;       /**< Connection is connected flag      */
 };
@@ -96,9 +99,16 @@ struct tcp_helper {
 };
 
 
+/**
+ * Defines an entry in the sending queue. The entry refers to the buffer
+ * of the caller, or to a copy which later data may be appended to.
+ */
 struct tcp_qent {
 	struct le le;
-	struct mbuf mb;
+	struct mbuf *mb;      /**< Queued data                       */
+	size_t pos;           /**< Next byte to send                 */
+	size_t end;           /**< End of queued data                */
+	bool ref;             /**< Buffer belongs to the caller      */
 };
 
 
@@ -174,11 +184,11 @@ static void qent_destructor(void *arg)
 	struct tcp_qent *qe = arg;
 
 	list_unlink(&qe->le);
-	mem_deref(qe->mb.buf);
+	mem_deref(qe->mb);
 }
 
 
-static int enqueue(struct tcp_conn *tc, struct mbuf *mb)
+static int enqueue(struct tcp_conn *tc, struct mbuf *mb, bool ref)
 {
 	const size_t n = mbuf_get_left(mb);
 	struct tcp_qent *qe;
@@ -195,26 +205,47 @@ static int enqueue(struct tcp_conn *tc, struct mbuf *mb)
 			return err;
 	}
 
+	qe = list_ledata(tc->sendq.tail);
+
+	/* append to the copy at the end of the queue, if it has room */
+	if (!ref && qe && !qe->ref && qe->mb->size - qe->end >= n) {
+
+		memcpy(qe->mb->buf + qe->end, mbuf_buf(mb), n);
+		qe->end   += n;
+		tc->txqsz += n;
+
+		return 0;
+	}
+
 	qe = mem_zalloc(sizeof(*qe), qent_destructor);
 	if (!qe)
 		return ENOMEM;
 
-	list_append(&tc->sendq, &qe->le, qe);
-
-	mbuf_init(&qe->mb);
+	if (ref) {
+		qe->mb  = mem_ref(mb);
+		qe->pos = mb->pos;
+		qe->end = mb->end;
+		qe->ref = true;
+	}
+	else {
+		qe->mb = mbuf_alloc(max(n, (size_t)TCP_QBUF_SIZE));
+		if (!qe->mb) {
+			mem_deref(qe);
+			return ENOMEM;
+		}
 
-	err = mbuf_write_mem(&qe->mb, mbuf_buf(mb), n);
-	qe->mb.pos = 0;
+		memcpy(qe->mb->buf, mbuf_buf(mb), n);
+		qe->end = n;
+	}
 
-	if (err)
-		mem_deref(qe);
-	else
-		tc->txqsz += qe->mb.end;
+	list_append(&tc->sendq, &qe->le, qe);
+	tc->txqsz += n;
 
-	return err;
+	return 0;
 }
 
 
+/* Send from the head of the queue, several entries at a time if we can */
 static int dequeue(struct tcp_conn *tc)
 {
 	struct tcp_qent *qe = list_ledata(tc->sendq.head);
@@ -231,8 +262,32 @@ static int dequeue(struct tcp_conn *tc)
 		return 0;
 	}
 
-	n = send(tc->fdc, BUF_CAST mbuf_buf(&qe->mb),
-		 qe->mb.end - qe->mb.pos, flags);
+#if defined (WIN32) || defined (__SYMBIAN32__)
+	n = send(tc->fdc, BUF_CAST (qe->mb->buf + qe->pos),
+		 SIZ_CAST (qe->end - qe->pos), flags);
+#else
+	{
+		struct iovec iov[TCP_IOV_MAX];
+		struct msghdr msg;
+		struct le *le;
+		int iovc = 0;
+
+		for (le = tc->sendq.head; le && iovc < TCP_IOV_MAX;
+		     le = le->next, iovc++) {
+
+			qe = le->data;
+
+			iov[iovc].iov_base = qe->mb->buf + qe->pos;
+			iov[iovc].iov_len  = qe->end - qe->pos;
+		}
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov    = iov;
+		msg.msg_iovlen = iovc;
+
+		n = sendmsg(tc->fdc, &msg, flags);
+	}
+#endif
 	if (n < 0) {
 		if (EAGAIN == errno)
 			return 0;
@@ -243,11 +298,23 @@ static int dequeue(struct tcp_conn *tc)
 		return errno;
 	}
 
-	tc->txqsz  -= n;
-	qe->mb.pos += n;
+	tc->txqsz -= n;
+
+	while (n > 0) {
+
+		size_t left;
 
-	if (qe->mb.pos >= qe->mb.end)
+		qe   = list_ledata(tc->sendq.head);
+		left = qe->end - qe->pos;
+
+		if ((size_t)n < left) {
+			qe->pos += n;
+			break;
+		}
+
+		n -= left;
 		mem_deref(qe);
+	}
 
 	return 0;
 }
@@ -1050,7 +1117,7 @@ int tcp_conn_connect(struct tcp_conn *tc, const struct sa *peer)
 
 
 static int tcp_send_internal(struct tcp_conn *tc, struct mbuf *mb,
-			     struct le *le)
+			     struct le *le, bool ref)
 {
 	int err = 0;
 	ssize_t n;
@@ -1080,17 +1147,17 @@ static int tcp_send_internal(struct tcp_conn *tc, struct mbuf *mb,
 	}
 
 	if (tc->sendq.head)
-		return enqueue(tc, mb);
+		return enqueue(tc, mb, ref);
 
 	n = send(tc->fdc, BUF_CAST mbuf_buf(mb), mb->end - mb->pos, flags);
 	if (n < 0) {
 
 		if (EAGAIN == errno)
-			return enqueue(tc, mb);
+			return enqueue(tc, mb, ref);
 
 #ifdef WIN32
 		if (WSAEWOULDBLOCK == WSAGetLastError())
-			return enqueue(tc, mb);
+			return enqueue(tc, mb, ref);
 #endif
 		err = errno;
 
@@ -1106,7 +1173,7 @@ static int tcp_send_internal(struct tcp_conn *tc, struct mbuf *mb,
 	if ((size_t)n < mb->end - mb->pos) {
 
 		mb->pos += n;
-		err = enqueue(tc, mb);
+		err = enqueue(tc, mb, ref);
 		mb->pos -= n;
 
 		return err;
@@ -1129,7 +1196,27 @@ int tcp_send(struct tcp_conn *tc, struct mbuf *mb)
 	if (!tc || !mb)
 		return EINVAL;
 
-	return tcp_send_internal(tc, mb, tc->helpers.tail);
+	return tcp_send_internal(tc, mb, tc->helpers.tail, false);
+}
+
+
+/**
+ * Send data on a TCP Connection to a remote peer, without copying it.
+ * If the data cannot be sent at once, the sending queue keeps a
+ * reference to the buffer, so its content must not be changed after
+ * this call.
+ *
+ * @param tc TCP Connection
+ * @param mb Buffer to send, must be allocated with mbuf_alloc()
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tcp_send_ref(struct tcp_conn *tc, struct mbuf *mb)
+{
+	if (!tc || !mb)
+		return EINVAL;
+
+	return tcp_send_internal(tc, mb, tc->helpers.tail, true);
 }
 
 
@@ -1149,7 +1236,7 @@ int tcp_send_helper(struct tcp_conn *tc, struct mbuf *mb,
 	if (!tc || !mb || !th)
 		return EINVAL;
 
-	return tcp_send_internal(tc, mb, th->le.prev);
+	return tcp_send_internal(tc, mb, th->le.prev, false);
 }
 
 
@@ -37,24 +37,225 @@ enum {
 	MAX_BLOCKING = 100   /**< Maximum time spent in handler [ms] */
 };
 
-extern struct list *tmrl_get(void);
+enum {
+	WHEEL_MASK = TMR_WHEEL_SIZE - 1,
+	WHEEL_SPAN = TMR_WHEEL_BITS * TMR_WHEEL_LEVELS
+};
+
+extern struct tmrl *tmrl_get(void);
+
+
+/*
+ * Hierarchical timing wheel
+ *
+ * Level 0 has one slot per millisecond for the next 256 ms. Each higher
+ * level covers 256 slots of the level below. When the wheel reaches a
+ * slot boundary the timers of the corresponding slot on the level above
+ * are cascaded down. Timers beyond the range of the wheel are parked in
+ * the top level and re-inserted when they are cascaded.
+ *
+ * Like the sorted list it replaces, timers fire in order of expiry, and
+ * timers with the same expiry fire in the order they were started. The
+ * slots of level 0 are kept sorted. A timer on a higher level was always
+ * started before any timer with the same expiry on a lower level, so
+ * cascaded timers are put in front of the timers already in a slot.
+ *
+ * Each timer remembers the wheel it is on, so that the per-level counts
+ * stay exact when a timer is cancelled or restarted from another thread.
+ */
+
+
+static uint32_t tmrl_count(const struct tmrl *tmrl)
+{
+	uint32_t n = 0;
+	int lvl;
+
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS; lvl++)
+		n += tmrl->cnt[lvl];
+
+	return n;
+}
+
+
+static int wheel_level(const struct tmrl *tmrl, const struct list *slot)
+{
+	const struct list *base = &tmrl->wheel[0][0];
+
+	if (slot < base || slot >= base + TMR_WHEEL_LEVELS * TMR_WHEEL_SIZE)
+		return -1;
+
+	return (int)((slot - base) / TMR_WHEEL_SIZE);
+}
+
+
+static void wheel_insert(struct tmrl *tmrl, struct tmr *tmr, bool cascade)
+{
+	uint64_t jfs = max(tmr->jfs, tmrl->jfs);
+	const uint64_t delta = jfs - tmrl->jfs;
+	struct list *slot;
+	struct le *le;
+	unsigned idx;
+	int lvl;
+
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS-1; lvl++) {
+
+		if (delta < (uint64_t)1 << (TMR_WHEEL_BITS * (lvl + 1)))
+			break;
+	}
+
+	if (delta >> WHEEL_SPAN)
+		jfs = tmrl->jfs + ((uint64_t)1 << WHEEL_SPAN) - 1;
+
+	idx = (unsigned)(jfs >> (TMR_WHEEL_BITS * lvl)) & WHEEL_MASK;
+	slot = &tmrl->wheel[lvl][idx];
+
+	if (lvl > 0) {
+		if (cascade)
+			list_prepend(slot, &tmr->le, tmr);
+		else
+			list_append(slot, &tmr->le, tmr);
+	}
+	else if (cascade) {
+		/* before the first timer with the same or a later expiry */
+		for (le = slot->head; le; le = le->next) {
+
+			const struct tmr *tmr2 = le->data;
+
+			if (tmr2->jfs >= tmr->jfs)
+				break;
+		}
+
+		if (le)
+			list_insert_before(slot, le, &tmr->le, tmr);
+		else
+			list_append(slot, &tmr->le, tmr);
+	}
+	else {
+		/* after the last timer with the same or an earlier expiry */
+		for (le = slot->tail; le; le = le->prev) {
+
+			const struct tmr *tmr2 = le->data;
+
+			if (tmr2->jfs <= tmr->jfs)
+				break;
+		}
+
+		if (le)
+			list_insert_after(slot, le, &tmr->le, tmr);
+		else
+			list_prepend(slot, &tmr->le, tmr);
+	}
+
+	tmr->tmrl = tmrl;
+	++tmrl->cnt[lvl];
+}
 
 
-static bool inspos_handler(struct le *le, void *arg)
+static void wheel_unlink(struct tmr *tmr)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+	struct tmrl *tmrl = tmr->tmrl;
+
+	if (tmrl) {
+		const int lvl = wheel_level(tmrl, tmr->le.list);
+
+		if (lvl >= 0)
+			--tmrl->cnt[lvl];
+
+		tmr->tmrl = NULL;
+	}
 
-	return tmr->jfs <= now;
+	list_unlink(&tmr->le);
 }
 
 
-static bool inspos_handler_0(struct le *le, void *arg)
+static void wheel_cascade(struct tmrl *tmrl, int lvl, unsigned idx)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+	struct list *slot = &tmrl->wheel[lvl][idx];
+	struct list tmp = LIST_INIT;
+	struct le *le;
+
+	while (slot->head) {
+		le = slot->head;
+		wheel_unlink(le->data);
+		list_append(&tmp, le, le->data);
+	}
 
-	return tmr->jfs > now;
+	/* last first, so that the slot order is kept in front */
+	while (tmp.tail) {
+		le = tmp.tail;
+		list_unlink(le);
+		wheel_insert(tmrl, le->data, true);
+	}
+}
+
+
+/* Move the wheel one tick ahead, skipping empty levels up to now */
+static void wheel_advance(struct tmrl *tmrl, uint64_t now)
+{
+	uint64_t next = tmrl->jfs + 1;
+	int lvl;
+
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS-1 && !tmrl->cnt[lvl]; lvl++) {
+
+		const unsigned shift = TMR_WHEEL_BITS * (lvl + 1);
+		const uint64_t b = ((tmrl->jfs >> shift) + 1) << shift;
+
+		if (b > now + 1)
+			break;
+
+		next = b;
+	}
+
+	tmrl->jfs = next;
+
+	if (next & WHEEL_MASK)
+		return;
+
+	for (lvl=1; lvl<TMR_WHEEL_LEVELS; lvl++) {
+
+		const unsigned idx =
+			(unsigned)(next >> (TMR_WHEEL_BITS * lvl)) & WHEEL_MASK;
+
+		wheel_cascade(tmrl, lvl, idx);
+
+		if (idx)
+			break;
+	}
+}
+
+
+/* Lower bound for the expiry of the first timer */
+static uint64_t wheel_next(const struct tmrl *tmrl)
+{
+	uint64_t next = 0;
+	int lvl;
+
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS; lvl++) {
+
+		const unsigned shift = TMR_WHEEL_BITS * lvl;
+		const uint64_t pos = tmrl->jfs >> shift;
+		unsigned j;
+
+		if (!tmrl->cnt[lvl])
+			continue;
+
+		/* the current slot of a higher level is one round ahead */
+		for (j = lvl ? 1 : 0; j <= (lvl ? WHEEL_MASK+1u : WHEEL_MASK);
+		     j++) {
+
+			const uint64_t jfs = (pos + j) << shift;
+
+			if (next && jfs >= next)
+				break;
+
+			if (tmrl->wheel[lvl][(pos + j) & WHEEL_MASK].head) {
+				next = jfs;
+				break;
+			}
+		}
+	}
+
+	return next;
 }
 
 
@@ -82,19 +283,21 @@ static void call_handler(tmr_h *th, void *arg)
  *
  * @param tmrl Timer list
  */
-void tmr_poll(struct list *tmrl)
+void tmr_poll(struct tmrl *tmrl)
 {
 	const uint64_t jfs = tmr_jiffies();
 
-	for (;;) {
+	while (tmrl->jfs <= jfs && tmrl_count(tmrl)) {
+
+		struct list *slot = &tmrl->wheel[0][tmrl->jfs & WHEEL_MASK];
 		struct tmr *tmr;
 		tmr_h *th;
 		void *th_arg;
 
-		tmr = list_ledata(tmrl->head);
-
-		if (!tmr || (tmr->jfs > jfs)) {
-			break;
+		tmr = list_ledata(slot->head);
+		if (!tmr) {
+			wheel_advance(tmrl, jfs);
+			continue;
 		}
 
 		th = tmr->th;
@@ -102,7 +305,7 @@ void tmr_poll(struct list *tmrl)
 
 		tmr->th = NULL;
 
-		list_unlink(&tmr->le);
+		wheel_unlink(tmr);
 
 		if (!th)
 			continue;
@@ -155,43 +358,51 @@ uint64_t tmr_jiffies(void)
  *
  * @return Number of [ms], or 0 if no active timers
  */
-uint64_t tmr_next_timeout(struct list *tmrl)
+uint64_t tmr_next_timeout(struct tmrl *tmrl)
 {
 	const uint64_t jif = tmr_jiffies();
-	const struct tmr *tmr;
+	uint64_t jfs;
 
-	tmr = list_ledata(tmrl->head);
-	if (!tmr)
+	if (!tmrl_count(tmrl))
 		return 0;
 
-	if (tmr->jfs <= jif)
+	jfs = wheel_next(tmrl);
+	if (!jfs)
+		return 0;
+
+	if (jfs <= jif)
 		return 1;
 	else
-		return tmr->jfs - jif;
+		return jfs - jif;
 }
 
 
 int tmr_status(struct re_printf *pf, void *unused)
 {
-	struct list *tmrl = tmrl_get();
+	struct tmrl *tmrl = tmrl_get();
 	struct le *le;
 	uint32_t n;
-	int err;
+	int i, err;
 
 	(void)unused;
 
-	n = list_count(tmrl);
+	n = tmrl_count(tmrl);
 	if (!n)
 		return 0;
 
 	err = re_hprintf(pf, "Timers (%u):\n", n);
 
-	for (le = tmrl->head; le; le = le->next) {
-		const struct tmr *tmr = le->data;
+	for (i=0; i<TMR_WHEEL_LEVELS*TMR_WHEEL_SIZE; i++) {
+
+		const struct list *slot = &tmrl->wheel[0][0] + i;
+
+		for (le = slot->head; le; le = le->next) {
+			const struct tmr *tmr = le->data;
 
-		err |= re_hprintf(pf, "  %p: th=%p expire=%llums\n",
-				  tmr, tmr->th,
-				  (unsigned long long)tmr_get_expire(tmr));
+			err |= re_hprintf(pf, "  %p: th=%p expire=%llums\n",
+					  tmr, tmr->th,
+					  (unsigned long long)tmr_get_expire(tmr));
+		}
 	}
 
 	if (n > 100)
@@ -206,7 +417,7 @@ int tmr_status(struct re_printf *pf, void *unused)
  */
 void tmr_debug(void)
 {
-	if (!list_isempty(tmrl_get()))
+	if (tmrl_count(tmrl_get()))
 		(void)re_fprintf(stderr, "%H", tmr_status, NULL);
 }
 
@@ -235,14 +446,14 @@ void tmr_init(struct tmr *tmr)
  */
 void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 {
-	struct list *tmrl = tmrl_get();
-	struct le *le;
+	struct tmrl *tmrl = tmrl_get();
+	uint64_t jfs;
 
 	if (!tmr)
 		return;
 
 	if (tmr->th) {
-		list_unlink(&tmr->le);
+		wheel_unlink(tmr);
 	}
 
 	tmr->th  = th;
@@ -251,26 +462,15 @@ void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 	if (!th)
 		return;
 
-	tmr->jfs = delay + tmr_jiffies();
+	jfs = tmr_jiffies();
 
-	if (delay == 0) {
-		le = list_apply(tmrl, true, inspos_handler_0, &tmr->jfs);
-		if (le) {
-			list_insert_before(tmrl, le, &tmr->le, tmr);
-		}
-		else {
-			list_append(tmrl, &tmr->le, tmr);
-		}
-	}
-	else {
-		le = list_apply(tmrl, false, inspos_handler, &tmr->jfs);
-		if (le) {
-			list_insert_after(tmrl, le, &tmr->le, tmr);
-		}
-		else {
-			list_prepend(tmrl, &tmr->le, tmr);
-		}
-	}
+	/* an empty wheel can be moved to the current time */
+	if (!tmrl_count(tmrl))
+		tmrl->jfs = jfs;
+
+	tmr->jfs = delay + jfs;
+
+	wheel_insert(tmrl, tmr, false);
 
 #ifdef HAVE_ACTSCHED
 	/* TODO: this is a hack. when a new timer is started we must reset
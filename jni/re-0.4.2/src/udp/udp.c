@@ -3,6 +3,9 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#if defined (HAVE_RECVMMSG) || defined (HAVE_SENDMMSG)
+#define _GNU_SOURCE 1
+#endif
 #include <stdlib.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -21,12 +24,20 @@
 #ifdef __APPLE__
 #include "TargetConditionals.h"
 #endif
+#if defined (HAVE_RECVMMSG) || defined (HAVE_SENDMMSG)
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SENDMMSG
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#endif
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
 #include <re_main.h>
+#include <re_tmr.h>
 #include <re_sa.h>
 #include <re_net.h>
 #include <re_udp.h>
@@ -55,8 +66,60 @@
 
 
 enum {
-	UDP_RXSZ_DEFAULT = 8192
+	UDP_RXSZ_DEFAULT = 8192,
+	UDP_RXBATCH_MAX  = 64,
+	UDP_RXCOPY_MAX   = 2048,
+	UDP_TXBATCH_MAX  = 64,
+	UDP_TXSZ_DEFAULT = 1500,
+	UDP_GSO_MAX_SEGS = 64,
+	UDP_GSO_MAX_SIZE = 65000
+};
+
+
+#ifdef HAVE_RECVMMSG
+/** Batched receive state with recycled buffers */
+struct udp_rxbatch {
+	struct mmsghdr msgv[UDP_RXBATCH_MAX];
+	struct iovec iov[UDP_RXBATCH_MAX];
+	struct mbuf *mbv[UDP_RXBATCH_MAX];
+	struct sa srcv[UDP_RXBATCH_MAX];
+	struct udp_rxstat stat;
+	unsigned n;
 };
+#endif
+
+
+#ifdef HAVE_SENDMMSG
+/** Queued outgoing datagram */
+struct udp_txpkt {
+	struct sa dst;       /**< Destination address         */
+	size_t pos;          /**< Offset of data in buffer    */
+	size_t len;          /**< Length of datagram          */
+	size_t size;         /**< Space for the datagram      */
+	int fd;              /**< Socket file descriptor      */
+	bool defer;          /**< Left to the batch helper    */
+};
+
+/** Batched send queue */
+struct udp_txbatch {
+	struct mmsghdr msgv[UDP_TXBATCH_MAX];
+	struct iovec iov[UDP_TXBATCH_MAX];
+	unsigned next[UDP_TXBATCH_MAX];
+#ifdef UDP_SEGMENT
+	union {
+		size_t align;
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+	} ctrl[UDP_TXBATCH_MAX];
+#endif
+	struct udp_txpkt pktv[UDP_TXBATCH_MAX];
+	struct mbuf *mb;     /**< Datagrams, back to back     */
+	struct udp_txstat stat; /**< Send statistics          */
+	unsigned n;          /**< Maximum queued datagrams    */
+	unsigned cnt;        /**< Number of queued datagrams  */
+	unsigned ndefer;     /**< Datagrams left to a helper  */
+	bool gso;            /**< UDP segmentation offload    */
+};
+#endif
 
 
 /** Defines a UDP socket */
@@ -70,6 +133,13 @@ struct udp_sock {
 	size_t rxsz;         /**< Maximum receive chunk size  */
 	size_t rx_presz;     /**< Preallocated rx buffer size */
 	int err;             /**< Cached error code           */
+	uint64_t rx_jfs;     /**< When last batch was read    */
+#ifdef HAVE_RECVMMSG
+	struct udp_rxbatch *rxb; /**< Batched receive state   */
+#endif
+#ifdef HAVE_SENDMMSG
+	struct udp_txbatch *txb; /**< Batched send queue      */
+#endif
 };
 
 /** Defines a UDP helper */
@@ -78,6 +148,9 @@ struct udp_helper {
 	int layer;
 	udp_helper_send_h *sendh;
 	udp_helper_recv_h *recvh;
+	udp_helper_send_batch_h *sendbh;
+	udp_helper_recv_batch_h *recvbh;
+	size_t tailroom;
 	void *arg;
 };
 
@@ -118,6 +191,13 @@ static void udp_destructor(void *data)
 
 	list_flush(&us->helpers);
 
+#ifdef HAVE_RECVMMSG
+	mem_deref(us->rxb);
+#endif
+#ifdef HAVE_SENDMMSG
+	mem_deref(us->txb);
+#endif
+
 	if (-1 != us->fd) {
 		fd_close(us->fd);
 		(void)close(us->fd);
@@ -130,11 +210,32 @@ static void udp_destructor(void *data)
 }
 
 
+/*
+ * Pass a received datagram through the helpers, starting at le, to the
+ * receive handler
+ */
+static void udp_recv_mb(struct udp_sock *us, struct le *le, struct sa *src,
+			struct mbuf *mb)
+{
+	while (le) {
+		struct udp_helper *uh = le->data;
+		bool hdld;
+
+		le = le->next;
+
+		hdld = uh->recvh(src, mb, uh->arg);
+		if (hdld)
+			return;
+	}
+
+	us->rh(src, mb, us->arg);
+}
+
+
 static void udp_read(struct udp_sock *us, int fd)
 {
 	struct mbuf *mb = mbuf_alloc(us->rxsz);
 	struct sa src;
-	struct le *le;
 	int err = 0;
 	ssize_t n;
 
@@ -207,23 +308,178 @@ static void udp_read(struct udp_sock *us, int fd)
 
 	(void)mbuf_resize(mb, mb->end);
 
-	/* call helpers */
+	us->rx_jfs = tmr_jiffies();
+
+	udp_recv_mb(us, us->helpers.head, &src, mb);
+
+ out:
+	mem_deref(mb);
+}
+
+
+#ifdef HAVE_RECVMMSG
+static void rxbatch_destructor(void *data)
+{
+	struct udp_rxbatch *rxb = data;
+	unsigned i;
+
+	for (i=0; i<UDP_RXBATCH_MAX; i++)
+		mem_deref(rxb->mbv[i]);
+}
+
+
+/* Get a buffer of the datagram size for receive buffer i */
+static struct mbuf *rxbatch_mbuf(struct udp_sock *us, struct udp_rxbatch *rxb,
+				 unsigned i, size_t len)
+{
+	struct mbuf *mb;
+
+	if (len <= UDP_RXCOPY_MAX) {
+
+		mb = mbuf_alloc(us->rx_presz + len);
+		if (!mb)
+			return NULL;
+
+		memcpy(mb->buf + us->rx_presz,
+		       rxb->mbv[i]->buf + us->rx_presz, len);
+
+		++rxb->stat.n_copy;
+	}
+	else {
+		mb = rxb->mbv[i];
+		rxb->mbv[i] = NULL;
+
+		(void)mbuf_resize(mb, us->rx_presz + len);
+
+		++rxb->stat.n_pass;
+	}
+
+	mb->pos = us->rx_presz;
+	mb->end = us->rx_presz + len;
+
+	return mb;
+}
+
+
+/*
+ * Drain up to N datagrams with one system call. The receive buffers stay
+ * with the socket: datagrams up to UDP_RXCOPY_MAX bytes are copied to a
+ * buffer of their own size before calling the handler, which may keep a
+ * reference (e.g. a jitter buffer). Larger datagrams are passed on in the
+ * shrunk receive buffer, like udp_read() does.
+ *
+ * If the lowest helper has a batch receive handler, it gets all the
+ * datagrams at once, before each of them goes up through the rest of
+ * the helpers.
+ */
+static void udp_read_batch(struct udp_sock *us, int fd)
+{
+	struct udp_rxbatch *rxb = us->rxb;
+	struct mbuf *mbv[UDP_RXBATCH_MAX];
+	bool hdldv[UDP_RXBATCH_MAX];
+	struct udp_helper *uh;
+	struct le *le;
+	unsigned i;
+	int n, err;
+
+	for (i=0; i<rxb->n; i++) {
+
+		struct mbuf *mb = rxb->mbv[i];
+
+		if (!mb || mem_nrefs(mb) > 1 || mb->size < us->rxsz) {
+			mem_deref(mb);
+			mb = rxb->mbv[i] = mbuf_alloc(us->rxsz);
+			if (!mb)
+				break;
+
+			++rxb->stat.n_alloc;
+		}
+		else {
+			++rxb->stat.n_reuse;
+		}
+
+		rxb->iov[i].iov_base = mb->buf + us->rx_presz;
+		rxb->iov[i].iov_len  = mb->size - us->rx_presz;
+
+		memset(&rxb->msgv[i].msg_hdr, 0, sizeof(struct msghdr));
+		rxb->msgv[i].msg_hdr.msg_iov     = &rxb->iov[i];
+		rxb->msgv[i].msg_hdr.msg_iovlen  = 1;
+		rxb->msgv[i].msg_hdr.msg_name    = &rxb->srcv[i].u.sa;
+		rxb->msgv[i].msg_hdr.msg_namelen = sizeof(rxb->srcv[i].u);
+	}
+
+	if (!i)
+		return;
+
+	n = recvmmsg(fd, rxb->msgv, i, 0, NULL);
+	if (n < 0) {
+		err = errno;
+
+		if (EAGAIN == err)
+			return;
+
+#ifdef EWOULDBLOCK
+		if (EWOULDBLOCK == err)
+			return;
+#endif
+
+		/* cache error code */
+		us->err = err;
+
+		return;
+	}
+
+	us->rx_jfs = tmr_jiffies();
+
+	for (i=0; i<(unsigned)n; i++) {
+
+		rxb->srcv[i].len = rxb->msgv[i].msg_hdr.msg_namelen;
+
+		mbv[i]   = rxbatch_mbuf(us, rxb, i, rxb->msgv[i].msg_len);
+		hdldv[i] = (mbv[i] == NULL);
+	}
+
+	/* keep the socket alive while calling handlers */
+	mem_ref(us);
+
 	le = us->helpers.head;
-	while (le) {
-		struct udp_helper *uh = le->data;
-		bool hdld;
+	uh = list_ledata(le);
 
+	if (uh && uh->recvbh) {
+		uh->recvbh(rxb->srcv, mbv, hdldv, n, uh->arg);
 		le = le->next;
+	}
 
-		hdld = uh->recvh(&src, mb, uh->arg);
-		if (hdld)
-			goto out;
+	for (i=0; i<(unsigned)n; i++) {
+
+		if (!hdldv[i])
+			udp_recv_mb(us, le, &rxb->srcv[i], mbv[i]);
+
+		mbv[i] = mem_deref(mbv[i]);
+
+		/* socket was closed by the handler */
+		if (mem_nrefs(us) == 1 || us->rxb != rxb)
+			break;
 	}
 
-	us->rh(&src, mb, us->arg);
+	for (; i<(unsigned)n; i++)
+		mem_deref(mbv[i]);
 
- out:
-	mem_deref(mb);
+	mem_deref(us);
+}
+#endif
+
+
+static void udp_recv_handler(struct udp_sock *us, int fd)
+{
+#ifdef HAVE_RECVMMSG
+	if (us->rxb) {
+		udp_read_batch(us, fd);
+		return;
+	}
+#endif
+
+	udp_read(us, fd);
 }
 
 
@@ -233,7 +489,7 @@ static void udp_read_handler(int flags, void *arg)
 
 	(void)flags;
 
-	udp_read(us, us->fd);
+	udp_recv_handler(us, us->fd);
 }
 
 
@@ -243,7 +499,7 @@ static void udp_read_handler6(int flags, void *arg)
 
 	(void)flags;
 
-	udp_read(us, us->fd6);
+	udp_recv_handler(us, us->fd6);
 }
 
 
@@ -411,8 +667,255 @@ void udp_connect(struct udp_sock *us, bool conn)
 }
 
 
+#ifdef HAVE_SENDMMSG
+static void txbatch_destructor(void *data)
+{
+	struct udp_txbatch *txb = data;
+
+	mem_deref(txb->mb);
+}
+
+
+/*
+ * Build messages for queued datagrams, starting at index i, that go out
+ * on the same socket. With segmentation offload, consecutive datagrams
+ * of equal size to the same destination are merged into one message
+ * (the last segment may be shorter).
+ */
+static unsigned txbatch_build(struct udp_txbatch *txb, unsigned i)
+{
+	const int fd = txb->pktv[i].fd;
+	unsigned nmsg = 0;
+
+	while (i < txb->cnt && txb->pktv[i].fd == fd) {
+
+		const struct udp_txpkt *pkt = &txb->pktv[i];
+		struct msghdr *hdr = &txb->msgv[nmsg].msg_hdr;
+		size_t len = pkt->len;
+		unsigned j = i + 1;
+
+#ifdef UDP_SEGMENT
+		while (txb->gso && j < txb->cnt &&
+		       j - i < UDP_GSO_MAX_SEGS &&
+		       txb->pktv[j].fd == fd &&
+		       txb->pktv[j].pos == pkt->pos + len &&
+		       txb->pktv[j-1].len == pkt->len &&
+		       txb->pktv[j].len <= pkt->len &&
+		       len + txb->pktv[j].len <= UDP_GSO_MAX_SIZE &&
+		       sa_cmp(&txb->pktv[j].dst, &pkt->dst, SA_ALL)) {
+
+			len += txb->pktv[j].len;
+			++j;
+		}
+#endif
+
+		memset(hdr, 0, sizeof(*hdr));
+
+		txb->iov[nmsg].iov_base = txb->mb->buf + pkt->pos;
+		txb->iov[nmsg].iov_len  = len;
+
+		hdr->msg_name    = (void *)&pkt->dst.u.sa;
+		hdr->msg_namelen = pkt->dst.len;
+		hdr->msg_iov     = &txb->iov[nmsg];
+		hdr->msg_iovlen  = 1;
+
+#ifdef UDP_SEGMENT
+		if (j - i > 1) {
+			struct cmsghdr *cm;
+
+			hdr->msg_control    = txb->ctrl[nmsg].buf;
+			hdr->msg_controllen = sizeof(txb->ctrl[nmsg].buf);
+
+			cm = CMSG_FIRSTHDR(hdr);
+			cm->cmsg_level = IPPROTO_UDP;
+			cm->cmsg_type  = UDP_SEGMENT;
+			cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+			*(uint16_t *)(void *)CMSG_DATA(cm) = (uint16_t)pkt->len;
+		}
+#endif
+
+		txb->next[nmsg++] = j;
+		i = j;
+	}
+
+	return nmsg;
+}
+
+
+/*
+ * Pass the deferred datagrams to the batch send handler of the lowest
+ * helper, in views of the send queue. The helper may append up to its
+ * tailroom to each datagram. If the handler fails, or the helper is
+ * gone, the deferred datagrams are dropped.
+ */
+static int txbatch_helper(struct udp_sock *us, struct udp_txbatch *txb)
+{
+	struct udp_helper *uh = list_ledata(us->helpers.head);
+	struct mbuf mbv[UDP_TXBATCH_MAX], *mbpv[UDP_TXBATCH_MAX];
+	const struct sa *dstv[UDP_TXBATCH_MAX];
+	unsigned i, j, n = 0;
+	int err;
+
+	for (i=0; i<txb->cnt; i++) {
+
+		struct udp_txpkt *pkt = &txb->pktv[i];
+		struct mbuf *mb = &mbv[n];
+
+		if (!pkt->defer)
+			continue;
+
+		mb->buf  = txb->mb->buf + pkt->pos;
+		mb->size = pkt->size;
+		mb->pos  = 0;
+		mb->end  = pkt->len;
+
+		mbpv[n] = mb;
+		dstv[n] = &pkt->dst;
+		++n;
+	}
+
+	if (uh && uh->sendbh)
+		err = uh->sendbh(dstv, mbpv, n, uh->arg);
+	else
+		err = ENOENT;
+
+	for (i=0, j=0, n=0; i<txb->cnt; i++) {
+
+		struct udp_txpkt *pkt = &txb->pktv[i];
+
+		if (pkt->defer) {
+
+			const struct mbuf *mb = &mbv[n++];
+
+			if (err || mb->end > mb->size || mb->pos > mb->end)
+				continue;
+
+			pkt->pos  += mb->pos;
+			pkt->len   = mb->end - mb->pos;
+			pkt->defer = false;
+		}
+
+		txb->pktv[j++] = *pkt;
+	}
+
+	txb->cnt    = j;
+	txb->ndefer = 0;
+
+	return err;
+}
+
+
+static int txbatch_flush(struct udp_sock *us)
+{
+	struct udp_txbatch *txb = us->txb;
+	unsigned i = 0;
+	int err = 0;
+
+	if (txb->ndefer)
+		err = txbatch_helper(us, txb);
+
+	while (i < txb->cnt) {
+
+		const int fd = txb->pktv[i].fd;
+		unsigned nmsg;
+		int n;
+
+		nmsg = txbatch_build(txb, i);
+
+		n = sendmmsg(fd, txb->msgv, nmsg, 0);
+		++txb->stat.n_syscall;
+		if (n < 0) {
+			const int e = errno;
+
+			/* segmentation offload not usable, resend */
+			if (txb->msgv[0].msg_hdr.msg_control &&
+			    (e == EIO || e == EINVAL || e == EOPNOTSUPP)) {
+				DEBUG_INFO("send: disabling GSO (%m)\n", e);
+				txb->gso = false;
+				continue;
+			}
+
+			/* drop the failed message, like sendto() would */
+			if (!err)
+				err = e;
+
+			i = txb->next[0];
+			continue;
+		}
+
+		/* continue after the last sent message */
+		txb->stat.n_dgram += txb->next[n-1] - i;
+		txb->stat.n_msg   += n;
+		i = txb->next[n-1];
+	}
+
+	txb->cnt = 0;
+	mbuf_rewind(txb->mb);
+
+	return err;
+}
+
+
+/* Check if the kernel supports UDP segmentation offload */
+static bool gso_supported(int fd)
+{
+#ifdef UDP_SEGMENT
+	socklen_t len;
+	int val;
+
+	len = sizeof(val);
+
+	return 0 == getsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &val, &len);
+#else
+	(void)fd;
+	return false;
+#endif
+}
+
+
+/* Queue a datagram, with room after it for a deferring helper */
+static int txbatch_add(struct udp_sock *us, int fd, const struct sa *dst,
+		       const struct mbuf *mb, const struct udp_helper *uh)
+{
+	struct udp_txbatch *txb = us->txb;
+	struct udp_txpkt *pkt;
+	int err = 0;
+
+	if (txb->cnt >= txb->n)
+		err = txbatch_flush(us);
+
+	pkt = &txb->pktv[txb->cnt];
+
+	pkt->pos   = txb->mb->end;
+	pkt->len   = mbuf_get_left(mb);
+	pkt->size  = pkt->len + (uh ? uh->tailroom : 0);
+	pkt->fd    = fd;
+	pkt->defer = (uh != NULL);
+	sa_cpy(&pkt->dst, dst);
+
+	txb->mb->pos = txb->mb->end;
+	if (mbuf_write_mem(txb->mb, mbuf_buf(mb), pkt->len))
+		return ENOMEM;
+
+	if (pkt->size > pkt->len) {
+		if (mbuf_resize(txb->mb, pkt->pos + pkt->size))
+			return ENOMEM;
+
+		txb->mb->end = pkt->pos + pkt->size;
+	}
+
+	if (pkt->defer)
+		++txb->ndefer;
+
+	++txb->cnt;
+
+	return err;
+}
+#endif
+
+
 static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
-			     struct mbuf *mb, struct le *le)
+			     struct mbuf *mb, struct le *le, bool queue)
 {
 	struct sa hdst;
 	int err = 0, fd;
@@ -436,6 +939,12 @@ static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
 
 		le = le->prev;
 
+#ifdef HAVE_SENDMMSG
+		/* the lowest helper may take the queued datagrams at once */
+		if (!le && uh->sendbh && queue && us->txb && !us->conn)
+			return txbatch_add(us, fd, dst, mb, uh);
+#endif
+
 		if (dst != &hdst) {
 			sa_cpy(&hdst, dst);
 			dst = &hdst;
@@ -445,6 +954,13 @@ static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
 			return err;
 	}
 
+#ifdef HAVE_SENDMMSG
+	if (queue && us->txb && !us->conn)
+		return txbatch_add(us, fd, dst, mb, NULL);
+#else
+	(void)queue;
+#endif
+
 	/* Connected socket? */
 	if (us->conn) {
 		if (0 != connect(fd, &dst->u.sa, dst->len)) {
@@ -480,7 +996,51 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 	if (!us || !dst || !mb)
 		return EINVAL;
 
-	return udp_send_internal(us, dst, mb, us->helpers.tail);
+	return udp_send_internal(us, dst, mb, us->helpers.tail, false);
+}
+
+
+/**
+ * Queue a UDP Datagram for sending to a peer. The datagram is passed
+ * through the UDP helpers and copied to the send queue of the socket,
+ * so the buffer can be reused at once. Queued datagrams are sent with
+ * udp_flush(), or when the queue is full. If batched sending is not
+ * enabled on the socket the datagram is sent immediately.
+ *
+ * @param us  UDP Socket
+ * @param dst Destination network address
+ * @param mb  Buffer to send
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_send_queue(struct udp_sock *us, const struct sa *dst,
+		   struct mbuf *mb)
+{
+	if (!us || !dst || !mb)
+		return EINVAL;
+
+	return udp_send_internal(us, dst, mb, us->helpers.tail, true);
+}
+
+
+/**
+ * Send all queued UDP Datagrams on a UDP Socket
+ *
+ * @param us UDP Socket
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_flush(struct udp_sock *us)
+{
+	if (!us)
+		return EINVAL;
+
+#ifdef HAVE_SENDMMSG
+	if (us->txb && us->txb->cnt)
+		return txbatch_flush(us);
+#endif
+
+	return 0;
 }
 
 
@@ -504,7 +1064,7 @@ int udp_send_anon(const struct sa *dst, struct mbuf *mb)
 	if (err)
 		return err;
 
-	err = udp_send_internal(us, dst, mb, NULL);
+	err = udp_send_internal(us, dst, mb, NULL, false);
 	mem_deref(us);
 
 	return err;
@@ -610,6 +1170,147 @@ void udp_rxsz_set(struct udp_sock *us, size_t rxsz)
 }
 
 
+/**
+ * Set the number of datagrams to receive per read event on a UDP Socket.
+ * The receive buffers are reused, and each datagram is passed to the
+ * receive handler in a buffer of its own size.
+ *
+ * @param us UDP Socket
+ * @param n  Maximum number of datagrams per read, 0 or 1 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_rxbatch_set(struct udp_sock *us, unsigned n)
+{
+	if (!us)
+		return EINVAL;
+
+#ifdef HAVE_RECVMMSG
+	if (n <= 1) {
+		us->rxb = mem_deref(us->rxb);
+		return 0;
+	}
+
+	if (!us->rxb) {
+		us->rxb = mem_zalloc(sizeof(*us->rxb), rxbatch_destructor);
+		if (!us->rxb)
+			return ENOMEM;
+	}
+
+	us->rxb->n = min(n, UDP_RXBATCH_MAX);
+
+	return 0;
+#else
+	return n <= 1 ? 0 : ENOSYS;
+#endif
+}
+
+
+/**
+ * Get the batched receive statistics of a UDP Socket
+ *
+ * @param us UDP Socket
+ * @param st Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_rxbatch_stat(const struct udp_sock *us, struct udp_rxstat *st)
+{
+	if (!us || !st)
+		return EINVAL;
+
+#ifdef HAVE_RECVMMSG
+	if (!us->rxb)
+		return ENOENT;
+
+	*st = us->rxb->stat;
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Get the batched send statistics of a UDP Socket
+ *
+ * @param us UDP Socket
+ * @param st Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_txbatch_stat(const struct udp_sock *us, struct udp_txstat *st)
+{
+	if (!us || !st)
+		return EINVAL;
+
+#ifdef HAVE_SENDMMSG
+	if (!us->txb)
+		return ENOENT;
+
+	*st = us->txb->stat;
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Set the maximum number of datagrams in the send queue of a UDP Socket.
+ * Datagrams queued with udp_send_queue() are sent with one system call,
+ * using UDP segmentation offload where the kernel supports it.
+ *
+ * @param us UDP Socket
+ * @param n  Maximum number of queued datagrams, 0 or 1 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_txbatch_set(struct udp_sock *us, unsigned n)
+{
+	if (!us)
+		return EINVAL;
+
+#ifdef HAVE_SENDMMSG
+	if (n <= 1) {
+		if (us->txb)
+			(void)udp_flush(us);
+		us->txb = mem_deref(us->txb);
+		return 0;
+	}
+
+	if (!us->txb) {
+		struct udp_txbatch *txb;
+
+		txb = mem_zalloc(sizeof(*txb), txbatch_destructor);
+		if (!txb)
+			return ENOMEM;
+
+		txb->mb = mbuf_alloc(UDP_TXBATCH_MAX * UDP_TXSZ_DEFAULT);
+		if (!txb->mb) {
+			mem_deref(txb);
+			return ENOMEM;
+		}
+
+		txb->gso = gso_supported(-1 != us->fd ? us->fd : us->fd6);
+
+		us->txb = txb;
+	}
+	else if (us->txb->cnt >= n) {
+		(void)udp_flush(us);
+	}
+
+	us->txb->n = min(n, UDP_TXBATCH_MAX);
+
+	return 0;
+#else
+	return n <= 1 ? 0 : ENOSYS;
+#endif
+}
+
+
 /**
  * Set preallocated space on receive buffer.
  *
@@ -664,6 +1365,23 @@ int udp_sock_fd(const struct udp_sock *us, int af)
 }
 
 
+/**
+ * Get the time when the datagrams being handled were received. All
+ * datagrams read with one system call have the same time.
+ *
+ * @param us UDP Socket
+ *
+ * @return Receive time in [ms], see tmr_jiffies()
+ */
+uint64_t udp_rx_jiffies(const struct udp_sock *us)
+{
+	if (!us || !us->rx_jfs)
+		return tmr_jiffies();
+
+	return us->rx_jfs;
+}
+
+
 /**
  * Attach the current thread to the UDP Socket
  *
@@ -792,5 +1510,36 @@ int udp_send_helper(struct udp_sock *us, const struct sa *dst,
 	if (!us || !dst || !mb || !uh)
 		return EINVAL;
 
-	return udp_send_internal(us, dst, mb, uh->le.prev);
+	return udp_send_internal(us, dst, mb, uh->le.prev, false);
+}
+
+
+/**
+ * Set the batch handlers of a UDP helper. They are used for the lowest
+ * helper of a socket, in addition to its per-datagram handlers: the
+ * datagrams queued with udp_send_queue() are passed to the send handler
+ * in one call when the queue is flushed, and the datagrams read in one
+ * batch (see udp_rxbatch_set()) are passed to the receive handler before
+ * going through the other helpers. The send handler may append up to
+ * tailroom bytes to each datagram, but must not resize the buffers.
+ *
+ * @param uh       UDP Helper
+ * @param tailroom Bytes the send handler may append to a datagram
+ * @param sbh      Batch send handler, or NULL
+ * @param rbh      Batch receive handler, or NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_helper_batch_set(struct udp_helper *uh, size_t tailroom,
+			 udp_helper_send_batch_h *sbh,
+			 udp_helper_recv_batch_h *rbh)
+{
+	if (!uh)
+		return EINVAL;
+
+	uh->tailroom = tailroom;
+	uh->sendbh   = sbh;
+	uh->recvbh   = rbh;
+
+	return 0;
 }
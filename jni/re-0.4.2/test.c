@@ -0,0 +1,153 @@
+/**
+ * @file test.c  Selftest and benchmarks for libre
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <time.h>
+#include <re.h>
+#include "tests/test.h"
+
+
+#define DEBUG_MODULE "test"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+struct test {
+	int (*exec)(void);
+	const char *name;
+};
+
+#define TEST(a) {a, #a}
+
+static const struct test tests[] = {
+	TEST(test_dns_cache_lru),
+	TEST(test_dns_cache_pending),
+	TEST(test_hmac_sha1),
+	TEST(test_jbuf_fixed),
+	TEST(test_jbuf_jump),
+	TEST(test_jbuf_adaptive),
+	TEST(test_jbuf_delay),
+	TEST(test_mem),
+	TEST(test_rtp_members),
+#ifndef USE_OPENSSL
+	TEST(test_sha1),
+#endif
+	TEST(test_sip_frame),
+	TEST(test_sip_msg),
+#ifdef USE_OPENSSL
+	TEST(test_srtp),
+	TEST(test_srtcp),
+#endif
+	TEST(test_stun_ctrans),
+	TEST(test_tcp_sendq),
+	TEST(test_tmr_order),
+	TEST(test_tmr_count),
+	TEST(test_udp_rxbatch),
+	TEST(test_udp_txbatch),
+	TEST(test_udp_helper_batch),
+	TEST(test_worker),
+};
+
+static const struct test perf_tests[] = {
+	TEST(test_perf_hmac_sha1),
+	TEST(test_perf_rtp_rx),
+	TEST(test_perf_sip_frame),
+	TEST(test_perf_sip_msg),
+#ifdef USE_OPENSSL
+	TEST(test_perf_srtp),
+#endif
+	TEST(test_perf_stun_ctrans),
+	TEST(test_perf_tmr),
+	TEST(test_perf_udp_rx),
+	TEST(test_perf_udp_tx),
+};
+
+
+/**
+ * Get a monotonic time stamp for benchmarks
+ *
+ * @return Time in [ns]
+ */
+uint64_t test_nsec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int run(const struct test *testv, size_t testc, const char *name)
+{
+	size_t i, n = 0;
+	int err = 0;
+
+	for (i=0; i<testc; i++) {
+
+		int e;
+
+		if (name && !strstr(testv[i].name, name))
+			continue;
+
+		e = testv[i].exec();
+		if (e) {
+			DEBUG_WARNING("%s: failed (%m)\n", testv[i].name, e);
+			err = e;
+		}
+
+		++n;
+	}
+
+	(void)re_printf("%zu test%s run, %s\n", n, n == 1 ? "" : "s",
+			err ? "FAILED" : "OK");
+
+	return err;
+}
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr, "usage: test [-p] [name]\n"
+			 "\t-p      Run benchmarks instead of tests\n"
+			 "\tname    Only run tests matching name\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	const struct test *testv = tests;
+	size_t testc = ARRAY_SIZE(tests);
+	const char *name = NULL;
+	int i, err;
+
+	for (i=1; i<argc; i++) {
+
+		if (0 == strcmp(argv[i], "-p")) {
+			testv = perf_tests;
+			testc = ARRAY_SIZE(perf_tests);
+		}
+		else if (argv[i][0] == '-') {
+			usage();
+			return 2;
+		}
+		else {
+			name = argv[i];
+		}
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	err = run(testv, testc, name);
+
+	libre_close();
+
+	tmr_debug();
+	mem_debug();
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+/**
+ * @file tests/dns.c  DNS Client cache -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+enum {
+	CACHE_SIZE = 3,
+	TTL        = 3600,
+	TIMEOUT    = 5000,
+};
+
+
+/* A DNS server on loopback, answering A queries with 127.0.0.1 */
+struct dnstest {
+	struct udp_sock *us;
+	struct dnsc *dnsc;
+	struct sa srv;
+	struct tmr tmr;
+	unsigned n_query;  /* Queries seen by the server */
+	bool hold;         /* Do not answer              */
+	bool done;
+	int err;
+};
+
+
+static void timeout_handler(void *arg)
+{
+	struct dnstest *dt = arg;
+
+	dt->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static void srv_recv_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct dnstest *dt = arg;
+	struct dnsrr rr;
+	struct dnshdr hdr;
+	struct mbuf *mbr = NULL;
+	char *name = NULL;
+	uint16_t type, dnsclass;
+	int err;
+
+	++dt->n_query;
+
+	err = dns_hdr_decode(mb, &hdr);
+	if (err)
+		goto out;
+
+	err = dns_dname_decode(mb, &name, 0);
+	if (err)
+		goto out;
+
+	if (mbuf_get_left(mb) < 4) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	type     = ntohs(mbuf_read_u16(mb));
+	dnsclass = ntohs(mbuf_read_u16(mb));
+
+	if (dt->hold)
+		goto out;
+
+	mbr = mbuf_alloc(512);
+	if (!mbr) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	hdr.qr   = true;
+	hdr.ra   = true;
+	hdr.nq   = 1;
+	hdr.nans = 1;
+
+	memset(&rr, 0, sizeof(rr));
+	rr.name        = name;
+	rr.type        = type;
+	rr.dnsclass    = dnsclass;
+	rr.ttl         = TTL;
+	rr.rdlen       = 4;
+	rr.rdata.a.addr = 0x7f000001;
+
+	err  = dns_hdr_encode(mbr, &hdr);
+	err |= dns_dname_encode(mbr, name, NULL, 0, false);
+	err |= mbuf_write_u16(mbr, htons(type));
+	err |= mbuf_write_u16(mbr, htons(dnsclass));
+	err |= dns_rr_encode(mbr, &rr, 0, NULL, 0);
+	if (err)
+		goto out;
+
+	mbr->pos = 0;
+	err = udp_send(dt->us, src, mbr);
+
+ out:
+	if (err) {
+		dt->err = err;
+		re_cancel();
+	}
+
+	mem_deref(mbr);
+	mem_deref(name);
+}
+
+
+static void query_handler(int err, const struct dnshdr *hdr,
+			  struct list *ansl, struct list *authl,
+			  struct list *addl, void *arg)
+{
+	struct dnstest *dt = arg;
+	const struct dnsrr *rr = list_ledata(list_head(ansl));
+	(void)hdr;
+	(void)authl;
+	(void)addl;
+
+	if (!err && (!rr || rr->type != DNS_TYPE_A ||
+		     rr->rdata.a.addr != 0x7f000001))
+		err = EBADMSG;
+
+	dt->err  = err;
+	dt->done = true;
+	re_cancel();
+}
+
+
+/* Resolve a name and return the number of queries sent to the server */
+static int resolve(struct dnstest *dt, const char *name, unsigned *n_query)
+{
+	const unsigned n = dt->n_query;
+	int err;
+
+	dt->done = false;
+
+	err = dnsc_query(NULL, dt->dnsc, name, DNS_TYPE_A, DNS_CLASS_IN,
+			 true, query_handler, dt);
+	if (err)
+		return err;
+
+	tmr_start(&dt->tmr, TIMEOUT, timeout_handler, dt);
+
+	while (!dt->done && !dt->err)
+		err = re_main(NULL);
+
+	tmr_cancel(&dt->tmr);
+
+	if (n_query)
+		*n_query = dt->n_query - n;
+
+	return err ? err : dt->err;
+}
+
+
+static int dnstest_init(struct dnstest *dt)
+{
+	struct dnsc_conf conf;
+	int err;
+
+	memset(dt, 0, sizeof(*dt));
+	tmr_init(&dt->tmr);
+
+	err = sa_set_str(&dt->srv, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err = udp_listen(&dt->us, &dt->srv, srv_recv_handler, dt);
+	if (err)
+		return err;
+
+	err = udp_local_get(dt->us, &dt->srv);
+	if (err)
+		return err;
+
+	memset(&conf, 0, sizeof(conf));
+	conf.query_hash_size = 16;
+	conf.tcp_hash_size   = 2;
+	conf.conn_timeout    = 1000;
+	conf.idle_timeout    = 1000;
+	conf.cache_size      = CACHE_SIZE;
+
+	return dnsc_alloc(&dt->dnsc, &conf, &dt->srv, 1);
+}
+
+
+static void dnstest_close(struct dnstest *dt)
+{
+	tmr_cancel(&dt->tmr);
+	mem_deref(dt->dnsc);
+	mem_deref(dt->us);
+}
+
+
+/* A full cache removes the least recently used reply */
+int test_dns_cache_lru(void)
+{
+	static const char *namev[] = {"a.test", "b.test", "c.test"};
+	struct dnstest dt;
+	unsigned n, i;
+	int err;
+
+	err = dnstest_init(&dt);
+	TEST_ERR(err);
+
+	for (i=0; i<ARRAY_SIZE(namev); i++) {
+		err = resolve(&dt, namev[i], &n);
+		TEST_ERR(err);
+		TEST_EQUALS(1, n);
+	}
+
+	/* a.test is used again, b.test is now the oldest */
+	err = resolve(&dt, "a.test", &n);
+	TEST_ERR(err);
+	TEST_EQUALS(0, n);
+
+	err = resolve(&dt, "d.test", &n);
+	TEST_ERR(err);
+	TEST_EQUALS(1, n);
+
+	err = resolve(&dt, "a.test", &n);
+	TEST_ERR(err);
+	TEST_EQUALS(0, n);
+
+	err = resolve(&dt, "c.test", &n);
+	TEST_ERR(err);
+	TEST_EQUALS(0, n);
+
+	err = resolve(&dt, "b.test", &n);
+	TEST_ERR(err);
+	TEST_EQUALS(1, n);
+
+ out:
+	dnstest_close(&dt);
+
+	return err;
+}
+
+
+/* Queries in progress fill the cache, further queries are not cached */
+int test_dns_cache_pending(void)
+{
+	static const char *namev[] = {"a.test", "b.test", "c.test",
+				      "d.test", "d.test"};
+	struct dns_query *qv[ARRAY_SIZE(namev)];
+	struct dnstest dt;
+	char *dbg = NULL;
+	unsigned i;
+	int err;
+
+	memset(qv, 0, sizeof(qv));
+
+	err = dnstest_init(&dt);
+	TEST_ERR(err);
+
+	dt.hold = true;
+
+	for (i=0; i<ARRAY_SIZE(namev); i++) {
+		err = dnsc_query(&qv[i], dt.dnsc, namev[i], DNS_TYPE_A,
+				 DNS_CLASS_IN, true, query_handler, &dt);
+		TEST_ERR(err);
+	}
+
+	/* the queries are sent, d.test twice since it is not cached */
+	tmr_start(&dt.tmr, 100, timeout_handler, &dt);
+	err = re_main(NULL);
+	TEST_ERR(err);
+	TEST_EQUALS(ETIMEDOUT, dt.err);
+	TEST_EQUALS(5, dt.n_query);
+	TEST_ASSERT(!dt.done);
+
+	err = re_sdprintf(&dbg, "%H", dnsc_debug, dt.dnsc);
+	TEST_ERR(err);
+	TEST_ASSERT(NULL != strstr(dbg, "cache: 3/3 entries (3 pending)"));
+	TEST_ASSERT(NULL != strstr(dbg, "uncached=2"));
+
+ out:
+	for (i=0; i<ARRAY_SIZE(qv); i++)
+		mem_deref(qv[i]);
+	mem_deref(dbg);
+	dnstest_close(&dt);
+
+	return err;
+}
@@ -0,0 +1,305 @@
+/**
+ * @file tests/hmac.c  HMAC-SHA1 and SHA-1 -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <re_hmac.h>
+#include <re_sha.h>
+#include "test.h"
+
+
+enum {
+	DIGEST_SIZE = 20,
+	STUN_SIZE   = 80,    /* A Binding request with USERNAME */
+	PERF_HMAC   = 200000,
+	PERF_BYTES  = 64 * 1024 * 1024,
+};
+
+
+/* RFC 2202 section 3; keys and data of repeated bytes are built */
+static const struct {
+	uint8_t key;         /* Repeated key byte, 0 for a string  */
+	size_t key_len;
+	const char *key_str;
+	uint8_t data;        /* Repeated data byte, 0 for a string */
+	size_t data_len;
+	const char *data_str;
+	const char *digest;
+} rfc2202v[] = {
+	{0x0b, 20, NULL, 0, 0, "Hi There",
+	 "b617318655057264e28bc0b6fb378c8ef146be00"},
+	{0, 0, "Jefe", 0, 0, "what do ya want for nothing?",
+	 "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79"},
+	{0xaa, 20, NULL, 0xdd, 50, NULL,
+	 "125d7342b9ac11cd91a39af48aa17b4f63f175d3"},
+	{0x01, 25, NULL, 0xcd, 50, NULL,
+	 "4c9007f4026250c6bc8414f9bf50c86c2d7235da"},
+	{0x0c, 20, NULL, 0, 0, "Test With Truncation",
+	 "4c1a03424b55e07fe7f27be1d58bb9324a9a5a04"},
+	{0xaa, 80, NULL, 0, 0,
+	 "Test Using Larger Than Block-Size Key - Hash Key First",
+	 "aa4ae5e15272d00e95705637ce8a3b55ed402112"},
+	{0xaa, 80, NULL, 0, 0,
+	 "Test Using Larger Than Block-Size Key and Larger"
+	 " Than One Block-Size Data",
+	 "e8e99d0f45237d786d6bbaa7965c7808bbff1a91"},
+};
+
+
+static size_t vec_fill(uint8_t *buf, uint8_t b, size_t n, const char *str)
+{
+	size_t i;
+
+	if (str) {
+		n = strlen(str);
+		memcpy(buf, str, n);
+		return n;
+	}
+
+	/* test case 4 counts up from 0x01 */
+	for (i=0; i<n; i++)
+		buf[i] = (b == 0x01) ? (uint8_t)(i + 1) : b;
+
+	return n;
+}
+
+
+/* The test vectors, with and without a precomputed key */
+int test_hmac_sha1(void)
+{
+	struct hmac_sha1_ctx *ctx = NULL;
+	uint8_t key[80], data[80];
+	uint8_t ref[DIGEST_SIZE], md[DIGEST_SIZE];
+	size_t i, lk, ld;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(rfc2202v); i++) {
+
+		lk = vec_fill(key, rfc2202v[i].key, rfc2202v[i].key_len,
+			      rfc2202v[i].key_str);
+		ld = vec_fill(data, rfc2202v[i].data, rfc2202v[i].data_len,
+			      rfc2202v[i].data_str);
+
+		err = str_hex(ref, sizeof(ref), rfc2202v[i].digest);
+		TEST_ERR(err);
+
+		hmac_sha1(key, lk, data, ld, md, sizeof(md));
+		TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+
+		ctx = mem_deref(ctx);
+		err = hmac_sha1_ctx_alloc(&ctx, key, lk);
+		TEST_ERR(err);
+
+		/* the context is not changed by a digest */
+		memset(md, 0, sizeof(md));
+		hmac_sha1_ctx_digest(ctx, data, ld, md, sizeof(md));
+		TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+
+		memset(md, 0, sizeof(md));
+		hmac_sha1_ctx_digest(ctx, data, ld, md, sizeof(md));
+		TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+
+		/* truncated */
+		memset(md, 0, sizeof(md));
+		hmac_sha1_ctx_digest(ctx, data, ld, md, 12);
+		TEST_ASSERT(0 == memcmp(ref, md, 12));
+		TEST_ASSERT(md[12] == 0);
+	}
+
+ out:
+	mem_deref(ctx);
+
+	return err;
+}
+
+
+#ifndef USE_OPENSSL
+
+/* The portable block transform, exported by sha1.c */
+void SHA1_Transform(uint32_t state[5], const uint8_t buffer[64]);
+
+
+/* SHA-1 with the portable transform only, one block at a time */
+static void sha1_ref(uint8_t *md, const uint8_t *d, size_t n)
+{
+	uint32_t state[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+	};
+	const uint64_t bits = (uint64_t)n * 8;
+	uint8_t blk[64];
+	size_t i, r;
+
+	for (; n >= 64; n -= 64, d += 64)
+		SHA1_Transform(state, d);
+
+	memset(blk, 0, sizeof(blk));
+	memcpy(blk, d, n);
+	blk[n] = 0x80;
+
+	if (n >= 56) {
+		SHA1_Transform(state, blk);
+		memset(blk, 0, sizeof(blk));
+	}
+
+	for (r=0; r<8; r++)
+		blk[63 - r] = (uint8_t)(bits >> (8 * r));
+
+	SHA1_Transform(state, blk);
+
+	for (i=0; i<DIGEST_SIZE; i++)
+		md[i] = (uint8_t)(state[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+
+static void sha1_split(uint8_t *md, const uint8_t *d, size_t n,
+		       size_t chunk)
+{
+	SHA1_CTX ctx;
+	size_t i;
+
+	SHA1_Init(&ctx);
+
+	for (i=0; i<n; i+=chunk)
+		SHA1_Update(&ctx, d + i, min(chunk, n - i));
+
+	SHA1_Final(md, &ctx);
+}
+
+
+/*
+ * The FIPS 180-1 vectors, and random input in random pieces, which goes
+ * through the accelerated transform where the CPU has one
+ */
+int test_sha1(void)
+{
+	static const struct {
+		const char *str;
+		const char *digest;
+	} fipsv[] = {
+		{"abc", "a9993e364706816aba3e25717850c26c9cd0d89d"},
+		{"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		 "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+	};
+	uint8_t ref[DIGEST_SIZE], md[DIGEST_SIZE];
+	uint8_t *buf;
+	size_t i, n;
+	int err = 0;
+
+	buf = mem_alloc(1000000, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	for (i=0; i<ARRAY_SIZE(fipsv); i++) {
+
+		err = str_hex(ref, sizeof(ref), fipsv[i].digest);
+		TEST_ERR(err);
+
+		n = strlen(fipsv[i].str);
+
+		sha1_split(md, (const uint8_t *)fipsv[i].str, n, n);
+		TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+
+		sha1_ref(md, (const uint8_t *)fipsv[i].str, n);
+		TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+	}
+
+	/* one million times 'a' */
+	memset(buf, 'a', 1000000);
+	err = str_hex(ref, sizeof(ref),
+		      "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+	TEST_ERR(err);
+
+	sha1_split(md, buf, 1000000, 1000000);
+	TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+
+	sha1_split(md, buf, 1000000, 999);
+	TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+
+	for (i=0; i<1000000; i++)
+		buf[i] = (uint8_t)rand();
+
+	for (i=0; i<500; i++) {
+
+		n = (size_t)rand() % 4096;
+
+		sha1_ref(ref, buf, n);
+		sha1_split(md, buf, n, 1 + (size_t)rand() % 200);
+		TEST_ASSERT(0 == memcmp(ref, md, sizeof(md)));
+	}
+
+ out:
+	mem_deref(buf);
+
+	return err;
+}
+
+#endif
+
+
+int test_perf_hmac_sha1(void)
+{
+	struct hmac_sha1_ctx *ctx = NULL;
+	uint8_t key[16], msg[STUN_SIZE], md[DIGEST_SIZE];
+	uint64_t t0, t_key, t_ctx;
+	unsigned i;
+	int err;
+#ifndef USE_OPENSSL
+	uint64_t t_ref, t_upd;
+	uint32_t state[5] = {0};
+	uint8_t *buf;
+	SHA1_CTX sctx;
+#endif
+
+	memset(key, 0x42, sizeof(key));
+	memset(msg, 0x17, sizeof(msg));
+
+	err = hmac_sha1_ctx_alloc(&ctx, key, sizeof(key));
+	if (err)
+		return err;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_HMAC; i++)
+		hmac_sha1(key, sizeof(key), msg, sizeof(msg), md, sizeof(md));
+	t_key = test_nsec() - t0;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_HMAC; i++)
+		hmac_sha1_ctx_digest(ctx, msg, sizeof(msg), md, sizeof(md));
+	t_ctx = test_nsec() - t0;
+
+	mem_deref(ctx);
+
+	(void)re_printf("hmac: HMAC-SHA1 of %u bytes, as STUN"
+			" MESSAGE-INTEGRITY\n", STUN_SIZE);
+	(void)re_printf("  key per call %5llu  precomputed key %5llu"
+			" ns/digest\n", t_key / PERF_HMAC, t_ctx / PERF_HMAC);
+
+#ifndef USE_OPENSSL
+	buf = mem_zalloc(PERF_BYTES, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_BYTES; i+=64)
+		SHA1_Transform(state, buf + i);
+	t_ref = test_nsec() - t0;
+
+	t0 = test_nsec();
+	SHA1_Init(&sctx);
+	SHA1_Update(&sctx, buf, PERF_BYTES);
+	SHA1_Final(md, &sctx);
+	t_upd = test_nsec() - t0;
+
+	mem_deref(buf);
+
+	(void)re_printf("sha1: %u MB\n", PERF_BYTES >> 20);
+	(void)re_printf("  portable %5llu  selected transform %5llu MB/s\n",
+			t_ref ? (uint64_t)PERF_BYTES * 1000 / t_ref : 0,
+			t_upd ? (uint64_t)PERF_BYTES * 1000 / t_upd : 0);
+#endif
+
+	return 0;
+}
@@ -0,0 +1,364 @@
+/**
+ * @file tests/jbuf.c  Jitter buffer -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+enum {
+	PTIME    = 160,  /* 20 ms at 8000 Hz */
+	PTIME_MS = 20,
+};
+
+
+static int put(struct jbuf *jb, uint16_t seq, uint32_t ts, bool marker)
+{
+	struct rtp_header hdr;
+	struct mbuf *mb;
+	int err;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.seq = seq;
+	hdr.ts  = ts;
+	hdr.m   = marker;
+
+	mb = mbuf_alloc(1);
+	if (!mb)
+		return ENOMEM;
+
+	err = jbuf_put(jb, &hdr, mb);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/* Get a frame, and return its sequence number or -1 */
+static int get(struct jbuf *jb)
+{
+	struct rtp_header hdr;
+	void *mem = NULL;
+	int err;
+
+	err = jbuf_get(jb, &hdr, &mem);
+
+	mem_deref(mem);
+
+	return err ? -1 : hdr.seq;
+}
+
+
+/* Fixed mode: played after min frames, at most max frames kept */
+int test_jbuf_fixed(void)
+{
+	struct jbuf *jb;
+	struct jbuf_stat st;
+	int err;
+
+	err = jbuf_alloc(&jb, 2, 4);
+	if (err)
+		return err;
+
+	err  = put(jb, 1, 0, false);
+	err |= put(jb, 2, 0, false);
+	TEST_ERR(err);
+	TEST_EQUALS(-1, get(jb));
+
+	err = put(jb, 3, 0, false);
+	TEST_ERR(err);
+	TEST_EQUALS(1, get(jb));
+	TEST_EQUALS(-1, get(jb));
+
+	/* a late frame within n frames of the last put is played next */
+	err = put(jb, 1, 0, false);
+	TEST_ERR(err);
+	TEST_EQUALS(1, get(jb));
+
+	/* more than max frames, the oldest is dropped */
+	err  = put(jb, 4, 0, false);
+	err |= put(jb, 5, 0, false);
+	err |= put(jb, 6, 0, false);
+	TEST_ERR(err);
+
+	TEST_EQUALS(3, get(jb));
+	TEST_EQUALS(4, get(jb));
+	TEST_EQUALS(-1, get(jb));
+
+	/* later than n frames before the last put, it is dropped */
+	err = put(jb, 3, 0, false);
+	TEST_EQUALS(ETIMEDOUT, err);
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	TEST_EQUALS(1, st.n_overflow);
+
+	/* a frame lost in the network is skipped */
+	err  = put(jb, 8, 0, false);
+	err |= put(jb, 9, 0, false);
+	TEST_ERR(err);
+	TEST_EQUALS(5, get(jb));
+	TEST_EQUALS(6, get(jb));
+
+ out:
+	mem_deref(jb);
+
+	return err;
+}
+
+
+/*
+ * A sequence jump of more than the ring size, forwards or backwards,
+ * keeps the buffered frames and moves the head on to the new frames
+ */
+int test_jbuf_jump(void)
+{
+	static const uint16_t putv[] = {1, 2, 3, 4, 5, 1000, 1001, 1002};
+	static const int getv[] = {1, 2, 3, 4, 5, 1000, 1001, -1};
+	struct jbuf *jb;
+	struct jbuf_stat st;
+	unsigned i;
+	int err = 0;
+
+	err = jbuf_alloc(&jb, 1, 8);
+	if (err)
+		return err;
+
+	for (i=0; i<ARRAY_SIZE(putv); i++) {
+		err = put(jb, putv[i], putv[i] * PTIME, false);
+		TEST_ERR(err);
+	}
+
+	for (i=0; i<ARRAY_SIZE(getv); i++)
+		TEST_EQUALS(getv[i], get(jb));
+
+	/* the sender restarts far behind the head */
+	err = put(jb, 100, 0, false);
+	TEST_ERR(err);
+	TEST_EQUALS(1002, get(jb));
+
+	err = put(jb, 101, PTIME, false);
+	TEST_ERR(err);
+	TEST_EQUALS(100, get(jb));
+
+	err = put(jb, 102, 2 * PTIME, false);
+	TEST_ERR(err);
+	TEST_EQUALS(101, get(jb));
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	TEST_EQUALS(0, st.n_overflow);
+	TEST_EQUALS(0, st.n_late);
+
+ out:
+	mem_deref(jb);
+
+	return err;
+}
+
+
+/*
+ * Get a frame, one per frame put as in the receive path. The frames come
+ * in order; the skipped ones are counted by the jitter buffer.
+ */
+static int play(struct jbuf *jb, uint16_t *seq_get, unsigned *n_got)
+{
+	int seq, err = 0;
+
+	seq = get(jb);
+	if (seq == -1)
+		return 0;
+
+	TEST_ASSERT((int16_t)(seq - *seq_get) > 0);
+
+	*seq_get = seq;
+	++*n_got;
+
+ out:
+	return err;
+}
+
+
+/*
+ * Adaptive mode: the target follows the jitter at talk spurts, and a
+ * lower target is reached by skipping the frames before a talk spurt
+ */
+int test_jbuf_adaptive(void)
+{
+	struct jbuf *jb;
+	struct jbuf_stat st;
+	uint16_t seq = 1, seq_get = 0;
+	uint32_t ts = 0;
+	unsigned i, n_got = 0;
+	int err;
+
+	err = jbuf_alloc(&jb, 1, 10);
+	if (err)
+		return err;
+
+	err = jbuf_set_type(jb, JBUF_ADAPTIVE);
+	TEST_ERR(err);
+
+	/*
+	 * talk spurts with jitter: the frames arrive at once, but their
+	 * timestamps are PTIME apart
+	 */
+	for (i=0; i<100; i++, seq++) {
+
+		ts += PTIME;
+
+		err  = put(jb, seq, ts, i % 25 == 0);
+		err |= play(jb, &seq_get, &n_got);
+		TEST_ERR(err);
+	}
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	TEST_ASSERT(st.delay_target > 20);
+	TEST_EQUALS(st.delay_target, st.delay_actual);
+	TEST_EQUALS(0, st.n_skip);
+
+	/* no jitter: the timestamps stay, the next talk spurt lowers it */
+	for (i=0; i<200; i++, seq++) {
+
+		err  = put(jb, seq, ts, i == 199);
+		err |= play(jb, &seq_get, &n_got);
+		TEST_ERR(err);
+	}
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	TEST_EQUALS(20, st.delay_target);
+	TEST_EQUALS(20, st.delay_actual);
+
+	/* every frame was played or skipped, none dropped or lost */
+	TEST_EQUALS(0, st.n_overflow);
+	TEST_EQUALS(0, st.n_lost);
+	TEST_ASSERT(st.n_skip > 0);
+	TEST_EQUALS(seq - 2U, n_got + st.n_skip);
+
+ out:
+	mem_deref(jb);
+
+	return err;
+}
+
+
+/* The receive path: put a packet, and get a frame for the decoder */
+static int recv_frame(struct jbuf *jb, uint16_t seq, uint32_t ts,
+		      bool marker, unsigned *n_dec)
+{
+	int err;
+
+	err = put(jb, seq, ts, marker);
+	if (err)
+		return err;
+
+	if (get(jb) != -1)
+		++*n_dec;
+
+	return 0;
+}
+
+
+/* The delay of the jitter buffer and of the decoded frames after it */
+static int delay_total(const struct jbuf *jb, unsigned n_dec,
+		       uint32_t *delay)
+{
+	struct jbuf_stat st;
+	int err;
+
+	err = jbuf_stats(jb, &st);
+	if (err)
+		return err;
+
+	*delay = st.delay_actual + n_dec * PTIME_MS;
+
+	return 0;
+}
+
+
+/*
+ * The total buffered delay, counting the frames which the decoder has
+ * not played yet, drops to the new target at a talk spurt. The decoder
+ * plays one frame per packet, so frames played out of the jitter buffer
+ * to shrink it would only wait after it.
+ */
+int test_jbuf_delay(void)
+{
+	struct jbuf *jb;
+	struct jbuf_stat st;
+	uint16_t seq = 1;
+	uint32_t ts = 0, delay, target, n_old;
+	unsigned i, n_dec = 0;
+	int err;
+
+	err = jbuf_alloc(&jb, 1, 10);
+	if (err)
+		return err;
+
+	err = jbuf_set_type(jb, JBUF_ADAPTIVE);
+	TEST_ERR(err);
+
+	/* jitter raises the target */
+	for (i=0; i<100; i++, seq++) {
+
+		ts += PTIME;
+
+		err = recv_frame(jb, seq, ts, i % 25 == 0, &n_dec);
+		TEST_ERR(err);
+
+		if (n_dec)
+			--n_dec;
+	}
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	target = st.delay_target;
+	TEST_ASSERT(target > 20);
+
+	/* no jitter: the target stays until the next talk spurt */
+	for (i=0; i<50; i++, seq++) {
+
+		err = recv_frame(jb, seq, ts, false, &n_dec);
+		TEST_ERR(err);
+
+		err = delay_total(jb, n_dec, &delay);
+		TEST_ERR(err);
+		TEST_EQUALS(target + PTIME_MS, delay);
+
+		--n_dec;
+	}
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	n_old = st.delay_actual / PTIME_MS;
+
+	/* the talk spurt, and the frames after it */
+	for (i=0; i<50; i++, seq++) {
+
+		err = recv_frame(jb, seq, ts, i == 0, &n_dec);
+		TEST_ERR(err);
+
+		err = delay_total(jb, n_dec, &delay);
+		TEST_ERR(err);
+		TEST_EQUALS(20 + PTIME_MS, delay);
+
+		--n_dec;
+	}
+
+	err = jbuf_stats(jb, &st);
+	TEST_ERR(err);
+	TEST_EQUALS(20, st.delay_target);
+	TEST_EQUALS(n_old - 1, st.n_skip);
+	TEST_EQUALS(0, st.n_lost);
+	TEST_EQUALS(0, st.n_overflow);
+
+ out:
+	mem_deref(jb);
+
+	return err;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file tests/mem.c  Memory management -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stddef.h>
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+/* Types with the strictest alignment, as returned by malloc() */
+union align {
+	uint64_t u;
+	double d;
+	long double ld;
+	void *p;
+};
+
+struct align_check {
+	char c;
+	union align a;
+};
+
+#define ALIGNMENT offsetof(struct align_check, a)
+
+
+static unsigned destroyed;
+
+
+static void destructor(void *data)
+{
+	(void)data;
+	++destroyed;
+}
+
+
+static int check_alloc(void)
+{
+	const uint64_t nallocs = mem_nallocs();
+	void *p, *q;
+	unsigned n = 0;
+	size_t sz;
+	int err = 0;
+
+	destroyed = 0;
+
+	for (sz=1; sz<=5000; sz += (sz < 256) ? 1 : 61) {
+
+		p = mem_alloc(sz, destructor);
+		TEST_ASSERT(p != NULL);
+		TEST_EQUALS(0, (uintptr_t)p % ALIGNMENT);
+
+		memset(p, 0xa5, sz);
+
+		q = mem_realloc(p, sz * 2);
+		TEST_ASSERT(q != NULL);
+		TEST_EQUALS(0, (uintptr_t)q % ALIGNMENT);
+		TEST_EQUALS(0xa5, ((uint8_t *)q)[sz - 1]);
+
+		TEST_EQUALS(1, mem_nrefs(q));
+		mem_ref(q);
+		TEST_EQUALS(2, mem_nrefs(q));
+		mem_deref(q);
+		mem_deref(q);
+
+		++n;
+	}
+
+	TEST_EQUALS(n, destroyed);
+
+	/* one allocation and one re-allocation each */
+	TEST_EQUALS(2 * n, mem_nallocs() - nallocs);
+
+ out:
+	return err;
+}
+
+
+int test_mem(void)
+{
+	int err;
+
+	err = check_alloc();
+	TEST_ERR(err);
+
+	mem_slab_set(true);
+	err = check_alloc();
+	mem_slab_set(false);
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
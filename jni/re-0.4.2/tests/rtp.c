@@ -0,0 +1,306 @@
+/**
+ * @file tests/rtp.c  RTCP members of received RTP -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "../src/rtp/rtcp.h"
+#include "test.h"
+
+
+enum {
+	NUM_SRC     = 66,    /* Two more than the default maximum */
+	PAYLOAD     = 160,
+	SRATE       = 8000,
+	TIMEOUT     = 5000,
+	PERF_PKTS   = 200000,
+	PERF_BATCH  = 32,    /* Packets per receive call */
+};
+
+
+struct rtptest {
+	struct rtp_sock *rs;
+	struct udp_sock *tx;
+	struct tmr tmr;
+	unsigned n_rx;
+	unsigned n_wait;
+	int err;
+};
+
+
+static uint32_t src_ssrc(unsigned i)
+{
+	return 0x10000000 + i * 0x9e3779b1;
+}
+
+
+static int pkt_encode(struct mbuf *mb, uint32_t ssrc, uint16_t seq)
+{
+	static const uint8_t payload[PAYLOAD];
+	struct rtp_header hdr;
+	int err;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.pt   = 0;
+	hdr.seq  = seq;
+	hdr.ts   = seq * PAYLOAD;
+	hdr.ssrc = ssrc;
+
+	mb->pos = mb->end = 0;
+	err  = rtp_hdr_encode(mb, &hdr);
+	err |= mbuf_write_mem(mb, payload, sizeof(payload));
+	mb->pos = 0;
+
+	return err;
+}
+
+
+static void timeout_handler(void *arg)
+{
+	struct rtptest *rt = arg;
+
+	rt->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static void rtp_recv_handler(const struct sa *src,
+			     const struct rtp_header *hdr,
+			     struct mbuf *mb, void *arg)
+{
+	struct rtptest *rt = arg;
+	(void)src;
+	(void)hdr;
+	(void)mb;
+
+	if (++rt->n_rx == rt->n_wait)
+		re_cancel();
+}
+
+
+/* Send rounds of one packet from each source, and wait for them */
+static int send_rounds(struct rtptest *rt, unsigned rounds, uint16_t seq)
+{
+	struct mbuf *mb;
+	unsigned i, j;
+	int err = 0;
+
+	mb = mbuf_alloc(RTP_HEADER_SIZE + PAYLOAD);
+	if (!mb)
+		return ENOMEM;
+
+	rt->n_rx   = 0;
+	rt->n_wait = rounds * NUM_SRC;
+
+	for (j=0; j<rounds; j++) {
+		for (i=0; i<NUM_SRC; i++) {
+
+			err  = pkt_encode(mb, src_ssrc(i), seq + j);
+			err |= udp_send(rt->tx, rtp_local(rt->rs), mb);
+			if (err)
+				goto out;
+		}
+	}
+
+	tmr_start(&rt->tmr, TIMEOUT, timeout_handler, rt);
+	err = re_main(NULL);
+	tmr_cancel(&rt->tmr);
+
+	if (!err)
+		err = rt->err;
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int rtptest_init(struct rtptest *rt)
+{
+	struct sa laddr;
+	int err;
+
+	memset(rt, 0, sizeof(*rt));
+	tmr_init(&rt->tmr);
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err = rtp_listen(&rt->rs, IPPROTO_UDP, &laddr, 10000, 60000, true,
+			 rtp_recv_handler, NULL, rt);
+	if (err)
+		return err;
+
+	rtcp_set_srate_rx(rt->rs, SRATE);
+
+	return udp_listen(&rt->tx, &laddr, NULL, NULL);
+}
+
+
+static void rtptest_close(struct rtptest *rt)
+{
+	tmr_cancel(&rt->tmr);
+	mem_deref(rt->tx);
+	mem_deref(rt->rs);
+}
+
+
+/* Sources beyond the maximum are not tracked, until it is raised */
+int test_rtp_members(void)
+{
+	struct rtcp_stats stats;
+	struct rtptest rt;
+	unsigned i;
+	int err;
+
+	err = rtptest_init(&rt);
+	TEST_ERR(err);
+
+	err = send_rounds(&rt, 2, 1);
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_SRC; i++) {
+
+		err = rtcp_stats(rt.rs, src_ssrc(i), &stats);
+		if (i < 64) {
+			TEST_ERR(err);
+			TEST_EQUALS(2, stats.rx.sent);
+			TEST_EQUALS(0, stats.rx.lost);
+		}
+		else {
+			TEST_EQUALS(ENOENT, err);
+		}
+	}
+
+	err = rtcp_set_maxmembers(rt.rs, 2 * NUM_SRC);
+	TEST_ERR(err);
+
+	err = send_rounds(&rt, 1, 3);
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_SRC; i++) {
+
+		err = rtcp_stats(rt.rs, src_ssrc(i), &stats);
+		TEST_ERR(err);
+		TEST_EQUALS(i < 64 ? 3 : 1, stats.rx.sent);
+	}
+
+ out:
+	rtptest_close(&rt);
+
+	return err;
+}
+
+
+/*
+ * The receive path of the RTP socket, without the socket: decode the
+ * header and update the member of the source. The arrival time is taken
+ * once per packet, as before, or once per batch.
+ */
+static uint64_t perf_rx(struct rtp_sock *rs, struct mbuf **mbv,
+			unsigned nsrc, unsigned base, bool batch)
+{
+	struct rtcp_sess *sess = rtp_rtcp_sess(rs);
+	struct rtp_header hdr;
+	uint64_t t0, jfs = 0;
+	unsigned i;
+
+	t0 = test_nsec();
+
+	for (i=0; i<PERF_PKTS; i++) {
+
+		struct mbuf *mb = mbv[i % nsrc];
+		const uint16_t seq = (uint16_t)(1 + (base + i) / nsrc);
+
+		if (!batch || i % PERF_BATCH == 0)
+			jfs = tmr_jiffies();
+
+		mb->pos = 0;
+		mb->buf[2] = seq >> 8;
+		mb->buf[3] = seq & 0xff;
+
+		if (rtp_decode(rs, mb, &hdr))
+			return 0;
+
+		rtcp_sess_rx_rtp(sess, hdr.seq, hdr.ts, hdr.ssrc,
+				 mbuf_get_left(mb), NULL, jfs);
+	}
+
+	return test_nsec() - t0;
+}
+
+
+static int perf_members(unsigned nsrc)
+{
+	struct mbuf **mbv;
+	struct rtptest rt;
+	uint64_t t_pkt, t_batch;
+	unsigned i;
+	int err;
+
+	mbv = mem_zalloc(nsrc * sizeof(*mbv), NULL);
+	if (!mbv)
+		return ENOMEM;
+
+	err = rtptest_init(&rt);
+	if (err)
+		goto out;
+
+	err = rtcp_set_maxmembers(rt.rs, nsrc);
+	if (err)
+		goto out;
+
+	for (i=0; i<nsrc; i++) {
+
+		mbv[i] = mbuf_alloc(RTP_HEADER_SIZE + PAYLOAD);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = pkt_encode(mbv[i], src_ssrc(i), 0);
+		if (err)
+			goto out;
+	}
+
+	t_pkt   = perf_rx(rt.rs, mbv, nsrc, 0, false);
+	t_batch = perf_rx(rt.rs, mbv, nsrc, PERF_PKTS, true);
+	if (!t_pkt || !t_batch) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	(void)re_printf("  %5u sources:  time per packet %4llu"
+			"  per batch %4llu ns/packet\n", nsrc,
+			t_pkt / PERF_PKTS, t_batch / PERF_PKTS);
+
+ out:
+	if (mbv) {
+		for (i=0; i<nsrc; i++)
+			mem_deref(mbv[i]);
+	}
+	mem_deref(mbv);
+	rtptest_close(&rt);
+
+	return err;
+}
+
+
+int test_perf_rtp_rx(void)
+{
+	int err;
+
+	(void)re_printf("rtp: received packet to RTCP member, batches of"
+			" %u packets\n", PERF_BATCH);
+
+	err  = perf_members(1);
+	err |= perf_members(8);
+	err |= perf_members(64);
+	err |= perf_members(1000);
+
+	return err;
+}
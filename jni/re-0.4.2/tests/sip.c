@@ -0,0 +1,601 @@
+/**
+ * @file tests/sip.c  SIP stream framing and message parser -- tests and
+ *                    benchmarks
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "../src/sip/sip.h"
+#include "test.h"
+
+
+enum {
+	PERF_ROUNDS = 200,
+};
+
+
+/*
+ * A corpus of messages as sent by common user agents. The Content-Length
+ * header and the body are added when the corpus is built.
+ */
+
+static const char sdp_offer[] =
+	"v=0\r\n"
+	"o=- 3820913344 3820913344 IN IP4 192.168.1.34\r\n"
+	"s=-\r\n"
+	"c=IN IP4 192.168.1.34\r\n"
+	"t=0 0\r\n"
+	"m=audio 40210 RTP/AVP 0 8 9 101\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"a=rtpmap:101 telephone-event/8000\r\n"
+	"a=fmtp:101 0-16\r\n"
+	"a=ptime:20\r\n"
+	"a=sendrecv\r\n"
+	"m=video 40212 RTP/AVP 96\r\n"
+	"a=rtpmap:96 H264/90000\r\n"
+	"a=fmtp:96 profile-level-id=42801f;packetization-mode=1\r\n"
+	"a=sendrecv\r\n";
+
+static const char sdp_answer[] =
+	"v=0\r\n"
+	"o=root 1938471 1938471 IN IP4 203.0.113.10\r\n"
+	"s=call\r\n"
+	"c=IN IP4 203.0.113.10\r\n"
+	"t=0 0\r\n"
+	"m=audio 17342 RTP/AVP 8 101\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:101 telephone-event/8000\r\n"
+	"a=fmtp:101 0-16\r\n"
+	"a=ptime:20\r\n"
+	"a=sendrecv\r\n"
+	"m=video 0 RTP/AVP 96\r\n";
+
+static const struct {
+	const char *hdrs;
+	const char *body;
+} corpusv[] = {
+	{
+	"INVITE sip:+4940123456@sip.example.net;user=phone SIP/2.0\r\n"
+	"Via: SIP/2.0/TCP 192.168.1.34:5060;rport"
+	";branch=z9hG4bK4c1d5e7a2f8b9c03\r\n"
+	"Max-Forwards: 70\r\n"
+	"From: \"Alice Example\" <sip:alice@sip.example.net>"
+	";tag=8d2f0e91c4\r\n"
+	"To: <sip:+4940123456@sip.example.net;user=phone>\r\n"
+	"Call-ID: 5f2a7c1e9b3d4a60@192.168.1.34\r\n"
+	"CSeq: 31862 INVITE\r\n"
+	"Contact: <sip:alice@192.168.1.34:5060;transport=tcp>"
+	";+sip.instance=\"<urn:uuid:2a4b6c8d-1e3f-5a7b-9c0d-e1f2a3b4c5d6>\"\r\n"
+	"User-Agent: baresip v0.4.2 (x86_64/linux)\r\n"
+	"Allow: INVITE,ACK,BYE,CANCEL,OPTIONS,NOTIFY,SUBSCRIBE,"
+	"INFO,MESSAGE,UPDATE,REFER\r\n"
+	"Supported: replaces, timer, 100rel\r\n"
+	"Session-Expires: 1800\r\n"
+	"Proxy-Authorization: Digest username=\"alice\""
+	", realm=\"sip.example.net\", nonce=\"5f1c2a8e3b7d\""
+	", uri=\"sip:+4940123456@sip.example.net;user=phone\""
+	", response=\"0a4f113eab2c9d3a1e6b5f7c8d9e0f12\""
+	", algorithm=MD5, qop=auth, nc=00000001"
+	", cnonce=\"7a3c2b1d\"\r\n"
+	"Content-Type: application/sdp\r\n",
+	sdp_offer
+	},
+	{
+	"SIP/2.0 200 OK\r\n"
+	"Via: SIP/2.0/TCP 192.168.1.34:5060;rport=52344"
+	";received=198.51.100.7;branch=z9hG4bK4c1d5e7a2f8b9c03\r\n"
+	"Record-Route: <sip:203.0.113.10;transport=tcp;lr;ftag=8d2f0e91c4>\r\n"
+	"Record-Route: <sip:10.0.0.5;lr>\r\n"
+	"From: \"Alice Example\" <sip:alice@sip.example.net>"
+	";tag=8d2f0e91c4\r\n"
+	"To: <sip:+4940123456@sip.example.net;user=phone>;tag=as5e1d2c3b\r\n"
+	"Call-ID: 5f2a7c1e9b3d4a60@192.168.1.34\r\n"
+	"CSeq: 31862 INVITE\r\n"
+	"Server: Asterisk PBX 11.25.3\r\n"
+	"Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE,"
+	" NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+	"Supported: replaces, timer\r\n"
+	"Session-Expires: 1800;refresher=uas\r\n"
+	"Contact: <sip:+4940123456@203.0.113.10:5060;transport=tcp>\r\n"
+	"Content-Type: application/sdp\r\n",
+	sdp_answer
+	},
+	{
+	"REGISTER sip:sip.example.net SIP/2.0\r\n"
+	"Via: SIP/2.0/TCP 192.168.1.34:5060;rport"
+	";branch=z9hG4bK0b9a8c7d6e5f\r\n"
+	"Max-Forwards: 70\r\n"
+	"To: <sip:alice@sip.example.net>\r\n"
+	"From: <sip:alice@sip.example.net>;tag=3e4f5a6b7c\r\n"
+	"Call-ID: 1c2d3e4f5a6b7c8d\r\n"
+	"CSeq: 5 REGISTER\r\n"
+	"User-Agent: baresip v0.4.2 (x86_64/linux)\r\n"
+	"Contact: <sip:alice@192.168.1.34:5060;transport=tcp>"
+	";expires=3600;+sip.instance=\"<urn:uuid:2a4b6c8d-1e3f-5a7b-"
+	"9c0d-e1f2a3b4c5d6>\";reg-id=1\r\n"
+	"Authorization: Digest username=\"alice\""
+	", realm=\"sip.example.net\", nonce=\"9d8c7b6a5f4e\""
+	", uri=\"sip:sip.example.net\""
+	", response=\"ffe0d1c2b3a4958677685a4b3c2d1e0f\""
+	", algorithm=MD5\r\n"
+	"Allow: INVITE,ACK,BYE,CANCEL,OPTIONS,NOTIFY,SUBSCRIBE,"
+	"INFO,MESSAGE,UPDATE,REFER\r\n"
+	"Supported: path, gruu, outbound\r\n",
+	""
+	},
+	{
+	"SIP/2.0 200 OK\r\n"
+	"v: SIP/2.0/TCP 192.168.1.34:5060;rport=52344"
+	";received=198.51.100.7;branch=z9hG4bK0b9a8c7d6e5f\r\n"
+	"f: <sip:alice@sip.example.net>;tag=3e4f5a6b7c\r\n"
+	"t: <sip:alice@sip.example.net>;tag=b27e1a7f\r\n"
+	"i: 1c2d3e4f5a6b7c8d\r\n"
+	"CSeq: 5 REGISTER\r\n"
+	"m: <sip:alice@192.168.1.34:5060;transport=tcp>;expires=600\r\n"
+	"Date: Fri, 16 Oct 2015 10:21:04 GMT\r\n"
+	"Server: Kamailio (4.3.3 (x86_64/linux))\r\n",
+	""
+	},
+};
+
+
+/* Build the corpus as one stream, with the length of each message */
+static int corpus_alloc(struct mbuf **mbp, size_t *lenv)
+{
+	struct mbuf *mb;
+	size_t i, pos;
+	int err = 0;
+
+	mb = mbuf_alloc(8192);
+	if (!mb)
+		return ENOMEM;
+
+	for (i=0; i<ARRAY_SIZE(corpusv); i++) {
+
+		const char *body = corpusv[i].body;
+
+		pos = mb->end;
+
+		/* the compact form in messages with compact headers */
+		err = mbuf_printf(mb, "%s%s: %zu\r\n\r\n%s",
+				  corpusv[i].hdrs,
+				  strstr(corpusv[i].hdrs, "\r\ni: ")
+				  ? "l" : "Content-Length",
+				  strlen(body), body);
+		if (err)
+			break;
+
+		lenv[i] = mb->end - pos;
+	}
+
+	mb->pos = 0;
+
+	if (err)
+		mem_deref(mb);
+	else
+		*mbp = mb;
+
+	return err;
+}
+
+
+/*
+ * Feed a stream in chunks, and frame it like the TCP transport. If
+ * decode is set, each complete message is decoded.
+ */
+static int frame_stream(struct mbuf *mb, size_t chunk, const size_t *lenv,
+			size_t lenc, bool decode)
+{
+	const size_t total = mb->end;
+	struct sip_frame fr;
+	size_t n = 0;
+	int err = 0;
+
+	memset(&fr, 0, sizeof(fr));
+
+	mb->pos = 0;
+	mb->end = 0;
+
+	while (mb->end < total) {
+
+		mb->end = min(mb->end + chunk, total);
+
+		for (;;) {
+			struct sip_msg *msg;
+			const size_t end = mb->end;
+
+			err = sip_frame(&fr, mb);
+			if (err == ENODATA) {
+				err = 0;
+				break;
+			}
+			else if (err)
+				goto out;
+
+			if (mbuf_get_left(mb) < fr.msglen)
+				break;
+
+			if (lenv && (n >= lenc || fr.msglen != lenv[n])) {
+				err = EPROTO;
+				goto out;
+			}
+
+			mb->end = mb->pos + fr.msglen;
+			memset(&fr, 0, sizeof(fr));
+
+			if (decode) {
+				err = sip_msg_decode(&msg, mb);
+				if (err)
+					goto out;
+
+				mem_deref(msg);
+			}
+
+			mb->pos = mb->end;
+			mb->end = end;
+			++n;
+		}
+	}
+
+	if (lenv && n != lenc)
+		err = EPROTO;
+
+ out:
+	mb->end = total;
+
+	return err;
+}
+
+
+int test_sip_frame(void)
+{
+	static const char *badv[] = {
+		"OPTIONS sip:a@b SIP/2.0\r\nVia: x\r\n\r\n",
+		"OPTIONS sip:a@b SIP/2.0\r\nContent-Length: x\r\n\r\n",
+		"OPTIONS sip:a@b SIP/2.0\r\nContent-Lengthy: 0\r\n\r\n",
+	};
+	size_t lenv[2 * ARRAY_SIZE(corpusv)];
+	struct mbuf *corpus = NULL, *mb = NULL;
+	struct sip_frame fr;
+	size_t i, chunk;
+	int err;
+
+	err = corpus_alloc(&corpus, lenv);
+	TEST_ERR(err);
+
+	/* the corpus twice, so that messages are split in every way */
+	mb = mbuf_alloc(2 * corpus->end);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_mem(mb, corpus->buf, corpus->end);
+	err |= mbuf_write_mem(mb, corpus->buf, corpus->end);
+	TEST_ERR(err);
+
+	memcpy(&lenv[ARRAY_SIZE(corpusv)], lenv,
+	       ARRAY_SIZE(corpusv) * sizeof(*lenv));
+
+	for (chunk=1; chunk<=1500; chunk++) {
+
+		err = frame_stream(mb, chunk, lenv, ARRAY_SIZE(lenv), false);
+		if (err) {
+			(void)re_fprintf(stderr, "sip_frame: chunk %zu\n",
+					 chunk);
+			goto out;
+		}
+	}
+
+	/* and the framed messages can be decoded */
+	err = frame_stream(mb, 100, lenv, ARRAY_SIZE(lenv), true);
+	TEST_ERR(err);
+
+	/* a Content-Length is required */
+	for (i=0; i<ARRAY_SIZE(badv); i++) {
+
+		struct mbuf mbb;
+
+		mbuf_init(&mbb);
+		mbb.buf  = (uint8_t *)badv[i];
+		mbb.size = mbb.end = strlen(badv[i]);
+
+		memset(&fr, 0, sizeof(fr));
+		err = sip_frame(&fr, &mbb);
+		TEST_EQUALS(EBADMSG, err);
+	}
+
+	err = 0;
+
+ out:
+	mem_deref(mb);
+	mem_deref(corpus);
+
+	return err;
+}
+
+
+/*
+ * The previous TCP receive path: the buffered data is decoded after each
+ * read, until the whole body has arrived
+ */
+static int legacy_stream(struct mbuf *mb, size_t chunk)
+{
+	const size_t total = mb->end;
+	int err = 0;
+
+	mb->pos = 0;
+	mb->end = 0;
+
+	while (mb->end < total) {
+
+		mb->end = min(mb->end + chunk, total);
+
+		for (;;) {
+			struct sip_msg *msg;
+			const size_t end = mb->end;
+			size_t pos = mb->pos;
+			uint32_t clen;
+
+			if (mbuf_get_left(mb) < 2)
+				break;
+
+			err = sip_msg_decode(&msg, mb);
+			if (err == ENODATA) {
+				err = 0;
+				break;
+			}
+			else if (err)
+				goto out;
+
+			clen = pl_u32(&msg->clen);
+
+			if (mbuf_get_left(mb) < clen) {
+				mb->pos = pos;
+				mem_deref(msg);
+				break;
+			}
+
+			mem_deref(msg);
+
+			mb->pos += clen;
+			mb->end  = end;
+		}
+	}
+
+ out:
+	mb->end = total;
+
+	return err;
+}
+
+
+int test_perf_sip_frame(void)
+{
+	static const size_t chunkv[] = {1, 10, 100, 536, 1460, 1500};
+	size_t lenv[ARRAY_SIZE(corpusv)];
+	struct mbuf *mb = NULL;
+	uint64_t t0, t_old, t_new;
+	unsigned i, n;
+	size_t j;
+	int err;
+
+	err = corpus_alloc(&mb, lenv);
+	if (err)
+		return err;
+
+	(void)re_printf("sip: TCP framing of %zu messages, %zu bytes\n",
+			ARRAY_SIZE(corpusv), mb->end);
+
+	for (j=0; j<ARRAY_SIZE(chunkv); j++) {
+
+		const unsigned rounds = chunkv[j] < 10
+			? PERF_ROUNDS / 10 : PERF_ROUNDS;
+
+		t0 = test_nsec();
+		for (i=0; i<rounds; i++)
+			err |= legacy_stream(mb, chunkv[j]);
+		t_old = test_nsec() - t0;
+
+		t0 = test_nsec();
+		for (i=0; i<rounds; i++)
+			err |= frame_stream(mb, chunkv[j], NULL, 0, true);
+		t_new = test_nsec() - t0;
+
+		if (err)
+			break;
+
+		n = rounds * ARRAY_SIZE(corpusv);
+
+		(void)re_printf("  %4zu byte chunks:  decode per read %8llu"
+				"  framing %6llu ns/msg\n", chunkv[j],
+				t_old / n, t_new / n);
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int msg_decode(struct sip_msg **msgp, size_t i)
+{
+	struct mbuf *mb;
+	size_t lenv[ARRAY_SIZE(corpusv)];
+	size_t pos = 0, j;
+	int err;
+
+	err = corpus_alloc(&mb, lenv);
+	if (err)
+		return err;
+
+	for (j=0; j<i; j++)
+		pos += lenv[j];
+
+	mb->pos = pos;
+	mb->end = pos + lenv[i];
+
+	err = sip_msg_decode(msgp, mb);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/* The corpus is decoded into the same fields and headers */
+int test_sip_msg(void)
+{
+	struct sip_msg *msg = NULL;
+	const struct sip_hdr *hdr;
+	int err;
+
+	/* INVITE */
+	err = msg_decode(&msg, 0);
+	TEST_ERR(err);
+
+	TEST_ASSERT(msg->req);
+	TEST_ASSERT(0 == pl_strcmp(&msg->met, "INVITE"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->ruri,
+				   "sip:+4940123456@sip.example.net;user=phone"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->uri.host, "sip.example.net"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->via.branch,
+				   "z9hG4bK4c1d5e7a2f8b9c03"));
+	TEST_EQUALS(SIP_TRANSP_TCP, msg->via.tp);
+	TEST_ASSERT(0 == pl_strcmp(&msg->callid,
+				   "5f2a7c1e9b3d4a60@192.168.1.34"));
+	TEST_EQUALS(31862, msg->cseq.num);
+	TEST_ASSERT(0 == pl_strcmp(&msg->from.tag, "8d2f0e91c4"));
+	TEST_EQUALS(strlen(sdp_offer), pl_u32(&msg->clen));
+	TEST_EQUALS(strlen(sdp_offer), mbuf_get_left(msg->mb));
+
+	/* comma separated values are separate headers */
+	TEST_EQUALS(11, sip_msg_hdr_count(msg, SIP_HDR_ALLOW));
+	TEST_EQUALS(3, sip_msg_hdr_count(msg, SIP_HDR_SUPPORTED));
+	TEST_ASSERT(sip_msg_hdr_has_value(msg, SIP_HDR_SUPPORTED, "timer"));
+	TEST_ASSERT(NULL != sip_msg_hdr(msg, SIP_HDR_PROXY_AUTHORIZATION));
+
+	/* known headers are also found by name, in any case */
+	hdr = sip_msg_xhdr(msg, "session-expires");
+	TEST_ASSERT(hdr != NULL);
+	TEST_ASSERT(0 == pl_strcmp(&hdr->val, "1800"));
+	TEST_EQUALS(0, sip_msg_xhdr_count(msg, "X-Unknown"));
+
+	msg = mem_deref(msg);
+
+	/* 200 OK to the INVITE */
+	err = msg_decode(&msg, 1);
+	TEST_ERR(err);
+
+	TEST_ASSERT(!msg->req);
+	TEST_EQUALS(200, msg->scode);
+	TEST_ASSERT(0 == pl_strcmp(&msg->reason, "OK"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->cseq.met, "INVITE"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->to.tag, "as5e1d2c3b"));
+	TEST_EQUALS(2, sip_msg_hdr_count(msg, SIP_HDR_RECORD_ROUTE));
+
+	/* headers are in message order */
+	hdr = sip_msg_hdr(msg, SIP_HDR_RECORD_ROUTE);
+	TEST_ASSERT(hdr != NULL);
+	TEST_ASSERT(0 == pl_strcmp(&hdr->val, "<sip:203.0.113.10;"
+				   "transport=tcp;lr;ftag=8d2f0e91c4>"));
+
+	msg = mem_deref(msg);
+
+	/* REGISTER */
+	err = msg_decode(&msg, 2);
+	TEST_ERR(err);
+
+	TEST_ASSERT(0 == pl_strcmp(&msg->met, "REGISTER"));
+	TEST_ASSERT(NULL != sip_msg_hdr(msg, SIP_HDR_CONTACT));
+	TEST_ASSERT(NULL != sip_msg_hdr(msg, SIP_HDR_AUTHORIZATION));
+	TEST_EQUALS(0, pl_u32(&msg->clen));
+
+	msg = mem_deref(msg);
+
+	/* compact header names */
+	err = msg_decode(&msg, 3);
+	TEST_ERR(err);
+
+	TEST_ASSERT(0 == pl_strcmp(&msg->via.branch, "z9hG4bK0b9a8c7d6e5f"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->callid, "1c2d3e4f5a6b7c8d"));
+	TEST_ASSERT(0 == pl_strcmp(&msg->to.tag, "b27e1a7f"));
+	TEST_ASSERT(NULL != sip_msg_hdr(msg, SIP_HDR_CONTACT));
+	TEST_ASSERT(NULL != msg->clen.p);
+	TEST_ASSERT(NULL != sip_msg_xhdr(msg, "Date"));
+
+ out:
+	mem_deref(msg);
+
+	return err;
+}
+
+
+int test_perf_sip_msg(void)
+{
+	static const char *namev[ARRAY_SIZE(corpusv)] = {
+		"INVITE", "200 OK (INVITE)", "REGISTER", "200 OK (compact)"
+	};
+	size_t lenv[ARRAY_SIZE(corpusv)];
+	struct mbuf *mb = NULL;
+	uint64_t t0, t, total = 0;
+	size_t i, pos = 0;
+	unsigned j;
+	int err;
+
+	err = corpus_alloc(&mb, lenv);
+	if (err)
+		return err;
+
+	(void)re_printf("sip: message decoding\n");
+
+	for (i=0; i<ARRAY_SIZE(corpusv); i++) {
+
+		struct sip_msg *msg;
+		uint32_t nhdr;
+
+		mb->pos = pos;
+		mb->end = pos + lenv[i];
+
+		err = sip_msg_decode(&msg, mb);
+		if (err)
+			break;
+
+		nhdr = list_count(&msg->hdrvl);
+		mem_deref(msg);
+
+		t0 = test_nsec();
+		for (j=0; j<PERF_ROUNDS * 10; j++) {
+
+			mb->pos = pos;
+
+			err |= sip_msg_decode(&msg, mb);
+			mem_deref(msg);
+		}
+		t = test_nsec() - t0;
+
+		if (err)
+			break;
+
+		total += t;
+
+		(void)re_printf("  %-18s %4zu bytes, %2u headers: %6llu ns/msg\n",
+				namev[i], lenv[i], nhdr,
+				t / (PERF_ROUNDS * 10));
+
+		pos += lenv[i];
+	}
+
+	if (!err && total) {
+		(void)re_printf("  corpus: %llu msgs/s\n",
+				(uint64_t)ARRAY_SIZE(corpusv) * PERF_ROUNDS
+				* 10 * 1000000000ULL / total);
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
@@ -0,0 +1,26 @@
+#
+# srcs.mk All selftest source files.
+#
+# Copyright (C) 2010 Creytiv.com
+#
+
+TEST_SRCS	+= dns.c
+TEST_SRCS	+= hmac.c
+TEST_SRCS	+= jbuf.c
+TEST_SRCS	+= mem.c
+TEST_SRCS	+= rtp.c
+TEST_SRCS	+= sip.c
+ifneq ($(USE_OPENSSL),)
+TEST_SRCS	+= srtp.c
+endif
+TEST_SRCS	+= stun.c
+TEST_SRCS	+= tcp.c
+TEST_SRCS	+= tmr.c
+TEST_SRCS	+= udp.c
+TEST_SRCS	+= worker.c
+
+# Compare the SRTP benchmark with libsrtp 2, found with pkg-config
+ifneq ($(USE_LIBSRTP),)
+$(BUILD)/tests/srtp.o: CFLAGS += -DUSE_LIBSRTP `pkg-config --cflags libsrtp2`
+test$(BIN_SUFFIX): LIBS += `pkg-config --libs libsrtp2`
+endif
@@ -0,0 +1,544 @@
+/**
+ * @file tests/srtp.c  SRTP protect and unprotect -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <string.h>
+#include <openssl/evp.h>
+#include <re.h>
+#include "../src/srtp/srtp.h"
+#ifdef USE_LIBSRTP
+#include <srtp2/srtp.h>
+#endif
+#include "test.h"
+
+
+enum {
+	KEY_LEN     = SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE,
+	HDR_SIZE    = 12,
+	TAG_LEN     = 10,
+	NUM_PKTS    = 100,
+	FRAME_PKTS  = 24,    /* Packets of a video frame */
+	PERF_FRAMES = 2000,
+	PKT_MAX     = 1500,
+};
+
+
+/* Test vector of AES_CM_128_HMAC_SHA1_80, from libsrtp */
+static const uint8_t test_key[KEY_LEN] = {
+	0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+	0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+	0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+	0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+static const uint8_t test_plain[28] = {
+	0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+	0xca, 0xfe, 0xba, 0xbe, 0xab, 0xab, 0xab, 0xab,
+	0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab, 0xab,
+	0xab, 0xab, 0xab, 0xab
+};
+
+static const uint8_t test_cipher[38] = {
+	0x80, 0x0f, 0x12, 0x34, 0xde, 0xca, 0xfb, 0xad,
+	0xca, 0xfe, 0xba, 0xbe, 0x4e, 0x55, 0xdc, 0x4c,
+	0xe7, 0x99, 0x78, 0xd8, 0x8c, 0xa4, 0xd2, 0x15,
+	0x94, 0x9d, 0x24, 0x02, 0xb7, 0x8d, 0x6a, 0xcc,
+	0x99, 0xea, 0x17, 0x9b, 0x8d, 0xbb
+};
+
+
+/* An RTP packet with a payload of len bytes */
+static void pkt_write(struct mbuf *mb, uint32_t ssrc, uint16_t seq,
+		      size_t len)
+{
+	uint8_t *p = mb->buf;
+	size_t i;
+
+	p[0]  = 0x80;
+	p[1]  = 96;
+	p[2]  = seq >> 8;
+	p[3]  = seq & 0xff;
+	p[4]  = 0;
+	p[5]  = 0;
+	p[6]  = seq >> 8;
+	p[7]  = seq & 0xff;
+	p[8]  = ssrc >> 24;
+	p[9]  = ssrc >> 16;
+	p[10] = ssrc >> 8;
+	p[11] = ssrc & 0xff;
+
+	for (i=0; i<len; i++)
+		p[HDR_SIZE + i] = (uint8_t)(seq + i);
+
+	mb->pos = 0;
+	mb->end = HDR_SIZE + len;
+}
+
+
+static int mbv_alloc(struct mbuf **mbv, unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		mbv[i] = mbuf_alloc(PKT_MAX);
+		if (!mbv[i])
+			return ENOMEM;
+	}
+
+	return 0;
+}
+
+
+static void mbv_free(struct mbuf **mbv, unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++)
+		mem_deref(mbv[i]);
+}
+
+
+/* The test vector, and a forged packet which does not add a stream */
+static int check_vector(void)
+{
+	struct srtp *tx = NULL, *rx = NULL;
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(64);
+	if (!mb)
+		return ENOMEM;
+
+	err  = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  test_key, sizeof(test_key));
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  test_key, sizeof(test_key));
+	TEST_ERR(err);
+
+	err = mbuf_write_mem(mb, test_plain, sizeof(test_plain));
+	TEST_ERR(err);
+	mb->pos = 0;
+
+	err = srtp_encrypt(tx, mb);
+	TEST_ERR(err);
+	TEST_EQUALS(sizeof(test_cipher), mbuf_get_left(mb));
+	TEST_ASSERT(0 == memcmp(test_cipher, mbuf_buf(mb),
+				sizeof(test_cipher)));
+
+	/* a forged tag */
+	mb->buf[mb->end - 1] ^= 0x01;
+	err = srtp_decrypt(rx, mb);
+	TEST_EQUALS(EAUTH, err);
+	TEST_ASSERT(NULL == srtp_stream_find(rx, 0xcafebabe));
+
+	mb->buf[mb->end - 1] ^= 0x01;
+	err = srtp_decrypt(rx, mb);
+	TEST_ERR(err);
+	TEST_EQUALS(sizeof(test_plain), mbuf_get_left(mb));
+	TEST_ASSERT(0 == memcmp(test_plain, mbuf_buf(mb),
+				sizeof(test_plain)));
+	TEST_ASSERT(NULL != srtp_stream_find(rx, 0xcafebabe));
+
+ out:
+	mem_deref(rx);
+	mem_deref(tx);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static void pkt_test(struct mbuf *mb, unsigned i)
+{
+	pkt_write(mb, (i & 1) ? 0x01020304 : 0x05060708,
+		  (uint16_t)(0xffd0 + i / 2),
+		  (i % 7 == 3) ? 0 : (i * 13) % 1200 + 1);
+}
+
+
+/*
+ * Batches give the same packets as one at a time, and report the result
+ * of each packet: a replay and a forged packet in the batch are dropped.
+ * The packets are from two sources, across the sequence number wrap,
+ * and some have no payload.
+ */
+static int check_batch(enum srtp_suite suite)
+{
+	struct srtp *tx1 = NULL, *tx2 = NULL, *rx = NULL;
+	struct mbuf *mbv[NUM_PKTS], *refv[NUM_PKTS], *plain;
+	int errv[NUM_PKTS];
+	unsigned i;
+	int err;
+
+	memset(mbv, 0, sizeof(mbv));
+	memset(refv, 0, sizeof(refv));
+
+	plain = mbuf_alloc(PKT_MAX);
+	if (!plain)
+		return ENOMEM;
+
+	err  = mbv_alloc(mbv, NUM_PKTS);
+	err |= mbv_alloc(refv, NUM_PKTS);
+	TEST_ERR(err);
+
+	err  = srtp_alloc(&tx1, suite, test_key, sizeof(test_key));
+	err |= srtp_alloc(&tx2, suite, test_key, sizeof(test_key));
+	err |= srtp_alloc(&rx, suite, test_key, sizeof(test_key));
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_PKTS; i++) {
+
+		pkt_test(mbv[i], i);
+		pkt_test(refv[i], i);
+
+		err = srtp_encrypt(tx1, refv[i]);
+		TEST_ERR(err);
+	}
+
+	err = srtp_encrypt_batch(tx2, mbv, NUM_PKTS);
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_PKTS; i++) {
+		TEST_EQUALS(mbuf_get_left(refv[i]), mbuf_get_left(mbv[i]));
+		TEST_ASSERT(0 == memcmp(mbuf_buf(refv[i]), mbuf_buf(mbv[i]),
+					mbuf_get_left(mbv[i])));
+	}
+
+	/* packet 20 is sent twice, packet 30 is forged */
+	mbuf_rewind(mbv[21]);
+	err = mbuf_write_mem(mbv[21], mbuf_buf(refv[20]),
+			     mbuf_get_left(refv[20]));
+	TEST_ERR(err);
+	mbv[21]->pos = 0;
+
+	mbv[30]->buf[HDR_SIZE] ^= 0x80;
+
+	err = srtp_decrypt_batch(rx, mbv, errv, NUM_PKTS);
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_PKTS; i++) {
+
+		if (i == 21) {
+			TEST_EQUALS(EALREADY, errv[i]);
+			continue;
+		}
+		else if (i == 30) {
+			TEST_EQUALS(EAUTH, errv[i]);
+			continue;
+		}
+
+		TEST_ERR(errv[i]);
+
+		pkt_test(plain, i);
+
+		TEST_EQUALS(mbuf_get_left(plain), mbuf_get_left(mbv[i]));
+		TEST_ASSERT(0 == memcmp(mbuf_buf(plain), mbuf_buf(mbv[i]),
+					mbuf_get_left(mbv[i])));
+	}
+
+	/* the batch again: the two dropped packets are new, the rest not */
+	err = srtp_decrypt_batch(rx, refv, errv, NUM_PKTS);
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_PKTS; i++) {
+		TEST_EQUALS((i == 21 || i == 30) ? 0 : EALREADY, errv[i]);
+	}
+
+ out:
+	mem_deref(rx);
+	mem_deref(tx2);
+	mem_deref(tx1);
+	mbv_free(refv, NUM_PKTS);
+	mbv_free(mbv, NUM_PKTS);
+	mem_deref(plain);
+
+	return err;
+}
+
+
+int test_srtp(void)
+{
+	int err;
+
+	err = check_vector();
+	TEST_ERR(err);
+
+	err = check_batch(SRTP_AES_CM_128_HMAC_SHA1_80);
+	TEST_ERR(err);
+
+	err = check_batch(SRTP_AES_CM_128_HMAC_SHA1_32);
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
+
+
+/* SRTCP round trip, with replays and forged packets dropped */
+int test_srtcp(void)
+{
+	static const uint8_t rr[] = {
+		0x80, 0xc9, 0x00, 0x01, 0xde, 0xca, 0xfb, 0xad
+	};
+	struct srtp *tx = NULL, *rx = NULL;
+	struct mbuf *mb, *ref = NULL;
+	unsigned i;
+	int err;
+
+	mb = mbuf_alloc(64);
+	if (!mb)
+		return ENOMEM;
+
+	err  = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_32,
+			  test_key, sizeof(test_key));
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_32,
+			  test_key, sizeof(test_key));
+	TEST_ERR(err);
+
+	for (i=0; i<3; i++) {
+
+		mbuf_rewind(mb);
+		err  = mbuf_write_mem(mb, rr, sizeof(rr));
+		err |= mbuf_write_u32(mb, htonl(i));
+		TEST_ERR(err);
+		mb->pos = 0;
+
+		err = srtcp_encrypt(tx, mb);
+		TEST_ERR(err);
+		TEST_EQUALS(sizeof(rr) + 4 + 4 + TAG_LEN, mbuf_get_left(mb));
+
+		mem_deref(ref);
+		ref = mbuf_alloc(64);
+		TEST_ASSERT(ref != NULL);
+		err = mbuf_write_mem(ref, mbuf_buf(mb), mbuf_get_left(mb));
+		TEST_ERR(err);
+		ref->pos = 0;
+
+		/* a forged packet */
+		mb->buf[sizeof(rr)] ^= 0x01;
+		err = srtcp_decrypt(rx, mb);
+		TEST_EQUALS(EAUTH, err);
+		mb->buf[sizeof(rr)] ^= 0x01;
+
+		err = srtcp_decrypt(rx, mb);
+		TEST_ERR(err);
+		TEST_EQUALS(sizeof(rr) + 4, mbuf_get_left(mb));
+		TEST_ASSERT(0 == memcmp(rr, mbuf_buf(mb), sizeof(rr)));
+		TEST_EQUALS(i, ntohl(*(uint32_t *)(void *)(mb->buf + 8)));
+
+		err = srtcp_decrypt(rx, ref);
+		TEST_EQUALS(EALREADY, err);
+		err = 0;
+	}
+
+ out:
+	mem_deref(rx);
+	mem_deref(tx);
+	mem_deref(ref);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static uint64_t pps(uint64_t nsec)
+{
+	return nsec ? (uint64_t)PERF_FRAMES * FRAME_PKTS * 1000000000ULL
+		/ nsec : 0;
+}
+
+
+/* Protect and unprotect video frames, packet by packet or in batches */
+static int perf_srtp(size_t len, bool batch, uint64_t *t_tx, uint64_t *t_rx)
+{
+	struct srtp *tx = NULL, *rx = NULL;
+	struct mbuf *mbv[FRAME_PKTS];
+	int errv[FRAME_PKTS];
+	uint16_t seq = 0;
+	uint64_t t0;
+	unsigned i, j;
+	int err;
+
+	memset(mbv, 0, sizeof(mbv));
+
+	err = mbv_alloc(mbv, FRAME_PKTS);
+	if (err)
+		goto out;
+
+	err  = srtp_alloc(&tx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  test_key, sizeof(test_key));
+	err |= srtp_alloc(&rx, SRTP_AES_CM_128_HMAC_SHA1_80,
+			  test_key, sizeof(test_key));
+	if (err)
+		goto out;
+
+	*t_tx = *t_rx = 0;
+
+	for (i=0; i<PERF_FRAMES; i++) {
+
+		for (j=0; j<FRAME_PKTS; j++)
+			pkt_write(mbv[j], 0x01020304, seq++, len);
+
+		t0 = test_nsec();
+
+		if (batch) {
+			err = srtp_encrypt_batch(tx, mbv, FRAME_PKTS);
+		}
+		else {
+			for (j=0; j<FRAME_PKTS; j++)
+				err |= srtp_encrypt(tx, mbv[j]);
+		}
+
+		*t_tx += test_nsec() - t0;
+		t0 = test_nsec();
+
+		if (batch) {
+			err |= srtp_decrypt_batch(rx, mbv, errv, FRAME_PKTS);
+			for (j=0; j<FRAME_PKTS; j++)
+				err |= errv[j];
+		}
+		else {
+			for (j=0; j<FRAME_PKTS; j++)
+				err |= srtp_decrypt(rx, mbv[j]);
+		}
+
+		*t_rx += test_nsec() - t0;
+
+		if (err)
+			goto out;
+	}
+
+ out:
+	mem_deref(rx);
+	mem_deref(tx);
+	mbv_free(mbv, FRAME_PKTS);
+
+	return err;
+}
+
+
+#ifdef USE_LIBSRTP
+static int perf_libsrtp(size_t len, uint64_t *t_tx, uint64_t *t_rx)
+{
+	srtp_t tx = NULL, rx = NULL;
+	srtp_policy_t policy;
+	uint8_t key[KEY_LEN];
+	struct mbuf *mb;
+	uint16_t seq = 0;
+	uint64_t t0;
+	unsigned i, j;
+	int err = 0, n;
+
+	mb = mbuf_alloc(PKT_MAX);
+	if (!mb)
+		return ENOMEM;
+
+	memcpy(key, test_key, sizeof(key));
+
+	memset(&policy, 0, sizeof(policy));
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtp);
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtcp);
+	policy.key = key;
+
+	policy.ssrc.type = ssrc_any_outbound;
+	if (srtp_create(&tx, &policy) != srtp_err_status_ok) {
+		err = EPROTO;
+		goto out;
+	}
+
+	policy.ssrc.type = ssrc_any_inbound;
+	if (srtp_create(&rx, &policy) != srtp_err_status_ok) {
+		err = EPROTO;
+		goto out;
+	}
+
+	*t_tx = *t_rx = 0;
+
+	/* one packet buffer, so the packets are protected one by one */
+	for (i=0; i<PERF_FRAMES; i++) {
+
+		for (j=0; j<FRAME_PKTS; j++) {
+
+			pkt_write(mb, 0x01020304, seq++, len);
+			n = (int)mb->end;
+
+			t0 = test_nsec();
+			if (srtp_protect(tx, mb->buf, &n))
+				err = EPROTO;
+			*t_tx += test_nsec() - t0;
+
+			t0 = test_nsec();
+			if (srtp_unprotect(rx, mb->buf, &n))
+				err = EPROTO;
+			*t_rx += test_nsec() - t0;
+		}
+
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (rx)
+		srtp_dealloc(rx);
+	if (tx)
+		srtp_dealloc(tx);
+	mem_deref(mb);
+
+	return err;
+}
+#endif
+
+
+static int perf_size(size_t len)
+{
+	uint64_t tx1, rx1, txb, rxb;
+	int err;
+
+	err  = perf_srtp(len, false, &tx1, &rx1);
+	err |= perf_srtp(len, true, &txb, &rxb);
+	if (err)
+		return err;
+
+	(void)re_printf("  %4zu bytes:  protect %8llu  batch %8llu"
+			"   unprotect %8llu  batch %8llu packets/s\n",
+			len, pps(tx1), pps(txb), pps(rx1), pps(rxb));
+
+#ifdef USE_LIBSRTP
+	err = perf_libsrtp(len, &tx1, &rx1);
+	if (err)
+		return err;
+
+	(void)re_printf("  %4zu bytes:  libsrtp %8llu                 "
+			"   libsrtp   %8llu packets/s\n",
+			len, pps(tx1), pps(rx1));
+#endif
+
+	return 0;
+}
+
+
+int test_perf_srtp(void)
+{
+	int err = 0;
+
+#ifdef USE_LIBSRTP
+	if (srtp_init() != srtp_err_status_ok)
+		return EPROTO;
+#endif
+
+	(void)re_printf("srtp: AES_CM_128_HMAC_SHA1_80, frames of %u"
+			" packets\n", FRAME_PKTS);
+
+	err |= perf_size(160);
+	err |= perf_size(1200);
+
+#ifdef USE_LIBSRTP
+	(void)srtp_shutdown();
+#endif
+
+	return err;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file tests/stun.c  STUN client transactions -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "../src/stun/stun.h"
+#include "test.h"
+
+
+enum {
+	NUM_CTRANS  = 1000,
+	PERF_CTRANS = 5000,
+};
+
+
+struct stuntest {
+	struct stun *stun;
+	struct udp_sock *us;
+	struct sa dst;
+	struct stun_msg **msgv;  /* Responses, in reverse order */
+	uint8_t (*tidv)[STUN_TID_SIZE];
+	unsigned n;
+	unsigned n_resp;
+	int err;
+};
+
+
+static void tid_set(uint8_t *tid, unsigned i)
+{
+	memset(tid, 0, STUN_TID_SIZE);
+
+	/* the same prefix for all, like a counter in the transaction ID */
+	tid[STUN_TID_SIZE - 4] = (uint8_t)(i >> 24);
+	tid[STUN_TID_SIZE - 3] = (uint8_t)(i >> 16);
+	tid[STUN_TID_SIZE - 2] = (uint8_t)(i >> 8);
+	tid[STUN_TID_SIZE - 1] = (uint8_t)(i >> 0);
+}
+
+
+static void resp_handler(int err, uint16_t scode, const char *reason,
+			 const struct stun_msg *msg, void *arg)
+{
+	struct stuntest *st = arg;
+	uint8_t tid[STUN_TID_SIZE];
+	(void)reason;
+
+	/* the responses arrive in reverse order */
+	tid_set(tid, st->n - 1 - st->n_resp);
+
+	if (err || scode || !msg ||
+	    memcmp(stun_msg_tid(msg), tid, STUN_TID_SIZE))
+		st->err = EBADMSG;
+
+	++st->n_resp;
+}
+
+
+static void stuntest_close(struct stuntest *st)
+{
+	unsigned i;
+
+	if (st->msgv) {
+		for (i=0; i<st->n; i++)
+			mem_deref(st->msgv[i]);
+	}
+
+	mem_deref(st->msgv);
+	mem_deref(st->tidv);
+	mem_deref(st->stun);
+	mem_deref(st->us);
+}
+
+
+/*
+ * Send n Binding requests to a socket which does not answer, and decode
+ * their responses in reverse order
+ */
+static int stuntest_init(struct stuntest *st, unsigned n)
+{
+	struct mbuf *mb;
+	unsigned i;
+	int err;
+
+	memset(st, 0, sizeof(*st));
+
+	st->n    = n;
+	st->msgv = mem_zalloc(n * sizeof(*st->msgv), NULL);
+	st->tidv = mem_alloc(n * sizeof(*st->tidv), NULL);
+	mb = mbuf_alloc(128);
+	if (!st->msgv || !st->tidv || !mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = stun_alloc(&st->stun, NULL, NULL, NULL);
+	err |= sa_set_str(&st->dst, "127.0.0.1", 0);
+	if (err)
+		goto out;
+
+	err  = udp_listen(&st->us, &st->dst, NULL, NULL);
+	err |= udp_local_get(st->us, &st->dst);
+	if (err)
+		goto out;
+
+	for (i=0; i<n; i++) {
+
+		tid_set(st->tidv[i], i);
+
+		mb->pos = mb->end = 0;
+		err = stun_msg_encode(mb, STUN_METHOD_BINDING,
+				      STUN_CLASS_REQUEST, st->tidv[i], NULL,
+				      NULL, 0, false, 0x00, 0);
+		if (err)
+			goto out;
+
+		mb->pos = 0;
+		err = stun_ctrans_request(NULL, st->stun, IPPROTO_UDP, st->us,
+					  &st->dst, mb, st->tidv[i],
+					  STUN_METHOD_BINDING, NULL,
+					  resp_handler, st);
+		if (err)
+			goto out;
+	}
+
+	for (i=0; i<n; i++) {
+
+		mb->pos = mb->end = 0;
+		err = stun_msg_encode(mb, STUN_METHOD_BINDING,
+				      STUN_CLASS_SUCCESS_RESP,
+				      st->tidv[n - 1 - i], NULL, NULL, 0,
+				      false, 0x00, 1,
+				      STUN_ATTR_XOR_MAPPED_ADDR, &st->dst);
+		if (err)
+			goto out;
+
+		mb->pos = 0;
+		err = stun_msg_decode(&st->msgv[i], mb, NULL);
+		if (err)
+			goto out;
+	}
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/* Every response completes its own transaction, and only once */
+int test_stun_ctrans(void)
+{
+	struct stun_unknown_attr ua;
+	struct stuntest st;
+	unsigned i;
+	int err;
+
+	memset(&ua, 0, sizeof(ua));
+
+	err = stuntest_init(&st, NUM_CTRANS);
+	TEST_ERR(err);
+
+	for (i=0; i<st.n; i++) {
+		err = stun_ctrans_recv(st.stun, st.msgv[i], &ua);
+		TEST_ERR(err);
+	}
+
+	TEST_ERR(st.err);
+	TEST_EQUALS(NUM_CTRANS, st.n_resp);
+
+	/* a retransmitted response has no transaction any more */
+	err = stun_ctrans_recv(st.stun, st.msgv[0], &ua);
+	TEST_EQUALS(ENOENT, err);
+	err = 0;
+
+ out:
+	stuntest_close(&st);
+
+	return err;
+}
+
+
+/*
+ * The previous matching: compare against each outstanding request. Only
+ * the matching is timed, not the completion of the transaction
+ */
+static unsigned list_match(uint8_t (*tidv)[STUN_TID_SIZE], unsigned n,
+			   const struct stun_msg *msg)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		if (!memcmp(tidv[i], stun_msg_tid(msg), STUN_TID_SIZE))
+			return i;
+	}
+
+	return n;
+}
+
+
+static int perf_ctrans(unsigned n)
+{
+	struct stun_unknown_attr ua;
+	struct stuntest st;
+	uint64_t t0, t_list, t_hash;
+	unsigned i, found = 0;
+	int err;
+
+	memset(&ua, 0, sizeof(ua));
+
+	err = stuntest_init(&st, n);
+	if (err)
+		goto out;
+
+	t0 = test_nsec();
+	for (i=0; i<n; i++)
+		found += list_match(st.tidv, n, st.msgv[i]) < n;
+	t_list = test_nsec() - t0;
+
+	t0 = test_nsec();
+	for (i=0; i<n; i++)
+		err |= stun_ctrans_recv(st.stun, st.msgv[i], &ua);
+	t_hash = test_nsec() - t0;
+
+	if (err || st.err || found != n || st.n_resp != n) {
+		err = err ? err : EBADMSG;
+		goto out;
+	}
+
+	(void)re_printf("  %5u outstanding:  list %6llu  hash %6llu"
+			" ns/response\n", n, t_list / n, t_hash / n);
+
+ out:
+	stuntest_close(&st);
+
+	return err;
+}
+
+
+int test_perf_stun_ctrans(void)
+{
+	int err;
+
+	(void)re_printf("stun: matching Binding responses to requests\n");
+
+	err  = perf_ctrans(100);
+	err |= perf_ctrans(1000);
+	err |= perf_ctrans(PERF_CTRANS);
+
+	return err;
+}
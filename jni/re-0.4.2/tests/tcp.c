@@ -0,0 +1,361 @@
+/**
+ * @file tests/tcp.c  TCP sending queue -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+enum {
+	SOCKBUF     = 4096,    /* Socket buffers of both ends           */
+	BIG_SIZE    = 262144,  /* Fills the socket buffers              */
+	NUM_SMALL   = 200,
+	NUM_REF     = 40,
+	REF_SIZE    = 64,
+	TAIL_SIZE   = 100,     /* A copy after the references           */
+	QBUF_SIZE   = 4096,    /* Copy buffer of the queue              */
+	IOV_MAX_    = 16,      /* Queue entries sent at a time          */
+	QENT_ALLOCS = 3,       /* Queue entry, mbuf and its buffer      */
+	MAX_POLLS   = 10000,
+	TIMEOUT     = 5000,
+};
+
+
+struct tcptest {
+	struct tcp_conn *tc;
+	struct tmr tmr;
+	struct mbuf *refv[NUM_REF];
+	int lfd;               /* Listening socket                      */
+	int pfd;               /* Peer, which reads when the test wants */
+	size_t n_tx;           /* Bytes sent                            */
+	size_t n_rx;           /* Bytes read by the peer                */
+	uint64_t allocs;       /* Allocations of the last send          */
+	bool estab;
+	int err;
+};
+
+
+static uint8_t pattern(size_t i)
+{
+	return (uint8_t)(i % 251);
+}
+
+
+static void timeout_handler(void *arg)
+{
+	struct tcptest *tt = arg;
+
+	tt->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static void cancel_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static void estab_handler(void *arg)
+{
+	struct tcptest *tt = arg;
+
+	tt->estab = true;
+	re_cancel();
+}
+
+
+static void recv_handler(struct mbuf *mb, void *arg)
+{
+	(void)mb;
+	(void)arg;
+}
+
+
+static void close_handler(int err, void *arg)
+{
+	struct tcptest *tt = arg;
+
+	tt->err = err ? err : ECONNRESET;
+	re_cancel();
+}
+
+
+/* Send the next bytes of the pattern, counting the allocations */
+static int send_data(struct tcptest *tt, size_t sz, struct mbuf **mbp)
+{
+	struct mbuf *mb;
+	uint64_t nallocs;
+	size_t i;
+	int err;
+
+	mb = mbuf_alloc(sz);
+	if (!mb)
+		return ENOMEM;
+
+	for (i=0; i<sz; i++)
+		mb->buf[i] = pattern(tt->n_tx + i);
+
+	mb->end = sz;
+
+	nallocs = mem_nallocs();
+
+	if (mbp)
+		err = tcp_send_ref(tt->tc, mb);
+	else
+		err = tcp_send(tt->tc, mb);
+
+	tt->allocs = mem_nallocs() - nallocs;
+
+	if (!err)
+		tt->n_tx += sz;
+
+	if (!err && mbp)
+		*mbp = mb;
+	else
+		mem_deref(mb);
+
+	return err;
+}
+
+
+/* Read what the peer has received, and check the byte order */
+static int peer_read(struct tcptest *tt)
+{
+	uint8_t buf[8192];
+	ssize_t n, i;
+
+	for (;;) {
+		n = recv(tt->pfd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (n < 0)
+			return (EAGAIN == errno) ? 0 : errno;
+		if (n == 0)
+			return ECONNRESET;
+
+		for (i=0; i<n; i++) {
+			if (buf[i] != pattern(tt->n_rx + i))
+				return EBADMSG;
+		}
+
+		tt->n_rx += n;
+	}
+}
+
+
+/* One pass of the main loop, which sends from the queue once */
+static int poll_once(struct tcptest *tt)
+{
+	int err;
+
+	tmr_start(&tt->tmr, 0, cancel_handler, tt);
+	err = re_main(NULL);
+	tmr_cancel(&tt->tmr);
+
+	return err ? err : tt->err;
+}
+
+
+static unsigned refs_held(const struct tcptest *tt)
+{
+	unsigned i, n = 0;
+
+	for (i=0; i<NUM_REF; i++)
+		n += (mem_nrefs(tt->refv[i]) > 1);
+
+	return n;
+}
+
+
+static int tcptest_init(struct tcptest *tt)
+{
+	const int sockbuf = SOCKBUF;
+	struct sa laddr;
+	socklen_t len;
+	int err;
+
+	memset(tt, 0, sizeof(*tt));
+	tt->lfd = -1;
+	tt->pfd = -1;
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	/* a plain socket, so that nothing is read until the test does */
+	tt->lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (tt->lfd < 0)
+		return errno;
+
+	len = laddr.len;
+	if (setsockopt(tt->lfd, SOL_SOCKET, SO_RCVBUF, &sockbuf,
+		       sizeof(sockbuf)) ||
+	    bind(tt->lfd, &laddr.u.sa, laddr.len) ||
+	    listen(tt->lfd, 1) ||
+	    getsockname(tt->lfd, &laddr.u.sa, &len))
+		return errno;
+
+	err = tcp_connect(&tt->tc, &laddr, estab_handler, recv_handler,
+			  close_handler, tt);
+	if (err)
+		return err;
+
+	tmr_start(&tt->tmr, TIMEOUT, timeout_handler, tt);
+	err = re_main(NULL);
+	tmr_cancel(&tt->tmr);
+	if (err || tt->err)
+		return err ? err : tt->err;
+
+	tt->pfd = accept(tt->lfd, NULL, NULL);
+	if (tt->pfd < 0)
+		return errno;
+
+	if (setsockopt(tcp_conn_fd(tt->tc), SOL_SOCKET, SO_SNDBUF, &sockbuf,
+		       sizeof(sockbuf)))
+		return errno;
+
+	return 0;
+}
+
+
+static void tcptest_reset(struct tcptest *tt)
+{
+	unsigned i;
+
+	tmr_cancel(&tt->tmr);
+
+	for (i=0; i<NUM_REF; i++)
+		mem_deref(tt->refv[i]);
+
+	mem_deref(tt->tc);
+
+	if (tt->pfd >= 0)
+		(void)close(tt->pfd);
+	if (tt->lfd >= 0)
+		(void)close(tt->lfd);
+}
+
+
+/*
+ * The peer does not read at first, so that a large send is partly written
+ * and the rest is queued. Copies are then appended to 4 KB buffers, and
+ * referenced buffers are queued as they are. The queue is sent as the
+ * peer reads, at most 16 entries at a time.
+ */
+int test_tcp_sendq(void)
+{
+	struct tcptest tt;
+	size_t txqsz, room = 0;
+	unsigned i, n_ent = 0, held, held_max, n_max = 0;
+	uint64_t allocs = 0;
+	int err;
+
+	err = tcptest_init(&tt);
+	TEST_ERR(err);
+	TEST_ASSERT(tt.estab);
+
+	/* the socket buffers take part of it, the rest is a copy */
+	err = send_data(&tt, BIG_SIZE, NULL);
+	TEST_ERR(err);
+
+	txqsz = tcp_conn_txqsz(tt.tc);
+	TEST_ASSERT(txqsz > 0 && txqsz < BIG_SIZE);
+	TEST_EQUALS(QENT_ALLOCS, tt.allocs);
+
+	/* small copies fill a buffer before the next is allocated */
+	for (i=0; i<NUM_SMALL; i++) {
+
+		const size_t sz = 1 + (i * 97) % 700;
+
+		if (room >= sz) {
+			room -= sz;
+		}
+		else {
+			room = QBUF_SIZE - sz;
+			++n_ent;
+		}
+
+		err = send_data(&tt, sz, NULL);
+		TEST_ERR(err);
+
+		allocs += tt.allocs;
+		txqsz  += sz;
+
+		TEST_EQUALS(txqsz, tcp_conn_txqsz(tt.tc));
+	}
+
+	TEST_EQUALS(QENT_ALLOCS * n_ent, allocs);
+
+	/* referenced buffers are not copied */
+	for (i=0; i<NUM_REF; i++) {
+
+		err = send_data(&tt, REF_SIZE, &tt.refv[i]);
+		TEST_ERR(err);
+
+		TEST_EQUALS(1, tt.allocs);
+		TEST_EQUALS(2, mem_nrefs(tt.refv[i]));
+		TEST_EQUALS(0, tt.refv[i]->pos);
+
+		txqsz += REF_SIZE;
+		TEST_EQUALS(txqsz, tcp_conn_txqsz(tt.tc));
+	}
+
+	/* nor is a copy appended to them */
+	err = send_data(&tt, TAIL_SIZE, NULL);
+	TEST_ERR(err);
+	TEST_EQUALS(QENT_ALLOCS, tt.allocs);
+
+	txqsz += TAIL_SIZE;
+	TEST_EQUALS(txqsz, tcp_conn_txqsz(tt.tc));
+
+	/* the peer reads, and the queue is sent in order */
+	held_max = NUM_REF;
+
+	for (i=0; i<MAX_POLLS && tt.n_rx < tt.n_tx; i++) {
+
+		err = peer_read(&tt);
+		TEST_ERR(err);
+
+		err = poll_once(&tt);
+		TEST_ERR(err);
+
+		TEST_ASSERT(tcp_conn_txqsz(tt.tc) <= txqsz);
+		txqsz = tcp_conn_txqsz(tt.tc);
+		TEST_ASSERT(tt.n_rx + txqsz <= tt.n_tx);
+
+		/* released in order, 16 at most at a time */
+		held = refs_held(&tt);
+		TEST_ASSERT(held_max - held <= IOV_MAX_);
+		n_max = max(n_max, held_max - held);
+
+		if (held)
+			TEST_EQUALS(2, mem_nrefs(tt.refv[NUM_REF - held]));
+
+		/* once the copies before them are sent, the queue is the
+		 * references still held and the last copy */
+		if (held < NUM_REF) {
+			TEST_ASSERT(txqsz <= TAIL_SIZE + held * REF_SIZE);
+			if (held)
+				TEST_ASSERT(txqsz >
+					    TAIL_SIZE + (held-1) * REF_SIZE);
+		}
+
+		held_max = held;
+	}
+
+	TEST_EQUALS(0, tcp_conn_txqsz(tt.tc));
+	TEST_EQUALS(tt.n_tx, tt.n_rx);
+	TEST_EQUALS(0, refs_held(&tt));
+	TEST_EQUALS(IOV_MAX_, n_max);
+
+ out:
+	tcptest_reset(&tt);
+
+	return err;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file test.h  Selftest and benchmarks for libre -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/** Fail the current test if the expression is false */
+#define TEST_ASSERT(expr)						\
+	if (!(expr)) {							\
+		(void)re_fprintf(stderr, "%s:%u: assertion failed: %s\n",\
+				 __FILE__, __LINE__, #expr);		\
+		err = EINVAL;						\
+		goto out;						\
+	}
+
+/** Fail the current test if two integers differ */
+#define TEST_EQUALS(expected, actual)					\
+	if ((expected) != (actual)) {					\
+		(void)re_fprintf(stderr, "%s:%u: expected %lld, got %lld\n",\
+				 __FILE__, __LINE__,			\
+				 (long long)(expected),			\
+				 (long long)(actual));			\
+		err = EINVAL;						\
+		goto out;						\
+	}
+
+/** Fail the current test on an error code */
+#define TEST_ERR(e)							\
+	if (e) {							\
+		(void)re_fprintf(stderr, "%s:%u: error: %m\n",		\
+				 __FILE__, __LINE__, (e));		\
+		goto out;						\
+	}
+
+
+uint64_t test_nsec(void);
+
+
+/* Tests */
+int test_dns_cache_lru(void);
+int test_dns_cache_pending(void);
+int test_hmac_sha1(void);
+int test_jbuf_fixed(void);
+int test_jbuf_jump(void);
+int test_jbuf_adaptive(void);
+int test_jbuf_delay(void);
+int test_mem(void);
+int test_rtp_members(void);
+#ifndef USE_OPENSSL
+int test_sha1(void);
+#endif
+int test_sip_frame(void);
+int test_sip_msg(void);
+#ifdef USE_OPENSSL
+int test_srtp(void);
+int test_srtcp(void);
+#endif
+int test_stun_ctrans(void);
+int test_tcp_sendq(void);
+int test_tmr_order(void);
+int test_tmr_count(void);
+int test_udp_rxbatch(void);
+int test_udp_txbatch(void);
+int test_udp_helper_batch(void);
+int test_worker(void);
+
+
+/* Benchmarks */
+int test_perf_hmac_sha1(void);
+int test_perf_rtp_rx(void);
+int test_perf_sip_frame(void);
+int test_perf_sip_msg(void);
+#ifdef USE_OPENSSL
+int test_perf_srtp(void);
+#endif
+int test_perf_stun_ctrans(void);
+int test_perf_tmr(void);
+int test_perf_udp_rx(void);
+int test_perf_udp_tx(void);
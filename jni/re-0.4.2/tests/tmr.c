@@ -0,0 +1,331 @@
+/**
+ * @file tests/tmr.c  Timer wheel -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re.h>
+#include "test.h"
+
+
+enum {
+	NUM_ORDER   = 64,
+	PERF_ACTIVE = 100000,
+	PERF_OPS    = 20000,
+	PERF_RANGE  = 60000,  /* Random delays up to 60 s */
+};
+
+
+struct tmrl *tmrl_get(void);
+
+
+struct order {
+	struct tmr tmrv[NUM_ORDER + 2];
+	uint64_t jfsv[NUM_ORDER + 2];
+	unsigned firedv[NUM_ORDER + 2];
+	unsigned n;
+};
+
+struct order_arg {
+	struct order *ord;
+	unsigned ix;
+};
+
+
+static struct order_arg argv_order[NUM_ORDER + 2];
+
+
+static void dummy_handler(void *arg)
+{
+	(void)arg;
+}
+
+
+static void order_handler(void *arg)
+{
+	struct order_arg *oa = arg;
+	struct order *ord = oa->ord;
+
+	ord->firedv[ord->n++] = oa->ix;
+}
+
+
+/* Fired timers must be sorted by expiry, then by start order */
+static int check_order(const struct order *ord, unsigned n)
+{
+	unsigned i;
+	int err = 0;
+
+	TEST_EQUALS(n, ord->n);
+
+	for (i=1; i<n; i++) {
+
+		const unsigned a = ord->firedv[i-1];
+		const unsigned b = ord->firedv[i];
+
+		TEST_ASSERT(ord->jfsv[a] < ord->jfsv[b] ||
+			    (ord->jfsv[a] == ord->jfsv[b] && a < b));
+	}
+
+ out:
+	return err;
+}
+
+
+static void start(struct order *ord, unsigned ix, uint64_t delay)
+{
+	argv_order[ix].ord = ord;
+	argv_order[ix].ix  = ix;
+
+	tmr_start(&ord->tmrv[ix], delay, order_handler, &argv_order[ix]);
+	ord->jfsv[ix] = ord->tmrv[ix].jfs;
+}
+
+
+static void cascade_handler(void *arg)
+{
+	struct order *ord = arg;
+
+	/* started directly on level 0, after A which is on level 1 */
+	start(ord, 1, 0);
+}
+
+
+int test_tmr_order(void)
+{
+	struct tmrl *tmrl = tmrl_get();
+	struct order *ord;
+	struct tmr guard, h;
+	uint64_t now;
+	unsigned i;
+	int err = 0;
+
+	ord = mem_zalloc(sizeof(*ord), NULL);
+	if (!ord)
+		return ENOMEM;
+
+	tmr_init(&guard);
+	tmr_init(&h);
+
+	/* a mix of delay 0 and short delays, polled until all fired */
+	for (i=0; i<NUM_ORDER; i++)
+		start(ord, i, (i % 3) ? i % 5 : 0);
+
+	while (ord->n < NUM_ORDER)
+		tmr_poll(tmrl);
+
+	err = check_order(ord, NUM_ORDER);
+	TEST_ERR(err);
+
+	/*
+	 * A wheel that is behind: A (delay 0) goes to level 1, then the
+	 * handler of H starts B (delay 0) on level 0 before A is cascaded.
+	 * A was started first, so it must fire first.
+	 */
+	memset(ord, 0, sizeof(*ord));
+
+	tmr_start(&guard, 10000, dummy_handler, NULL);
+
+	now = tmr_jiffies();
+	tmrl->jfs = now - 256;
+
+	start(ord, 0, 0);
+	tmr_start(&h, (uint64_t)0 - (now % 256 + 1), cascade_handler, ord);
+
+	while (ord->n < 2)
+		tmr_poll(tmrl);
+
+	err = check_order(ord, 2);
+	TEST_ERR(err);
+
+ out:
+	tmr_cancel(&guard);
+	tmr_cancel(&h);
+	for (i=0; i<NUM_ORDER + 2; i++)
+		tmr_cancel(&ord->tmrv[i]);
+	mem_deref(ord);
+
+	return err;
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *cancel_thread(void *arg)
+{
+	struct tmr *tmrv = arg;
+	unsigned i;
+
+	/* this thread has a timer wheel of its own */
+	if (re_thread_init())
+		return NULL;
+
+	for (i=0; i<NUM_ORDER; i++)
+		tmr_cancel(&tmrv[i]);
+
+	re_thread_close();
+
+	return NULL;
+}
+#endif
+
+
+/* The timer count must follow timers cancelled from another thread */
+int test_tmr_count(void)
+{
+	struct tmrl *tmrl = tmrl_get();
+	struct tmr *tmrv;
+	struct mbuf *mb = NULL;
+	unsigned i;
+	int err = 0;
+
+	tmrv = mem_zalloc(NUM_ORDER * sizeof(*tmrv), NULL);
+	if (!tmrv)
+		return ENOMEM;
+
+	mb = mbuf_alloc(256);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<NUM_ORDER; i++)
+		tmr_start(&tmrv[i], 1000 + i * 300, dummy_handler, NULL);
+
+	TEST_ASSERT(tmr_next_timeout(tmrl) != 0);
+
+#ifdef HAVE_PTHREAD
+	{
+		pthread_t tid;
+
+		err = pthread_create(&tid, NULL, cancel_thread, tmrv);
+		TEST_ERR(err);
+		pthread_join(tid, NULL);
+	}
+#else
+	for (i=0; i<NUM_ORDER; i++)
+		tmr_cancel(&tmrv[i]);
+#endif
+
+	TEST_EQUALS(0, tmr_next_timeout(tmrl));
+
+	err = mbuf_printf(mb, "%H", tmr_status, NULL);
+	TEST_ERR(err);
+	TEST_EQUALS(0, mb->end);
+
+ out:
+	for (i=0; i<NUM_ORDER; i++)
+		tmr_cancel(&tmrv[i]);
+	mem_deref(tmrv);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * The previous timer list, sorted by expiry with a linear search from
+ * the tail on insert
+ */
+
+static bool inspos_handler(struct le *le, void *arg)
+{
+	struct tmr *tmr = le->data;
+	const uint64_t jfs = *(uint64_t *)arg;
+
+	return tmr->jfs <= jfs;
+}
+
+
+static void list_tmr_start(struct list *tmrl, struct tmr *tmr, uint64_t jfs)
+{
+	struct le *le;
+
+	list_unlink(&tmr->le);
+
+	tmr->jfs = jfs;
+	tmr->th  = dummy_handler;
+
+	le = list_apply(tmrl, false, inspos_handler, &jfs);
+	if (le)
+		list_insert_after(tmrl, le, &tmr->le, tmr);
+	else
+		list_prepend(tmrl, &tmr->le, tmr);
+}
+
+
+int test_perf_tmr(void)
+{
+	struct list tmrl = LIST_INIT;
+	struct tmr *tmrv;
+	uint32_t *rndv;
+	uint64_t now, t0, t1, t2, t3;
+	unsigned i;
+	int err = 0;
+
+	tmrv = mem_zalloc(PERF_ACTIVE * sizeof(*tmrv), NULL);
+	rndv = mem_alloc(PERF_OPS * 2 * sizeof(*rndv), NULL);
+	if (!tmrv || !rndv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<PERF_OPS*2; i++)
+		rndv[i] = rand();
+
+	now = tmr_jiffies();
+
+	/* sorted list: fill in order, then restart random timers */
+	for (i=0; i<PERF_ACTIVE; i++)
+		list_tmr_start(&tmrl, &tmrv[i],
+			       now + (uint64_t)i * PERF_RANGE / PERF_ACTIVE);
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_OPS; i++) {
+		list_tmr_start(&tmrl, &tmrv[rndv[2*i] % PERF_ACTIVE],
+			       now + rndv[2*i+1] % PERF_RANGE);
+	}
+	t1 = test_nsec();
+
+	list_clear(&tmrl);
+	memset(tmrv, 0, PERF_ACTIVE * sizeof(*tmrv));
+
+	/* timer wheel: the same pattern through tmr_start() */
+	for (i=0; i<PERF_ACTIVE; i++)
+		tmr_start(&tmrv[i], (uint64_t)i * PERF_RANGE / PERF_ACTIVE,
+			  dummy_handler, NULL);
+
+	t2 = test_nsec();
+	for (i=0; i<PERF_OPS; i++) {
+		tmr_start(&tmrv[rndv[2*i] % PERF_ACTIVE],
+			  rndv[2*i+1] % PERF_RANGE, dummy_handler, NULL);
+	}
+	t3 = test_nsec();
+
+	(void)re_printf("tmr: %u active timers, random restart\n",
+			PERF_ACTIVE);
+	(void)re_printf("  sorted list:  %8llu ns/op\n",
+			(t1 - t0) / PERF_OPS);
+	(void)re_printf("  timer wheel:  %8llu ns/op\n",
+			(t3 - t2) / PERF_OPS);
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_OPS; i++)
+		(void)tmr_next_timeout(tmrl_get());
+	t1 = test_nsec();
+
+	(void)re_printf("  next timeout: %8llu ns/op\n",
+			(t1 - t0) / PERF_OPS);
+
+	for (i=0; i<PERF_ACTIVE; i++)
+		tmr_cancel(&tmrv[i]);
+
+ out:
+	mem_deref(rndv);
+	mem_deref(tmrv);
+
+	return err;
+}
@@ -0,0 +1,629 @@
+/**
+ * @file tests/udp.c  UDP batched receive and send -- tests and benchmarks
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include "test.h"
+
+
+enum {
+	BURST       = 32,
+	NUM_DGRAM   = 320,
+	KEEP_MAX    = 64,   /* References held, like a jitter buffer */
+	PERF_ROUNDS = 2000,
+	LARGE_SIZE  = 4000,
+	TIMEOUT     = 5000,
+	FRAME_PKTS  = 24,   /* Packets of a video frame */
+	TRAILER     = 4,    /* Bytes added by the batch helper */
+};
+
+
+struct udptest {
+	struct udp_sock *tx;
+	struct udp_sock *rx;
+	struct sa dst;
+	struct tmr tmr;
+	struct mbuf *keepv[NUM_DGRAM];
+	unsigned nkeep;    /* Number of held references     */
+	unsigned keep_max; /* Oldest reference is released  */
+	unsigned n_tx;
+	unsigned n_rx;
+	unsigned n_wait;
+	bool video;        /* Send video frames             */
+	struct udp_helper *uh_tx;
+	struct udp_helper *uh_rx;
+	unsigned n_send;   /* Datagrams per helper handler  */
+	unsigned n_sendb;
+	unsigned n_recv;
+	unsigned n_recvb;
+	unsigned n_call_sendb; /* Calls of the batch handlers */
+	unsigned n_call_recvb;
+	uint64_t nsec;     /* Time spent receiving          */
+	int err;
+};
+
+
+static size_t dgram_size(const struct udptest *ut, unsigned i)
+{
+	/* video frames: full packets, and a shorter last packet */
+	if (ut->video)
+		return (i % FRAME_PKTS == FRAME_PKTS - 1) ? 700 : 1200;
+
+	/* mostly RTP sized, with a few large datagrams */
+	return (i % 50 == 49) ? LARGE_SIZE : 1 + (i * 37) % 1400;
+}
+
+
+static void timeout_handler(void *arg)
+{
+	struct udptest *ut = arg;
+
+	ut->err = ETIMEDOUT;
+	re_cancel();
+}
+
+
+static void recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct udptest *ut = arg;
+	const size_t sz = dgram_size(ut, ut->n_rx);
+	size_t i;
+	(void)src;
+
+	if (mbuf_get_left(mb) != sz) {
+		ut->err = EPROTO;
+		goto out;
+	}
+
+	for (i=0; i<sz; i++) {
+		if (mb->buf[mb->pos + i] != (uint8_t)(ut->n_rx + i)) {
+			ut->err = EBADMSG;
+			goto out;
+		}
+	}
+
+	if (ut->nkeep == ut->keep_max) {
+		mem_deref(ut->keepv[0]);
+		memmove(ut->keepv, ut->keepv + 1,
+			--ut->nkeep * sizeof(ut->keepv[0]));
+	}
+
+	ut->keepv[ut->nkeep++] = mem_ref(mb);
+
+ out:
+	++ut->n_rx;
+
+	if (ut->err || ut->n_rx == ut->n_wait)
+		re_cancel();
+}
+
+
+static int send_frame(struct udptest *ut, unsigned n, bool queue)
+{
+	uint8_t pattern[256 + LARGE_SIZE];
+	struct mbuf *mb;
+	unsigned i;
+	int err = 0;
+
+	mb = mbuf_alloc(LARGE_SIZE);
+	if (!mb)
+		return ENOMEM;
+
+	for (i=0; i<sizeof(pattern); i++)
+		pattern[i] = (uint8_t)i;
+
+	for (i=0; i<n; i++) {
+
+		const size_t sz = dgram_size(ut, ut->n_tx);
+
+		mb->pos = mb->end = 0;
+		err |= mbuf_write_mem(mb, &pattern[ut->n_tx % 256], sz);
+		mb->pos = 0;
+
+		if (queue)
+			err |= udp_send_queue(ut->tx, &ut->dst, mb);
+		else
+			err |= udp_send(ut->tx, &ut->dst, mb);
+		if (err)
+			break;
+
+		++ut->n_tx;
+	}
+
+	mem_deref(mb);
+
+	if (!err && queue)
+		err = udp_flush(ut->tx);
+
+	return err;
+}
+
+
+static int recv_wait(struct udptest *ut)
+{
+	uint64_t t0;
+	int err;
+
+	ut->n_wait = ut->n_tx;
+
+	tmr_start(&ut->tmr, TIMEOUT, timeout_handler, ut);
+	t0 = test_nsec();
+	err = re_main(NULL);
+	ut->nsec += test_nsec() - t0;
+	tmr_cancel(&ut->tmr);
+
+	return err ? err : ut->err;
+}
+
+
+static int send_burst(struct udptest *ut, unsigned n)
+{
+	int err;
+
+	err = send_frame(ut, n, false);
+	if (err)
+		return err;
+
+	return recv_wait(ut);
+}
+
+
+static void udptest_reset(struct udptest *ut)
+{
+	unsigned i;
+
+	tmr_cancel(&ut->tmr);
+
+	for (i=0; i<ut->nkeep; i++)
+		mem_deref(ut->keepv[i]);
+
+	/* the helpers before their sockets */
+	mem_deref(ut->uh_tx);
+	mem_deref(ut->uh_rx);
+	mem_deref(ut->rx);
+	mem_deref(ut->tx);
+
+	memset(ut, 0, sizeof(*ut));
+}
+
+
+static int udptest_init(struct udptest *ut, unsigned batch, unsigned keep)
+{
+	struct sa laddr;
+	int err;
+
+	memset(ut, 0, sizeof(*ut));
+	ut->keep_max = keep;
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err  = udp_listen(&ut->rx, &laddr, recv_handler, ut);
+	err |= udp_listen(&ut->tx, &laddr, NULL, NULL);
+	if (err)
+		return err;
+
+	err = udp_local_get(ut->rx, &ut->dst);
+	if (err)
+		return err;
+
+	return udp_rxbatch_set(ut->rx, batch);
+}
+
+
+/*
+ * Batched receive: every held datagram has a buffer of its own size,
+ * and the receive buffers are reused even if the handler keeps all the
+ * datagrams.
+ */
+int test_udp_rxbatch(void)
+{
+	struct udptest ut;
+	struct udp_rxstat st;
+	unsigned i, n_large = 0;
+	int err;
+
+	err = udptest_init(&ut, 16, NUM_DGRAM);
+	if (err == ENOSYS) {
+		err = 0;  /* no recvmmsg() */
+		goto out;
+	}
+	TEST_ERR(err);
+
+	for (i=0; i<NUM_DGRAM; i+=BURST) {
+		err = send_burst(&ut, BURST);
+		TEST_ERR(err);
+	}
+
+	TEST_EQUALS(NUM_DGRAM, ut.nkeep);
+
+	for (i=0; i<NUM_DGRAM; i++) {
+
+		const struct mbuf *mb = ut.keepv[i];
+
+		TEST_EQUALS(dgram_size(&ut, i), mbuf_get_left(mb));
+		TEST_EQUALS(mb->end, mb->size);
+
+		if (dgram_size(&ut, i) == LARGE_SIZE)
+			++n_large;
+	}
+
+	err = udp_rxbatch_stat(ut.rx, &st);
+	TEST_ERR(err);
+
+	TEST_EQUALS(NUM_DGRAM - n_large, st.n_copy);
+	TEST_EQUALS(n_large, st.n_pass);
+
+	/* allocations: the first batch, and one per large datagram */
+	TEST_ASSERT(st.n_alloc <= 16 + n_large);
+
+ out:
+	udptest_reset(&ut);
+
+	return err;
+}
+
+
+static int perf_run(unsigned batch, uint64_t *nsec, struct udp_rxstat *st)
+{
+	struct udptest ut;
+	unsigned i;
+	int err;
+
+	err = udptest_init(&ut, batch, KEEP_MAX);
+	if (err)
+		goto out;
+
+	for (i=0; i<PERF_ROUNDS; i++) {
+		err = send_burst(&ut, BURST);
+		if (err)
+			goto out;
+	}
+
+	*nsec = ut.nsec / (PERF_ROUNDS * BURST);
+
+	if (batch > 1)
+		err = udp_rxbatch_stat(ut.rx, st);
+
+ out:
+	udptest_reset(&ut);
+
+	return err;
+}
+
+
+int test_perf_udp_rx(void)
+{
+	struct udp_rxstat st;
+	uint64_t t_single = 0, t_batch = 0;
+	unsigned total;
+	int err;
+
+	err  = perf_run(1, &t_single, NULL);
+	err |= perf_run(BURST, &t_batch, &st);
+	if (err)
+		return err;
+
+	total = st.n_reuse + st.n_alloc;
+
+	(void)re_printf("udp: bursts of %u datagrams, %u references held\n",
+			BURST, KEEP_MAX);
+	(void)re_printf("  recvfrom:  %6llu ns/datagram\n", t_single);
+	(void)re_printf("  recvmmsg:  %6llu ns/datagram\n", t_batch);
+	(void)re_printf("  rx buffers reused: %u of %u (%u.%u%%),"
+			" %u copied, %u passed\n",
+			st.n_reuse, total,
+			st.n_reuse * 100 / total,
+			st.n_reuse * 1000 / total % 10,
+			st.n_copy, st.n_pass);
+
+	return 0;
+}
+
+
+/*
+ * Batched send: the queue is sent in order and complete, also when it
+ * fills up before udp_flush(), with fewer system calls
+ */
+int test_udp_txbatch(void)
+{
+	struct udptest ut;
+	struct udp_txstat st;
+	unsigned i;
+	int err;
+
+	err = udptest_init(&ut, 0, NUM_DGRAM);
+	TEST_ERR(err);
+
+	err = udp_txbatch_set(ut.tx, 16);
+	if (err == ENOSYS) {
+		err = 0;  /* no sendmmsg() */
+		goto out;
+	}
+	TEST_ERR(err);
+
+	ut.video = true;
+
+	for (i=0; i<4; i++) {
+		err = send_frame(&ut, FRAME_PKTS, true);
+		TEST_ERR(err);
+		err = recv_wait(&ut);
+		TEST_ERR(err);
+	}
+
+	TEST_EQUALS(4 * FRAME_PKTS, ut.n_rx);
+
+	err = udp_txbatch_stat(ut.tx, &st);
+	TEST_ERR(err);
+
+	TEST_EQUALS(4 * FRAME_PKTS, st.n_dgram);
+	TEST_ASSERT(st.n_msg <= st.n_dgram);
+
+	/* one call per 16 datagrams, and one for the rest of a frame */
+	TEST_EQUALS(4 * 2, st.n_syscall);
+
+ out:
+	udptest_reset(&ut);
+
+	return err;
+}
+
+
+static const uint8_t trailer[TRAILER] = {0xa5, 0xa5, 0xa5, 0xa5};
+
+
+static int trailer_strip(struct mbuf *mb)
+{
+	if (mbuf_get_left(mb) < TRAILER ||
+	    memcmp(mb->buf + mb->end - TRAILER, trailer, TRAILER))
+		return EBADMSG;
+
+	mb->end -= TRAILER;
+
+	return 0;
+}
+
+
+/* A helper that appends a trailer on send, and removes it on receive */
+static bool helper_send(int *err, struct sa *dst, struct mbuf *mb,
+			void *arg)
+{
+	struct udptest *ut = arg;
+	const size_t pos = mb->pos;
+	(void)dst;
+
+	mb->pos = mb->end;
+	*err = mbuf_write_mem(mb, trailer, TRAILER);
+	mb->pos = pos;
+
+	++ut->n_send;
+
+	return false;
+}
+
+
+static int helper_send_batch(const struct sa **dstv, struct mbuf **mbv,
+			     size_t n, void *arg)
+{
+	struct udptest *ut = arg;
+	size_t i;
+	(void)dstv;
+
+	for (i=0; i<n; i++) {
+
+		struct mbuf *mb = mbv[i];
+
+		if (mb->size - mb->end < TRAILER)
+			return ENOBUFS;
+
+		memcpy(mb->buf + mb->end, trailer, TRAILER);
+		mb->end += TRAILER;
+	}
+
+	ut->n_sendb += (unsigned)n;
+	++ut->n_call_sendb;
+
+	return 0;
+}
+
+
+static bool helper_recv(struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct udptest *ut = arg;
+	(void)src;
+
+	++ut->n_recv;
+
+	if (trailer_strip(mb))
+		ut->err = EBADMSG;
+
+	return false;
+}
+
+
+static void helper_recv_batch(struct sa *srcv, struct mbuf **mbv,
+			      bool *hdldv, size_t n, void *arg)
+{
+	struct udptest *ut = arg;
+	size_t i;
+	(void)srcv;
+
+	for (i=0; i<n; i++) {
+
+		if (hdldv[i])
+			continue;
+
+		if (trailer_strip(mbv[i]))
+			ut->err = EBADMSG;
+	}
+
+	ut->n_recvb += (unsigned)n;
+	++ut->n_call_recvb;
+}
+
+
+/*
+ * Batch helpers: the queued datagrams go to the batch send handler once
+ * per flush, and the datagrams read in one batch to the batch receive
+ * handler. Datagrams that are sent at once use the per-datagram handler.
+ */
+int test_udp_helper_batch(void)
+{
+	struct udptest ut;
+	struct udp_txstat st;
+	struct mbuf *mb = NULL;
+	unsigned i;
+	int err;
+
+	err = udptest_init(&ut, 16, NUM_DGRAM);
+	if (err == ENOSYS) {
+		err = 0;  /* no recvmmsg() */
+		goto out;
+	}
+	TEST_ERR(err);
+
+	err = udp_txbatch_set(ut.tx, 16);
+	if (err == ENOSYS) {
+		err = 0;  /* no sendmmsg() */
+		goto out;
+	}
+	TEST_ERR(err);
+
+	err  = udp_register_helper(&ut.uh_tx, ut.tx, 0, helper_send,
+				   NULL, &ut);
+	err |= udp_register_helper(&ut.uh_rx, ut.rx, 0, NULL,
+				   helper_recv, &ut);
+	TEST_ERR(err);
+
+	err  = udp_helper_batch_set(ut.uh_tx, TRAILER, helper_send_batch,
+				    NULL);
+	err |= udp_helper_batch_set(ut.uh_rx, 0, NULL, helper_recv_batch);
+	TEST_ERR(err);
+
+	ut.video = true;
+
+	for (i=0; i<4; i++) {
+		err = send_frame(&ut, FRAME_PKTS, true);
+		TEST_ERR(err);
+		err = recv_wait(&ut);
+		TEST_ERR(err);
+	}
+
+	TEST_EQUALS(4 * FRAME_PKTS, ut.n_rx);
+	TEST_EQUALS(0, ut.n_send);
+	TEST_EQUALS(4 * FRAME_PKTS, ut.n_sendb);
+	TEST_EQUALS(4 * 2, ut.n_call_sendb);
+	TEST_EQUALS(0, ut.n_recv);
+	TEST_EQUALS(4 * FRAME_PKTS, ut.n_recvb);
+	TEST_ASSERT(ut.n_call_recvb <= ut.n_recvb);
+
+	/* with the trailers, the queue is still merged for offload */
+	err = udp_txbatch_stat(ut.tx, &st);
+	TEST_ERR(err);
+	TEST_EQUALS(4 * FRAME_PKTS, st.n_dgram);
+	TEST_ASSERT(st.n_msg <= st.n_dgram);
+
+	err = send_frame(&ut, BURST, false);
+	TEST_ERR(err);
+	err = recv_wait(&ut);
+	TEST_ERR(err);
+
+	TEST_EQUALS(BURST, ut.n_send);
+
+	/* queued datagrams are dropped when their helper is gone */
+	mb = mbuf_alloc(64);
+	TEST_ASSERT(mb != NULL);
+	err = mbuf_write_mem(mb, trailer, TRAILER);
+	TEST_ERR(err);
+
+	for (i=0; i<3; i++) {
+		mb->pos = 0;
+		err = udp_send_queue(ut.tx, &ut.dst, mb);
+		TEST_ERR(err);
+	}
+
+	ut.uh_tx = mem_deref(ut.uh_tx);
+
+	err = udp_flush(ut.tx);
+	TEST_EQUALS(ENOENT, err);
+	err = 0;
+
+	err = udp_txbatch_stat(ut.tx, &st);
+	TEST_ERR(err);
+	TEST_EQUALS(4 * FRAME_PKTS, st.n_dgram);
+
+ out:
+	mem_deref(mb);
+	udptest_reset(&ut);
+
+	return err;
+}
+
+
+static int perf_tx(bool queue, uint64_t *nsec, struct udp_txstat *st)
+{
+	struct udptest ut;
+	uint64_t t0;
+	unsigned i;
+	int err;
+
+	err = udptest_init(&ut, 0, KEEP_MAX);
+	if (err)
+		goto out;
+
+	if (queue) {
+		err = udp_txbatch_set(ut.tx, 32);
+		if (err)
+			goto out;
+	}
+
+	ut.video = true;
+
+	/* the receiver is not read, datagrams are dropped when it is full */
+	t0 = test_nsec();
+
+	for (i=0; i<PERF_ROUNDS; i++) {
+		err = send_frame(&ut, FRAME_PKTS, queue);
+		if (err)
+			goto out;
+	}
+
+	*nsec = (test_nsec() - t0) / (PERF_ROUNDS * FRAME_PKTS);
+
+	if (queue)
+		err = udp_txbatch_stat(ut.tx, st);
+
+ out:
+	udptest_reset(&ut);
+
+	return err;
+}
+
+
+int test_perf_udp_tx(void)
+{
+	struct udp_txstat st;
+	uint64_t t_single = 0, t_batch = 0;
+	int err;
+
+	err  = perf_tx(false, &t_single, NULL);
+	err |= perf_tx(true, &t_batch, &st);
+	if (err)
+		return err;
+
+	(void)re_printf("udp: video frames of %u datagrams\n", FRAME_PKTS);
+	(void)re_printf("  sendto:    %6llu ns/datagram, %u syscalls/frame\n",
+			t_single, FRAME_PKTS);
+	(void)re_printf("  sendmmsg:  %6llu ns/datagram, %u.%02u syscalls/frame,"
+			" %u.%02u messages/frame\n",
+			t_batch,
+			st.n_syscall / PERF_ROUNDS,
+			st.n_syscall * 100 / PERF_ROUNDS % 100,
+			st.n_msg / PERF_ROUNDS,
+			st.n_msg * 100 / PERF_ROUNDS % 100);
+
+	return 0;
+}
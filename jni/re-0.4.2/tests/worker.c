@@ -0,0 +1,80 @@
+/**
+ * @file tests/worker.c  Worker threads -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re.h>
+#include "test.h"
+
+
+#ifdef HAVE_PTHREAD
+struct wtest {
+	pthread_t tid;
+	unsigned n;
+};
+
+
+static void count_handler(int id, void *data)
+{
+	struct wtest *wt = data;
+
+	wt->tid = pthread_self();
+	wt->n += id;
+}
+
+
+static void exit_handler(int id, void *data)
+{
+	(void)id;
+	(void)data;
+
+	re_cancel();
+}
+#endif
+
+
+/*
+ * Calls run in the worker thread, and a sync call returns an error
+ * instead of waiting for a worker whose main loop has stopped
+ */
+int test_worker(void)
+{
+#ifdef HAVE_PTHREAD
+	struct re_worker *w = NULL;
+	struct wtest wt;
+	int err;
+
+	memset(&wt, 0, sizeof(wt));
+
+	err = re_worker_alloc(&w);
+	TEST_ERR(err);
+
+	err  = re_worker_call(w, count_handler, 1, &wt);
+	err |= re_worker_sync(w, count_handler, 2, &wt);
+	TEST_ERR(err);
+
+	TEST_EQUALS(3, wt.n);
+	TEST_ASSERT(!pthread_equal(wt.tid, pthread_self()));
+
+	/* the worker loop stops, the worker object is still referenced */
+	err = re_worker_call(w, exit_handler, 0, NULL);
+	TEST_ERR(err);
+
+	TEST_EQUALS(ESHUTDOWN, re_worker_sync(w, count_handler, 4, &wt));
+	TEST_EQUALS(ESHUTDOWN, re_worker_call(w, count_handler, 4, &wt));
+	TEST_EQUALS(3, wt.n);
+
+	err = 0;
+
+ out:
+	mem_deref(w);
+
+	return err;
+#else
+	return 0;
+#endif
+}
@@ -5,22 +5,34 @@
  */
 
 
-/** Maximum number of inputs that can be handled in one function call */
-#define FIR_MAX_INPUT_LEN   160
-
 /** Maximum length of filter than can be handled */
-#define FIR_MAX_FLT_LEN     63
+#define FIR_MAX_FLT_LEN     256
 
-/** Buffer to hold all of the input samples */
-#define FIR_BUFFER_LEN      (FIR_MAX_FLT_LEN - 1 + FIR_MAX_INPUT_LEN)
+/** Length of the history ring, power of two and >= FIR_MAX_FLT_LEN */
+#define FIR_RING_LEN        256
 
 /** Maximum number of audio channels */
-#define FIR_MAX_CHANNELS    2
+#define FIR_MAX_CHANNELS    8
+
 
+/**
+ * Defines the FIR dot product kernel
+ *
+ * @param coeffs Filter coefficients
+ * @param samp   Samples, newest first
+ * @param n      Number of coefficients
+ *
+ * @return Sum of products
+ */
+typedef int32_t (fir_dot_h)(const int16_t *coeffs, const int16_t *samp,
+			    int n);
 
 /** FIR filter state */
 struct fir {
-	int16_t insamp[FIR_MAX_CHANNELS][FIR_BUFFER_LEN];  /**< Samples */
+	/** Mirrored history ring, newest sample at pos and pos+RING_LEN */
+	int16_t hist[FIR_MAX_CHANNELS][2 * FIR_RING_LEN];
+	unsigned pos;     /**< Ring position of the newest sample */
+	fir_dot_h *dot;   /**< Dot product kernel for this CPU    */
 };
 
 
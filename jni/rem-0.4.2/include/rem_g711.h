@@ -9,6 +9,8 @@ extern const uint8_t g711_l2u[4096];
 extern const uint8_t g711_l2A[2048];
 extern const int16_t g711_u2l[256];
 extern const int16_t g711_A2l[256];
+extern const uint8_t g711_A2u[256];
+extern const uint8_t g711_u2A[256];
 
 
 /**
@@ -18,8 +20,9 @@ extern const int16_t g711_A2l[256];
  *
  * @return U-law byte
  */
-static inline uint8_t g711_pcm2ulaw(int16_t l)
+static inline uint8_t g711_pcm2ulaw(int16_t s)
 {
+	int32_t l = s;
 	const uint8_t mask = (l < 0) ? 0x7f : 0xff;
 	if (l < 0)
 		l = -l;
@@ -39,11 +42,14 @@ static inline uint8_t g711_pcm2ulaw(int16_t l)
  *
  * @return A-law byte
  */
-static inline uint8_t g711_pcm2alaw(int16_t l)
+static inline uint8_t g711_pcm2alaw(int16_t s)
 {
+	int32_t l = s;
 	const uint8_t mask = (l < 0) ? 0x7f : 0xff;
 	if (l < 0)
 		l = -l;
+	if (l > 0x7fff)
+		l = 0x7fff;
 	l >>= 4;
 
 	return g711_l2A[l] & mask;
@@ -74,3 +80,11 @@ static inline int16_t g711_alaw2pcm(uint8_t a)
 {
 	return g711_A2l[a];
 }
+
+
+void g711_pcm2ulaw_block(uint8_t *dst, const int16_t *src, size_t n);
+void g711_pcm2alaw_block(uint8_t *dst, const int16_t *src, size_t n);
+void g711_ulaw2pcm_block(int16_t *dst, const uint8_t *src, size_t n);
+void g711_alaw2pcm_block(int16_t *dst, const uint8_t *src, size_t n);
+void g711_alaw2ulaw_block(uint8_t *dst, const uint8_t *src, size_t n);
+void g711_ulaw2alaw_block(uint8_t *dst, const uint8_t *src, size_t n);
@@ -0,0 +1,27 @@
+/**
+ * @file rem_h264.h  H.264 byte stream (Annex B) and RTP payload format
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+enum {
+	H264_RTP_TAILROOM = 32,  /**< Bytes a send handler may append */
+};
+
+/**
+ * Defines the handler which sends an RTP packet of H.264
+ *
+ * @param marker Marker bit, set on the last packet of a frame
+ * @param mb     RTP payload, with headroom before the current position
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+typedef int (h264_rtp_send_h)(bool marker, struct mbuf *mb, void *arg);
+
+const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end);
+bool h264_rtp_is_start(const struct mbuf *mb);
+int  h264_rtp_packetize(struct mbuf *mb, size_t pktsize, size_t presz,
+			struct mbuf *mb_frag, h264_rtp_send_h *sendh,
+			void *arg);
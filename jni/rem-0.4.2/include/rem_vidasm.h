@@ -0,0 +1,21 @@
+/**
+ * @file rem_vidasm.h  Video frame assembler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+struct vidasm;
+
+typedef bool (vidasm_start_h)(const struct rtp_header *hdr,
+			      const struct mbuf *mb, void *arg);
+typedef void (vidasm_pkt_h)(const struct rtp_header *hdr, struct mbuf *mb,
+			    void *arg);
+typedef void (vidasm_loss_h)(void *arg);
+
+int  vidasm_alloc(struct vidasm **vap, uint32_t max_frames,
+		  vidasm_start_h *starth, vidasm_pkt_h *pkth,
+		  vidasm_loss_h *lossh, void *arg);
+int  vidasm_put(struct vidasm *va, const struct rtp_header *hdr,
+		struct mbuf *mb);
+void vidasm_flush(struct vidasm *va);
+int  vidasm_debug(struct re_printf *pf, const struct vidasm *va);
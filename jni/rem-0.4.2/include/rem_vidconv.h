@@ -9,3 +9,28 @@ void vidconv(struct vidframe *dst, const struct vidframe *src,
 	     struct vidrect *r);
 void vidconv_aspect(struct vidframe *dst, const struct vidframe *src,
 		    struct vidrect *r);
+
+
+struct vidconv_pool;
+
+int  vidconv_pool_alloc(struct vidconv_pool **poolp, unsigned nthreads);
+void vidconv_pool(struct vidconv_pool *pool, struct vidframe *dst,
+		  const struct vidframe *src, struct vidrect *r);
+
+
+/** Scaling modes */
+enum vidconv_scale {
+	VIDCONV_NEAREST = 0,  /**< Nearest neighbour               */
+	VIDCONV_BILINEAR,     /**< Bilinear interpolation          */
+	VIDCONV_AREA,         /**< Area averaging when downscaling */
+};
+
+struct vidconv_ctx;
+
+int  vidconv_ctx_alloc(struct vidconv_ctx **ctxp, enum vidconv_scale scale);
+void vidconv_ctx_set_pool(struct vidconv_ctx *ctx,
+			  struct vidconv_pool *pool);
+int  vidconv_ctx(struct vidconv_ctx *ctx, struct vidframe *dst,
+		 const struct vidframe *src, struct vidrect *r);
+int  vidconv_scale(struct vidframe *dst, const struct vidframe *src,
+		   struct vidrect *r, enum vidconv_scale scale);
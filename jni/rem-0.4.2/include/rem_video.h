@@ -8,3 +8,5 @@
 #include <rem_vid.h>
 #include <rem_vidmix.h>
 #include <rem_vidconv.h>
+#include <rem_h264.h>
+#include <rem_vidasm.h>
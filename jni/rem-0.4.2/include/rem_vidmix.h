@@ -32,3 +32,5 @@ void vidmix_source_toggle_selfview(struct vidmix_source *src);
 void vidmix_source_set_focus(struct vidmix_source *src, unsigned pidx);
 void vidmix_source_put(struct vidmix_source *src,
 		       const struct vidframe *frame);
+int  vidmix_source_debug(struct re_printf *pf,
+			 const struct vidmix_source *src);
@@ -10,23 +10,43 @@
 
 #define AUBUF_DEBUG 0
 
+/** Cache-line size, used to keep the ring indices apart */
+#define AUBUF_CACHELINE 64
+
+
+/**
+ * Fixed-capacity single-producer/single-consumer ring. The write position
+ * is only updated by the producer and the read position only by the
+ * consumer, so no locking or allocation is needed on either side.
+ */
+struct aubuf_ring {
+	uint8_t pad0[AUBUF_CACHELINE];
+	size_t wpos;                           /**< Producer position      */
+	uint8_t pad1[AUBUF_CACHELINE - sizeof(size_t)];
+	size_t rpos;                           /**< Consumer position      */
+	uint8_t pad2[AUBUF_CACHELINE - sizeof(size_t)];
+	unsigned flush_req;                    /**< Flush requests         */
+	unsigned flush_ack;                    /**< Flushes done by reader */
+	size_t mask;                           /**< Ring size minus one    */
+	uint8_t *buf;                          /**< Ring memory            */
+};
+
 
 /** Locked audio-buffer with almost zero-copy */
 struct aubuf {
 	struct list afl;
 	struct lock *lock;
+	struct aubuf_ring *ring;
 	size_t wish_sz;
 	size_t cur_sz;
 	size_t max_sz;
 	bool filling;
 	uint64_t ts;
 
-#if AUBUF_DEBUG
 	struct {
-		size_t or;
-		size_t ur;
+		size_t or;          /**< Overruns, data was dropped     */
+		size_t ur;          /**< Underruns, silence was played */
 	} stats;
-#endif
 };
 
 
@@ -51,6 +71,142 @@ static void aubuf_destructor(void *arg)
 
 	list_flush(&ab->afl);
 	mem_deref(ab->lock);
+	mem_deref(ab->ring);
+}
+
+
+static void ring_destructor(void *arg)
+{
+	struct aubuf_ring *ring = arg;
+
+	mem_deref(ring->buf);
+}
+
+
+static inline size_t ring_load(const size_t *pos)
+{
+	return __atomic_load_n(pos, __ATOMIC_ACQUIRE);
+}
+
+
+static inline void ring_store(size_t *pos, size_t val)
+{
+	__atomic_store_n(pos, val, __ATOMIC_RELEASE);
+}
+
+
+static void ring_copy_in(struct aubuf_ring *ring, size_t pos,
+			 const uint8_t *p, size_t sz)
+{
+	const size_t ofs = pos & ring->mask;
+	const size_t n = min(sz, ring->mask + 1 - ofs);
+
+	memcpy(ring->buf + ofs, p, n);
+	memcpy(ring->buf, p + n, sz - n);
+}
+
+
+static void ring_copy_out(const struct aubuf_ring *ring, size_t pos,
+			  uint8_t *p, size_t sz)
+{
+	const size_t ofs = pos & ring->mask;
+	const size_t n = min(sz, ring->mask + 1 - ofs);
+
+	memcpy(p, ring->buf + ofs, n);
+	memcpy(p + n, ring->buf, sz - n);
+}
+
+
+/* Producer side. If the ring is full the new data is dropped. */
+static int ring_write(struct aubuf *ab, const uint8_t *p, size_t sz)
+{
+	struct aubuf_ring *ring = ab->ring;
+	size_t wpos, rpos;
+
+	wpos = ring->wpos;
+	rpos = ring_load(&ring->rpos);
+
+	if (sz > ring->mask + 1 - (wpos - rpos)) {
+		__atomic_add_fetch(&ab->stats.or, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	ring_copy_in(ring, wpos, p, sz);
+	ring_store(&ring->wpos, wpos + sz);
+
+	return 0;
+}
+
+
+/* Consumer side. Drops the oldest data above max_sz, like aubuf_append() */
+static void ring_read(struct aubuf *ab, uint8_t *p, size_t sz)
+{
+	struct aubuf_ring *ring = ab->ring;
+	unsigned flush_req;
+	size_t wpos, rpos, cur;
+
+	rpos = ring->rpos;
+	wpos = ring_load(&ring->wpos);
+
+	flush_req = __atomic_load_n(&ring->flush_req, __ATOMIC_ACQUIRE);
+	if (flush_req != ring->flush_ack) {
+		__atomic_store_n(&ring->flush_ack, flush_req,
+				 __ATOMIC_RELEASE);
+		rpos = wpos;
+		ab->filling = true;
+		ab->ts = 0;
+	}
+
+	cur = wpos - rpos;
+
+	if (ab->max_sz && cur > ab->max_sz) {
+
+		/* drop in units of the read size to keep sample alignment */
+		size_t drop = (cur - ab->max_sz + sz - 1) / sz * sz;
+
+		__atomic_add_fetch(&ab->stats.or, 1, __ATOMIC_RELAXED);
+#if AUBUF_DEBUG
+		(void)re_printf("aubuf: %p overrun (cur=%zu)\n", ab, cur);
+#endif
+		drop  = min(drop, cur);
+		rpos += drop;
+		cur  -= drop;
+	}
+
+	if (cur < (ab->filling ? ab->wish_sz : sz)) {
+		if (!ab->filling) {
+			++ab->stats.ur;
+#if AUBUF_DEBUG
+			(void)re_printf("aubuf: %p underrun (cur=%zu)\n",
+					ab, cur);
+#endif
+		}
+		ab->filling = true;
+		memset(p, 0, sz);
+	}
+	else {
+		ab->filling = false;
+
+		ring_copy_out(ring, rpos, p, sz);
+		rpos += sz;
+	}
+
+	ring_store(&ring->rpos, rpos);
+}
+
+
+/* A flush which the reader has not done yet counts as done */
+static size_t ring_cur_size(const struct aubuf_ring *ring)
+{
+	size_t rpos;
+
+	if (__atomic_load_n(&ring->flush_req, __ATOMIC_ACQUIRE) !=
+	    __atomic_load_n(&ring->flush_ack, __ATOMIC_ACQUIRE))
+		return 0;
+
+	rpos = ring_load(&ring->rpos);
+
+	return ring_load(&ring->wpos) - rpos;
 }
 
 
@@ -93,6 +249,58 @@ int aubuf_alloc(struct aubuf **abp, size_t min_sz, size_t max_sz)
 }
 
 
+/**
+ * Allocate a new audio buffer backed by a lock-free ring. The ring
+ * supports exactly one writing thread and one reading thread, and does
+ * no locking or memory allocation when writing or reading.
+ *
+ * @param abp    Pointer to allocated audio buffer
+ * @param min_sz Minimum buffer size
+ * @param max_sz Maximum buffer size
+ *
+ * @return 0 for success, otherwise error code
+ */
+int aubuf_alloc_ring(struct aubuf **abp, size_t min_sz, size_t max_sz)
+{
+	struct aubuf *ab;
+	size_t size = 1;
+	int err;
+
+	if (!abp || !min_sz || max_sz < min_sz)
+		return EINVAL;
+
+	/* leave headroom so the reader can trim overruns */
+	while (size < 2 * max_sz)
+		size <<= 1;
+
+	err = aubuf_alloc(&ab, min_sz, max_sz);
+	if (err)
+		return err;
+
+	ab->ring = mem_zalloc(sizeof(*ab->ring), ring_destructor);
+	if (!ab->ring) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	ab->ring->buf = mem_alloc(size, NULL);
+	if (!ab->ring->buf) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	ab->ring->mask = size - 1;
+
+ out:
+	if (err)
+		mem_deref(ab);
+	else
+		*abp = ab;
+
+	return err;
+}
+
+
 /**
  * Append a PCM-buffer to the end of the audio buffer
  *
@@ -108,6 +316,9 @@ int aubuf_append(struct aubuf *ab, struct mbuf *mb)
 	if (!ab || !mb)
 		return EINVAL;
 
+	if (ab->ring)
+		return ring_write(ab, mbuf_buf(mb), mbuf_get_left(mb));
+
 	af = mem_zalloc(sizeof(*af), auframe_destructor);
 	if (!af)
 		return ENOMEM;
@@ -120,8 +331,8 @@ int aubuf_append(struct aubuf *ab, struct mbuf *mb)
 	ab->cur_sz += mbuf_get_left(mb);
 
 	if (ab->max_sz && ab->cur_sz > ab->max_sz) {
-#if AUBUF_DEBUG
 		++ab->stats.or;
+#if AUBUF_DEBUG
 		(void)re_printf("aubuf: %p overrun (cur=%zu)\n",
 				ab, ab->cur_sz);
 #endif
@@ -149,9 +360,16 @@ int aubuf_append(struct aubuf *ab, struct mbuf *mb)
  */
 int aubuf_write(struct aubuf *ab, const uint8_t *p, size_t sz)
 {
-	struct mbuf *mb = mbuf_alloc(sz);
+	struct mbuf *mb;
 	int err;
 
+	if (!ab || !p)
+		return EINVAL;
+
+	if (ab->ring)
+		return ring_write(ab, p, sz);
+
+	mb = mbuf_alloc(sz);
 	if (!mb)
 		return ENOMEM;
 
@@ -181,16 +399,21 @@ void aubuf_read(struct aubuf *ab, uint8_t *p, size_t sz)
 	if (!ab || !p || !sz)
 		return;
 
+	if (ab->ring) {
+		ring_read(ab, p, sz);
+		return;
+	}
+
 	lock_write_get(ab->lock);
 
 	if (ab->cur_sz < (ab->filling ? ab->wish_sz : sz)) {
-#if AUBUF_DEBUG
 		if (!ab->filling) {
 			++ab->stats.ur;
+#if AUBUF_DEBUG
 			(void)re_printf("aubuf: %p underrun (cur=%zu)\n",
 					ab, ab->cur_sz);
-		}
 #endif
+		}
 		ab->filling = true;
 		memset(p, 0, sz);
 		goto out;
@@ -248,7 +471,9 @@ int aubuf_get(struct aubuf *ab, uint32_t ptime, uint8_t *p, size_t sz)
 	if (!ab || !ptime)
 		return EINVAL;
 
-	lock_write_get(ab->lock);
+	/* in ring mode the timestamp is only used by the reader */
+	if (!ab->ring)
+		lock_write_get(ab->lock);
 
 	now = tmr_jiffies();
 	if (!ab->ts)
@@ -262,7 +487,8 @@ int aubuf_get(struct aubuf *ab, uint32_t ptime, uint8_t *p, size_t sz)
 	ab->ts += ptime;
 
  out:
-	lock_rel(ab->lock);
+	if (!ab->ring)
+		lock_rel(ab->lock);
 
 	if (!err)
 		aubuf_read(ab, p, sz);
@@ -281,6 +507,12 @@ void aubuf_flush(struct aubuf *ab)
 	if (!ab)
 		return;
 
+	/* the ring is emptied by the reader on its next read */
+	if (ab->ring) {
+		__atomic_add_fetch(&ab->ring->flush_req, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
 	lock_write_get(ab->lock);
 
 	list_flush(&ab->afl);
@@ -307,14 +539,21 @@ int aubuf_debug(struct re_printf *pf, const struct aubuf *ab)
 	if (!ab)
 		return 0;
 
+	if (ab->ring) {
+		err = re_hprintf(pf, "wish_sz=%zu cur_sz=%zu filling=%d"
+				 " ring=%zu",
+				 ab->wish_sz, ring_cur_size(ab->ring),
+				 ab->filling, ab->ring->mask + 1);
+		err |= re_hprintf(pf, " [overrun=%zu underrun=%zu]",
+				  ab->stats.or, ab->stats.ur);
+		return err;
+	}
+
 	lock_read_get(ab->lock);
 	err = re_hprintf(pf, "wish_sz=%zu cur_sz=%zu filling=%d",
 			 ab->wish_sz, ab->cur_sz, ab->filling);
-
-#if AUBUF_DEBUG
 	err |= re_hprintf(pf, " [overrun=%zu underrun=%zu]",
 			  ab->stats.or, ab->stats.ur);
-#endif
 
 	lock_rel(ab->lock);
 
@@ -328,6 +567,9 @@ int aubuf_debug(struct re_printf *pf, const struct aubuf *ab)
  * @param ab Audio buffer
  *
  * @return Number of bytes in the audio buffer
+ *
+ * @note After aubuf_flush() this is 0, also while a ring is still waiting
+ *       for the reader to empty it
  */
 size_t aubuf_cur_size(const struct aubuf *ab)
 {
@@ -336,6 +578,9 @@ size_t aubuf_cur_size(const struct aubuf *ab)
 	if (!ab)
 		return 0;
 
+	if (ab->ring)
+		return ring_cur_size(ab->ring);
+
 	lock_read_get(ab->lock);
 	sz = ab->cur_sz;
 	lock_rel(ab->lock);
@@ -13,6 +13,7 @@
 #include <rem_aubuf.h>
 #include <rem_aufile.h>
 #include <rem_aumix.h>
+#include "aumix.h"
 
 
 /** Defines an Audio mixer */
@@ -87,13 +88,15 @@ static void *aumix_thread(void *arg)
 	uint8_t *silence, *frame, *base_frame;
 	struct aumix *mix = arg;
 	int16_t *mix_frame;
+	int32_t *acc;
 	uint64_t ts = 0;
 
 	silence   = mem_zalloc(mix->frame_size*2, NULL);
 	frame     = mem_alloc(mix->frame_size*2, NULL);
 	mix_frame = mem_alloc(mix->frame_size*2, NULL);
+	acc       = mem_alloc(mix->frame_size*4, NULL);
 
-	if (!silence || !frame || !mix_frame)
+	if (!silence || !frame || !mix_frame || !acc)
 		goto out;
 
 	pthread_mutex_lock(&mix->mutex);
@@ -141,33 +144,25 @@ static void *aumix_thread(void *arg)
 			base_frame = silence;
 		}
 
+		aumix_acc_init(acc, (int16_t *)base_frame, mix->frame_size);
+
 		for (le=mix->srcl.head; le; le=le->next) {
 
 			struct aumix_source *src = le->data;
 
 			aubuf_read(src->aubuf, (uint8_t *)src->frame,
 				   mix->frame_size*2);
+
+			aumix_acc_add(acc, src->frame, mix->frame_size);
 		}
 
 		for (le=mix->srcl.head; le; le=le->next) {
 
 			struct aumix_source *src = le->data;
-			struct le *cle;
-
-			memcpy(mix_frame, base_frame, mix->frame_size*2);
 
-			for (cle=mix->srcl.head; cle; cle=cle->next) {
-
-				struct aumix_source *csrc = cle->data;
-				size_t i;
-#if 1
-				/* skip self */
-				if (csrc == src)
-					continue;
-#endif
-				for (i=0; i<mix->frame_size; i++)
-					mix_frame[i] += csrc->frame[i];
-			}
+			/* N-1 mix: everything except self */
+			aumix_acc_sub(mix_frame, acc, src->frame,
+				      mix->frame_size);
 
 			src->fh(mix_frame, mix->frame_size, src->arg);
 		}
@@ -178,6 +173,7 @@ static void *aumix_thread(void *arg)
 	pthread_mutex_unlock(&mix->mutex);
 
  out:
+	mem_deref(acc);
 	mem_deref(mix_frame);
 	mem_deref(silence);
 	mem_deref(frame);
@@ -328,7 +324,7 @@ int aumix_source_alloc(struct aumix_source **srcp, struct aumix *mix,
 		goto out;
 	}
 
-	err = aubuf_alloc(&src->aubuf, sz * 6, sz * 12);
+	err = aubuf_alloc_ring(&src->aubuf, sz * 6, sz * 12);
 	if (err)
 		goto out;
 
@@ -0,0 +1,19 @@
+/**
+ * @file aumix.h  Audio Mixer -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/*
+ * Mixing kernels
+ *
+ * The mixer sums all sources once into a 32-bit accumulator, and then
+ * derives the output for each source by subtracting its own contribution
+ * with saturation (N-1 mixing).
+ */
+
+void aumix_acc_init(int32_t *acc, const int16_t *sampv, size_t sampc);
+void aumix_acc_add(int32_t *acc, const int16_t *sampv, size_t sampc);
+void aumix_acc_sub(int16_t *outv, const int32_t *acc, const int16_t *sampv,
+		   size_t sampc);
@@ -0,0 +1,139 @@
+/**
+ * @file mix.c  Audio Mixer -- mixing kernels
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <re.h>
+#include <rem_dsp.h>
+#include "aumix.h"
+
+#if defined (HAVE_NEON)
+#include <arm_neon.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Initialize the mix accumulator with a base frame
+ *
+ * @param acc   32-bit mix accumulator
+ * @param sampv Base PCM samples (e.g. announcement or silence)
+ * @param sampc Number of samples
+ */
+void aumix_acc_init(int32_t *acc, const int16_t *sampv, size_t sampc)
+{
+	size_t i = 0;
+
+#if defined (HAVE_NEON)
+	for (; i + 8 <= sampc; i += 8) {
+
+		int16x8_t v = vld1q_s16(&sampv[i]);
+
+		vst1q_s32(&acc[i],   vmovl_s16(vget_low_s16(v)));
+		vst1q_s32(&acc[i+4], vmovl_s16(vget_high_s16(v)));
+	}
+#elif defined (__SSE2__)
+	for (; i + 8 <= sampc; i += 8) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)&sampv[i]);
+
+		_mm_storeu_si128((__m128i *)&acc[i],
+				 _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+		_mm_storeu_si128((__m128i *)&acc[i+4],
+				 _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+	}
+#endif
+
+	for (; i < sampc; i++)
+		acc[i] = sampv[i];
+}
+
+
+/**
+ * Add the PCM samples of one source to the mix accumulator
+ *
+ * @param acc   32-bit mix accumulator
+ * @param sampv PCM samples
+ * @param sampc Number of samples
+ */
+void aumix_acc_add(int32_t *acc, const int16_t *sampv, size_t sampc)
+{
+	size_t i = 0;
+
+#if defined (HAVE_NEON)
+	for (; i + 8 <= sampc; i += 8) {
+
+		int16x8_t v = vld1q_s16(&sampv[i]);
+
+		vst1q_s32(&acc[i],   vaddw_s16(vld1q_s32(&acc[i]),
+					       vget_low_s16(v)));
+		vst1q_s32(&acc[i+4], vaddw_s16(vld1q_s32(&acc[i+4]),
+					       vget_high_s16(v)));
+	}
+#elif defined (__SSE2__)
+	for (; i + 8 <= sampc; i += 8) {
+
+		__m128i v  = _mm_loadu_si128((const __m128i *)&sampv[i]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		__m128i *ap = (__m128i *)&acc[i];
+
+		_mm_storeu_si128(ap,   _mm_add_epi32(_mm_loadu_si128(ap),
+						     lo));
+		_mm_storeu_si128(ap+1, _mm_add_epi32(_mm_loadu_si128(ap+1),
+						     hi));
+	}
+#endif
+
+	for (; i < sampc; i++)
+		acc[i] += sampv[i];
+}
+
+
+/**
+ * Get the mix for one source by subtracting its own contribution from
+ * the mix accumulator. The result is saturated to 16-bit.
+ *
+ * @param outv  Output PCM samples
+ * @param acc   32-bit mix accumulator
+ * @param sampv PCM samples of the source to exclude
+ * @param sampc Number of samples
+ */
+void aumix_acc_sub(int16_t *outv, const int32_t *acc, const int16_t *sampv,
+		   size_t sampc)
+{
+	size_t i = 0;
+
+#if defined (HAVE_NEON)
+	for (; i + 8 <= sampc; i += 8) {
+
+		int16x8_t v = vld1q_s16(&sampv[i]);
+		int32x4_t lo, hi;
+
+		lo = vsubw_s16(vld1q_s32(&acc[i]),   vget_low_s16(v));
+		hi = vsubw_s16(vld1q_s32(&acc[i+4]), vget_high_s16(v));
+
+		vst1q_s16(&outv[i], vcombine_s16(vqmovn_s32(lo),
+						 vqmovn_s32(hi)));
+	}
+#elif defined (__SSE2__)
+	for (; i + 8 <= sampc; i += 8) {
+
+		__m128i v  = _mm_loadu_si128((const __m128i *)&sampv[i]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		const __m128i *ap = (const __m128i *)&acc[i];
+
+		lo = _mm_sub_epi32(_mm_loadu_si128(ap),   lo);
+		hi = _mm_sub_epi32(_mm_loadu_si128(ap+1), hi);
+
+		_mm_storeu_si128((__m128i *)&outv[i],
+				 _mm_packs_epi32(lo, hi));
+	}
+#endif
+
+	for (; i < sampc; i++)
+		outv[i] = saturate_s16(acc[i] - sampv[i]);
+}
@@ -5,3 +5,4 @@
 #
 
 SRCS	+= aumix/aumix.c
+SRCS	+= aumix/mix.c
@@ -6,116 +6,245 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <re.h>
-#include <rem_fir.h>
+#include <rem_dsp.h>
 #include <rem_auresamp.h>
 
+#if defined (HAVE_NEON)
+#include <arm_neon.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
 
-typedef void (resample_h)(struct auresamp *ar, int16_t *dst,
-			  const int16_t *src, size_t nsamp_dst);
+
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+/*
+ * Polyphase resampler
+ *
+ * The sample rate ratio is reduced to up/down (L/M). A windowed-sinc
+ * lowpass prototype filter is designed for the virtual rate L * srate_in
+ * and split into L phases, which are stored time-reversed as Q14 integer
+ * coefficients. Each output sample is then a single dot product between
+ * one phase and the most recent input samples. The filter history is kept
+ * between calls, so blocks can have any length.
+ *
+ * When decimating, the taps per phase grow with the ratio M/L, so that
+ * the transition band stays the same and the cost per input sample is
+ * constant. There is no limit on the taps, only on the size of the bank.
+ */
+
+
+enum {
+	RESAMP_TAPS       = 24,    /**< Taps per phase when upsampling     */
+	RESAMP_BANK_MAX   = 1<<20, /**< Maximum coefficients in the bank   */
+	RESAMP_PHASES_MAX = 1024,  /**< Maximum number of phases (L)       */
+	RESAMP_ALIGN      = 8,     /**< Taps are padded to this multiple   */
+	RESAMP_SHIFT      = 14,    /**< Coefficients are in Q14            */
+};
+
+#define RESAMP_ROLLOFF 0.92   /**< Passband edge relative to Nyquist */
+#define RESAMP_BETA    8.0    /**< Kaiser window shape, ~80 dB       */
 
 
 /** Defines an Audio resampler */
 struct auresamp {
-	struct fir fir;
-	const int16_t *coeffv;
-	int16_t *sampv;
-	size_t sampc;
-	int coeffn;
-	double ratio;
+	int16_t *coeffv;     /**< Filter bank, up * taps coefficients  */
+	int16_t *bufv[2];    /**< Input history and block per channel  */
+	size_t bufsz;        /**< Size of each input buffer in samples */
+	uint32_t up;         /**< Interpolation factor (L)             */
+	uint32_t down;       /**< Decimation factor (M)                */
+	uint32_t taps;       /**< Number of taps per phase             */
+	uint32_t phase;      /**< Phase of next output sample          */
+	size_t pos;          /**< Input position of next output sample */
 	uint8_t ch_in;
 	uint8_t ch_out;
-	resample_h *resample;
+	uint8_t nch;         /**< Number of filtered channels          */
 };
 
 
-/*
- * FIR filter with cutoff 8000Hz, samplerate 16000Hz
- */
-static const int16_t fir_lowpass[31] = {
-   -55,      0,     96,      0,   -220,      0,    461,      0,
-  -877,      0,   1608,      0,  -3176,      0,  10342,  16410,
- 10342,      0,  -3176,      0,   1608,      0,   -877,      0,
-   461,      0,   -220,      0,     96,      0,    -55,
-};
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
 
+	return a;
+}
 
-static inline void resample(struct auresamp *ar, int16_t *dst,
-			    const int16_t *src, size_t nsamp_dst)
+
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
 {
-	double p = 0;
+	double sum = 1.0, term = 1.0;
+	int k;
 
-	while (nsamp_dst--) {
+	for (k=1; k<32; k++) {
 
-		*dst++ = src[(int)p];
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum  += term;
 
-		p += 1/ar->ratio;
+		if (term < sum * 1e-12)
+			break;
 	}
+
+	return sum;
 }
 
 
-static inline void resample_mono2stereo(struct auresamp *ar, int16_t *dst,
-					const int16_t *src, size_t nsamp_dst)
+static int bank_alloc(struct auresamp *ar)
 {
-	double p = 0;
+	const uint32_t L = ar->up, T = ar->taps;
+	const size_t n = (size_t)L * T;
+	const double fc = RESAMP_ROLLOFF * 0.5 / max(L, ar->down);
+	const double c = (n - 1) / 2.0;
+	const double i0b = bessel_i0(RESAMP_BETA);
+	double *h;
+	size_t i;
+	uint32_t p, j;
+
+	h = mem_alloc(n * sizeof(*h), NULL);
+	if (!h)
+		return ENOMEM;
+
+	ar->coeffv = mem_alloc(n * sizeof(*ar->coeffv), NULL);
+	if (!ar->coeffv) {
+		mem_deref(h);
+		return ENOMEM;
+	}
 
-	while (nsamp_dst--) {
+	for (i=0; i<n; i++) {
 
-		const int i = (int)p;
+		const double t = i - c;
+		const double r = (n > 1) ? (2.0 * t / (n - 1)) : 0.0;
+		double s;
 
-		*dst++ = src[i];  /* Left channel */
-		*dst++ = src[i];  /* Right channel */
+		if (t == 0.0)
+			s = 2.0 * fc;
+		else
+			s = sin(2.0 * M_PI * fc * t) / (M_PI * t);
 
-		p += 1/ar->ratio;
+		h[i] = s * bessel_i0(RESAMP_BETA * sqrt(1.0 - r*r)) / i0b;
 	}
-}
 
+	/* split into phases, each normalized to unity gain at DC */
+	for (p=0; p<L; p++) {
 
-static inline void resample_stereo2mono(struct auresamp *ar, int16_t *dst,
-					const int16_t *src, size_t nsamp_dst)
-{
-	double p = 0;
+		int16_t *coeffv = &ar->coeffv[p * T];
+		double sum = 0;
 
-	while (nsamp_dst--) {
+		for (j=0; j<T; j++)
+			sum += h[p + j*L];
 
-		const int i = ((int)p) & ~1;
+		for (j=0; j<T; j++) {
 
-		*dst++ = (src[i] + src[i+1]) / 2;
+			const double v = h[p + (T-1-j)*L] / sum;
 
-		p += 1/ar->ratio * 2;
+			coeffv[j] = saturate_s16((int32_t)
+						 lrint(v * (1 << RESAMP_SHIFT)));
+		}
 	}
+
+	mem_deref(h);
+
+	return 0;
 }
 
 
-static inline void resample_stereo(struct auresamp *ar, int16_t *dst,
-				   const int16_t *src, size_t nsamp_dst)
+static inline int32_t dotprod(const int16_t *a, const int16_t *b, uint32_t n)
 {
-	double p = 0;
+	int32_t acc = 0;
+	uint32_t i = 0;
+
+#if defined (HAVE_NEON)
+	int32x4_t va = vdupq_n_s32(0);
+	int32x2_t v2;
+
+	for (; i + 8 <= n; i += 8) {
+
+		int16x8_t x = vld1q_s16(&a[i]);
+		int16x8_t y = vld1q_s16(&b[i]);
+
+		va = vmlal_s16(va, vget_low_s16(x),  vget_low_s16(y));
+		va = vmlal_s16(va, vget_high_s16(x), vget_high_s16(y));
+	}
 
-	while (nsamp_dst--) {
+	v2  = vadd_s32(vget_low_s32(va), vget_high_s32(va));
+	acc = vget_lane_s32(vpadd_s32(v2, v2), 0);
+#elif defined (__SSE2__)
+	__m128i va = _mm_setzero_si128();
 
-		const int i = ((int)p) & ~1;
+	for (; i + 8 <= n; i += 8) {
 
-		*dst++ = src[i];    /* Left channel */
-		*dst++ = src[i+1];  /* Right channel */
+		__m128i x = _mm_loadu_si128((const __m128i *)&a[i]);
+		__m128i y = _mm_loadu_si128((const __m128i *)&b[i]);
 
-		p += 1/ar->ratio * 2;
+		va = _mm_add_epi32(va, _mm_madd_epi16(x, y));
 	}
+
+	va  = _mm_add_epi32(va, _mm_shuffle_epi32(va, 0x4e));
+	va  = _mm_add_epi32(va, _mm_shuffle_epi32(va, 0xb1));
+	acc = _mm_cvtsi128_si32(va);
+#endif
+
+	for (; i < n; i++)
+		acc += (int32_t)a[i] * b[i];
+
+	return acc;
 }
 
 
-static void auresamp_lowpass(struct auresamp *ar, int16_t *buf, size_t nsamp,
-			     int channels)
+/* Filter one channel, returns the input position after the block */
+static size_t filter(const struct auresamp *ar, int16_t *dst, size_t stride,
+		     const int16_t *src, size_t end, uint32_t *phasep)
 {
-	while (nsamp > 0) {
+	const uint32_t T = ar->taps, L = ar->up, M = ar->down;
+	uint32_t phase = *phasep;
+	size_t pos = ar->pos;
+
+	while (pos < end) {
+
+		const int32_t acc = dotprod(&ar->coeffv[phase * T],
+					    &src[pos + 1 - T], T);
+
+		*dst = saturate_s16((acc + (1 << (RESAMP_SHIFT-1)))
+				    >> RESAMP_SHIFT);
+		dst += stride;
+
+		phase += M;
+		pos   += phase / L;
+		phase %= L;
+	}
+
+	*phasep = phase;
+
+	return pos;
+}
 
-		size_t len = min(nsamp, FIR_MAX_INPUT_LEN);
 
-		fir_process(&ar->fir, ar->coeffv, buf, buf, len, ar->coeffn,
-			    channels);
+static void convert_channels(struct auresamp *ar, int16_t *dst,
+			     const int16_t *src, size_t ns)
+{
+	size_t i;
 
-		buf   += (len*channels);
-		nsamp -= len;
+	if (ar->ch_in == ar->ch_out) {
+		memcpy(dst, src, ns * ar->ch_in * sizeof(*dst));
+	}
+	else if (ar->ch_in == 1) {
+		for (i=0; i<ns; i++) {
+			dst[2*i]   = src[i];
+			dst[2*i+1] = src[i];
+		}
+	}
+	else {
+		for (i=0; i<ns; i++)
+			dst[i] = (src[2*i] + src[2*i+1]) / 2;
 	}
 }
 
@@ -124,7 +253,9 @@ static void destructor(void *arg)
 {
 	struct auresamp *ar = arg;
 
-	mem_deref(ar->sampv);
+	mem_deref(ar->coeffv);
+	mem_deref(ar->bufv[0]);
+	mem_deref(ar->bufv[1]);
 }
 
 
@@ -139,49 +270,75 @@ static void destructor(void *arg)
  * @param ch_out    Number of channels for the output
  *
  * @return 0 for success, otherwise error code
+ *
+ * @note The rate ratio, reduced to lowest terms, must have a numerator
+ *       of at most 1024 (e.g. 8000 to 44100 Hz is 441/80). The filter
+ *       bank has 24 * max(L, M) coefficients, at most 2^20 (e.g. 192000
+ *       to 8000 Hz needs 576 coefficients, 192000 to 1001 Hz is too many)
  */
 int auresamp_alloc(struct auresamp **arp, size_t sampc_max,
 		   uint32_t srate_in, uint8_t ch_in,
 		   uint32_t srate_out, uint8_t ch_out)
 {
 	struct auresamp *ar;
+	uint64_t taps;
+	uint32_t g;
+	uint8_t i;
 	int err = 0;
 
 	if (!arp || !sampc_max || !srate_in || !srate_out)
 		return EINVAL;
 
+	if (ch_in < 1 || ch_in > 2 || ch_out < 1 || ch_out > 2)
+		return EINVAL;
+
+	g = gcd(srate_in, srate_out);
+
+	if (srate_out / g > RESAMP_PHASES_MAX)
+		return ENOTSUP;
+
 	ar = mem_zalloc(sizeof(*ar), destructor);
 	if (!ar)
 		return ENOMEM;
 
-	ar->sampv = mem_zalloc(sampc_max * 2, NULL);
-	if (!ar->sampv) {
-		err = ENOMEM;
+	ar->up     = srate_out / g;
+	ar->down   = srate_in / g;
+	ar->ch_in  = ch_in;
+	ar->ch_out = ch_out;
+	ar->nch    = min(ch_in, ch_out);
+
+	if (ar->up == ar->down)
 		goto out;
-	}
 
-	ar->sampc = sampc_max;
-	ar->ratio = 1.0 * srate_out / srate_in;
-	ar->ch_in = ch_in;
-	ar->ch_out = ch_out;
+	/* a longer filter keeps the transition band when decimating */
+	taps = RESAMP_TAPS;
+	if (ar->down > ar->up)
+		taps = taps * ar->down / ar->up;
 
-	fir_init(&ar->fir);
+	taps = (taps + RESAMP_ALIGN - 1) & ~(uint64_t)(RESAMP_ALIGN - 1);
 
-	if (ch_in == 1 && ch_out == 1)
-		ar->resample = resample;
-	else if (ch_in == 1 && ch_out == 2)
-		ar->resample = resample_mono2stereo;
-	else if (ch_in == 2 && ch_out == 1)
-		ar->resample = resample_stereo2mono;
-	else if (ch_in == 2 && ch_out == 2)
-		ar->resample = resample_stereo;
-	else {
-		err = EINVAL;
+	if (taps * ar->up > RESAMP_BANK_MAX) {
+		err = ENOTSUP;
 		goto out;
 	}
 
-	ar->coeffv = fir_lowpass;
-	ar->coeffn = (int)ARRAY_SIZE(fir_lowpass);
+	ar->taps = (uint32_t)taps;
+
+	err = bank_alloc(ar);
+	if (err)
+		goto out;
+
+	ar->bufsz = ar->taps - 1 + sampc_max / ch_in;
+	ar->pos   = ar->taps - 1;
+
+	for (i=0; i<ar->nch; i++) {
+
+		ar->bufv[i] = mem_zalloc(ar->bufsz * sizeof(int16_t), NULL);
+		if (!ar->bufv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
 
  out:
 	if (err)
@@ -203,43 +360,99 @@ int auresamp_alloc(struct auresamp **arp, size_t sampc_max,
  * @param src_sampc Number of source samples
  *
  * @return 0 for success, otherwise error code
+ *
+ * @note The number of destination samples can vary by one frame between
+ *       calls, since the resampler keeps its phase across blocks
  */
 int auresamp_process(struct auresamp *ar,
 		     int16_t *dst_sampv, size_t *dst_sampc,
 		     const int16_t *src_sampv, size_t src_sampc)
 {
-	size_t ns, nd;
+	const int16_t *src;
+	size_t ns, nd, end, pos = 0, i;
+	uint32_t phase = 0;
+	uint8_t ch;
 
 	if (!ar || !dst_sampv || !dst_sampc || !src_sampv)
 		return EINVAL;
 
 	ns = src_sampc / ar->ch_in;
-	nd = (size_t)(ns * ar->ratio);
+
+	if (ar->up == ar->down) {
+
+		if (*dst_sampc < ns * ar->ch_out)
+			return ENOMEM;
+
+		convert_channels(ar, dst_sampv, src_sampv, ns);
+		*dst_sampc = ns * ar->ch_out;
+
+		return 0;
+	}
+
+	end = ar->taps - 1 + ns;
+
+	/* number of output frames for this block */
+	if (ar->pos < end) {
+		const uint64_t rem = (uint64_t)(end - ar->pos) * ar->up
+			- ar->phase;
+		nd = (size_t)((rem + ar->down - 1) / ar->down);
+	}
+	else
+		nd = 0;
 
 	if (*dst_sampc < nd * ar->ch_out)
 		return ENOMEM;
 
-	if (ar->ratio > 1) {
+	if (end > ar->bufsz) {
 
-		ar->resample(ar, dst_sampv, src_sampv, nd);
-		auresamp_lowpass(ar, dst_sampv, nd, ar->ch_out);
-	}
-	else if (ar->ratio < 1) {
+		for (ch=0; ch<ar->nch; ch++) {
 
-		/* decimation: low-pass filter, then downsample */
+			int16_t *buf;
 
-		if (src_sampc > ar->sampc)
-			return ENOMEM;
+			buf = mem_realloc(ar->bufv[ch], end * sizeof(*buf));
+			if (!buf)
+				return ENOMEM;
+
+			ar->bufv[ch] = buf;
+		}
 
-		memcpy(ar->sampv, src_sampv, src_sampc * 2);
+		ar->bufsz = end;
+	}
 
-		auresamp_lowpass(ar, ar->sampv, ns, ar->ch_in);
-		ar->resample(ar, dst_sampv, ar->sampv, nd);
+	/* de-interleave behind the filter history */
+	src = src_sampv;
+	if (ar->ch_in == 1) {
+		memcpy(&ar->bufv[0][ar->taps - 1], src, ns * sizeof(*src));
+	}
+	else if (ar->ch_out == 1) {
+		for (i=0; i<ns; i++, src += 2)
+			ar->bufv[0][ar->taps - 1 + i] = (src[0] + src[1]) / 2;
 	}
 	else {
-		ar->resample(ar, dst_sampv, src_sampv, nd);
+		for (i=0; i<ns; i++, src += 2) {
+			ar->bufv[0][ar->taps - 1 + i] = src[0];
+			ar->bufv[1][ar->taps - 1 + i] = src[1];
+		}
 	}
 
+	for (ch=0; ch<ar->nch; ch++) {
+
+		phase = ar->phase;
+		pos = filter(ar, &dst_sampv[ch], ar->ch_out, ar->bufv[ch],
+			     end, &phase);
+
+		memmove(ar->bufv[ch], &ar->bufv[ch][ns],
+			(ar->taps - 1) * sizeof(int16_t));
+	}
+
+	if (ar->nch < ar->ch_out) {
+		for (i=0; i<nd; i++)
+			dst_sampv[2*i+1] = dst_sampv[2*i];
+	}
+
+	ar->pos   = pos - ns;
+	ar->phase = phase;
+
 	*dst_sampc = nd * ar->ch_out;
 
 	return 0;
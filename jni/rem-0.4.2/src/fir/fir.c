@@ -9,6 +9,16 @@
 #include <re.h>
 #include <rem_fir.h>
 
+#if defined (HAVE_NEON)
+#include <arm_neon.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define FIR_AVX2 1
+#endif
+#endif
+
 
 /*
  * FIR -- Finite Impulse Response
@@ -16,9 +26,128 @@
  * Inspiration:
  *
  *     http://sestevenson.files.wordpress.com/2009/10/firfixed.pdf
+ *
+ * The input history of each channel is a ring which is stored twice, back
+ * to back, and filled backwards in time. The last filterLength samples
+ * are then always contiguous and newest first, in the same order as the
+ * coefficients, so each output sample is one plain dot product.
+ *
+ * The dot product kernel is selected at runtime, and the scalar loop is
+ * used for short filters. All kernels sum the same 32-bit products, so
+ * the output is bit-exact across CPUs.
  */
 
 
+static int32_t dot_generic(const int16_t *coeffs, const int16_t *samp,
+			   int n)
+{
+	int32_t acc = 0;
+	int k;
+
+	for (k = 0; k < n; k++)
+		acc += (int32_t)coeffs[k] * (int32_t)samp[k];
+
+	return acc;
+}
+
+
+#if defined (HAVE_NEON)
+static int32_t dot_neon(const int16_t *coeffs, const int16_t *samp, int n)
+{
+	int32x4_t va = vdupq_n_s32(0);
+	int32x2_t v2;
+	int32_t acc;
+	int k = 0;
+
+	for (; k + 8 <= n; k += 8) {
+
+		int16x8_t c = vld1q_s16(&coeffs[k]);
+		int16x8_t s = vld1q_s16(&samp[k]);
+
+		va = vmlal_s16(va, vget_low_s16(c),  vget_low_s16(s));
+		va = vmlal_s16(va, vget_high_s16(c), vget_high_s16(s));
+	}
+
+	v2  = vadd_s32(vget_low_s32(va), vget_high_s32(va));
+	acc = vget_lane_s32(vpadd_s32(v2, v2), 0);
+
+	return acc + dot_generic(&coeffs[k], &samp[k], n - k);
+}
+#endif
+
+
+#if defined (__SSE2__) && !defined (HAVE_NEON)
+static int32_t dot_sse2(const int16_t *coeffs, const int16_t *samp, int n)
+{
+	__m128i va = _mm_setzero_si128();
+	int k = 0;
+
+	for (; k + 8 <= n; k += 8) {
+
+		__m128i c = _mm_loadu_si128((const __m128i *)&coeffs[k]);
+		__m128i s = _mm_loadu_si128((const __m128i *)&samp[k]);
+
+		va = _mm_add_epi32(va, _mm_madd_epi16(c, s));
+	}
+
+	va = _mm_add_epi32(va, _mm_shuffle_epi32(va, 0x4e));
+	va = _mm_add_epi32(va, _mm_shuffle_epi32(va, 0xb1));
+
+	return _mm_cvtsi128_si32(va) +
+		dot_generic(&coeffs[k], &samp[k], n - k);
+}
+#endif
+
+
+#ifdef FIR_AVX2
+__attribute__((target("avx2")))
+static int32_t dot_avx2(const int16_t *coeffs, const int16_t *samp, int n)
+{
+	__m256i va = _mm256_setzero_si256();
+	__m128i v;
+	int k = 0;
+
+	for (; k + 16 <= n; k += 16) {
+
+		__m256i c = _mm256_loadu_si256((const __m256i *)&coeffs[k]);
+		__m256i s = _mm256_loadu_si256((const __m256i *)&samp[k]);
+
+		va = _mm256_add_epi32(va, _mm256_madd_epi16(c, s));
+	}
+
+	v = _mm_add_epi32(_mm256_castsi256_si128(va),
+			  _mm256_extracti128_si256(va, 1));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+
+	return _mm_cvtsi128_si32(v) +
+		dot_generic(&coeffs[k], &samp[k], n - k);
+}
+#endif
+
+
+enum {
+	SIMD_MIN_LEN = 12,  /* Shorter filters are faster with dot_generic */
+	SIMD_PAD     = 16,  /* Coefficients of the SIMD kernels, padded to */
+};
+
+
+static fir_dot_h *dot_select(void)
+{
+#if defined (HAVE_NEON)
+	return dot_neon;
+#elif defined (__SSE2__)
+#ifdef FIR_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return dot_avx2;
+#endif
+	return dot_sse2;
+#else
+	return dot_generic;
+#endif
+}
+
+
 /**
  * Initialize the FIR-filter
  *
@@ -26,7 +155,9 @@
  */
 void fir_init(struct fir *fir)
 {
-	memset(fir->insamp, 0, sizeof(fir->insamp));
+	memset(fir->hist, 0, sizeof(fir->hist));
+	fir->pos = 0;
+	fir->dot = dot_select();
 }
 
 
@@ -38,63 +169,105 @@ void fir_init(struct fir *fir)
  * @param input        Input PCM samples
  * @param output       Output PCM samples
  * @param length       Number of samples
- * @param filterLength Number of coefficients
- * @param channels     Number of channels
+ * @param filterLength Number of coefficients, max FIR_MAX_FLT_LEN
+ * @param channels     Number of channels, max FIR_MAX_CHANNELS
+ *
+ * @note The history holds FIR_MAX_FLT_LEN samples of FIR_MAX_CHANNELS
+ *       channels. With more coefficients or channels, or none, the output
+ *       is silence and the history is not changed.
  */
 void fir_process(struct fir *fir, const int16_t *coeffs,
 		 const int16_t *input, int16_t *output,
 		 size_t length, int filterLength, uint8_t channels)
 {
-	const int16_t *inputx = input;
-	int32_t acc;
-	const int16_t *coeffp;
-	int16_t *inputp;
-	size_t n;
-	int k;
-	int ch;
+	fir_dot_h *dot = fir->dot ? fir->dot : dot_generic;
+	int16_t padded[FIR_MAX_FLT_LEN];
+	unsigned pos = fir->pos, p;
+	size_t n, c, i;
+	int len, ch;
 
-	/* put the new samples at the high end of the buffer */
-	for (n = 0; n < length; n++) {
+	if (filterLength < 1 || filterLength > FIR_MAX_FLT_LEN ||
+	    channels > FIR_MAX_CHANNELS) {
+		memset(output, 0, length * channels * sizeof(*output));
+		return;
+	}
 
-		for (ch = 0; ch < channels; ch++) {
+	len = filterLength;
 
-			fir->insamp[ch][filterLength - 1 + n] = *inputx++;
-		}
+	/*
+	 * The SIMD kernels only pay off above a few coefficients. They get
+	 * the coefficients padded with zeros, so that no scalar tail is left.
+	 * The products of the padding are zero, and the older samples which
+	 * they read are within the mirrored ring.
+	 */
+	if (filterLength < SIMD_MIN_LEN) {
+		dot = dot_generic;
 	}
+	else if (dot != dot_generic && filterLength % SIMD_PAD) {
 
-	for (ch = 0; ch < channels; ch++) {
+		len = filterLength + SIMD_PAD - filterLength % SIMD_PAD;
 
-		/* apply the filter to each input sample */
-		for ( n = 0; n < length; n++ ) {
+		memcpy(padded, coeffs, filterLength * sizeof(*coeffs));
+		memset(&padded[filterLength], 0,
+		       (len - filterLength) * sizeof(*coeffs));
 
-			coeffp = coeffs;
-			inputp = &fir->insamp[ch][filterLength - 1 + n];
+		coeffs = padded;
+	}
 
-			/* load rounding constant */
-			acc = 1 << 14;
+	/*
+	 * The input is stored a chunk at a time, and then filtered. A vector
+	 * load of a sample which has just been stored waits for the store to
+	 * complete. The chunk is as long as the ring keeps the history of
+	 * its oldest sample.
+	 */
+	for (n = 0; n < length; n += c) {
 
-			/* perform the multiply-accumulate */
-			for ( k = 0; k < filterLength; k++ ) {
-				acc += (int32_t)(*coeffp++) *
-					(int32_t)(*inputp--);
-			}
+		c = min(length - n, (size_t)FIR_RING_LEN + 1 - filterLength);
 
-			/* saturate the result */
-			if ( acc > 0x3fffffff ) {
-				acc = 0x3fffffff;
-			}
-			else if ( acc < -0x40000000 ) {
-				acc = -0x40000000;
+		for (i = 0; i < c; i++) {
+
+			pos = (pos - 1) & (FIR_RING_LEN - 1);
+
+			for (ch = 0; ch < channels; ch++) {
+
+				int16_t *hist = fir->hist[ch];
+
+				hist[pos] = *input++;
+				hist[pos + FIR_RING_LEN] = hist[pos];
 			}
+		}
+
+		for (i = 0; i < c; i++) {
 
-			/* convert from Q30 to Q15 */
-			output[channels*n + ch] = (int16_t)(acc >> 15);
+			p = (pos + (unsigned)(c - 1 - i)) & (FIR_RING_LEN - 1);
+
+			for (ch = 0; ch < channels; ch++) {
+
+				const int16_t *samp = &fir->hist[ch][p];
+				int32_t acc;
+
+				/* load rounding constant, and inline the
+				 * scalar loop, for short filters */
+				if (dot == dot_generic)
+					acc = dot_generic(coeffs, samp, len);
+				else
+					acc = dot(coeffs, samp, len);
+
+				acc += 1 << 14;
+
+				/* saturate the result */
+				if ( acc > 0x3fffffff ) {
+					acc = 0x3fffffff;
+				}
+				else if ( acc < -0x40000000 ) {
+					acc = -0x40000000;
+				}
+
+				/* convert from Q30 to Q15 */
+				*output++ = (int16_t)(acc >> 15);
+			}
 		}
 	}
 
-	/* shift input samples back in time for next time */
-	for (ch = 0; ch < channels; ch++) {
-		memmove( &fir->insamp[ch][0], &fir->insamp[ch][length],
-			 (filterLength - 1) * sizeof(int16_t) );
-	}
+	fir->pos = pos;
 }
@@ -851,3 +851,205 @@ const int16_t g711_A2l[256] = {
 	   688,   656,   752,   720,   560,   528,   624,   592,
 	   944,   912,  1008,   976,   816,   784,   880,   848,
 };
+
+
+/* Direct A-law to U-law, same as going through 16-bit PCM */
+const uint8_t g711_A2u[256] = {
+	0x29, 0x2a, 0x27, 0x28, 0x2d, 0x2e, 0x2b, 0x2c,
+	0x21, 0x22, 0x1f, 0x20, 0x25, 0x26, 0x23, 0x24,
+	0x39, 0x3a, 0x37, 0x38, 0x3d, 0x3e, 0x3b, 0x3c,
+	0x31, 0x32, 0x2f, 0x30, 0x35, 0x36, 0x33, 0x34,
+	0x0a, 0x0b, 0x08, 0x09, 0x0e, 0x0f, 0x0c, 0x0d,
+	0x02, 0x03, 0x00, 0x01, 0x06, 0x07, 0x04, 0x05,
+	0x1a, 0x1b, 0x18, 0x19, 0x1e, 0x1f, 0x1c, 0x1d,
+	0x12, 0x13, 0x10, 0x11, 0x16, 0x17, 0x14, 0x15,
+	0x62, 0x63, 0x60, 0x61, 0x66, 0x67, 0x64, 0x65,
+	0x5d, 0x5d, 0x5c, 0x5c, 0x5f, 0x5f, 0x5e, 0x5e,
+	0x74, 0x76, 0x70, 0x72, 0x7c, 0x7e, 0x78, 0x7a,
+	0x6a, 0x6b, 0x68, 0x69, 0x6e, 0x6f, 0x6c, 0x6d,
+	0x48, 0x49, 0x46, 0x47, 0x4c, 0x4d, 0x4a, 0x4b,
+	0x40, 0x41, 0x3f, 0x3f, 0x44, 0x45, 0x42, 0x43,
+	0x56, 0x57, 0x54, 0x55, 0x5a, 0x5b, 0x58, 0x59,
+	0x4f, 0x4f, 0x4e, 0x4e, 0x52, 0x53, 0x50, 0x51,
+	0xa9, 0xaa, 0xa7, 0xa8, 0xad, 0xae, 0xab, 0xac,
+	0xa1, 0xa2, 0x9f, 0xa0, 0xa5, 0xa6, 0xa3, 0xa4,
+	0xb9, 0xba, 0xb7, 0xb8, 0xbd, 0xbe, 0xbb, 0xbc,
+	0xb1, 0xb2, 0xaf, 0xb0, 0xb5, 0xb6, 0xb3, 0xb4,
+	0x8a, 0x8b, 0x88, 0x89, 0x8e, 0x8f, 0x8c, 0x8d,
+	0x82, 0x83, 0x80, 0x81, 0x86, 0x87, 0x84, 0x85,
+	0x9a, 0x9b, 0x98, 0x99, 0x9e, 0x9f, 0x9c, 0x9d,
+	0x92, 0x93, 0x90, 0x91, 0x96, 0x97, 0x94, 0x95,
+	0xe2, 0xe3, 0xe0, 0xe1, 0xe6, 0xe7, 0xe4, 0xe5,
+	0xdd, 0xdd, 0xdc, 0xdc, 0xdf, 0xdf, 0xde, 0xde,
+	0xf4, 0xf6, 0xf0, 0xf2, 0xfc, 0xfe, 0xf8, 0xfa,
+	0xea, 0xeb, 0xe8, 0xe9, 0xee, 0xef, 0xec, 0xed,
+	0xc8, 0xc9, 0xc6, 0xc7, 0xcc, 0xcd, 0xca, 0xcb,
+	0xc0, 0xc1, 0xbf, 0xbf, 0xc4, 0xc5, 0xc2, 0xc3,
+	0xd6, 0xd7, 0xd4, 0xd5, 0xda, 0xdb, 0xd8, 0xd9,
+	0xcf, 0xcf, 0xce, 0xce, 0xd2, 0xd3, 0xd0, 0xd1,
+};
+
+
+/* Direct U-law to A-law, same as going through 16-bit PCM */
+const uint8_t g711_u2A[256] = {
+	0x2a, 0x2b, 0x28, 0x29, 0x2e, 0x2f, 0x2c, 0x2d,
+	0x22, 0x23, 0x20, 0x21, 0x26, 0x27, 0x24, 0x25,
+	0x3a, 0x3b, 0x38, 0x39, 0x3e, 0x3f, 0x3c, 0x3d,
+	0x32, 0x33, 0x30, 0x31, 0x36, 0x37, 0x34, 0x35,
+	0x0b, 0x08, 0x09, 0x0e, 0x0f, 0x0c, 0x0d, 0x02,
+	0x03, 0x00, 0x01, 0x06, 0x07, 0x04, 0x05, 0x1a,
+	0x1b, 0x18, 0x19, 0x1e, 0x1f, 0x1c, 0x1d, 0x12,
+	0x13, 0x10, 0x11, 0x16, 0x17, 0x14, 0x15, 0x6b,
+	0x68, 0x69, 0x6e, 0x6f, 0x6c, 0x6d, 0x62, 0x63,
+	0x60, 0x61, 0x66, 0x67, 0x64, 0x65, 0x7b, 0x79,
+	0x7e, 0x7f, 0x7c, 0x7d, 0x72, 0x73, 0x70, 0x71,
+	0x76, 0x77, 0x74, 0x75, 0x4b, 0x49, 0x4f, 0x4d,
+	0x42, 0x43, 0x40, 0x41, 0x46, 0x47, 0x44, 0x45,
+	0x5a, 0x5b, 0x58, 0x59, 0x5e, 0x5f, 0x5c, 0x5d,
+	0x52, 0x52, 0x53, 0x53, 0x50, 0x50, 0x51, 0x51,
+	0x56, 0x56, 0x57, 0x57, 0x54, 0x54, 0x55, 0x55,
+	0xaa, 0xab, 0xa8, 0xa9, 0xae, 0xaf, 0xac, 0xad,
+	0xa2, 0xa3, 0xa0, 0xa1, 0xa6, 0xa7, 0xa4, 0xa5,
+	0xba, 0xbb, 0xb8, 0xb9, 0xbe, 0xbf, 0xbc, 0xbd,
+	0xb2, 0xb3, 0xb0, 0xb1, 0xb6, 0xb7, 0xb4, 0xb5,
+	0x8b, 0x88, 0x89, 0x8e, 0x8f, 0x8c, 0x8d, 0x82,
+	0x83, 0x80, 0x81, 0x86, 0x87, 0x84, 0x85, 0x9a,
+	0x9b, 0x98, 0x99, 0x9e, 0x9f, 0x9c, 0x9d, 0x92,
+	0x93, 0x90, 0x91, 0x96, 0x97, 0x94, 0x95, 0xeb,
+	0xe8, 0xe9, 0xee, 0xef, 0xec, 0xed, 0xe2, 0xe3,
+	0xe0, 0xe1, 0xe6, 0xe7, 0xe4, 0xe5, 0xfb, 0xf9,
+	0xfe, 0xff, 0xfc, 0xfd, 0xf2, 0xf3, 0xf0, 0xf1,
+	0xf6, 0xf7, 0xf4, 0xf5, 0xcb, 0xc9, 0xcf, 0xcd,
+	0xc2, 0xc3, 0xc0, 0xc1, 0xc6, 0xc7, 0xc4, 0xc5,
+	0xda, 0xdb, 0xd8, 0xd9, 0xde, 0xdf, 0xdc, 0xdd,
+	0xd2, 0xd2, 0xd3, 0xd3, 0xd0, 0xd0, 0xd1, 0xd1,
+	0xd6, 0xd6, 0xd7, 0xd7, 0xd4, 0xd4, 0xd5, 0xd5,
+};
+
+
+/*
+ * Block transcoding
+ *
+ * The loops are unrolled by four with independent table lookups, so the
+ * loads can be issued back to back. The encoders are branch-free apart
+ * from the loop, and give the same result as the per-sample functions.
+ */
+
+
+#define BLOCK_LOOP(n, expr)			\
+	while ((n) >= 4) {			\
+		dst[0] = expr(src[0]);		\
+		dst[1] = expr(src[1]);		\
+		dst[2] = expr(src[2]);		\
+		dst[3] = expr(src[3]);		\
+		dst += 4;			\
+		src += 4;			\
+		(n) -= 4;			\
+	}					\
+	while ((n)--)				\
+		*dst++ = expr(*src++)
+
+
+#define ULAW2PCM(u)  g711_u2l[u]
+#define ALAW2PCM(a)  g711_A2l[a]
+#define ALAW2ULAW(a) g711_A2u[a]
+#define ULAW2ALAW(u) g711_u2A[u]
+
+
+static inline uint8_t enc_ulaw(int16_t s)
+{
+	const int32_t sign = (int32_t)s >> 31;
+	const int32_t l    = (s ^ sign) - sign;
+	const uint8_t mask = 0xff ^ (sign & 0x80);
+	const uint8_t u    = (l < 4) ? 0xff : g711_l2u[(l - 4) >> 3];
+
+	return u & mask;
+}
+
+
+static inline uint8_t enc_alaw(int16_t s)
+{
+	const int32_t sign = (int32_t)s >> 31;
+	const int32_t l    = min((s ^ sign) - sign, 0x7fff);
+	const uint8_t mask = 0xff ^ (sign & 0x80);
+
+	return g711_l2A[l >> 4] & mask;
+}
+
+
+/**
+ * Encode a block of 16-bit PCM samples to U-law format
+ *
+ * @param dst U-law bytes
+ * @param src Signed PCM samples
+ * @param n   Number of samples
+ */
+void g711_pcm2ulaw_block(uint8_t *dst, const int16_t *src, size_t n)
+{
+	BLOCK_LOOP(n, enc_ulaw);
+}
+
+
+/**
+ * Encode a block of 16-bit PCM samples to A-law format
+ *
+ * @param dst A-law bytes
+ * @param src Signed PCM samples
+ * @param n   Number of samples
+ */
+void g711_pcm2alaw_block(uint8_t *dst, const int16_t *src, size_t n)
+{
+	BLOCK_LOOP(n, enc_alaw);
+}
+
+
+/**
+ * Decode a block of U-law samples to 16-bit PCM samples
+ *
+ * @param dst Signed PCM samples
+ * @param src U-law bytes
+ * @param n   Number of samples
+ */
+void g711_ulaw2pcm_block(int16_t *dst, const uint8_t *src, size_t n)
+{
+	BLOCK_LOOP(n, ULAW2PCM);
+}
+
+
+/**
+ * Decode a block of A-law samples to 16-bit PCM samples
+ *
+ * @param dst Signed PCM samples
+ * @param src A-law bytes
+ * @param n   Number of samples
+ */
+void g711_alaw2pcm_block(int16_t *dst, const uint8_t *src, size_t n)
+{
+	BLOCK_LOOP(n, ALAW2PCM);
+}
+
+
+/**
+ * Convert a block of A-law samples to U-law, without going through PCM
+ *
+ * @param dst U-law bytes
+ * @param src A-law bytes
+ * @param n   Number of samples
+ */
+void g711_alaw2ulaw_block(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	BLOCK_LOOP(n, ALAW2ULAW);
+}
+
+
+/**
+ * Convert a block of U-law samples to A-law, without going through PCM
+ *
+ * @param dst A-law bytes
+ * @param src U-law bytes
+ * @param n   Number of samples
+ */
+void g711_ulaw2alaw_block(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	BLOCK_LOOP(n, ULAW2ALAW);
+}
@@ -0,0 +1,141 @@
+/**
+ * @file h264/nal.c  H.264 byte stream (Annex B) -- NAL unit start codes
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem_h264.h>
+#if defined (HAVE_NEON) && defined (USE_H264_NEON)
+#include <arm_neon.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * Find the NAL start sequence in a H.264 byte stream
+ *
+ * @note: copied from ffmpeg source
+ */
+static const uint8_t *find_startcode_generic(const uint8_t *p,
+					     const uint8_t *end)
+{
+	const uint8_t *a = p + 4 - ((long)p & 3);
+
+	for (end -= 3; p < a && p < end; p++ ) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	for (end -= 3; p < end; p += 4) {
+		uint32_t x = *(const uint32_t*)p;
+		if ( (x - 0x01010101) & (~x) & 0x80808080 ) {
+			if (p[1] == 0 ) {
+				if ( p[0] == 0 && p[2] == 1 )
+					return p;
+				if ( p[2] == 0 && p[3] == 1 )
+					return p+1;
+			}
+			if ( p[3] == 0 ) {
+				if ( p[2] == 0 && p[4] == 1 )
+					return p+2;
+				if ( p[4] == 0 && p[5] == 1 )
+					return p+3;
+			}
+		}
+	}
+
+	for (end += 3; p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	return end + 3;
+}
+
+
+/*
+ * The vector scanners test 16 positions at a time for the sequence
+ * 00 00 01, with the three bytes of each position in three loads that
+ * are one byte apart. Emulation prevention keeps 00 00 rare inside NAL
+ * units, so almost every block is rejected with one test. On a hit, the
+ * first matching position is taken from the mask. As in the generic
+ * scanner, a start code must be followed by at least one byte.
+ *
+ * The NEON scanner is NOT verified on ARM: it has not been compiled with
+ * a real arm_neon.h, nor run or benchmarked on ARM hardware or under
+ * emulation. Only its logic was checked, on x86 with a scalar stand-in
+ * for the intrinsics, against the generic scanner. It is therefore only
+ * built with USE_H264_NEON, and ARM builds use the generic scanner.
+ */
+
+#if defined (HAVE_NEON) && defined (USE_H264_NEON)
+static const uint8_t *find_startcode_neon(const uint8_t *p,
+					  const uint8_t *end)
+{
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t one  = vdupq_n_u8(1);
+
+	for (; end - p > 18; p += 16) {
+
+		uint8x16_t m;
+		uint64_t x;
+
+		m = vandq_u8(vceqq_u8(vld1q_u8(p), zero),
+			     vceqq_u8(vld1q_u8(p + 1), zero));
+		m = vandq_u8(m, vceqq_u8(vld1q_u8(p + 2), one));
+
+		/* four bits per position, the first position lowest */
+		x = vget_lane_u64(vreinterpret_u64_u8(
+				  vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (x)
+			return p + (__builtin_ctzll(x) >> 2);
+	}
+
+	return find_startcode_generic(p, end);
+}
+#elif defined (__SSE2__)
+static const uint8_t *find_startcode_sse2(const uint8_t *p,
+					  const uint8_t *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one  = _mm_set1_epi8(1);
+
+	for (; end - p > 18; p += 16) {
+
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i c = _mm_loadu_si128((const __m128i *)(p + 2));
+		int m;
+
+		a = _mm_and_si128(_mm_cmpeq_epi8(a, zero),
+				  _mm_cmpeq_epi8(b, zero));
+		m = _mm_movemask_epi8(_mm_and_si128(a,
+						    _mm_cmpeq_epi8(c, one)));
+		if (m)
+			return p + __builtin_ctz((unsigned)m);
+	}
+
+	return find_startcode_generic(p, end);
+}
+#endif
+
+
+/**
+ * Find the NAL start sequence in a H.264 byte stream
+ *
+ * @param p   Start of the byte stream
+ * @param end End of the byte stream
+ *
+ * @return Start of the sequence, or end if not found
+ */
+const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
+{
+#if defined (HAVE_NEON) && defined (USE_H264_NEON)
+	return find_startcode_neon(p, end);
+#elif defined (__SSE2__)
+	return find_startcode_sse2(p, end);
+#else
+	return find_startcode_generic(p, end);
+#endif
+}
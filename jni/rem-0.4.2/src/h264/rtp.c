@@ -0,0 +1,226 @@
+/**
+ * @file h264/rtp.c  H.264 RTP payload format (RFC 3984)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem_h264.h>
+
+
+enum {
+	NAL_TYPE_MASK = 0x1f,
+	NAL_NRI_MASK  = 0x60,
+	NAL_FU_A      = 28,    /**< Fragmentation unit             */
+	NAL_FU_B      = 29,    /**< Fragmentation unit, with DON   */
+	FU_START      = 0x80,  /**< Start bit of the FU header     */
+	FU_END        = 0x40,  /**< End bit of the FU header       */
+	FU_HDR_SIZE   = 2,
+};
+
+
+/** Packetizer of one frame */
+struct pktz {
+	struct mbuf *mb;          /**< Frame, Annex B                  */
+	struct mbuf *mb_frag;     /**< Buffer for packets not in place */
+	size_t presz;             /**< Headroom of a packet            */
+	h264_rtp_send_h *sendh;   /**< Send handler                    */
+	void *arg;                /**< Handler argument                */
+};
+
+
+/**
+ * Check if an RTP packet starts a NAL unit. A frame starts with a NAL
+ * unit, so a packet which continues a fragmented NAL unit cannot be the
+ * first packet of a frame.
+ *
+ * @param mb RTP payload
+ *
+ * @return True if the packet starts a NAL unit, otherwise false
+ */
+bool h264_rtp_is_start(const struct mbuf *mb)
+{
+	const uint8_t *p = mbuf_buf(mb);
+	const size_t n = mbuf_get_left(mb);
+	uint8_t type;
+
+	if (!n)
+		return false;
+
+	type = p[0] & NAL_TYPE_MASK;
+
+	if (type == NAL_FU_A || type == NAL_FU_B)
+		return n >= 2 && (p[1] & FU_START);
+
+	return true;
+}
+
+
+/* A packet copied to the fragment buffer, after its headroom */
+static int send_copy(struct pktz *pz, const uint8_t *hdr, size_t hdr_sz,
+		     size_t pos, size_t sz, bool marker)
+{
+	struct mbuf *mb = pz->mb_frag;
+	int err = 0;
+
+	mb->pos = mb->end = pz->presz;
+
+	if (hdr_sz)
+		err = mbuf_write_mem(mb, hdr, hdr_sz);
+
+	err |= mbuf_write_mem(mb, pz->mb->buf + pos, sz);
+	if (err)
+		return err;
+
+	mb->pos = pz->presz;
+
+	return pz->sendh(marker, mb, pz->arg);
+}
+
+
+/*
+ * Packets of a frame are built in place: the RTP and payload headers of
+ * each packet are written over the bytes just before its payload, which
+ * are the start code or the tail of a packet already sent. The send
+ * handler is synchronous and may append to the packet (e.g. an SRTP tag),
+ * so the bytes after it are kept and put back when it returns.
+ */
+static int send_inplace(struct pktz *pz, const uint8_t *hdr, size_t hdr_sz,
+			size_t pos, size_t sz, bool marker)
+{
+	struct mbuf *mb = pz->mb;
+	const size_t end = mb->end;
+	uint8_t tail[H264_RTP_TAILROOM];
+	size_t n;
+	int err;
+
+	if (pos < pz->presz + hdr_sz)
+		return send_copy(pz, hdr, hdr_sz, pos, sz, marker);
+
+	n = min(sizeof(tail), mb->size - (pos + sz));
+	memcpy(tail, mb->buf + pos + sz, n);
+
+	memcpy(mb->buf + pos - hdr_sz, hdr, hdr_sz);
+
+	mb->pos = pos - hdr_sz;
+	mb->end = pos + sz;
+
+	err = pz->sendh(marker, mb, pz->arg);
+
+	/* the send handler may have grown the buffer */
+	memcpy(mb->buf + pos + sz, tail, n);
+	mb->end = end;
+
+	return err;
+}
+
+
+/* Send the NAL unit at offset pos of the frame, in FU-A if too large */
+static int nal_send(struct pktz *pz, size_t pos, size_t size,
+		    size_t pktsize, bool marker)
+{
+	const uint8_t hdr = pz->mb->buf[pos];
+	const size_t sz = pktsize - FU_HDR_SIZE;
+	uint8_t fu_hdr[FU_HDR_SIZE];
+	int err = 0;
+
+	if (size <= pktsize)
+		return send_inplace(pz, NULL, 0, pos, size, marker);
+
+	fu_hdr[0] = (hdr & NAL_NRI_MASK) | NAL_FU_A;
+	fu_hdr[1] = FU_START | (hdr & NAL_TYPE_MASK);
+
+	++pos;
+	--size;
+
+	while (size > sz) {
+		err |= send_inplace(pz, fu_hdr, sizeof(fu_hdr), pos, sz,
+				    false);
+		pos  += sz;
+		size -= sz;
+		fu_hdr[1] &= ~FU_START;
+	}
+
+	fu_hdr[1] |= FU_END;
+
+	err |= send_inplace(pz, fu_hdr, sizeof(fu_hdr), pos, size, marker);
+
+	return err;
+}
+
+
+/**
+ * Packetize a frame of H.264 in packetization mode 1 (RFC 3984), without
+ * copying the NAL units. A NAL unit larger than a packet is sent in FU-A
+ * packets. The marker bit is set on the last packet of the frame.
+ *
+ * The headers of a packet are written over the bytes before its payload,
+ * so the frame is modified. A packet is copied to the fragment buffer if
+ * there is no headroom for it in the frame, which is only the case for
+ * the first NAL unit.
+ *
+ * @param mb      Frame in Annex B format, from the current position
+ * @param pktsize Maximum size of an RTP payload
+ * @param presz   Headroom for the RTP header, before a payload
+ * @param mb_frag Buffer for packets without headroom in the frame,
+ *                of at least presz + pktsize bytes
+ * @param sendh   Send handler, may append up to H264_RTP_TAILROOM bytes
+ * @param arg     Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int h264_rtp_packetize(struct mbuf *mb, size_t pktsize, size_t presz,
+		       struct mbuf *mb_frag, h264_rtp_send_h *sendh,
+		       void *arg)
+{
+	struct pktz pz;
+	const uint8_t *start, *end, *r;
+	const size_t pos0 = mb ? mb->pos : 0;
+	int err = 0;
+
+	if (!mb || pktsize <= FU_HDR_SIZE || !mb_frag || !sendh)
+		return EINVAL;
+
+	pz.mb      = mb;
+	pz.mb_frag = mb_frag;
+	pz.presz   = presz;
+	pz.sendh   = sendh;
+	pz.arg     = arg;
+
+	start = mb->buf;
+	end   = start + mb->end;
+
+	r = h264_find_startcode(mbuf_buf(mb), end);
+
+	while (r < end) {
+		const uint8_t *r1;
+		size_t off, next, len;
+
+		/* skip zeros */
+		while (!*(r++))
+			;
+
+		r1 = h264_find_startcode(r, end);
+
+		/* offsets, the buffer may move while sending */
+		off  = r - start;
+		next = r1 - start;
+		len  = next - off;
+
+		/* a NAL unit does not end with a zero byte, the next start
+		 * code of four bytes does */
+		while (len > 1 && r[len - 1] == 0)
+			--len;
+
+		if (len)
+			err |= nal_send(&pz, off, len, pktsize, (r1 >= end));
+
+		start = mb->buf;
+		end   = start + mb->end;
+		r     = start + next;
+	}
+
+	mb->pos = pos0;
+
+	return err;
+}
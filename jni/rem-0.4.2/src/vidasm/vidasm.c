@@ -0,0 +1,486 @@
+/**
+ * @file vidasm.c  Video frame assembler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem_vidasm.h>
+
+
+#define DEBUG_MODULE "vidasm"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/*
+ * The video frame assembler sits between the network and the video
+ * decoder. Incoming RTP packets are grouped into frames by RTP timestamp,
+ * and kept in sequence number order. A frame is passed on to the decoder
+ * only when it is complete:
+ *
+ *   - the last packet has the marker bit set
+ *   - there are no gaps in the sequence numbers
+ *   - the first packet follows the last packet of the previous frame,
+ *     or for the first frame, the start handler tells that it starts
+ *     the frame
+ *
+ * Frames are released in sequence number order, which is also the
+ * decoding order. If too many frames are pending, the oldest one is
+ * dropped without decoding and the loss handler is called, so that the
+ * application can ask for a new keyframe. The next pending frame is then
+ * taken as the first one. Packets missing before the first packet of a
+ * frame may be whole lost frames, or the head of this one. The start
+ * handler tells them apart from the payload format: only in the first
+ * case is the frame decoded, also with a call of the loss handler.
+ */
+
+
+enum {
+	PKT_POOL_MAX   =  256,  /**< Maximum number of pooled packets  */
+	FRAME_PKTS_MAX = 1024,  /**< Maximum number of packets a frame */
+	SEQ_RESYNC     = 1000,  /**< Sequence jump that restarts      */
+};
+
+
+/** A received RTP packet */
+struct vpkt {
+	struct le le;
+	struct rtp_header hdr;
+	struct mbuf *mb;
+};
+
+/** A partly or fully received video frame */
+struct vframe {
+	struct le le;
+	struct list pktl;    /**< Packets in sequence number order  */
+	uint32_t ts;         /**< RTP timestamp                     */
+	uint32_t npkt;       /**< Number of packets                 */
+};
+
+/** Video frame assembler */
+struct vidasm {
+	struct list framel;  /**< Pending frames, oldest first      */
+	struct list pool;    /**< Free packets (struct vpkt)        */
+	struct list fpool;   /**< Free frames (struct vframe)       */
+	uint32_t max_frames; /**< Maximum number of pending frames  */
+	uint32_t ssrc;       /**< Current synchronization source    */
+	uint16_t seq_next;   /**< First sequence of next frame      */
+	bool started;        /**< Set when seq_next is valid        */
+	vidasm_start_h *starth;
+	vidasm_pkt_h *pkth;
+	vidasm_loss_h *lossh;
+	void *arg;
+
+	struct {
+		uint32_t n_frames;  /**< Frames released to decoder    */
+		uint32_t n_lost;    /**< Incomplete frames dropped     */
+		uint32_t n_late;    /**< Late or duplicate packets     */
+	} stat;
+};
+
+
+static inline int16_t seq_diff(uint16_t a, uint16_t b)
+{
+	return (int16_t)(a - b);
+}
+
+
+static inline struct vpkt *frame_first(const struct vframe *f)
+{
+	return list_ledata(f->pktl.head);
+}
+
+
+static inline struct vpkt *frame_last(const struct vframe *f)
+{
+	return list_ledata(f->pktl.tail);
+}
+
+
+static void pkt_release(struct vidasm *va, struct vpkt *pkt)
+{
+	list_unlink(&pkt->le);
+	pkt->mb = mem_deref(pkt->mb);
+
+	if (list_count(&va->pool) < PKT_POOL_MAX)
+		list_append(&va->pool, &pkt->le, pkt);
+	else
+		mem_deref(pkt);
+}
+
+
+static void frame_release(struct vidasm *va, struct vframe *f)
+{
+	list_unlink(&f->le);
+
+	while (f->pktl.head)
+		pkt_release(va, f->pktl.head->data);
+
+	f->npkt = 0;
+
+	list_append(&va->fpool, &f->le, f);
+}
+
+
+static void vpkt_destructor(void *data)
+{
+	struct vpkt *pkt = data;
+
+	list_unlink(&pkt->le);
+	mem_deref(pkt->mb);
+}
+
+
+static void vframe_destructor(void *data)
+{
+	struct vframe *f = data;
+
+	list_unlink(&f->le);
+	list_flush(&f->pktl);
+}
+
+
+static void destructor(void *data)
+{
+	struct vidasm *va = data;
+
+	list_flush(&va->framel);
+	list_flush(&va->fpool);
+	list_flush(&va->pool);
+}
+
+
+/* Insert a frame, keeping the list ordered by first sequence number */
+static void frame_insert(struct vidasm *va, struct vframe *f)
+{
+	const uint16_t seq = frame_first(f)->hdr.seq;
+	struct le *le;
+
+	for (le = va->framel.tail; le; le = le->prev) {
+
+		struct vframe *f2 = le->data;
+
+		if (seq_diff(seq, frame_first(f2)->hdr.seq) > 0)
+			break;
+	}
+
+	if (le)
+		list_insert_after(&va->framel, le, &f->le, f);
+	else
+		list_prepend(&va->framel, &f->le, f);
+}
+
+
+/* Find the frame with a given timestamp, searching the newest first */
+static struct vframe *frame_find(const struct vidasm *va, uint32_t ts)
+{
+	struct le *le;
+
+	for (le = va->framel.tail; le; le = le->prev) {
+
+		struct vframe *f = le->data;
+
+		if (f->ts == ts)
+			return f;
+	}
+
+	return NULL;
+}
+
+
+/* All packets of the frame itself are there */
+static bool frame_whole(const struct vframe *f)
+{
+	const struct vpkt *first = frame_first(f);
+	const struct vpkt *last  = frame_last(f);
+
+	if (!last->hdr.m)
+		return false;
+
+	return (uint16_t)(last->hdr.seq - first->hdr.seq + 1) == f->npkt;
+}
+
+
+/* The first packet starts the frame, as told by the payload format */
+static bool frame_starts(const struct vidasm *va, const struct vframe *f)
+{
+	const struct vpkt *first = frame_first(f);
+
+	return va->starth(&first->hdr, first->mb, va->arg);
+}
+
+
+static bool frame_complete(const struct vidasm *va, const struct vframe *f)
+{
+	if (!frame_whole(f))
+		return false;
+
+	if (va->started)
+		return frame_first(f)->hdr.seq == va->seq_next;
+
+	/* the first packets of the first frame may still come */
+	return frame_starts(va, f);
+}
+
+
+/* Pass all packets of the oldest frame to the decoder */
+static void frame_decode(struct vidasm *va, struct vframe *f)
+{
+	struct le *le;
+
+	va->seq_next = frame_last(f)->hdr.seq + 1;
+	va->started  = true;
+
+	for (le = f->pktl.head; le; le = le->next) {
+
+		struct vpkt *pkt = le->data;
+
+		va->pkth(&pkt->hdr, pkt->mb, va->arg);
+	}
+
+	++va->stat.n_frames;
+
+	frame_release(va, f);
+}
+
+
+/*
+ * Drop the oldest frame, and continue with the next pending frame. The
+ * lost packets may be at the end of the dropped frame or at the start of
+ * the next one, so the next frame must not wait for them.
+ */
+static void frame_drop(struct vidasm *va, struct vframe *f)
+{
+	struct vframe *next;
+
+	DEBUG_INFO("dropping incomplete frame ts=%u (%u packets)\n",
+		   f->ts, f->npkt);
+
+	va->seq_next = frame_last(f)->hdr.seq + 1;
+	va->started  = true;
+
+	++va->stat.n_lost;
+
+	frame_release(va, f);
+
+	next = list_ledata(va->framel.head);
+	if (next && seq_diff(frame_first(next)->hdr.seq, va->seq_next) > 0)
+		va->seq_next = frame_first(next)->hdr.seq;
+
+	if (va->lossh)
+		va->lossh(va->arg);
+}
+
+
+/*
+ * Decode the oldest frame although packets before it are missing. The
+ * frame has all its packets, so those were of whole lost frames.
+ */
+static void frame_skip(struct vidasm *va, struct vframe *f)
+{
+	DEBUG_INFO("lost packets before frame ts=%u\n", f->ts);
+
+	++va->stat.n_lost;
+
+	frame_decode(va, f);
+
+	if (va->lossh)
+		va->lossh(va->arg);
+}
+
+
+static void process(struct vidasm *va)
+{
+	struct vframe *f;
+
+	while ((f = list_ledata(va->framel.head))) {
+
+		if (frame_complete(va, f))
+			frame_decode(va, f);
+		else if (list_count(&va->framel) <= va->max_frames)
+			break;
+		else if (frame_whole(f) && frame_starts(va, f))
+			frame_skip(va, f);
+		else
+			frame_drop(va, f);
+	}
+}
+
+
+/**
+ * Allocate a new video frame assembler
+ *
+ * @param vap        Pointer to allocated video frame assembler
+ * @param max_frames Maximum number of frames waiting to be completed
+ * @param starth     Start handler, tells if a packet starts a frame
+ * @param pkth       Packet handler, called in decoding order
+ * @param lossh      Optional handler called when a frame is dropped
+ * @param arg        Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidasm_alloc(struct vidasm **vap, uint32_t max_frames,
+		 vidasm_start_h *starth, vidasm_pkt_h *pkth,
+		 vidasm_loss_h *lossh, void *arg)
+{
+	struct vidasm *va;
+
+	if (!vap || !max_frames || !starth || !pkth)
+		return EINVAL;
+
+	va = mem_zalloc(sizeof(*va), destructor);
+	if (!va)
+		return ENOMEM;
+
+	va->max_frames = max_frames;
+	va->starth     = starth;
+	va->pkth       = pkth;
+	va->lossh      = lossh;
+	va->arg        = arg;
+
+	*vap = va;
+
+	return 0;
+}
+
+
+/**
+ * Put an RTP packet into the video frame assembler. Complete frames are
+ * passed to the packet handler before this function returns.
+ *
+ * @param va  Video frame assembler
+ * @param hdr RTP header
+ * @param mb  RTP payload, a reference is kept until the frame is released
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidasm_put(struct vidasm *va, const struct rtp_header *hdr,
+	       struct mbuf *mb)
+{
+	struct vframe *f;
+	struct vpkt *pkt;
+	struct le *le;
+
+	if (!va || !hdr || !mb)
+		return EINVAL;
+
+	if (hdr->ssrc != va->ssrc) {
+		vidasm_flush(va);
+		va->ssrc = hdr->ssrc;
+	}
+
+	if (va->started && seq_diff(hdr->seq, va->seq_next) < 0) {
+
+		/* the sender restarted, without changing SSRC */
+		if (seq_diff(hdr->seq, va->seq_next) < -SEQ_RESYNC) {
+			vidasm_flush(va);
+		}
+		else {
+			++va->stat.n_late;
+			return EALREADY;
+		}
+	}
+
+	f = frame_find(va, hdr->ts);
+	if (f) {
+		/* find the position, packets usually arrive in order */
+		for (le = f->pktl.tail; le; le = le->prev) {
+
+			const struct vpkt *pkt2 = le->data;
+			const int16_t d = seq_diff(hdr->seq, pkt2->hdr.seq);
+
+			if (d == 0) {
+				++va->stat.n_late;
+				return EALREADY;
+			}
+			else if (d > 0)
+				break;
+		}
+
+		if (f->npkt >= FRAME_PKTS_MAX)
+			return EOVERFLOW;
+	}
+	else {
+		f = list_ledata(va->fpool.head);
+		if (f) {
+			list_unlink(&f->le);
+		}
+		else {
+			f = mem_zalloc(sizeof(*f), vframe_destructor);
+			if (!f)
+				return ENOMEM;
+		}
+
+		f->ts = hdr->ts;
+		le = NULL;
+	}
+
+	pkt = list_ledata(va->pool.head);
+	if (pkt) {
+		list_unlink(&pkt->le);
+	}
+	else {
+		pkt = mem_zalloc(sizeof(*pkt), vpkt_destructor);
+		if (!pkt) {
+			if (!f->npkt)
+				list_append(&va->fpool, &f->le, f);
+			return ENOMEM;
+		}
+	}
+
+	pkt->hdr = *hdr;
+	pkt->mb  = mem_ref(mb);
+
+	if (le)
+		list_insert_after(&f->pktl, le, &pkt->le, pkt);
+	else
+		list_prepend(&f->pktl, &pkt->le, pkt);
+
+	/* a new first packet moves the frame */
+	if (f->pktl.head == &pkt->le) {
+		list_unlink(&f->le);
+		frame_insert(va, f);
+	}
+
+	++f->npkt;
+
+	process(va);
+
+	return 0;
+}
+
+
+/**
+ * Drop all pending frames, and start over with the next packet
+ *
+ * @param va Video frame assembler
+ */
+void vidasm_flush(struct vidasm *va)
+{
+	if (!va)
+		return;
+
+	while (va->framel.head)
+		frame_release(va, va->framel.head->data);
+
+	va->started = false;
+}
+
+
+/**
+ * Print the video frame assembler statistics
+ *
+ * @param pf Print function
+ * @param va Video frame assembler
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidasm_debug(struct re_printf *pf, const struct vidasm *va)
+{
+	if (!va)
+		return 0;
+
+	return re_hprintf(pf, " asm: frames=%u lost=%u late=%u pending=%u\n",
+			  va->stat.n_frames, va->stat.n_lost,
+			  va->stat.n_late, list_count(&va->framel));
+}
@@ -0,0 +1,621 @@
+/**
+ * @file fast.c Video Conversion -- same-size line converters
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <string.h>
+#include <re.h>
+#include <rem_vid.h>
+#include <rem_dsp.h>
+#include "vconv.h"
+
+#if defined (HAVE_NEON)
+#include <arm_neon.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * When source and destination have the same size there is no need for
+ * any scaling math, and the pixels of a line can be converted in bulk.
+ * The SIMD loops convert 16 pixels (8 for RGB32 input) per iteration,
+ * and the rest of the line is done by the scalar loops. All paths give
+ * the same output as the scaling converters at a 1:1 ratio.
+ */
+
+
+/* Chroma contributions, same values as the lookup tables in vconv.c */
+static inline void chroma(uint8_t u, uint8_t v, int *ruv, int *guv, int *buv)
+{
+	*ruv = (COEF_RV * (v - 128)) >> VIDCONV_P;
+	*guv = ((COEF_GV * (v - 128)) >> VIDCONV_P) +
+		((COEF_GU * (u - 128)) >> VIDCONV_P);
+	*buv = (COEF_BU * (u - 128)) >> VIDCONV_P;
+}
+
+
+static void yuv420p_to_yuv420p(uint8_t *dd[3], const uint16_t *lsd,
+			       const uint8_t *ds[3], const uint16_t *lss,
+			       unsigned width)
+{
+	memcpy(dd[0],          ds[0],          width);
+	memcpy(dd[0] + lsd[0], ds[0] + lss[0], width);
+	memcpy(dd[1],          ds[1],          width/2);
+	memcpy(dd[2],          ds[2],          width/2);
+}
+
+
+/* Packed 4:2:2, luma at byte offset yo and chroma at the other */
+static inline void packed422_to_yuv420p(uint8_t *dd[3], const uint16_t *lsd,
+					const uint8_t *ds[3], const uint16_t *lss,
+					unsigned width, const unsigned yo)
+{
+	const unsigned co = yo ^ 1;
+	const uint8_t *s0 = ds[0], *s1 = ds[0] + lss[0];
+	uint8_t *y0 = dd[0], *y1 = dd[0] + lsd[0];
+	uint8_t *u = dd[1], *v = dd[2];
+	unsigned x = 0;
+
+#if defined (HAVE_NEON)
+	for (; x + 16 <= width; x += 16) {
+
+		uint8x8x4_t a = vld4_u8(&s0[2*x]);
+		uint8x8x4_t b = vld4_u8(&s1[2*x]);
+		uint8x8x2_t ya, yb;
+
+		ya.val[0] = a.val[yo];
+		ya.val[1] = a.val[yo + 2];
+		yb.val[0] = b.val[yo];
+		yb.val[1] = b.val[yo + 2];
+
+		vst2_u8(&y0[x], ya);
+		vst2_u8(&y1[x], yb);
+		vst1_u8(&u[x/2], a.val[co]);
+		vst1_u8(&v[x/2], a.val[co + 2]);
+	}
+#elif defined (__SSE2__)
+	const __m128i m = _mm_set1_epi16(0x00ff);
+	const __m128i z = _mm_setzero_si128();
+
+	for (; x + 16 <= width; x += 16) {
+
+		__m128i a0 = _mm_loadu_si128((const __m128i *)&s0[2*x]);
+		__m128i a1 = _mm_loadu_si128((const __m128i *)&s0[2*x + 16]);
+		__m128i b0 = _mm_loadu_si128((const __m128i *)&s1[2*x]);
+		__m128i b1 = _mm_loadu_si128((const __m128i *)&s1[2*x + 16]);
+		__m128i ya, yb, uv;
+
+		if (yo) {
+			ya = _mm_packus_epi16(_mm_srli_epi16(a0, 8),
+					      _mm_srli_epi16(a1, 8));
+			yb = _mm_packus_epi16(_mm_srli_epi16(b0, 8),
+					      _mm_srli_epi16(b1, 8));
+			uv = _mm_packus_epi16(_mm_and_si128(a0, m),
+					      _mm_and_si128(a1, m));
+		}
+		else {
+			ya = _mm_packus_epi16(_mm_and_si128(a0, m),
+					      _mm_and_si128(a1, m));
+			yb = _mm_packus_epi16(_mm_and_si128(b0, m),
+					      _mm_and_si128(b1, m));
+			uv = _mm_packus_epi16(_mm_srli_epi16(a0, 8),
+					      _mm_srli_epi16(a1, 8));
+		}
+
+		_mm_storeu_si128((__m128i *)&y0[x], ya);
+		_mm_storeu_si128((__m128i *)&y1[x], yb);
+		_mm_storel_epi64((__m128i *)&u[x/2],
+				 _mm_packus_epi16(_mm_and_si128(uv, m), z));
+		_mm_storel_epi64((__m128i *)&v[x/2],
+				 _mm_packus_epi16(_mm_srli_epi16(uv, 8), z));
+	}
+#endif
+
+	for (; x < width; x += 2) {
+
+		y0[x]   = s0[2*x + yo];
+		y0[x+1] = s0[2*x + yo + 2];
+		y1[x]   = s1[2*x + yo];
+		y1[x+1] = s1[2*x + yo + 2];
+
+		u[x/2] = s0[2*x + co];
+		v[x/2] = s0[2*x + co + 2];
+	}
+}
+
+
+static void yuyv422_to_yuv420p(uint8_t *dd[3], const uint16_t *lsd,
+			       const uint8_t *ds[3], const uint16_t *lss,
+			       unsigned width)
+{
+	packed422_to_yuv420p(dd, lsd, ds, lss, width, 0);
+}
+
+
+static void uyvy422_to_yuv420p(uint8_t *dd[3], const uint16_t *lsd,
+			       const uint8_t *ds[3], const uint16_t *lss,
+			       unsigned width)
+{
+	packed422_to_yuv420p(dd, lsd, ds, lss, width, 1);
+}
+
+
+static void nv12_to_yuv420p(uint8_t *dd[3], const uint16_t *lsd,
+			    const uint8_t *ds[3], const uint16_t *lss,
+			    unsigned width)
+{
+	const uint8_t *s = ds[1];
+	uint8_t *u = dd[1], *v = dd[2];
+	unsigned x = 0;
+
+	memcpy(dd[0],          ds[0],          width);
+	memcpy(dd[0] + lsd[0], ds[0] + lss[0], width);
+
+	/* x counts chroma samples */
+	width /= 2;
+
+#if defined (HAVE_NEON)
+	for (; x + 16 <= width; x += 16) {
+
+		uint8x16x2_t uv = vld2q_u8(&s[2*x]);
+
+		vst1q_u8(&u[x], uv.val[0]);
+		vst1q_u8(&v[x], uv.val[1]);
+	}
+#elif defined (__SSE2__)
+	{
+		const __m128i m = _mm_set1_epi16(0x00ff);
+
+		for (; x + 16 <= width; x += 16) {
+
+			__m128i a = _mm_loadu_si128((const __m128i *)&s[2*x]);
+			__m128i b = _mm_loadu_si128((const __m128i *)
+						    &s[2*x + 16]);
+
+			_mm_storeu_si128((__m128i *)&u[x],
+					 _mm_packus_epi16(_mm_and_si128(a, m),
+							  _mm_and_si128(b, m)));
+			_mm_storeu_si128((__m128i *)&v[x],
+					 _mm_packus_epi16(_mm_srli_epi16(a, 8),
+							  _mm_srli_epi16(b, 8)));
+		}
+	}
+#endif
+
+	for (; x < width; x++) {
+		u[x] = s[2*x];
+		v[x] = s[2*x + 1];
+	}
+}
+
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+static void rgb32_to_yuv420p(uint8_t *dd[3], const uint16_t *lsd,
+			     const uint8_t *ds[3], const uint16_t *lss,
+			     unsigned width)
+{
+	const uint8_t *s0 = ds[0], *s1 = ds[0] + lss[0];
+	uint8_t *y0 = dd[0], *y1 = dd[0] + lsd[0];
+	uint8_t *u = dd[1], *v = dd[2];
+	unsigned x = 0;
+
+#if defined (HAVE_NEON)
+	for (; x + 8 <= width; x += 8) {
+
+		uint8x8x4_t a = vld4_u8(&s0[4*x]);
+		uint8x8x4_t b = vld4_u8(&s1[4*x]);
+		int16x8_t r, g, bl, cu, cv;
+		uint16x8_t t;
+		uint8_t tmp[8];
+
+		t = vmull_u8(a.val[2], vdup_n_u8(66));
+		t = vmlal_u8(t, a.val[1], vdup_n_u8(129));
+		t = vmlal_u8(t, a.val[0], vdup_n_u8(25));
+		t = vaddq_u16(t, vdupq_n_u16(128));
+		vst1_u8(&y0[x], vadd_u8(vshrn_n_u16(t, 8), vdup_n_u8(16)));
+
+		t = vmull_u8(b.val[2], vdup_n_u8(66));
+		t = vmlal_u8(t, b.val[1], vdup_n_u8(129));
+		t = vmlal_u8(t, b.val[0], vdup_n_u8(25));
+		t = vaddq_u16(t, vdupq_n_u16(128));
+		vst1_u8(&y1[x], vadd_u8(vshrn_n_u16(t, 8), vdup_n_u8(16)));
+
+		r  = vreinterpretq_s16_u16(vmovl_u8(a.val[2]));
+		g  = vreinterpretq_s16_u16(vmovl_u8(a.val[1]));
+		bl = vreinterpretq_s16_u16(vmovl_u8(a.val[0]));
+
+		cu = vmulq_n_s16(bl, 112);
+		cu = vmlsq_n_s16(cu, r, 38);
+		cu = vmlsq_n_s16(cu, g, 74);
+		cu = vshrq_n_s16(vaddq_s16(cu, vdupq_n_s16(128)), 8);
+
+		cv = vmulq_n_s16(r, 112);
+		cv = vmlsq_n_s16(cv, g, 94);
+		cv = vmlsq_n_s16(cv, bl, 18);
+		cv = vshrq_n_s16(vaddq_s16(cv, vdupq_n_s16(128)), 8);
+
+		/* chroma from the even pixels of the top line */
+		vst1_u8(tmp, vuzp_u8(vmovn_u16(vreinterpretq_u16_s16(
+				     vaddq_s16(cu, vdupq_n_s16(128)))),
+				     vmovn_u16(vreinterpretq_u16_s16(
+				     vaddq_s16(cv, vdupq_n_s16(128))))).val[0]);
+		memcpy(&u[x/2], tmp,     4);
+		memcpy(&v[x/2], tmp + 4, 4);
+	}
+#elif defined (__SSE2__)
+	const __m128i ff  = _mm_set1_epi32(0xff);
+	const __m128i lo  = _mm_set1_epi32(0xffff);
+	const __m128i c16 = _mm_set1_epi16(16);
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i z   = _mm_setzero_si128();
+
+	for (; x + 8 <= width; x += 8) {
+
+		int k;
+
+		for (k=0; k<2; k++) {
+
+			const uint8_t *s = k ? s1 : s0;
+			__m128i a = _mm_loadu_si128((const __m128i *)&s[4*x]);
+			__m128i b = _mm_loadu_si128((const __m128i *)
+						    &s[4*x + 16]);
+			__m128i bl, g, r, y, cu, cv;
+			int32_t c;
+
+			bl = _mm_packs_epi32(_mm_and_si128(a, ff),
+					     _mm_and_si128(b, ff));
+			g  = _mm_packs_epi32(
+				_mm_and_si128(_mm_srli_epi32(a, 8), ff),
+				_mm_and_si128(_mm_srli_epi32(b, 8), ff));
+			r  = _mm_packs_epi32(
+				_mm_and_si128(_mm_srli_epi32(a, 16), ff),
+				_mm_and_si128(_mm_srli_epi32(b, 16), ff));
+
+			y = _mm_add_epi16(
+				_mm_add_epi16(
+				    _mm_mullo_epi16(r, _mm_set1_epi16(66)),
+				    _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+				_mm_add_epi16(
+				    _mm_mullo_epi16(bl, _mm_set1_epi16(25)),
+				    c128));
+			y = _mm_add_epi16(_mm_srli_epi16(y, 8), c16);
+
+			_mm_storel_epi64((__m128i *)(k ? &y1[x] : &y0[x]),
+					 _mm_packus_epi16(y, z));
+
+			if (k)
+				break;
+
+			cu = _mm_sub_epi16(
+				_mm_mullo_epi16(bl, _mm_set1_epi16(112)),
+				_mm_add_epi16(
+				    _mm_mullo_epi16(r, _mm_set1_epi16(38)),
+				    _mm_mullo_epi16(g, _mm_set1_epi16(74))));
+			cv = _mm_sub_epi16(
+				_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+				_mm_add_epi16(
+				    _mm_mullo_epi16(g, _mm_set1_epi16(94)),
+				    _mm_mullo_epi16(bl, _mm_set1_epi16(18))));
+
+			cu = _mm_add_epi16(_mm_srai_epi16(
+					 _mm_add_epi16(cu, c128), 8), c128);
+			cv = _mm_add_epi16(_mm_srai_epi16(
+					 _mm_add_epi16(cv, c128), 8), c128);
+
+			/* chroma from the even pixels of the top line */
+			cu = _mm_packs_epi32(_mm_and_si128(cu, lo), z);
+			cv = _mm_packs_epi32(_mm_and_si128(cv, lo), z);
+
+			c = _mm_cvtsi128_si32(_mm_packus_epi16(cu, z));
+			memcpy(&u[x/2], &c, 4);
+			c = _mm_cvtsi128_si32(_mm_packus_epi16(cv, z));
+			memcpy(&v[x/2], &c, 4);
+		}
+	}
+#endif
+
+	for (; x < width; x += 2) {
+
+		const uint32_t x0 = rd32(&s0[4*x]);
+		const uint32_t x1 = rd32(&s0[4*x + 4]);
+		const uint32_t x2 = rd32(&s1[4*x]);
+		const uint32_t x3 = rd32(&s1[4*x + 4]);
+
+		y0[x]   = rgb2y(x0 >> 16, x0 >> 8, x0);
+		y0[x+1] = rgb2y(x1 >> 16, x1 >> 8, x1);
+		y1[x]   = rgb2y(x2 >> 16, x2 >> 8, x2);
+		y1[x+1] = rgb2y(x3 >> 16, x3 >> 8, x3);
+
+		u[x/2] = rgb2u(x0 >> 16, x0 >> 8, x0);
+		v[x/2] = rgb2v(x0 >> 16, x0 >> 8, x0);
+	}
+}
+
+
+enum rgb_out {
+	OUT_RGB32,
+	OUT_RGB565,
+	OUT_RGB555,
+};
+
+
+static inline void yuv420p_to_rgb(uint8_t *dd[3], const uint16_t *lsd,
+				  const uint8_t *ds[3], const uint16_t *lss,
+				  unsigned width, const enum rgb_out out)
+{
+	const unsigned bpp = (out == OUT_RGB32) ? 4 : 2;
+	const uint8_t *su = ds[1], *sv = ds[2];
+	unsigned x = 0;
+	int k;
+
+#if defined (HAVE_NEON)
+	if (out != OUT_RGB555) {
+
+		for (; x + 16 <= width; x += 16) {
+
+			int16x8_t u = vreinterpretq_s16_u16(
+				vmovl_u8(vld1_u8(&su[x/2])));
+			int16x8_t v = vreinterpretq_s16_u16(
+				vmovl_u8(vld1_u8(&sv[x/2])));
+			int16x8x2_t ruv, guv, buv;
+
+			u = vshlq_n_s16(vsubq_s16(u, vdupq_n_s16(128)), 1);
+			v = vshlq_n_s16(vsubq_s16(v, vdupq_n_s16(128)), 1);
+
+			ruv = vzipq_s16(vqdmulhq_n_s16(v, COEF_RV),
+					vqdmulhq_n_s16(v, COEF_RV));
+			buv = vzipq_s16(vqdmulhq_n_s16(u, COEF_BU),
+					vqdmulhq_n_s16(u, COEF_BU));
+			guv.val[0] = vaddq_s16(vqdmulhq_n_s16(v, COEF_GV),
+					       vqdmulhq_n_s16(u, COEF_GU));
+			guv = vzipq_s16(guv.val[0], guv.val[0]);
+
+			for (k=0; k<2; k++) {
+
+				const uint8x16_t y8 = vld1q_u8(&ds[0][k*lss[0]
+								      + x]);
+				const int16x8_t yl = vreinterpretq_s16_u16(
+					vmovl_u8(vget_low_u8(y8)));
+				const int16x8_t yh = vreinterpretq_s16_u16(
+					vmovl_u8(vget_high_u8(y8)));
+				uint8_t *d = &dd[0][k*lsd[0] + x*bpp];
+				uint8x16x4_t p;
+
+				p.val[2] = vcombine_u8(
+					vqmovun_s16(vaddq_s16(yl, ruv.val[0])),
+					vqmovun_s16(vaddq_s16(yh, ruv.val[1])));
+				p.val[1] = vcombine_u8(
+					vqmovun_s16(vaddq_s16(yl, guv.val[0])),
+					vqmovun_s16(vaddq_s16(yh, guv.val[1])));
+				p.val[0] = vcombine_u8(
+					vqmovun_s16(vaddq_s16(yl, buv.val[0])),
+					vqmovun_s16(vaddq_s16(yh, buv.val[1])));
+				p.val[3] = vdupq_n_u8(0);
+
+				if (out == OUT_RGB32) {
+					vst4q_u8(d, p);
+				}
+				else {
+					uint16x8_t lo, hi;
+
+					lo = vshll_n_u8(vget_low_u8(p.val[2]),
+							8);
+					lo = vsriq_n_u16(lo, vshll_n_u8(
+						vget_low_u8(p.val[1]), 8), 5);
+					lo = vsriq_n_u16(lo, vshll_n_u8(
+						vget_low_u8(p.val[0]), 8), 11);
+					hi = vshll_n_u8(vget_high_u8(p.val[2]),
+							8);
+					hi = vsriq_n_u16(hi, vshll_n_u8(
+						vget_high_u8(p.val[1]), 8), 5);
+					hi = vsriq_n_u16(hi, vshll_n_u8(
+						vget_high_u8(p.val[0]), 8), 11);
+
+					vst1q_u8(d,      vreinterpretq_u8_u16(lo));
+					vst1q_u8(d + 16, vreinterpretq_u8_u16(hi));
+				}
+			}
+		}
+	}
+#elif defined (__SSE2__)
+	if (out != OUT_RGB555) {
+
+		const __m128i z    = _mm_setzero_si128();
+		const __m128i c128 = _mm_set1_epi16(128);
+
+		for (; x + 16 <= width; x += 16) {
+
+			__m128i u, v, ruv, guv, buv;
+			__m128i rl, rh, gl, gh, bl, bh;
+
+			u = _mm_loadl_epi64((const __m128i *)&su[x/2]);
+			v = _mm_loadl_epi64((const __m128i *)&sv[x/2]);
+			u = _mm_slli_epi16(_mm_sub_epi16(
+				_mm_unpacklo_epi8(u, z), c128), 2);
+			v = _mm_slli_epi16(_mm_sub_epi16(
+				_mm_unpacklo_epi8(v, z), c128), 2);
+
+			ruv = _mm_mulhi_epi16(v, _mm_set1_epi16(COEF_RV));
+			guv = _mm_add_epi16(
+				_mm_mulhi_epi16(v, _mm_set1_epi16(COEF_GV)),
+				_mm_mulhi_epi16(u, _mm_set1_epi16(COEF_GU)));
+			buv = _mm_mulhi_epi16(u, _mm_set1_epi16(COEF_BU));
+
+			rl = _mm_unpacklo_epi16(ruv, ruv);
+			rh = _mm_unpackhi_epi16(ruv, ruv);
+			gl = _mm_unpacklo_epi16(guv, guv);
+			gh = _mm_unpackhi_epi16(guv, guv);
+			bl = _mm_unpacklo_epi16(buv, buv);
+			bh = _mm_unpackhi_epi16(buv, buv);
+
+			for (k=0; k<2; k++) {
+
+				const __m128i y8 = _mm_loadu_si128(
+					(const __m128i *)&ds[0][k*lss[0] + x]);
+				const __m128i yl = _mm_unpacklo_epi8(y8, z);
+				const __m128i yh = _mm_unpackhi_epi8(y8, z);
+				__m128i *d = (__m128i *)(void *)
+					&dd[0][k*lsd[0] + x*bpp];
+				__m128i r, g, b;
+
+				r = _mm_packus_epi16(_mm_add_epi16(yl, rl),
+						     _mm_add_epi16(yh, rh));
+				g = _mm_packus_epi16(_mm_add_epi16(yl, gl),
+						     _mm_add_epi16(yh, gh));
+				b = _mm_packus_epi16(_mm_add_epi16(yl, bl),
+						     _mm_add_epi16(yh, bh));
+
+				if (out == OUT_RGB32) {
+					const __m128i bgl =
+						_mm_unpacklo_epi8(b, g);
+					const __m128i bgh =
+						_mm_unpackhi_epi8(b, g);
+					const __m128i r0l =
+						_mm_unpacklo_epi8(r, z);
+					const __m128i r0h =
+						_mm_unpackhi_epi8(r, z);
+
+					_mm_storeu_si128(d,
+						 _mm_unpacklo_epi16(bgl, r0l));
+					_mm_storeu_si128(d + 1,
+						 _mm_unpackhi_epi16(bgl, r0l));
+					_mm_storeu_si128(d + 2,
+						 _mm_unpacklo_epi16(bgh, r0h));
+					_mm_storeu_si128(d + 3,
+						 _mm_unpackhi_epi16(bgh, r0h));
+				}
+				else {
+					const __m128i mr = _mm_set1_epi16(0xf8);
+					const __m128i mg = _mm_set1_epi16(0xfc);
+					__m128i p[2];
+					int i;
+
+					for (i=0; i<2; i++) {
+
+						__m128i r16, g16, b16;
+
+						r16 = i ? _mm_unpackhi_epi8(r, z)
+							: _mm_unpacklo_epi8(r, z);
+						g16 = i ? _mm_unpackhi_epi8(g, z)
+							: _mm_unpacklo_epi8(g, z);
+						b16 = i ? _mm_unpackhi_epi8(b, z)
+							: _mm_unpacklo_epi8(b, z);
+
+						p[i] = _mm_or_si128(
+						  _mm_or_si128(
+						    _mm_slli_epi16(
+						      _mm_and_si128(r16, mr), 8),
+						    _mm_slli_epi16(
+						      _mm_and_si128(g16, mg), 3)),
+						  _mm_srli_epi16(b16, 3));
+					}
+
+					_mm_storeu_si128(d,     p[0]);
+					_mm_storeu_si128(d + 1, p[1]);
+				}
+			}
+		}
+	}
+#endif
+
+	for (; x < width; x += 2) {
+
+		int ruv, guv, buv;
+
+		chroma(su[x/2], sv[x/2], &ruv, &guv, &buv);
+
+		for (k=0; k<2; k++) {
+
+			const uint8_t *sy = &ds[0][k*lss[0] + x];
+			uint8_t *d = &dd[0][k*lsd[0] + x*bpp];
+
+			switch (out) {
+
+			case OUT_RGB32:
+				yuv2rgb(d,     sy[0], ruv, guv, buv);
+				yuv2rgb(d + 4, sy[1], ruv, guv, buv);
+				break;
+
+			case OUT_RGB565:
+				yuv2rgb565(d,     sy[0], ruv, guv, buv);
+				yuv2rgb565(d + 2, sy[1], ruv, guv, buv);
+				break;
+
+			case OUT_RGB555:
+				yuv2rgb555(d,     sy[0], ruv, guv, buv);
+				yuv2rgb555(d + 2, sy[1], ruv, guv, buv);
+				break;
+			}
+		}
+	}
+}
+
+
+static void yuv420p_to_rgb32(uint8_t *dd[3], const uint16_t *lsd,
+			     const uint8_t *ds[3], const uint16_t *lss,
+			     unsigned width)
+{
+	yuv420p_to_rgb(dd, lsd, ds, lss, width, OUT_RGB32);
+}
+
+
+static void yuv420p_to_rgb565(uint8_t *dd[3], const uint16_t *lsd,
+			      const uint8_t *ds[3], const uint16_t *lss,
+			      unsigned width)
+{
+	yuv420p_to_rgb(dd, lsd, ds, lss, width, OUT_RGB565);
+}
+
+
+static void yuv420p_to_rgb555(uint8_t *dd[3], const uint16_t *lsd,
+			      const uint8_t *ds[3], const uint16_t *lss,
+			      unsigned width)
+{
+	yuv420p_to_rgb(dd, lsd, ds, lss, width, OUT_RGB555);
+}
+
+
+/**
+ * Get the same-size line converter for a pair of pixel formats
+ *
+ * @param src Source pixel format
+ * @param dst Destination pixel format
+ *
+ * @return Line converter, or NULL if not supported
+ */
+vidconv_fast_h *vidconv_fast_get(enum vidfmt src, enum vidfmt dst)
+{
+	if (src == VID_FMT_YUV420P) {
+
+		switch (dst) {
+
+		case VID_FMT_YUV420P: return yuv420p_to_yuv420p;
+		case VID_FMT_RGB32:   return yuv420p_to_rgb32;
+		case VID_FMT_RGB565:  return yuv420p_to_rgb565;
+		case VID_FMT_RGB555:  return yuv420p_to_rgb555;
+		default:              return NULL;
+		}
+	}
+
+	if (dst != VID_FMT_YUV420P)
+		return NULL;
+
+	switch (src) {
+
+	case VID_FMT_YUYV422: return yuyv422_to_yuv420p;
+	case VID_FMT_UYVY422: return uyvy422_to_yuv420p;
+	case VID_FMT_RGB32:   return rgb32_to_yuv420p;
+	case VID_FMT_ARGB:    return rgb32_to_yuv420p;
+	case VID_FMT_NV12:    return nv12_to_yuv420p;
+	default:              return NULL;
+	}
+}
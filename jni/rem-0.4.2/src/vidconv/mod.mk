@@ -5,3 +5,6 @@
 #
 
 SRCS	+= vidconv/vconv.c
+SRCS	+= vidconv/fast.c
+SRCS	+= vidconv/pool.c
+SRCS	+= vidconv/scale.c
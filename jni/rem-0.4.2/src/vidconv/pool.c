@@ -0,0 +1,215 @@
+/**
+ * @file pool.c Video Conversion -- slice-parallel execution
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re.h>
+#include <rem_vid.h>
+#include <rem_dsp.h>
+#include <rem_vidconv.h>
+#include "vconv.h"
+
+
+/*
+ * A conversion is split into horizontal slices of line pairs. The
+ * calling thread converts one slice itself, and the worker threads take
+ * the others. Small frames are converted by the calling thread only.
+ */
+
+
+enum {
+	POOL_THREADS_MAX = 16,        /**< Maximum number of threads    */
+	POOL_MIN_PIXELS  = 640 * 480, /**< Smallest area to split       */
+};
+
+
+#ifdef HAVE_PTHREAD
+
+/** Defines a pool of video conversion threads */
+struct vidconv_pool {
+	pthread_t tidv[POOL_THREADS_MAX];  /**< Worker threads           */
+	unsigned n;                        /**< Number of worker threads */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_job;           /**< New job or stop          */
+	pthread_cond_t cond_done;          /**< All slices are done      */
+	const struct vidconv_job *job;     /**< Current job              */
+	unsigned slices;                   /**< Number of slices         */
+	unsigned next;                     /**< Next slice to take       */
+	unsigned pending;                  /**< Slices not yet done      */
+	uint32_t gen;                      /**< Job generation           */
+	bool stop;
+};
+
+
+static void run_slice(struct vidconv_pool *pool, unsigned k)
+{
+	const struct vidconv_job *job = pool->job;
+	const int pairs = job->r.h / 2;
+	const int y0 = 2 * (pairs * (int)k / (int)pool->slices);
+	const int y1 = 2 * (pairs * ((int)k+1) / (int)pool->slices);
+
+	vidconv_job_run(job, y0, y1);
+}
+
+
+/* Take and run slices until there are none left, pool must be locked */
+static void run_slices(struct vidconv_pool *pool)
+{
+	while (pool->next < pool->slices) {
+
+		const unsigned k = pool->next++;
+
+		pthread_mutex_unlock(&pool->mutex);
+		run_slice(pool, k);
+		pthread_mutex_lock(&pool->mutex);
+
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->cond_done);
+	}
+}
+
+
+static void *pool_thread(void *arg)
+{
+	struct vidconv_pool *pool = arg;
+	uint32_t gen = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for (;;) {
+
+		while (!pool->stop && pool->gen == gen)
+			pthread_cond_wait(&pool->cond_job, &pool->mutex);
+
+		if (pool->stop)
+			break;
+
+		gen = pool->gen;
+
+		run_slices(pool);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidconv_pool *pool = arg;
+	unsigned i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->cond_job);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i=0; i<pool->n; i++)
+		pthread_join(pool->tidv[i], NULL);
+
+	pthread_cond_destroy(&pool->cond_done);
+	pthread_cond_destroy(&pool->cond_job);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+#endif
+
+
+/**
+ * Allocate a pool of video conversion threads
+ *
+ * @param poolp    Pointer to allocated pool
+ * @param nthreads Number of threads, including the calling thread
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidconv_pool_alloc(struct vidconv_pool **poolp, unsigned nthreads)
+{
+#ifdef HAVE_PTHREAD
+	struct vidconv_pool *pool;
+	int err = 0;
+
+	if (!poolp || nthreads < 2 || nthreads > POOL_THREADS_MAX + 1)
+		return EINVAL;
+
+	pool = mem_zalloc(sizeof(*pool), destructor);
+	if (!pool)
+		return ENOMEM;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond_job, NULL);
+	pthread_cond_init(&pool->cond_done, NULL);
+
+	for (pool->n=0; pool->n<nthreads-1; pool->n++) {
+
+		err = pthread_create(&pool->tidv[pool->n], NULL,
+				     pool_thread, pool);
+		if (err)
+			break;
+	}
+
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+#else
+	(void)poolp;
+	(void)nthreads;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Same as vidconv(), but split the work over a pool of threads
+ *
+ * @param pool Conversion thread pool, NULL to use the calling thread only
+ * @param dst  Destination video frame
+ * @param src  Source video frame
+ * @param r    Drawing area in destination frame, NULL means whole frame
+ */
+void vidconv_pool(struct vidconv_pool *pool, struct vidframe *dst,
+		  const struct vidframe *src, struct vidrect *r)
+{
+	struct vidconv_job job;
+
+	if (!vidconv_job_init(&job, dst, src, r))
+		return;
+
+#ifdef HAVE_PTHREAD
+	if (pool && job.r.w * job.r.h >= POOL_MIN_PIXELS) {
+
+		pthread_mutex_lock(&pool->mutex);
+
+		pool->job     = &job;
+		pool->slices  = pool->n + 1;
+		pool->next    = 0;
+		pool->pending = pool->slices;
+		++pool->gen;
+
+		pthread_cond_broadcast(&pool->cond_job);
+
+		run_slices(pool);
+
+		while (pool->pending)
+			pthread_cond_wait(&pool->cond_done, &pool->mutex);
+
+		pool->job = NULL;
+
+		pthread_mutex_unlock(&pool->mutex);
+
+		return;
+	}
+#else
+	(void)pool;
+#endif
+
+	vidconv_job_run(&job, 0, job.r.h);
+}
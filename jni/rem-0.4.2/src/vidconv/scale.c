@@ -0,0 +1,488 @@
+/**
+ * @file scale.c Video Conversion -- scaler with precomputed tables
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <rem_vid.h>
+#include <rem_dsp.h>
+#include <rem_vidconv.h>
+#include "vconv.h"
+
+
+/*
+ * The scaler works on the planes of a YUV420P frame. Other formats are
+ * converted to or from YUV420P at the unscaled size, using the same-size
+ * fast path.
+ *
+ * Each axis of each plane has a table with the first source index and
+ * the Q14 weights of a fixed number of taps for every output index. The
+ * tables are built once per pair of source and destination sizes and are
+ * kept in the context. Scaling is separable: source lines are filtered
+ * horizontally into a small ring of 16-bit lines, which are then combined
+ * vertically. The first source index never decreases, so each source
+ * line is filtered at most once.
+ *
+ * Area averaging needs one tap per source pixel of an output pixel. An
+ * axis which is scaled down by more than MAX_TAPS - 1 falls back to
+ * nearest neighbour.
+ */
+
+
+enum {
+	W_SHIFT = 14,      /**< Weights are in Q14                  */
+	H_SHIFT = 6,       /**< Horizontal pass output is in Q8     */
+	V_SHIFT = W_SHIFT + W_SHIFT - H_SHIFT,
+	MAX_TAPS = 64,     /**< Maximum taps per output index       */
+};
+
+
+/** Filter table for one axis */
+struct scale_axis {
+	uint32_t *offv;    /**< First source index per output index */
+	uint16_t *wv;      /**< Weights, ntaps per output index     */
+	unsigned ntaps;    /**< Number of taps per output index     */
+	unsigned ns;       /**< Source size                         */
+	unsigned nd;       /**< Destination size                    */
+};
+
+/** Defines a video conversion context */
+struct vidconv_ctx {
+	enum vidconv_scale scale;     /**< Scaling mode                  */
+	struct vidconv_pool *pool;    /**< Optional conversion threads   */
+	struct vidsz ssz;             /**< Source size of the tables     */
+	struct vidsz dsz;             /**< Destination size of tables    */
+	struct scale_axis ax[2];      /**< Horizontal, luma and chroma   */
+	struct scale_axis ay[2];      /**< Vertical, luma and chroma     */
+	uint16_t *ring;               /**< Horizontally scaled lines     */
+	struct vidframe *sfr;         /**< Source converted to YUV420P   */
+	struct vidframe *dfr;         /**< Scaled YUV420P frame          */
+};
+
+
+static void axis_reset(struct scale_axis *ax)
+{
+	ax->offv = mem_deref(ax->offv);
+	ax->wv   = mem_deref(ax->wv);
+	ax->ntaps = ax->ns = ax->nd = 0;
+}
+
+
+static unsigned axis_taps(unsigned ns, unsigned nd, enum vidconv_scale scale)
+{
+	unsigned n;
+
+	if (scale == VIDCONV_NEAREST || ns == 1)
+		return 1;
+
+	if (scale == VIDCONV_AREA && ns > nd) {
+
+		n = (ns + nd - 1) / nd + 1;
+		if (n > MAX_TAPS)
+			return 1;
+	}
+	else
+		n = 2;
+
+	return min(n, ns);
+}
+
+
+/* Weights of one output index, with the first source index in *start */
+static unsigned axis_weights(double *wv, int *start, unsigned i,
+			     unsigned ns, unsigned nd,
+			     enum vidconv_scale scale)
+{
+	const double ratio = (double)ns / (double)nd;
+
+	if (scale == VIDCONV_AREA && ns > nd) {
+
+		const double a = i * ratio, b = (i + 1) * ratio;
+		int j = (int)a, n = 0;
+
+		*start = j;
+
+		for (; j < (int)ns && j < b; j++)
+			wv[n++] = (min(b, j + 1.0) - max(a, (double)j)) / ratio;
+
+		return n;
+	}
+	else {
+		double pos = (i + 0.5) * ratio - 0.5;
+		int j;
+
+		if (pos < 0)
+			pos = 0;
+		if (pos > ns - 1)
+			pos = ns - 1;
+
+		j = (int)pos;
+
+		*start = j;
+		wv[0] = 1.0 - (pos - j);
+		wv[1] = pos - j;
+
+		return 2;
+	}
+}
+
+
+static int axis_alloc(struct scale_axis *ax, unsigned ns, unsigned nd,
+		      enum vidconv_scale scale)
+{
+	double wv[MAX_TAPS];
+	unsigned i, k;
+
+	axis_reset(ax);
+
+	ax->ntaps = axis_taps(ns, nd, scale);
+	ax->ns    = ns;
+	ax->nd    = nd;
+
+	ax->offv = mem_alloc(nd * sizeof(*ax->offv), NULL);
+	ax->wv   = mem_zalloc(nd * ax->ntaps * sizeof(*ax->wv), NULL);
+	if (!ax->offv || !ax->wv)
+		return ENOMEM;
+
+	for (i=0; i<nd; i++) {
+
+		uint16_t *w = &ax->wv[i * ax->ntaps];
+		unsigned n, kmax = 0;
+		int start, off, sum = 0;
+
+		if (ax->ntaps == 1) {
+			ax->offv[i] = min((2*i + 1) * ns / (2*nd), ns - 1);
+			w[0] = 1 << W_SHIFT;
+			continue;
+		}
+
+		n = axis_weights(wv, &start, i, ns, nd, scale);
+
+		/* keep all taps inside the source */
+		off = min(start, (int)(ns - ax->ntaps));
+
+		for (k=0; k<n; k++) {
+
+			const unsigned t = start - off + k;
+
+			if (t >= ax->ntaps)
+				break;
+
+			w[t] = (uint16_t)lrint(wv[k] * (1 << W_SHIFT));
+			sum += w[t];
+
+			if (w[t] > w[kmax])
+				kmax = t;
+		}
+
+		/* weights must add up to exactly one */
+		w[kmax] += (1 << W_SHIFT) - sum;
+
+		ax->offv[i] = off;
+	}
+
+	return 0;
+}
+
+
+static void scale_line(uint16_t *dst, const uint8_t *src,
+		       const struct scale_axis *ax)
+{
+	const unsigned ntaps = ax->ntaps;
+	const uint16_t *w = ax->wv;
+	unsigned x, k;
+
+	for (x=0; x<ax->nd; x++, w += ntaps) {
+
+		const uint8_t *s = &src[ax->offv[x]];
+		uint32_t acc = 1 << (H_SHIFT - 1);
+
+		for (k=0; k<ntaps; k++)
+			acc += (uint32_t)w[k] * s[k];
+
+		dst[x] = (uint16_t)(acc >> H_SHIFT);
+	}
+}
+
+
+static void scale_plane(uint16_t *ring, uint8_t *dst, unsigned lsd,
+			const uint8_t *src, unsigned lss,
+			const struct scale_axis *ax,
+			const struct scale_axis *ay)
+{
+	const unsigned nd = ax->nd, ntaps = ay->ntaps;
+	const uint16_t *w = ay->wv;
+	int next = 0;
+	unsigned y, x, k;
+
+	/* nearest neighbour, no filtering */
+	if (ax->ntaps == 1 && ay->ntaps == 1) {
+
+		for (y=0; y<ay->nd; y++, dst += lsd) {
+
+			const uint8_t *s = &src[ay->offv[y] * lss];
+
+			for (x=0; x<nd; x++)
+				dst[x] = s[ax->offv[x]];
+		}
+
+		return;
+	}
+
+	for (y=0; y<ay->nd; y++, dst += lsd, w += ntaps) {
+
+		const int off = ay->offv[y];
+		const uint16_t *rowv[64];
+
+		/* filter the source lines which are new in the window */
+		for (next = max(next, off); next < off + (int)ntaps; next++) {
+			scale_line(&ring[(next % ntaps) * nd],
+				   &src[next * lss], ax);
+		}
+
+		for (k=0; k<ntaps; k++)
+			rowv[k] = &ring[((off + k) % ntaps) * nd];
+
+		for (x=0; x<nd; x++) {
+
+			uint32_t acc = 1 << (V_SHIFT - 1);
+
+			for (k=0; k<ntaps; k++)
+				acc += (uint32_t)w[k] * rowv[k][x];
+
+			dst[x] = saturate_u8(acc >> V_SHIFT);
+		}
+	}
+}
+
+
+static int tables_update(struct vidconv_ctx *ctx, const struct vidsz *ssz,
+			 const struct vidsz *dsz)
+{
+	const unsigned scw = (ssz->w + 1) / 2, sch = (ssz->h + 1) / 2;
+	size_t ringsz;
+	int err;
+
+	if (vidsz_cmp(&ctx->ssz, ssz) && vidsz_cmp(&ctx->dsz, dsz))
+		return 0;
+
+	memset(&ctx->ssz, 0, sizeof(ctx->ssz));
+	memset(&ctx->dsz, 0, sizeof(ctx->dsz));
+
+	err  = axis_alloc(&ctx->ax[0], ssz->w, dsz->w,   ctx->scale);
+	err |= axis_alloc(&ctx->ay[0], ssz->h, dsz->h,   ctx->scale);
+	err |= axis_alloc(&ctx->ax[1], scw,    dsz->w/2, ctx->scale);
+	err |= axis_alloc(&ctx->ay[1], sch,    dsz->h/2, ctx->scale);
+	if (err)
+		return err;
+
+	ringsz = max(ctx->ay[0].ntaps, ctx->ay[1].ntaps) * dsz->w;
+	ringsz *= sizeof(*ctx->ring);
+
+	ctx->ring = mem_deref(ctx->ring);
+	ctx->ring = mem_alloc(ringsz, NULL);
+	if (!ctx->ring)
+		return ENOMEM;
+
+	ctx->ssz = *ssz;
+	ctx->dsz = *dsz;
+
+	return 0;
+}
+
+
+static int frame_get(struct vidframe **vfp, const struct vidsz *sz)
+{
+	if (*vfp && vidsz_cmp(&(*vfp)->size, sz))
+		return 0;
+
+	*vfp = mem_deref(*vfp);
+
+	return vidframe_alloc(vfp, VID_FMT_YUV420P, sz);
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidconv_ctx *ctx = arg;
+	int i;
+
+	for (i=0; i<2; i++) {
+		axis_reset(&ctx->ax[i]);
+		axis_reset(&ctx->ay[i]);
+	}
+
+	mem_deref(ctx->ring);
+	mem_deref(ctx->sfr);
+	mem_deref(ctx->dfr);
+	mem_deref(ctx->pool);
+}
+
+
+/**
+ * Allocate a video conversion context, which keeps the scaling tables
+ * and intermediate frames between calls
+ *
+ * @param ctxp  Pointer to allocated context
+ * @param scale Scaling mode
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidconv_ctx_alloc(struct vidconv_ctx **ctxp, enum vidconv_scale scale)
+{
+	struct vidconv_ctx *ctx;
+
+	if (!ctxp)
+		return EINVAL;
+
+	ctx = mem_zalloc(sizeof(*ctx), destructor);
+	if (!ctx)
+		return ENOMEM;
+
+	ctx->scale = scale;
+
+	*ctxp = ctx;
+
+	return 0;
+}
+
+
+/**
+ * Set the thread pool used for the pixel format conversions
+ *
+ * @param ctx  Video conversion context
+ * @param pool Conversion thread pool, NULL for none
+ */
+void vidconv_ctx_set_pool(struct vidconv_ctx *ctx, struct vidconv_pool *pool)
+{
+	if (!ctx)
+		return;
+
+	mem_deref(ctx->pool);
+	ctx->pool = mem_ref(pool);
+}
+
+
+/**
+ * Convert and scale a video frame, using a conversion context
+ *
+ * @param ctx  Video conversion context
+ * @param dst  Destination video frame
+ * @param src  Source video frame
+ * @param r    Drawing area in destination frame, NULL means whole frame
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidconv_ctx(struct vidconv_ctx *ctx, struct vidframe *dst,
+		const struct vidframe *src, struct vidrect *r)
+{
+	const struct vidframe *s = src;
+	struct vidframe *d;
+	struct vidrect rect;
+	struct vidsz dsz;
+	uint8_t *dpv[3];
+	unsigned dlsv[3];
+	int i, err;
+
+	if (!ctx || !vidframe_isvalid(dst) || !vidframe_isvalid(src))
+		return EINVAL;
+
+	if (!vidconv_rect(&rect, dst, r))
+		return EINVAL;
+
+	dsz.w = rect.w;
+	dsz.h = rect.h;
+
+	if (!dsz.w || !dsz.h)
+		return 0;
+
+	/* no scaling needed */
+	if (vidsz_cmp(&src->size, &dsz)) {
+		vidconv_pool(ctx->pool, dst, src, &rect);
+		return 0;
+	}
+
+	if (src->fmt != VID_FMT_YUV420P) {
+
+		err = frame_get(&ctx->sfr, &src->size);
+		if (err)
+			return err;
+
+		vidconv_pool(ctx->pool, ctx->sfr, src, NULL);
+		s = ctx->sfr;
+	}
+
+	err = tables_update(ctx, &s->size, &dsz);
+	if (err)
+		return err;
+
+	if (dst->fmt == VID_FMT_YUV420P) {
+
+		d = dst;
+
+		dpv[0] = d->data[0] + rect.y * d->linesize[0] + rect.x;
+		dpv[1] = d->data[1] + rect.y/2 * d->linesize[1] + rect.x/2;
+		dpv[2] = d->data[2] + rect.y/2 * d->linesize[2] + rect.x/2;
+	}
+	else {
+		err = frame_get(&ctx->dfr, &dsz);
+		if (err)
+			return err;
+
+		d = ctx->dfr;
+
+		for (i=0; i<3; i++)
+			dpv[i] = d->data[i];
+	}
+
+	for (i=0; i<3; i++)
+		dlsv[i] = d->linesize[i];
+
+	for (i=0; i<3; i++) {
+
+		const int c = i ? 1 : 0;
+
+		scale_plane(ctx->ring, dpv[i], dlsv[i],
+			    s->data[i], s->linesize[i],
+			    &ctx->ax[c], &ctx->ay[c]);
+	}
+
+	if (d != dst)
+		vidconv_pool(ctx->pool, dst, d, &rect);
+
+	return 0;
+}
+
+
+/**
+ * Convert and scale a video frame with a given scaling mode
+ *
+ * @param dst   Destination video frame
+ * @param src   Source video frame
+ * @param r     Drawing area in destination frame, NULL means whole frame
+ * @param scale Scaling mode
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note The scaling tables are built for each call, use a conversion
+ *       context for repeated conversions
+ */
+int vidconv_scale(struct vidframe *dst, const struct vidframe *src,
+		  struct vidrect *r, enum vidconv_scale scale)
+{
+	struct vidconv_ctx *ctx;
+	int err;
+
+	err = vidconv_ctx_alloc(&ctx, scale);
+	if (err)
+		return err;
+
+	err = vidconv_ctx(ctx, dst, src, r);
+
+	mem_deref(ctx);
+
+	return err;
+}
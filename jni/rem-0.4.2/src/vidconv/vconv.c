@@ -9,6 +9,7 @@
 #include <rem_vid.h>
 #include <rem_dsp.h>
 #include <rem_vidconv.h>
+#include "vconv.h"
 
 
 #if 0
@@ -17,12 +18,7 @@
  * The lookup tables are generated with the following code:
  */
 
-#define P 14
-
-#define COEF_RV ((int32_t) (1.370705f * (float)(1 << P)))
-#define COEF_GU ((int32_t) (-0.337633f * (float)(1 << P)))
-#define COEF_GV ((int32_t) (-0.698001f * (float)(1 << P)))
-#define COEF_BU ((int32_t) (1.732446f * (float)(1 << P)))
+#define P VIDCONV_P
 
 #define ERV(a) (COEF_RV * ((a) - 128))
 #define EGU(a) (COEF_GU * ((a) - 128))
@@ -147,47 +143,6 @@ static const int16_t CBU[256] = {
 	 214, 216, 218, 220};
 
 
-static inline void yuv2rgb(uint8_t *rgb, uint8_t y, int ruv, int guv, int buv)
-{
-	*rgb++ = saturate_u8(y + buv);
-	*rgb++ = saturate_u8(y + guv);
-	*rgb++ = saturate_u8(y + ruv);
-	*rgb   = 0;
-}
-
-
-static inline void yuv2rgb565(uint8_t *rgb, uint8_t y,
-			      int ruv, int guv, int buv)
-{
-	int r = saturate_u8(y + ruv) >> 3;
-	int g = saturate_u8(y + guv) >> 2;
-	int b = saturate_u8(y + buv) >> 3;
-
-	rgb[1] = r << 3 | g >> 3;
-	rgb[0] = g << 5 | b;
-}
-
-
-static inline void yuv2rgb555(uint8_t *rgb, uint8_t y,
-			      int ruv, int guv, int buv)
-{
-	uint8_t r = saturate_u8(y + ruv) >> 3;
-	uint8_t g = saturate_u8(y + guv) >> 3;
-	uint8_t b = saturate_u8(y + buv) >> 3;
-
-	rgb[1] = r << 2 | g >> 3;
-	rgb[0] = g << 5 | b;
-}
-
-
-typedef void (line_h)(int xoffs, unsigned width, double rw,
-		      int yd, int ys, int ys2,
-		      uint8_t *dd0, uint8_t *dd1, uint8_t *dd2,
-		      int lsd,
-		      const uint8_t *sd0, const uint8_t *sd1,
-		      const uint8_t *sd2, int lss);
-
-
 static void yuv420p_to_yuv420p(int xoffs, unsigned width, double rw,
 			       int yd, int ys, int ys2,
 			       uint8_t *dd0, uint8_t *dd1, uint8_t *dd2,
@@ -489,11 +444,11 @@ static void nv12_to_yuv420p(int xoffs, unsigned width, double rw,
 		dd0[id + lsd]   = ds0[xs  + ys2*lss];
 		dd0[id+1 + lsd] = ds0[xs2 + ys2*lss];
 
-		id = xd/2    + yd*lsd/4;
-		is = ((xs>>1) + (ys>>1)*lss/2) & ~1;
+		id = xd/2       + yd*lsd/4;
+		is = (xs & ~1u) + (ys>>1)*lss;
 
-		dd1[id] = ds1[2*is];
-		dd2[id] = ds1[2*is+1];
+		dd1[id] = ds1[is];
+		dd2[id] = ds1[is+1];
 	}
 }
 
@@ -506,7 +461,7 @@ static void nv12_to_yuv420p(int xoffs, unsigned width, double rw,
  *
  * @note Index must be aligned to values in enum vidfmt
  */
-static line_h *conv_table[MAX_SRC][MAX_DST] = {
+static vidconv_line_h *conv_table[MAX_SRC][MAX_DST] = {
 
 /*
  * Dst:  YUV420P              YUYV422   UYVY422   RGB32
@@ -523,30 +478,88 @@ static line_h *conv_table[MAX_SRC][MAX_DST] = {
 };
 
 
+/* Plane pointers of a pixel position, chroma line for planar formats */
+static void plane_ptrs(uint8_t *p[3], const struct vidframe *f,
+		       unsigned x, unsigned y)
+{
+	p[0] = f->data[0] + y * f->linesize[0];
+	p[1] = NULL;
+	p[2] = NULL;
+
+	switch (f->fmt) {
+
+	case VID_FMT_YUV420P:
+		p[0] += x;
+		p[1] = f->data[1] + (y/2) * f->linesize[1] + x/2;
+		p[2] = f->data[2] + (y/2) * f->linesize[2] + x/2;
+		break;
+
+	case VID_FMT_NV12:
+		p[0] += x;
+		p[1] = f->data[1] + (y/2) * f->linesize[1] + x;
+		break;
+
+	case VID_FMT_RGB32:
+	case VID_FMT_ARGB:
+		p[0] += x * 4;
+		break;
+
+	default:
+		p[0] += x * 2;
+		break;
+	}
+}
+
+
+/*
+ * Align the drawing area to even pixels and check it against the bounds
+ * of the destination frame. A NULL area means the whole frame.
+ */
+bool vidconv_rect(struct vidrect *rect, const struct vidframe *dst,
+		  struct vidrect *r)
+{
+	if (r) {
+		r->x &= ~1;
+		r->y &= ~1;
+		r->w &= ~1;
+		r->h &= ~1;
+
+		if ((r->x + r->w) > dst->size.w ||
+		    (r->y + r->h) > dst->size.h) {
+			(void)re_printf("vidconv: out of bounds (%i x %i)\n",
+					dst->size.w, dst->size.h);
+			return false;
+		}
+
+		*rect = *r;
+	}
+	else {
+		rect->x = rect->y = 0;
+		rect->w = dst->size.w & ~1;
+		rect->h = dst->size.h & ~1;
+	}
+
+	return true;
+}
+
+
 /**
- * Convert a video frame from one pixel format to another pixel format
- *
- * Speed matches swscale: SWS_BILINEAR
- *
- * todo: optimize (check out SWS_FAST_BILINEAR)
+ * Prepare the conversion of a video frame
  *
+ * @param job  Conversion job to initialize
  * @param dst  Destination video frame
  * @param src  Source video frame
  * @param r    Drawing area in destination frame, NULL means whole frame
+ *
+ * @return True if there is something to convert, otherwise false
  */
-void vidconv(struct vidframe *dst, const struct vidframe *src,
-	     struct vidrect *r)
+bool vidconv_job_init(struct vidconv_job *job, struct vidframe *dst,
+		      const struct vidframe *src, struct vidrect *r)
 {
-	struct vidrect rdst;
-	unsigned yd, ys, ys2, lsd, lss;
-	int y;
-	const uint8_t *ds0, *ds1, *ds2;
-	uint8_t *dd0, *dd1, *dd2;
-	double rw, rh;
-	line_h *lineh = NULL;
+	vidconv_line_h *lineh = NULL;
 
 	if (!vidframe_isvalid(dst) || !vidframe_isvalid(src))
-		return;
+		return false;
 
 	if (src->fmt < MAX_SRC && dst->fmt < MAX_DST) {
 
@@ -557,31 +570,58 @@ void vidconv(struct vidframe *dst, const struct vidframe *src,
 		(void)re_printf("vidconv: no pixel converter found for"
 				" %s -> %s\n", vidfmt_name(src->fmt),
 				vidfmt_name(dst->fmt));
-		return;
+		return false;
 	}
 
-	if (r) {
-		r->x &= ~1;
-		r->y &= ~1;
-		r->w &= ~1;
-		r->h &= ~1;
+	if (!vidconv_rect(&job->r, dst, r))
+		return false;
 
-		if ((r->x + r->w) > dst->size.w ||
-		    (r->y + r->h) > dst->size.h) {
-			(void)re_printf("vidconv: out of bounds (%i x %i)\n",
-					dst->size.w, dst->size.h);
-			return;
+	job->dst   = dst;
+	job->src   = src;
+	job->lineh = lineh;
+	job->fasth = NULL;
+	job->rw    = (double)src->size.w / (double)job->r.w;
+	job->rh    = (double)src->size.h / (double)job->r.h;
+
+	/* no scaling, convert whole lines */
+	if (src->size.w == job->r.w && src->size.h == job->r.h)
+		job->fasth = vidconv_fast_get(src->fmt, dst->fmt);
+
+	return true;
+}
+
+
+/**
+ * Run a prepared conversion for a range of lines
+ *
+ * @param job Conversion job
+ * @param y0  First line in drawing area, must be even
+ * @param y1  End line in drawing area, must be even
+ */
+void vidconv_job_run(const struct vidconv_job *job, int y0, int y1)
+{
+	const struct vidframe *dst = job->dst, *src = job->src;
+	const struct vidrect *r = &job->r;
+	unsigned yd, ys, ys2, lsd, lss;
+	const uint8_t *ds0, *ds1, *ds2;
+	uint8_t *dd0, *dd1, *dd2;
+	int y;
+
+	if (job->fasth) {
+
+		for (y=y0; y<y1; y+=2) {
+
+			uint8_t *dd[3], *ds[3];
+
+			plane_ptrs(dd, dst, r->x, r->y + y);
+			plane_ptrs(ds, src, 0, y);
+
+			job->fasth(dd, dst->linesize, (const uint8_t **)ds,
+				   src->linesize, r->w);
 		}
-	}
-	else {
-		rdst.x = rdst.y = 0;
-		rdst.w = dst->size.w & ~1;
-		rdst.h = dst->size.h & ~1;
-		r = &rdst;
-	}
 
-	rw = (double)src->size.w / (double)r->w;
-	rh = (double)src->size.h / (double)r->h;
+		return;
+	}
 
 	lsd = dst->linesize[0];
 	lss = src->linesize[0];
@@ -594,20 +634,44 @@ void vidconv(struct vidframe *dst, const struct vidframe *src,
 	ds1 = src->data[1];
 	ds2 = src->data[2];
 
-	for (y=0; y<r->h; y+=2) {
+	for (y=y0; y<y1; y+=2) {
 
 		yd  = y + r->y;
 
-		ys  = (unsigned)(y * rh);
-		ys2 = (unsigned)((y+1) * rh);
+		ys  = (unsigned)(y * job->rh);
+		ys2 = (unsigned)((y+1) * job->rh);
 
-		lineh(r->x, r->w, rw, yd, ys, ys2,
-		      dd0, dd1, dd2, lsd,
-		      ds0, ds1, ds2, lss);
+		job->lineh(r->x, r->w, job->rw, yd, ys, ys2,
+			   dd0, dd1, dd2, lsd,
+			   ds0, ds1, ds2, lss);
 	}
 }
 
 
+/**
+ * Convert a video frame from one pixel format to another pixel format
+ *
+ * Speed matches swscale: SWS_BILINEAR
+ *
+ * If the source and the drawing area have the same size, whole lines are
+ * converted without any scaling math.
+ *
+ * @param dst  Destination video frame
+ * @param src  Source video frame
+ * @param r    Drawing area in destination frame, NULL means whole frame
+ */
+void vidconv(struct vidframe *dst, const struct vidframe *src,
+	     struct vidrect *r)
+{
+	struct vidconv_job job;
+
+	if (!vidconv_job_init(&job, dst, src, r))
+		return;
+
+	vidconv_job_run(&job, 0, job.r.h);
+}
+
+
 /**
  * Same as vidconv(), but maintain source aspect ratio within bounds of r
  *
@@ -0,0 +1,101 @@
+/**
+ * @file vconv.h  Video Conversion -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/*
+ * Color conversion, fixed point with 14 fractional bits
+ */
+
+#define VIDCONV_P 14
+
+#define COEF_RV ((int32_t) (1.370705f * (float)(1 << VIDCONV_P)))
+#define COEF_GU ((int32_t) (-0.337633f * (float)(1 << VIDCONV_P)))
+#define COEF_GV ((int32_t) (-0.698001f * (float)(1 << VIDCONV_P)))
+#define COEF_BU ((int32_t) (1.732446f * (float)(1 << VIDCONV_P)))
+
+
+static inline void yuv2rgb(uint8_t *rgb, uint8_t y, int ruv, int guv, int buv)
+{
+	*rgb++ = saturate_u8(y + buv);
+	*rgb++ = saturate_u8(y + guv);
+	*rgb++ = saturate_u8(y + ruv);
+	*rgb   = 0;
+}
+
+
+static inline void yuv2rgb565(uint8_t *rgb, uint8_t y,
+			      int ruv, int guv, int buv)
+{
+	int r = saturate_u8(y + ruv) >> 3;
+	int g = saturate_u8(y + guv) >> 2;
+	int b = saturate_u8(y + buv) >> 3;
+
+	rgb[1] = r << 3 | g >> 3;
+	rgb[0] = g << 5 | b;
+}
+
+
+static inline void yuv2rgb555(uint8_t *rgb, uint8_t y,
+			      int ruv, int guv, int buv)
+{
+	uint8_t r = saturate_u8(y + ruv) >> 3;
+	uint8_t g = saturate_u8(y + guv) >> 3;
+	uint8_t b = saturate_u8(y + buv) >> 3;
+
+	rgb[1] = r << 2 | g >> 3;
+	rgb[0] = g << 5 | b;
+}
+
+
+/*
+ * Scaling line converters
+ */
+
+typedef void (vidconv_line_h)(int xoffs, unsigned width, double rw,
+			      int yd, int ys, int ys2,
+			      uint8_t *dd0, uint8_t *dd1, uint8_t *dd2,
+			      int lsd,
+			      const uint8_t *sd0, const uint8_t *sd1,
+			      const uint8_t *sd2, int lss);
+
+
+/*
+ * Same-size line converters
+ *
+ * Converts one pair of lines when source and destination have the same
+ * size. The plane pointers point to the first pixel of the top line (and
+ * of the chroma line for planar formats), and the linesizes are the
+ * linesizes of the frames.
+ */
+
+typedef void (vidconv_fast_h)(uint8_t *dd[3], const uint16_t *lsd,
+			      const uint8_t *ds[3], const uint16_t *lss,
+			      unsigned width);
+
+vidconv_fast_h *vidconv_fast_get(enum vidfmt src, enum vidfmt dst);
+
+
+/*
+ * Conversion job
+ *
+ * A prepared conversion of a whole drawing area, which can be run in
+ * horizontal slices of line pairs.
+ */
+
+struct vidconv_job {
+	struct vidframe *dst;
+	const struct vidframe *src;
+	struct vidrect r;
+	vidconv_line_h *lineh;
+	vidconv_fast_h *fasth;
+	double rw, rh;
+};
+
+bool vidconv_rect(struct vidrect *rect, const struct vidframe *dst,
+		  struct vidrect *r);
+bool vidconv_job_init(struct vidconv_job *job, struct vidframe *dst,
+		      const struct vidframe *src, struct vidrect *r);
+void vidconv_job_run(const struct vidconv_job *job, int y0, int y1);
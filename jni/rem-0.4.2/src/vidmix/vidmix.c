@@ -15,6 +15,27 @@
 #include <rem_vidmix.h>
 
 
+/*
+ * Each output thread composes a layout of tiles, one per participant.
+ * The scaled tiles are cached in the participant which they show, keyed
+ * by the tile size. A tile is scaled only when the participant has put a
+ * new frame since, so the output threads which share a tile size also
+ * share the scaling work, and the rest is plane copies.
+ */
+
+
+enum {
+	TILE_CACHE_SIZE = 4,  /**< Cached tile sizes per participant */
+};
+
+/** A scaled copy of the received frame */
+struct vidmix_tile {
+	struct vidframe *frame;    /**< Scaled frame, NULL if unused   */
+	struct vidconv_ctx *ctx;   /**< Scaler for this tile size      */
+	uint64_t gen;              /**< Received frame it was made of  */
+	uint64_t used;             /**< Time of last use               */
+};
+
 struct vidmix {
 	pthread_rwlock_t rwlock;
 	struct list srcl;
@@ -27,6 +48,10 @@ struct vidmix_source {
 	pthread_mutex_t mutex;
 	struct vidframe *frame_tx;
 	struct vidframe *frame_rx;
+	pthread_mutex_t tile_mutex;
+	struct vidmix_tile tilev[TILE_CACHE_SIZE];
+	uint64_t rx_gen;
+	uint64_t n_scaled;
 	struct vidmix *mix;
 	vidmix_frame_h *fh;
 	void *arg;
@@ -36,6 +61,7 @@ struct vidmix_source {
 	bool selfview;
 	bool clear;
 	bool run;
+	bool initialized;
 };
 
 
@@ -73,6 +99,7 @@ static void destructor(void *arg)
 static void source_destructor(void *arg)
 {
 	struct vidmix_source *src = arg;
+	unsigned i;
 
 	if (src->run) {
 		src->run = false;
@@ -89,17 +116,141 @@ static void source_destructor(void *arg)
 	mem_deref(src->frame_tx);
 	mem_deref(src->frame_rx);
 	mem_deref(src->mix);
+
+	for (i=0; i<TILE_CACHE_SIZE; i++) {
+		mem_deref(src->tilev[i].frame);
+		mem_deref(src->tilev[i].ctx);
+	}
+
+	if (src->initialized) {
+		(void)pthread_mutex_destroy(&src->tile_mutex);
+		(void)pthread_mutex_destroy(&src->mutex);
+	}
+}
+
+
+/* Find the cached tile of this size, or the least recently used one */
+static struct vidmix_tile *tile_find(struct vidmix_source *src,
+				     const struct vidsz *sz)
+{
+	struct vidmix_tile *lru = &src->tilev[0];
+	unsigned i;
+
+	for (i=0; i<TILE_CACHE_SIZE; i++) {
+
+		struct vidmix_tile *tile = &src->tilev[i];
+
+		if (tile->frame && vidsz_cmp(&tile->frame->size, sz))
+			return tile;
+
+		if (!tile->frame || (lru->frame && tile->used < lru->used))
+			lru = tile;
+	}
+
+	return lru;
+}
+
+
+static int tile_update(struct vidmix_source *src, struct vidmix_tile *tile,
+		       const struct vidsz *sz)
+{
+	int err;
+
+	if (!tile->ctx) {
+		err = vidconv_ctx_alloc(&tile->ctx, VIDCONV_AREA);
+		if (err)
+			return err;
+	}
+
+	if (!tile->frame || !vidsz_cmp(&tile->frame->size, sz)) {
+
+		tile->frame = mem_deref(tile->frame);
+
+		err = vidframe_alloc(&tile->frame, VID_FMT_YUV420P, sz);
+		if (err)
+			return err;
+	}
+	else if (tile->gen == src->rx_gen) {
+		return 0;
+	}
+
+	err = vidconv_ctx(tile->ctx, tile->frame, src->frame_rx, NULL);
+	if (err)
+		return err;
+
+	tile->gen = src->rx_gen;
+	++src->n_scaled;
+
+	return 0;
+}
+
+
+static void frame_put(struct vidframe *dst, const struct vidframe *src,
+		      const struct vidrect *r)
+{
+	const unsigned w = src->size.w & ~1, h = src->size.h & ~1;
+	unsigned i, y;
+
+	for (i=0; i<3; i++) {
+
+		const unsigned sh = i ? 1 : 0;
+		const unsigned lsd = dst->linesize[i], lss = src->linesize[i];
+		uint8_t *dd = dst->data[i] + (r->y >> sh) * lsd + (r->x >> sh);
+		const uint8_t *ds = src->data[i];
+
+		for (y=0; y<(h >> sh); y++, dd += lsd, ds += lss)
+			memcpy(dd, ds, w >> sh);
+	}
+}
+
+
+/*
+ * Put a participant into an area of the mixed frame, keeping its aspect
+ * ratio. The area must be inside the mixed frame.
+ */
+static void source_tile(struct vidframe *mframe, struct vidmix_source *lsrc,
+			struct vidrect *rect)
+{
+	const struct vidframe *frame_rx = lsrc->frame_rx;
+	struct vidmix_tile *tile;
+	struct vidsz sz;
+	double ar;
+
+	ar = (double)frame_rx->size.w / (double)frame_rx->size.h;
+
+	sz.w = (int)min((double)rect->w, (double)rect->h * ar) & ~1;
+	sz.h = (int)min((double)rect->h, (double)rect->w / ar) & ~1;
+
+	if (!sz.w || !sz.h)
+		return;
+
+	rect->x = (rect->x + (rect->w - sz.w) / 2) & ~1;
+	rect->y = (rect->y + (rect->h - sz.h) / 2) & ~1;
+	rect->w = sz.w;
+	rect->h = sz.h;
+
+	pthread_mutex_lock(&lsrc->tile_mutex);
+
+	tile = tile_find(lsrc, &sz);
+
+	if (!tile_update(lsrc, tile, &sz)) {
+
+		tile->used = tmr_jiffies();
+		frame_put(mframe, tile->frame, rect);
+	}
+
+	pthread_mutex_unlock(&lsrc->tile_mutex);
 }
 
 
 static inline void source_mix(struct vidframe *mframe,
-			      const struct vidframe *frame_src,
+			      struct vidmix_source *lsrc,
 			      unsigned n, unsigned rows, unsigned idx,
 			      bool focus, bool focus_this, bool focus_full)
 {
 	struct vidrect rect;
 
-	if (!frame_src)
+	if (!lsrc->frame_rx)
 		return;
 
 	if (focus) {
@@ -138,13 +289,15 @@ static inline void source_mix(struct vidframe *mframe,
 		rect.y = rect.h * (idx / rows);
 	}
 
-	vidconv_aspect(mframe, frame_src, &rect);
+	source_tile(mframe, lsrc, &rect);
 }
 
 
 static inline void source_mix_full(struct vidframe *mframe,
-				   const struct vidframe *frame_src)
+				   struct vidmix_source *lsrc)
 {
+	const struct vidframe *frame_src = lsrc->frame_rx;
+
 	if (!frame_src)
 		return;
 
@@ -160,7 +313,7 @@ static inline void source_mix_full(struct vidframe *mframe,
 		rect.x = 0;
 		rect.y = 0;
 
-		vidconv_aspect(mframe, frame_src, &rect);
+		source_tile(mframe, lsrc, &rect);
 	}
 }
 
@@ -222,7 +375,7 @@ static void *vidmix_thread(void *arg)
 				if (lsrc == src && !src->selfview)
 					continue;
 
-				source_mix_full(src->frame_tx, lsrc->frame_rx);
+				source_mix_full(src->frame_tx, lsrc);
 				break;
 			}
 		}
@@ -244,7 +397,7 @@ static void *vidmix_thread(void *arg)
 			if (lsrc == src->focus && src->focus_full)
 				continue;
 
-			source_mix(src->frame_tx, lsrc->frame_rx, n, rows, idx,
+			source_mix(src->frame_tx, lsrc, n, rows, idx,
 				   src->focus != NULL, src->focus == lsrc,
 				   src->focus_full);
 
@@ -351,6 +504,14 @@ int vidmix_source_alloc(struct vidmix_source **srcp, struct vidmix *mix,
 	if (err)
 		goto out;
 
+	err = pthread_mutex_init(&src->tile_mutex, NULL);
+	if (err) {
+		(void)pthread_mutex_destroy(&src->mutex);
+		goto out;
+	}
+
+	src->initialized = true;
+
 	if (sz) {
 		err = vidframe_alloc(&src->frame_tx, VID_FMT_YUV420P, sz);
 		if (err)
@@ -643,4 +804,41 @@ void vidmix_source_put(struct vidmix_source *src, const struct vidframe *frame)
 	}
 
 	vidframe_copy(src->frame_rx, frame);
+
+	pthread_mutex_lock(&src->tile_mutex);
+	++src->rx_gen;
+	pthread_mutex_unlock(&src->tile_mutex);
+}
+
+
+/**
+ * Print the tile cache of a video mixer source, as a participant
+ *
+ * @param pf  Print function
+ * @param src Video mixer source
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidmix_source_debug(struct re_printf *pf, const struct vidmix_source *src)
+{
+	struct vidmix_source *msrc = (struct vidmix_source *)src;
+	unsigned i, n = 0;
+	uint64_t n_scaled;
+
+	if (!src)
+		return 0;
+
+	pthread_mutex_lock(&msrc->tile_mutex);
+
+	for (i=0; i<TILE_CACHE_SIZE; i++) {
+		if (src->tilev[i].frame)
+			++n;
+	}
+
+	n_scaled = src->n_scaled;
+
+	pthread_mutex_unlock(&msrc->tile_mutex);
+
+	return re_hprintf(pf, "tiles=%u/%u scaled=%llu", n, TILE_CACHE_SIZE,
+			  n_scaled);
 }
@@ -0,0 +1,140 @@
+/**
+ * @file test.c  Selftest and benchmarks for librem
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <time.h>
+#include <re.h>
+#include "tests/test.h"
+
+
+#define DEBUG_MODULE "test"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+struct test {
+	int (*exec)(void);
+	const char *name;
+};
+
+#define TEST(a) {a, #a}
+
+static const struct test tests[] = {
+	TEST(test_aubuf_fill),
+	TEST(test_aubuf_overrun),
+	TEST(test_aubuf_wrap),
+	TEST(test_aubuf_flush),
+	TEST(test_auresamp),
+	TEST(test_fir),
+	TEST(test_g711),
+	TEST(test_h264_packetize),
+	TEST(test_h264_startcode),
+	TEST(test_vidasm),
+	TEST(test_vidconv),
+#ifdef HAVE_PTHREAD
+	TEST(test_aumix),
+	TEST(test_vidmix),
+#endif
+};
+
+static const struct test perf_tests[] = {
+	TEST(test_perf_aubuf),
+	TEST(test_perf_auresamp),
+	TEST(test_perf_fir),
+	TEST(test_perf_g711),
+	TEST(test_perf_h264_startcode),
+	TEST(test_perf_vidconv),
+#ifdef HAVE_PTHREAD
+	TEST(test_perf_aumix),
+#endif
+};
+
+
+/**
+ * Get a monotonic time stamp for benchmarks
+ *
+ * @return Time in [ns]
+ */
+uint64_t test_nsec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int run(const struct test *testv, size_t testc, const char *name)
+{
+	size_t i, n = 0;
+	int err = 0;
+
+	for (i=0; i<testc; i++) {
+
+		int e;
+
+		if (name && !strstr(testv[i].name, name))
+			continue;
+
+		e = testv[i].exec();
+		if (e) {
+			DEBUG_WARNING("%s: failed (%m)\n", testv[i].name, e);
+			err = e;
+		}
+
+		++n;
+	}
+
+	(void)re_printf("%zu test%s run, %s\n", n, n == 1 ? "" : "s",
+			err ? "FAILED" : "OK");
+
+	return err;
+}
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr, "usage: test [-p] [name]\n"
+			 "\t-p      Run benchmarks instead of tests\n"
+			 "\tname    Only run tests matching name\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	const struct test *testv = tests;
+	size_t testc = ARRAY_SIZE(tests);
+	const char *name = NULL;
+	int i, err;
+
+	for (i=1; i<argc; i++) {
+
+		if (0 == strcmp(argv[i], "-p")) {
+			testv = perf_tests;
+			testc = ARRAY_SIZE(perf_tests);
+		}
+		else if (argv[i][0] == '-') {
+			usage();
+			return 2;
+		}
+		else {
+			name = argv[i];
+		}
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	err = run(testv, testc, name);
+
+	libre_close();
+
+	tmr_debug();
+	mem_debug();
+
+	return err ? 1 : 0;
+}
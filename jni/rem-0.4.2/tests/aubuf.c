@@ -0,0 +1,353 @@
+/**
+ * @file tests/aubuf.c  Audio buffer ring -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem_aubuf.h>
+#include "test.h"
+
+
+enum {
+	FRAME       = 320,          /* 20 ms of 8 kHz 16-bit mono */
+	WISH        = 2 * FRAME,
+	MAX         = 4 * FRAME,
+	RING        = 4096,         /* Power of two above 2 * MAX */
+	CHUNK       = 300,          /* Does not divide the ring   */
+	PERF_FRAMES = 200000,
+};
+
+
+static void frame_fill(uint8_t *p, size_t sz, uint8_t v)
+{
+	memset(p, v, sz);
+}
+
+
+static bool frame_is(const uint8_t *p, size_t sz, uint8_t v)
+{
+	size_t i;
+
+	for (i=0; i<sz; i++) {
+		if (p[i] != v)
+			return false;
+	}
+
+	return true;
+}
+
+
+/* The overrun and underrun counts, from the debug output */
+static int stats_get(const struct aubuf *ab, uint32_t *or, uint32_t *ur)
+{
+	struct pl pl_or, pl_ur;
+	char *str = NULL;
+	int err;
+
+	err = re_sdprintf(&str, "%H", aubuf_debug, ab);
+	if (err)
+		return err;
+
+	err = re_regex(str, strlen(str), "overrun=[0-9]+ underrun=[0-9]+",
+		       &pl_or, &pl_ur);
+	if (!err) {
+		*or = pl_u32(&pl_or);
+		*ur = pl_u32(&pl_ur);
+	}
+
+	mem_deref(str);
+
+	return err;
+}
+
+
+static int write_frame(struct aubuf *ab, uint8_t v)
+{
+	uint8_t buf[FRAME];
+
+	frame_fill(buf, sizeof(buf), v);
+
+	return aubuf_write(ab, buf, sizeof(buf));
+}
+
+
+/* Nothing is played until min_sz is reached, then until it runs dry */
+int test_aubuf_fill(void)
+{
+	struct aubuf *ab = NULL;
+	uint8_t buf[FRAME];
+	uint32_t or, ur;
+	int err;
+
+	err = aubuf_alloc_ring(&ab, WISH, MAX);
+	TEST_ERR(err);
+
+	err = write_frame(ab, 1);
+	TEST_ERR(err);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 0));
+	TEST_EQUALS(FRAME, aubuf_cur_size(ab));
+
+	err = write_frame(ab, 2);
+	TEST_ERR(err);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 1));
+
+	/* playing, so less than min_sz is enough */
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 2));
+	TEST_EQUALS(0, aubuf_cur_size(ab));
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 0));
+
+	/* filling again, the underrun is counted once */
+	err = write_frame(ab, 3);
+	TEST_ERR(err);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 0));
+
+	err = write_frame(ab, 4);
+	TEST_ERR(err);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 3));
+
+	err = stats_get(ab, &or, &ur);
+	TEST_ERR(err);
+	TEST_EQUALS(0, or);
+	TEST_EQUALS(1, ur);
+
+ out:
+	mem_deref(ab);
+
+	return err;
+}
+
+
+/*
+ * Above max_sz the reader drops the oldest data, in units of the read
+ * size. A write to a full ring is dropped by the writer.
+ */
+int test_aubuf_overrun(void)
+{
+	struct aubuf *ab = NULL;
+	uint8_t buf[FRAME];
+	uint32_t or, ur;
+	unsigned i;
+	int err;
+
+	err = aubuf_alloc_ring(&ab, WISH, MAX);
+	TEST_ERR(err);
+
+	for (i=1; i<=7; i++) {
+		err = write_frame(ab, i);
+		TEST_ERR(err);
+	}
+
+	/* 7 frames, 3 above max_sz are dropped */
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 4));
+	TEST_EQUALS(3 * FRAME, aubuf_cur_size(ab));
+
+	err = stats_get(ab, &or, &ur);
+	TEST_ERR(err);
+	TEST_EQUALS(1, or);
+	TEST_EQUALS(0, ur);
+
+	/* 100 bytes above max_sz drop a whole read */
+	err  = write_frame(ab, 8);
+	err |= aubuf_write(ab, buf, 100);
+	TEST_ERR(err);
+	TEST_EQUALS(MAX + 100, aubuf_cur_size(ab));
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 6));
+	TEST_EQUALS(MAX + 100 - 2 * FRAME, aubuf_cur_size(ab));
+
+	aubuf_flush(ab);
+	aubuf_read(ab, buf, sizeof(buf));
+
+	/* the ring holds 12 frames, the 13th is dropped */
+	for (i=1; i<=RING / FRAME + 1; i++) {
+		err = write_frame(ab, i);
+		TEST_ERR(err);
+	}
+	TEST_EQUALS(RING / FRAME * FRAME, aubuf_cur_size(ab));
+
+	err = stats_get(ab, &or, &ur);
+	TEST_ERR(err);
+	TEST_EQUALS(3, or);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), RING / FRAME - 3));
+
+ out:
+	mem_deref(ab);
+
+	return err;
+}
+
+
+/* A stream of reads and writes which do not divide the ring size */
+int test_aubuf_wrap(void)
+{
+	struct aubuf *ab = NULL;
+	uint8_t buf[CHUNK];
+	size_t wpos = 0, rpos = 0, i;
+	unsigned n;
+	int err;
+
+	err = aubuf_alloc_ring(&ab, 2 * CHUNK, RING / 2);
+	TEST_ERR(err);
+
+	for (n=0; n<2000; n++) {
+
+		/* the writer is ahead by one or two chunks */
+		do {
+			for (i=0; i<CHUNK; i++)
+				buf[i] = (uint8_t)((wpos + i) * 7 + 1);
+
+			err = aubuf_write(ab, buf, CHUNK);
+			TEST_ERR(err);
+
+			wpos += CHUNK;
+
+		} while (wpos - rpos < 2 * CHUNK);
+
+		aubuf_read(ab, buf, CHUNK);
+
+		for (i=0; i<CHUNK; i++) {
+			TEST_EQUALS((uint8_t)((rpos + i) * 7 + 1), buf[i]);
+		}
+
+		rpos += CHUNK;
+
+		TEST_EQUALS(wpos - rpos, aubuf_cur_size(ab));
+	}
+
+ out:
+	mem_deref(ab);
+
+	return err;
+}
+
+
+/*
+ * A flush of a ring is done by the reader, on its next read. Until then
+ * the size is 0, and data written meanwhile is flushed too.
+ */
+int test_aubuf_flush(void)
+{
+	struct aubuf *ab = NULL;
+	uint8_t buf[FRAME];
+	int err;
+
+	err = aubuf_alloc_ring(&ab, WISH, MAX);
+	TEST_ERR(err);
+
+	err  = write_frame(ab, 1);
+	err |= write_frame(ab, 2);
+	err |= write_frame(ab, 3);
+	TEST_ERR(err);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 1));
+
+	aubuf_flush(ab);
+	TEST_EQUALS(0, aubuf_cur_size(ab));
+
+	err = write_frame(ab, 4);
+	TEST_ERR(err);
+	TEST_EQUALS(0, aubuf_cur_size(ab));
+
+	/* the reader flushes, and is filling again */
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 0));
+	TEST_EQUALS(0, aubuf_cur_size(ab));
+
+	err = write_frame(ab, 5);
+	TEST_ERR(err);
+	TEST_EQUALS(FRAME, aubuf_cur_size(ab));
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 0));
+
+	err = write_frame(ab, 6);
+	TEST_ERR(err);
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 5));
+
+	/* a second flush before any read */
+	aubuf_flush(ab);
+	aubuf_flush(ab);
+	TEST_EQUALS(0, aubuf_cur_size(ab));
+
+	aubuf_read(ab, buf, sizeof(buf));
+	TEST_ASSERT(frame_is(buf, sizeof(buf), 0));
+
+ out:
+	mem_deref(ab);
+
+	return err;
+}
+
+
+static int perf_aubuf(bool ring)
+{
+	struct aubuf *ab = NULL;
+	uint8_t buf[FRAME];
+	uint64_t t0, t;
+	unsigned i;
+	int err;
+
+	if (ring)
+		err = aubuf_alloc_ring(&ab, WISH, MAX);
+	else
+		err = aubuf_alloc(&ab, WISH, MAX);
+	if (err)
+		return err;
+
+	frame_fill(buf, sizeof(buf), 1);
+	err = aubuf_write(ab, buf, sizeof(buf));
+	if (err)
+		goto out;
+
+	t0 = test_nsec();
+
+	for (i=0; i<PERF_FRAMES; i++) {
+
+		err |= aubuf_write(ab, buf, sizeof(buf));
+		aubuf_read(ab, buf, sizeof(buf));
+	}
+
+	t = test_nsec() - t0;
+	if (err)
+		goto out;
+
+	(void)re_printf("  %-5s %4llu ns/frame\n", ring ? "ring" : "list",
+			t / PERF_FRAMES);
+
+ out:
+	mem_deref(ab);
+
+	return err;
+}
+
+
+int test_perf_aubuf(void)
+{
+	int err;
+
+	(void)re_printf("aubuf: write and read of %u-byte frames\n", FRAME);
+
+	err  = perf_aubuf(false);
+	err |= perf_aubuf(true);
+
+	return err;
+}
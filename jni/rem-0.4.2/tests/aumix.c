@@ -0,0 +1,190 @@
+/**
+ * @file tests/aumix.c  Audio mixer kernels -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <re.h>
+#include <rem_dsp.h>
+#include "../src/aumix/aumix.h"
+#include "test.h"
+
+
+enum {
+	FRAME_SIZE  = 960,   /* 48 kHz mono, 20 ms */
+	MAX_SOURCES = 64,
+	PERF_ROUNDS = 2000,
+};
+
+
+static int16_t rand_s16(void)
+{
+	/* mostly loud samples, so that the mix saturates */
+	switch (rand() % 4) {
+
+	case 0:  return 32767;
+	case 1:  return -32768;
+	default: return (int16_t)(rand() - RAND_MAX/2);
+	}
+}
+
+
+static int check_mix(size_t nsrc, size_t sampc)
+{
+	int16_t *srcv, *base, *outv;
+	int32_t *acc;
+	size_t i, j, k;
+	int err = 0;
+
+	srcv = mem_alloc(nsrc * sampc * sizeof(*srcv), NULL);
+	base = mem_alloc(sampc * sizeof(*base), NULL);
+	outv = mem_alloc(sampc * sizeof(*outv), NULL);
+	acc  = mem_alloc(sampc * sizeof(*acc), NULL);
+	if (!srcv || !base || !outv || !acc) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<sampc; i++)
+		base[i] = rand_s16();
+	for (i=0; i<nsrc*sampc; i++)
+		srcv[i] = rand_s16();
+
+	aumix_acc_init(acc, base, sampc);
+	for (j=0; j<nsrc; j++)
+		aumix_acc_add(acc, &srcv[j*sampc], sampc);
+
+	for (j=0; j<nsrc; j++) {
+
+		aumix_acc_sub(outv, acc, &srcv[j*sampc], sampc);
+
+		/* reference: base plus every other source, saturated once */
+		for (i=0; i<sampc; i++) {
+
+			int32_t sum = base[i];
+
+			for (k=0; k<nsrc; k++) {
+				if (k != j)
+					sum += srcv[k*sampc + i];
+			}
+
+			TEST_EQUALS(saturate_s16(sum), outv[i]);
+		}
+	}
+
+ out:
+	mem_deref(acc);
+	mem_deref(outv);
+	mem_deref(base);
+	mem_deref(srcv);
+
+	return err;
+}
+
+
+int test_aumix(void)
+{
+	static const size_t sampcv[] = {1, 7, 8, 9, 160, 961};
+	size_t i, n;
+	int err = 0;
+
+	srand(1);
+
+	for (n=1; n<=MAX_SOURCES; n*=2) {
+		for (i=0; i<ARRAY_SIZE(sampcv); i++) {
+			err = check_mix(n, sampcv[i]);
+			TEST_ERR(err);
+		}
+	}
+
+ out:
+	return err;
+}
+
+
+/* The old mixer: re-sum all other sources for every source, in 16-bit */
+static void mix_legacy(int16_t *outv, const int16_t *base,
+		       const int16_t *srcv, size_t nsrc, size_t sampc)
+{
+	size_t i, j, k;
+
+	for (j=0; j<nsrc; j++) {
+
+		for (i=0; i<sampc; i++)
+			outv[i] = base[i];
+
+		for (k=0; k<nsrc; k++) {
+
+			if (k == j)
+				continue;
+
+			for (i=0; i<sampc; i++)
+				outv[i] += srcv[k*sampc + i];
+		}
+	}
+}
+
+
+static void mix_acc(int16_t *outv, int32_t *acc, const int16_t *base,
+		    const int16_t *srcv, size_t nsrc, size_t sampc)
+{
+	size_t j;
+
+	aumix_acc_init(acc, base, sampc);
+
+	for (j=0; j<nsrc; j++)
+		aumix_acc_add(acc, &srcv[j*sampc], sampc);
+
+	for (j=0; j<nsrc; j++)
+		aumix_acc_sub(outv, acc, &srcv[j*sampc], sampc);
+}
+
+
+int test_perf_aumix(void)
+{
+	int16_t *srcv, *base, *outv;
+	int32_t *acc;
+	size_t i, n;
+	int err = 0;
+
+	srcv = mem_alloc(MAX_SOURCES * FRAME_SIZE * sizeof(*srcv), NULL);
+	base = mem_zalloc(FRAME_SIZE * sizeof(*base), NULL);
+	outv = mem_alloc(FRAME_SIZE * sizeof(*outv), NULL);
+	acc  = mem_alloc(FRAME_SIZE * sizeof(*acc), NULL);
+	if (!srcv || !base || !outv || !acc) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<MAX_SOURCES*FRAME_SIZE; i++)
+		srcv[i] = (int16_t)(rand() - RAND_MAX/2);
+
+	(void)re_printf("aumix: %u samples per frame, ns per frame\n",
+			FRAME_SIZE);
+	(void)re_printf("%8s %12s %12s\n", "sources", "legacy", "acc");
+
+	for (n=2; n<=MAX_SOURCES; n*=2) {
+
+		uint64_t t0, t1, t2;
+
+		t0 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++)
+			mix_legacy(outv, base, srcv, n, FRAME_SIZE);
+		t1 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++)
+			mix_acc(outv, acc, base, srcv, n, FRAME_SIZE);
+		t2 = test_nsec();
+
+		(void)re_printf("%8zu %12llu %12llu\n", n,
+				(t1 - t0) / PERF_ROUNDS,
+				(t2 - t1) / PERF_ROUNDS);
+	}
+
+ out:
+	mem_deref(acc);
+	mem_deref(outv);
+	mem_deref(base);
+	mem_deref(srcv);
+
+	return err;
+}
@@ -0,0 +1,488 @@
+/**
+ * @file tests/auresamp.c  Audio resampler -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <rem_fir.h>
+#include <rem_auresamp.h>
+#include "test.h"
+
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+enum {
+	PTIME       = 20,     /* Block length in [ms]            */
+	DURATION    = 1000,   /* Signal length in [ms]           */
+	SETTLE      = 100,    /* Output skipped while settling   */
+	AMPLITUDE   = 16000,
+	PERF_ROUNDS = 500,
+};
+
+
+struct rates {
+	uint32_t in;
+	uint32_t out;
+	int snr_min;     /* Minimum SNR of an in-band tone [dB]            */
+	int alias_max;   /* Maximum level of an out-of-band tone [dB], 0:- */
+};
+
+
+static const struct rates ratev[] = {
+	{ 48000,  8000, 60, -60},
+	{  8000, 48000, 60,   0},
+	{ 44100, 16000, 60, -60},
+	{ 16000, 44100, 60,   0},
+	{ 96000,  8000, 60, -60},
+	{192000,  8000, 60, -60},
+};
+
+
+static void tone(int16_t *sampv, size_t n, uint8_t ch, uint32_t srate,
+		 const double *freqv)
+{
+	size_t i;
+	uint8_t c;
+
+	for (i=0; i<n; i++) {
+		for (c=0; c<ch; c++) {
+			sampv[i*ch + c] = (int16_t)lrint(AMPLITUDE *
+				sin(2 * M_PI * freqv[c] * (double)i / srate));
+		}
+	}
+}
+
+
+/*
+ * Level of a tone at freq relative to a full-amplitude tone, and the
+ * level of everything else, in [dB]
+ */
+static void analyse(const int16_t *sampv, size_t n, uint8_t ch, uint8_t c,
+		    uint32_t srate, double freq, double *tone_db,
+		    double *noise_db)
+{
+	double re = 0, im = 0, total = 0, sig;
+	size_t i;
+
+	for (i=0; i<n; i++) {
+
+		const double x = sampv[i*ch + c];
+		const double w = 2 * M_PI * freq * (double)i / srate;
+
+		re    += x * cos(w);
+		im    += x * sin(w);
+		total += x * x;
+	}
+
+	/* power of the projection on the tone */
+	sig = 2 * (re * re + im * im) / n;
+
+	*tone_db  = 10 * log10(sig / n / (AMPLITUDE * AMPLITUDE / 2.0));
+	*noise_db = 10 * log10((total - sig + 1) / sig);
+}
+
+
+/* Resample a signal in blocks, the output is appended to dst */
+static int run(struct auresamp *ar, int16_t *dst, size_t *dstc,
+	       const int16_t *src, size_t srcc, size_t blk)
+{
+	size_t n = 0;
+	int err = 0;
+
+	while (srcc) {
+
+		const size_t len = min(blk, srcc);
+		size_t nd = *dstc - n;
+
+		err = auresamp_process(ar, &dst[n], &nd, src, len);
+		if (err)
+			break;
+
+		n    += nd;
+		src  += len;
+		srcc -= len;
+	}
+
+	*dstc = n;
+
+	return err;
+}
+
+
+static int resample(int16_t **dstp, size_t *dstc,
+		    uint32_t srate_in, uint8_t ch_in,
+		    uint32_t srate_out, uint8_t ch_out,
+		    const double *freqv)
+{
+	struct auresamp *ar = NULL;
+	const size_t ns = srate_in * DURATION / 1000;
+	const size_t blk = srate_in * PTIME / 1000 * ch_in;
+	int16_t *src, *dst;
+	int err;
+
+	src = mem_alloc(ns * ch_in * sizeof(*src), NULL);
+	*dstc = ((size_t)srate_out * DURATION / 1000 + 64) * ch_out;
+	dst = mem_alloc(*dstc * sizeof(*dst), NULL);
+	if (!src || !dst) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	tone(src, ns, ch_in, srate_in, freqv);
+
+	err = auresamp_alloc(&ar, blk, srate_in, ch_in, srate_out, ch_out);
+	if (err)
+		goto out;
+
+	err = run(ar, dst, dstc, src, ns * ch_in, blk);
+
+ out:
+	mem_deref(ar);
+	mem_deref(src);
+
+	if (err)
+		mem_deref(dst);
+	else
+		*dstp = dst;
+
+	return err;
+}
+
+
+static int check_rates(const struct rates *r)
+{
+	static const double inband[2] = {1000, 1000};
+	const size_t skip = r->out * SETTLE / 1000;
+	const double stop = r->out * 0.6;
+	int16_t *dst = NULL;
+	double tone_db, noise_db;
+	size_t n;
+	int err;
+
+	err = resample(&dst, &n, r->in, 1, r->out, 1, inband);
+	TEST_ERR(err);
+	TEST_ASSERT(n > skip + r->out / 2);
+
+	analyse(&dst[skip], n - skip, 1, 0, r->out, 1000, &tone_db, &noise_db);
+	TEST_ASSERT(fabs(tone_db) < 0.5);
+	TEST_ASSERT(-noise_db > r->snr_min);
+
+	if (!r->alias_max)
+		goto out;
+
+	/* a tone above the output Nyquist rate must be removed */
+	dst = mem_deref(dst);
+	{
+		const double freqv[2] = {stop, stop};
+
+		err = resample(&dst, &n, r->in, 1, r->out, 1, freqv);
+		TEST_ERR(err);
+	}
+
+	analyse(&dst[skip], n - skip, 1, 0, r->out, r->out - stop,
+		&tone_db, &noise_db);
+	TEST_ASSERT(tone_db < r->alias_max);
+
+ out:
+	if (err) {
+		(void)re_fprintf(stderr, "auresamp: %u -> %u Hz\n",
+				 r->in, r->out);
+	}
+
+	mem_deref(dst);
+
+	return err;
+}
+
+
+static int check_channels(void)
+{
+	static const double freqv[2] = {1000, 1500};
+	const size_t skip = 16000 * SETTLE / 1000;
+	int16_t *dst = NULL;
+	double tone_db, noise_db;
+	size_t n, i;
+	int err;
+
+	/* stereo: the channels are kept apart */
+	err = resample(&dst, &n, 48000, 2, 16000, 2, freqv);
+	TEST_ERR(err);
+
+	n /= 2;
+	analyse(&dst[2*skip], n - skip, 2, 0, 16000, 1000,
+		&tone_db, &noise_db);
+	TEST_ASSERT(-noise_db > 60);
+	analyse(&dst[2*skip], n - skip, 2, 1, 16000, 1500,
+		&tone_db, &noise_db);
+	TEST_ASSERT(-noise_db > 60);
+
+	/* mono to stereo: both channels are the same */
+	dst = mem_deref(dst);
+	err = resample(&dst, &n, 8000, 1, 48000, 2, freqv);
+	TEST_ERR(err);
+
+	for (i=0; i<n; i+=2)
+		TEST_EQUALS(dst[i], dst[i+1]);
+
+	/* stereo to mono: the channels are mixed */
+	dst = mem_deref(dst);
+	err = resample(&dst, &n, 48000, 2, 8000, 1, freqv);
+	TEST_ERR(err);
+
+	analyse(&dst[skip/2], n - skip/2, 1, 0, 8000, 1000,
+		&tone_db, &noise_db);
+	TEST_ASSERT(fabs(tone_db + 6.02) < 0.5);
+	analyse(&dst[skip/2], n - skip/2, 1, 0, 8000, 1500,
+		&tone_db, &noise_db);
+	TEST_ASSERT(fabs(tone_db + 6.02) < 0.5);
+
+ out:
+	mem_deref(dst);
+
+	return err;
+}
+
+
+/* The output does not depend on how the input is split into blocks */
+static int check_blocks(void)
+{
+	static const double freqv[2] = {1000, 1000};
+	struct auresamp *ar1 = NULL, *ar2 = NULL;
+	const size_t ns = 44100;
+	int16_t *src, *dst1, *dst2;
+	size_t n1 = 20000, n2 = 20000, pos = 0;
+	size_t i;
+	int err;
+
+	src  = mem_alloc(ns * sizeof(*src), NULL);
+	dst1 = mem_alloc(n1 * sizeof(*dst1), NULL);
+	dst2 = mem_alloc(n2 * sizeof(*dst2), NULL);
+	if (!src || !dst1 || !dst2) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	tone(src, ns, 1, 44100, freqv);
+
+	err  = auresamp_alloc(&ar1, ns, 44100, 1, 16000, 1);
+	err |= auresamp_alloc(&ar2, 1024, 44100, 1, 16000, 1);
+	TEST_ERR(err);
+
+	err = run(ar1, dst1, &n1, src, ns, ns);
+	TEST_ERR(err);
+
+	n2 = 0;
+	while (pos < ns) {
+
+		const size_t blk = 1 + rand() % 1024;
+		const size_t len = min(blk, ns - pos);
+		size_t nd = 20000 - n2;
+
+		err = auresamp_process(ar2, &dst2[n2], &nd, &src[pos], len);
+		TEST_ERR(err);
+
+		n2  += nd;
+		pos += len;
+	}
+
+	TEST_EQUALS(n1, n2);
+	for (i=0; i<n1; i++)
+		TEST_EQUALS(dst1[i], dst2[i]);
+
+ out:
+	mem_deref(ar2);
+	mem_deref(ar1);
+	mem_deref(dst2);
+	mem_deref(dst1);
+	mem_deref(src);
+
+	return err;
+}
+
+
+int test_auresamp(void)
+{
+	struct auresamp *ar = NULL;
+	size_t i;
+	int err;
+
+	for (i=0; i<ARRAY_SIZE(ratev); i++) {
+		err = check_rates(&ratev[i]);
+		if (err)
+			return err;
+	}
+
+	err = check_channels();
+	if (err)
+		return err;
+
+	err = check_blocks();
+	if (err)
+		return err;
+
+	/* the filter bank would be too large */
+	err = auresamp_alloc(&ar, 960, 192000, 1, 1001, 1);
+	TEST_EQUALS(ENOTSUP, err);
+	err = 0;
+
+ out:
+	mem_deref(ar);
+
+	return err;
+}
+
+
+/*
+ * The previous resampler: nearest-neighbour, and a fixed 31-tap FIR
+ * low-pass with cutoff at a quarter of the sample rate, mono only
+ */
+
+static const int16_t legacy_lowpass[31] = {
+   -55,      0,     96,      0,   -220,      0,    461,      0,
+  -877,      0,   1608,      0,  -3176,      0,  10342,  16410,
+ 10342,      0,  -3176,      0,   1608,      0,   -877,      0,
+   461,      0,   -220,      0,     96,      0,    -55,
+};
+
+
+struct legacy {
+	struct fir fir;
+	int16_t *sampv;
+	double ratio;
+};
+
+
+static void legacy_resample(const struct legacy *lg, int16_t *dst,
+			    const int16_t *src, size_t nd)
+{
+	double p = 0;
+
+	while (nd--) {
+		*dst++ = src[(int)p];
+		p += 1/lg->ratio;
+	}
+}
+
+
+static void legacy_process(struct legacy *lg, int16_t *dst, size_t *dstc,
+			   const int16_t *src, size_t srcc)
+{
+	const size_t nd = (size_t)(srcc * lg->ratio);
+
+	if (lg->ratio > 1) {
+		legacy_resample(lg, dst, src, nd);
+		fir_process(&lg->fir, legacy_lowpass, dst, dst, nd,
+			    (int)ARRAY_SIZE(legacy_lowpass), 1);
+	}
+	else {
+		fir_process(&lg->fir, legacy_lowpass, src, lg->sampv, srcc,
+			    (int)ARRAY_SIZE(legacy_lowpass), 1);
+		legacy_resample(lg, dst, lg->sampv, nd);
+	}
+
+	*dstc = nd;
+}
+
+
+static int perf_rates(uint32_t srate_in, uint32_t srate_out)
+{
+	static const double freqv[2] = {1000, 1000};
+	struct auresamp *ar = NULL;
+	struct legacy lg;
+	const size_t blk = srate_in * PTIME / 1000;
+	const size_t ns = srate_in * DURATION / 1000;
+	const size_t skip = srate_out * SETTLE / 1000;
+	const size_t dstsz = (size_t)srate_out * DURATION / 1000 + 64;
+	int16_t *src, *dst;
+	double snr_new, snr_old, tone_db;
+	uint64_t t0, t_new, t_old;
+	size_t n, pos;
+	unsigned i;
+	int err;
+
+	memset(&lg, 0, sizeof(lg));
+
+	src      = mem_alloc(ns * sizeof(*src), NULL);
+	dst      = mem_alloc(dstsz * sizeof(*dst), NULL);
+	lg.sampv = mem_alloc(blk * sizeof(*lg.sampv), NULL);
+	if (!src || !dst || !lg.sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	tone(src, ns, 1, srate_in, freqv);
+
+	err = auresamp_alloc(&ar, blk, srate_in, 1, srate_out, 1);
+	if (err)
+		goto out;
+
+	fir_init(&lg.fir);
+	lg.ratio = 1.0 * srate_out / srate_in;
+
+	/* quality of one second of a 1 kHz tone */
+	n = dstsz;
+	err = run(ar, dst, &n, src, ns, blk);
+	if (err)
+		goto out;
+	analyse(&dst[skip], n - skip, 1, 0, srate_out, 1000,
+		&tone_db, &snr_new);
+
+	for (n=0, pos=0; pos + blk <= ns; pos += blk) {
+		size_t nd;
+		legacy_process(&lg, &dst[n], &nd, &src[pos], blk);
+		n += nd;
+	}
+	analyse(&dst[skip], n - skip, 1, 0, srate_out, 1000,
+		&tone_db, &snr_old);
+
+	/* speed of 20 ms blocks */
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++) {
+		n = dstsz;
+		err |= auresamp_process(ar, dst, &n, src, blk);
+	}
+	t_new = test_nsec() - t0;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++)
+		legacy_process(&lg, dst, &n, src, blk);
+	t_old = test_nsec() - t0;
+
+	(void)re_printf("  %6u -> %6u Hz:  legacy %6llu ns/frame %5.1f dB,"
+			"  polyphase %6llu ns/frame %5.1f dB\n",
+			srate_in, srate_out,
+			t_old / PERF_ROUNDS, -snr_old,
+			t_new / PERF_ROUNDS, -snr_new);
+
+ out:
+	mem_deref(ar);
+	mem_deref(lg.sampv);
+	mem_deref(dst);
+	mem_deref(src);
+
+	return err;
+}
+
+
+int test_perf_auresamp(void)
+{
+	size_t i;
+	int err = 0;
+
+	(void)re_printf("auresamp: mono, %u ms frames, SNR of a 1 kHz tone\n",
+			PTIME);
+
+	for (i=0; i<ARRAY_SIZE(ratev); i++) {
+		err = perf_rates(ratev[i].in, ratev[i].out);
+		if (err)
+			break;
+	}
+
+	return err;
+}
@@ -0,0 +1,316 @@
+/**
+ * @file tests/fir.c  FIR filter -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem_fir.h>
+#include "test.h"
+
+
+enum {
+	LEGACY_INPUT_LEN = 1024,  /* Maximum block of the reference       */
+	NUM_FRAMES       = 4000,
+	PERF_BLOCK       = 160,
+	PERF_ROUNDS      = 2000,
+};
+
+
+/*
+ * The previous FIR filter, with the history shifted after each block,
+ * as the reference for the output
+ */
+
+struct legacy {
+	int16_t insamp[FIR_MAX_CHANNELS]
+		[FIR_MAX_FLT_LEN - 1 + LEGACY_INPUT_LEN];
+};
+
+
+static void legacy_process(struct legacy *fir, const int16_t *coeffs,
+			   const int16_t *input, int16_t *output,
+			   size_t length, int filterLength, uint8_t channels)
+{
+	const int16_t *inputx = input;
+	int32_t acc;
+	const int16_t *coeffp;
+	int16_t *inputp;
+	size_t n;
+	int k;
+	int ch;
+
+	for (n = 0; n < length; n++) {
+		for (ch = 0; ch < channels; ch++)
+			fir->insamp[ch][filterLength - 1 + n] = *inputx++;
+	}
+
+	for (ch = 0; ch < channels; ch++) {
+
+		for (n = 0; n < length; n++) {
+
+			coeffp = coeffs;
+			inputp = &fir->insamp[ch][filterLength - 1 + n];
+
+			acc = 1 << 14;
+
+			for (k = 0; k < filterLength; k++) {
+				acc += (int32_t)(*coeffp++) *
+					(int32_t)(*inputp--);
+			}
+
+			if (acc > 0x3fffffff)
+				acc = 0x3fffffff;
+			else if (acc < -0x40000000)
+				acc = -0x40000000;
+
+			output[channels*n + ch] = (int16_t)(acc >> 15);
+		}
+	}
+
+	for (ch = 0; ch < channels; ch++) {
+		memmove(&fir->insamp[ch][0], &fir->insamp[ch][length],
+			(filterLength - 1) * sizeof(int16_t));
+	}
+}
+
+
+static int16_t rand_s16(void)
+{
+	/* mostly loud samples, so that the output saturates */
+	switch (rand() % 4) {
+
+	case 0:  return 32767;
+	case 1:  return -32768;
+	default: return (int16_t)(rand() - RAND_MAX/2);
+	}
+}
+
+
+/*
+ * Random coefficients, with a sum of magnitudes below 2^16, so that the
+ * accumulator saturates but does not overflow
+ */
+static void rand_coeffs(int16_t *coeffs, int n)
+{
+	const int lim = min(65535 / n, 32767);
+	int k;
+
+	for (k=0; k<n; k++)
+		coeffs[k] = (int16_t)(rand() % (2 * lim + 1) - lim);
+}
+
+
+static int check_fir(int taps, uint8_t ch, bool generic)
+{
+	int16_t coeffs[FIR_MAX_FLT_LEN];
+	struct legacy *lg;
+	struct fir *fir;
+	int16_t *in, *out, *ref;
+	size_t pos = 0, i;
+	int err = 0;
+
+	fir = mem_alloc(sizeof(*fir), NULL);
+	lg  = mem_zalloc(sizeof(*lg), NULL);
+	in  = mem_alloc(NUM_FRAMES * ch * sizeof(*in), NULL);
+	out = mem_alloc(NUM_FRAMES * ch * sizeof(*out), NULL);
+	ref = mem_alloc(NUM_FRAMES * ch * sizeof(*ref), NULL);
+	if (!fir || !lg || !in || !out || !ref) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	rand_coeffs(coeffs, taps);
+	for (i=0; i<NUM_FRAMES * ch; i++)
+		in[i] = rand_s16();
+
+	fir_init(fir);
+	if (generic)
+		fir->dot = NULL;
+
+	/* random block sizes, also longer than the history ring */
+	while (pos < NUM_FRAMES) {
+
+		const size_t blk = 1 + rand() % 600;
+		const size_t len = min(blk, NUM_FRAMES - pos);
+
+		fir_process(fir, coeffs, &in[pos*ch], &out[pos*ch], len,
+			    taps, ch);
+		legacy_process(lg, coeffs, &in[pos*ch], &ref[pos*ch], len,
+			       taps, ch);
+
+		pos += len;
+	}
+
+	for (i=0; i<NUM_FRAMES * ch; i++) {
+		if (out[i] != ref[i]) {
+			(void)re_fprintf(stderr, "fir: %d taps, %u channels,"
+					 " sample %zu: %d != %d\n",
+					 taps, ch, i, out[i], ref[i]);
+			err = EBADMSG;
+			break;
+		}
+	}
+
+ out:
+	mem_deref(ref);
+	mem_deref(out);
+	mem_deref(in);
+	mem_deref(lg);
+	mem_deref(fir);
+
+	return err;
+}
+
+
+/* Parameters beyond the history give silence, and leave it unchanged */
+static int check_invalid(void)
+{
+	static const struct {
+		int taps;
+		uint8_t ch;
+	} parv[] = {
+		{FIR_MAX_FLT_LEN + 1, 1},
+		{0, 1},
+		{-1, 2},
+		{8, FIR_MAX_CHANNELS + 1},
+	};
+	int16_t coeffs[FIR_MAX_FLT_LEN + 1];
+	int16_t in[16 * (FIR_MAX_CHANNELS + 1)];
+	int16_t out[16 * (FIR_MAX_CHANNELS + 1)];
+	struct fir *fir;
+	size_t i, j;
+	int err = 0;
+
+	fir = mem_alloc(sizeof(*fir), NULL);
+	if (!fir)
+		return ENOMEM;
+
+	rand_coeffs(coeffs, ARRAY_SIZE(coeffs));
+	for (i=0; i<ARRAY_SIZE(in); i++)
+		in[i] = rand_s16();
+
+	fir_init(fir);
+
+	for (i=0; i<ARRAY_SIZE(parv); i++) {
+
+		memset(out, 0x55, sizeof(out));
+
+		fir_process(fir, coeffs, in, out, 16, parv[i].taps,
+			    parv[i].ch);
+
+		for (j=0; j<16u * parv[i].ch; j++) {
+			TEST_EQUALS(0, out[j]);
+		}
+	}
+
+	for (i=0; i<ARRAY_SIZE(fir->hist); i++) {
+		for (j=0; j<ARRAY_SIZE(fir->hist[i]); j++) {
+			TEST_EQUALS(0, fir->hist[i][j]);
+		}
+	}
+
+ out:
+	mem_deref(fir);
+
+	return err;
+}
+
+
+/* Bit-exact with the previous filter, for the scalar and SIMD kernels */
+int test_fir(void)
+{
+	static const int tapv[] = {1, 2, 7, 8, 9, 11, 12, 13, 15, 16, 17,
+				   20, 24, 31, 32, 63, 100, 127, 128, 255,
+				   256};
+	size_t i;
+	uint8_t ch;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(tapv); i++) {
+
+		for (ch=1; ch<=FIR_MAX_CHANNELS; ch++) {
+
+			err  = check_fir(tapv[i], ch, false);
+			err |= check_fir(tapv[i], ch, true);
+			if (err)
+				return err;
+		}
+	}
+
+	return check_invalid();
+}
+
+
+static int perf_fir(int taps, uint8_t ch)
+{
+	int16_t coeffs[FIR_MAX_FLT_LEN];
+	int16_t in[PERF_BLOCK * 2], out[PERF_BLOCK * 2];
+	struct legacy *lg;
+	struct fir *fir;
+	uint64_t t0, t_old, t_gen, t_new;
+	unsigned i;
+	int err = 0;
+
+	fir = mem_alloc(sizeof(*fir), NULL);
+	lg  = mem_zalloc(sizeof(*lg), NULL);
+	if (!fir || !lg) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	rand_coeffs(coeffs, taps);
+	for (i=0; i<ARRAY_SIZE(in); i++)
+		in[i] = rand_s16();
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++)
+		legacy_process(lg, coeffs, in, out, PERF_BLOCK, taps, ch);
+	t_old = test_nsec() - t0;
+
+	fir_init(fir);
+	fir->dot = NULL;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++)
+		fir_process(fir, coeffs, in, out, PERF_BLOCK, taps, ch);
+	t_gen = test_nsec() - t0;
+
+	fir_init(fir);
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++)
+		fir_process(fir, coeffs, in, out, PERF_BLOCK, taps, ch);
+	t_new = test_nsec() - t0;
+
+	(void)re_printf("  %3d taps, %u ch:  legacy %6llu  scalar %6llu"
+			"  simd %6llu ns/block\n", taps, ch,
+			t_old / PERF_ROUNDS, t_gen / PERF_ROUNDS,
+			t_new / PERF_ROUNDS);
+
+ out:
+	mem_deref(lg);
+	mem_deref(fir);
+
+	return err;
+}
+
+
+int test_perf_fir(void)
+{
+	int err;
+
+	(void)re_printf("fir: blocks of %u samples per channel\n",
+			PERF_BLOCK);
+
+	err  = perf_fir(8, 1);
+	err |= perf_fir(16, 1);
+	err |= perf_fir(31, 1);
+	err |= perf_fir(31, 2);
+	err |= perf_fir(63, 1);
+	err |= perf_fir(128, 1);
+	err |= perf_fir(256, 2);
+
+	return err;
+}
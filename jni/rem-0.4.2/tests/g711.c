@@ -0,0 +1,243 @@
+/**
+ * @file tests/g711.c  G.711 block transcoding -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <re.h>
+#include <rem_g711.h>
+#include "test.h"
+
+
+enum {
+	FRAME_SIZE  = 160,    /* 8 kHz, 20 ms */
+	PERF_FRAMES = 1024,
+	PERF_ROUNDS = 50,
+};
+
+
+typedef uint8_t (enc_h)(int16_t samp);
+typedef int16_t (dec_h)(uint8_t octet);
+
+
+static uint8_t enc_ulaw(int16_t s) { return g711_pcm2ulaw(s); }
+static uint8_t enc_alaw(int16_t s) { return g711_pcm2alaw(s); }
+static int16_t dec_ulaw(uint8_t u) { return g711_ulaw2pcm(u); }
+static int16_t dec_alaw(uint8_t a) { return g711_alaw2pcm(a); }
+
+
+/* The block functions match the per-sample functions for every input */
+int test_g711(void)
+{
+	int16_t *pcm, dec[256];
+	uint8_t *ulaw, *alaw, code[256], conv[256];
+	size_t i, n;
+	int err = 0;
+
+	pcm  = mem_alloc(65536 * sizeof(*pcm), NULL);
+	ulaw = mem_alloc(65536, NULL);
+	alaw = mem_alloc(65536, NULL);
+	if (!pcm || !ulaw || !alaw) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<65536; i++)
+		pcm[i] = (int16_t)(i - 32768);
+
+	/* odd lengths and offsets, for the unrolled loops */
+	for (n=0; n<8; n++) {
+
+		g711_pcm2ulaw_block(ulaw, pcm + n, 65536 - n);
+		g711_pcm2alaw_block(alaw, pcm + n, 65536 - n);
+
+		for (i=0; i<65536 - n; i++) {
+			TEST_EQUALS(g711_pcm2ulaw(pcm[i + n]), ulaw[i]);
+			TEST_EQUALS(g711_pcm2alaw(pcm[i + n]), alaw[i]);
+		}
+	}
+
+	for (i=0; i<256; i++)
+		code[i] = (uint8_t)i;
+
+	for (n=0; n<8; n++) {
+
+		g711_ulaw2pcm_block(dec, code + n, 256 - n);
+		for (i=0; i<256 - n; i++)
+			TEST_EQUALS(g711_ulaw2pcm(code[i + n]), dec[i]);
+
+		g711_alaw2pcm_block(dec, code + n, 256 - n);
+		for (i=0; i<256 - n; i++)
+			TEST_EQUALS(g711_alaw2pcm(code[i + n]), dec[i]);
+
+		/* direct conversion is the same as a round trip via PCM */
+		g711_alaw2ulaw_block(conv, code + n, 256 - n);
+		for (i=0; i<256 - n; i++) {
+			TEST_EQUALS(g711_pcm2ulaw(g711_alaw2pcm(code[i + n])),
+				    conv[i]);
+		}
+
+		g711_ulaw2alaw_block(conv, code + n, 256 - n);
+		for (i=0; i<256 - n; i++) {
+			TEST_EQUALS(g711_pcm2alaw(g711_ulaw2pcm(code[i + n])),
+				    conv[i]);
+		}
+	}
+
+ out:
+	mem_deref(alaw);
+	mem_deref(ulaw);
+	mem_deref(pcm);
+
+	return err;
+}
+
+
+/*
+ * The previous path in the codec module: a function pointer call and an
+ * mbuf read or write per sample
+ */
+
+static void sample_encode(enc_h *enc, struct mbuf *dst, struct mbuf *src)
+{
+	size_t nsamp = mbuf_get_left(src) / 2;
+	uint8_t *d = dst->buf + dst->pos;
+
+	dst->end = dst->pos = (dst->pos + nsamp);
+
+	while (nsamp--)
+		*d++ = enc(mbuf_read_u16(src));
+}
+
+
+static void sample_decode(dec_h *dec, struct mbuf *dst, struct mbuf *src)
+{
+	while (mbuf_get_left(src))
+		(void)mbuf_write_u16(dst, dec(mbuf_read_u8(src)));
+}
+
+
+static uint64_t msps(uint64_t nsec)
+{
+	return nsec ? (uint64_t)PERF_ROUNDS * PERF_FRAMES * FRAME_SIZE * 1000
+		/ nsec : 0;
+}
+
+
+int test_perf_g711(void)
+{
+	/* volatile, so that the calls are not inlined */
+	enc_h * volatile encv[2] = {enc_ulaw, enc_alaw};
+	dec_h * volatile decv[2] = {dec_ulaw, dec_alaw};
+	static const char *lawv[2] = {"U-law", "A-law"};
+	struct mbuf *pcm, *code, *out;
+	uint64_t t0, t_enc[2], t_dec[2];
+	unsigned i, j, law;
+	int err = 0;
+
+	pcm  = mbuf_alloc(PERF_FRAMES * FRAME_SIZE * 2);
+	code = mbuf_alloc(PERF_FRAMES * FRAME_SIZE);
+	out  = mbuf_alloc(PERF_FRAMES * FRAME_SIZE * 2);
+	if (!pcm || !code || !out) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<PERF_FRAMES * FRAME_SIZE; i++)
+		err |= mbuf_write_u16(pcm, (uint16_t)(rand() - RAND_MAX/2));
+	if (err)
+		goto out;
+
+	(void)re_printf("g711: %u-sample frames, Msamples/s\n", FRAME_SIZE);
+
+	for (law=0; law<2; law++) {
+
+		/* per sample */
+		t0 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++) {
+			pcm->pos = 0;
+			for (j=0; j<PERF_FRAMES; j++) {
+				code->pos = j * FRAME_SIZE;
+				pcm->end = (j + 1) * FRAME_SIZE * 2;
+				sample_encode(encv[law], code, pcm);
+			}
+		}
+		t_enc[0] = test_nsec() - t0;
+
+		t0 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++) {
+			code->pos = 0;
+			out->pos = out->end = 0;
+			sample_decode(decv[law], out, code);
+		}
+		t_dec[0] = test_nsec() - t0;
+
+		/* block */
+		t0 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++) {
+			for (j=0; j<PERF_FRAMES; j++) {
+				const int16_t *s = (void *)&pcm->buf[j * FRAME_SIZE
+								     * 2];
+				uint8_t *d = &code->buf[j * FRAME_SIZE];
+
+				if (law)
+					g711_pcm2alaw_block(d, s, FRAME_SIZE);
+				else
+					g711_pcm2ulaw_block(d, s, FRAME_SIZE);
+			}
+		}
+		t_enc[1] = test_nsec() - t0;
+
+		t0 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++) {
+			for (j=0; j<PERF_FRAMES; j++) {
+				const uint8_t *s = &code->buf[j * FRAME_SIZE];
+				int16_t *d = (void *)&out->buf[j * FRAME_SIZE * 2];
+
+				if (law)
+					g711_alaw2pcm_block(d, s, FRAME_SIZE);
+				else
+					g711_ulaw2pcm_block(d, s, FRAME_SIZE);
+			}
+		}
+		t_dec[1] = test_nsec() - t0;
+
+		(void)re_printf("  %s encode:  per sample %5llu  block %5llu\n",
+				lawv[law], msps(t_enc[0]), msps(t_enc[1]));
+		(void)re_printf("  %s decode:  per sample %5llu  block %5llu\n",
+				lawv[law], msps(t_dec[0]), msps(t_dec[1]));
+	}
+
+	/* A-law to U-law: via 16-bit PCM, or with one table */
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++) {
+		for (j=0; j<PERF_FRAMES; j++) {
+			int16_t *tmp = (void *)out->buf;
+			uint8_t *c = &code->buf[j * FRAME_SIZE];
+
+			g711_alaw2pcm_block(tmp, c, FRAME_SIZE);
+			g711_pcm2ulaw_block(c, tmp, FRAME_SIZE);
+		}
+	}
+	t_enc[0] = test_nsec() - t0;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++) {
+		for (j=0; j<PERF_FRAMES; j++) {
+			uint8_t *c = &code->buf[j * FRAME_SIZE];
+
+			g711_alaw2ulaw_block(c, c, FRAME_SIZE);
+		}
+	}
+	t_enc[1] = test_nsec() - t0;
+
+	(void)re_printf("  A-law to U-law:  via PCM %5llu  direct %5llu\n",
+			msps(t_enc[0]), msps(t_enc[1]));
+
+ out:
+	mem_deref(out);
+	mem_deref(code);
+	mem_deref(pcm);
+
+	return err;
+}
@@ -0,0 +1,456 @@
+/**
+ * @file tests/h264.c  H.264 start-code scanner and packetizer -- tests and
+ *                     benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem_h264.h>
+#include "test.h"
+
+
+enum {
+	NUM_BUFS    = 20000,
+	MAX_LEN     = 300,
+	STREAM_SIZE = 4 * 1024 * 1024,
+	PERF_ROUNDS = 20,
+	PKTSIZE     = 100,                   /* RTP payload             */
+	PRESZ       = 4 + RTP_HEADER_SIZE,   /* As a TURN channel       */
+	TAG_SIZE    = 10,                    /* As an SRTP tag          */
+	NAL_FU_A    = 28,
+};
+
+
+/* The NAL units of a frame, rebuilt from its packets */
+struct rebuild {
+	struct mbuf *mb;          /* NAL units with 4-byte start codes */
+	struct mbuf *mb_frag;
+	bool tag;                 /* Append a tag to each packet       */
+	bool fu;                  /* In a fragmented NAL unit          */
+	bool marker;
+	unsigned n_pkt;
+	unsigned n_copy;          /* Packets in the fragment buffer    */
+	unsigned n_bad;
+};
+
+
+/* The word scanner from ffmpeg, as used before, as the reference */
+static const uint8_t *find_startcode_generic(const uint8_t *p,
+					     const uint8_t *end)
+{
+	const uint8_t *a = p + 4 - ((long)p & 3);
+
+	for (end -= 3; p < a && p < end; p++ ) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	for (end -= 3; p < end; p += 4) {
+		uint32_t x = *(const uint32_t*)p;
+		if ( (x - 0x01010101) & (~x) & 0x80808080 ) {
+			if (p[1] == 0 ) {
+				if ( p[0] == 0 && p[2] == 1 )
+					return p;
+				if ( p[2] == 0 && p[3] == 1 )
+					return p+1;
+			}
+			if ( p[3] == 0 ) {
+				if ( p[2] == 0 && p[4] == 1 )
+					return p+2;
+				if ( p[4] == 0 && p[5] == 1 )
+					return p+3;
+			}
+		}
+	}
+
+	for (end += 3; p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	return end + 3;
+}
+
+
+/* Every start code from p to end, in order, as the reference finds them */
+static int check_scan(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *r, *ref;
+	int err = 0;
+
+	for (;;) {
+		r   = h264_find_startcode(p, end);
+		ref = find_startcode_generic(p, end);
+		TEST_EQUALS(ref - p, r - p);
+
+		if (r == end)
+			break;
+
+		p = r + 1;
+	}
+
+ out:
+	return err;
+}
+
+
+int test_h264_startcode(void)
+{
+	static const uint8_t sc[] = {0, 0, 1};
+	uint8_t *buf;
+	size_t len, off, pos, i;
+	int err = 0;
+
+	buf = mem_alloc(MAX_LEN + 8, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	/*
+	 * One start code at every position of a block. It is found when
+	 * a byte follows it, as by the reference.
+	 */
+	for (len=4; len<=64; len++) {
+		for (pos=0; pos+4<=len; pos++) {
+
+			memset(buf, 0xff, len);
+			memcpy(&buf[pos], sc, sizeof(sc));
+
+			TEST_EQUALS((long)pos,
+				    h264_find_startcode(buf, buf + len) - buf);
+			TEST_EQUALS((long)len,
+				    h264_find_startcode(buf + pos + 1,
+							buf + len) - buf);
+			TEST_EQUALS((long)(pos + 3),
+				    h264_find_startcode(buf,
+							buf + pos + 3) - buf);
+		}
+	}
+
+	/* random bytes, mostly 0 and 1, at every alignment */
+	for (i=0; i<NUM_BUFS; i++) {
+
+		off = rand() % 8;
+		len = rand() % MAX_LEN;
+
+		for (pos=0; pos<len; pos++) {
+			const int v = rand() % 8;
+			buf[off + pos] = v < 3 ? 0 : v < 6 ? 1 : (uint8_t)v;
+		}
+
+		err = check_scan(buf + off, buf + off + len);
+		if (err)
+			break;
+	}
+
+ out:
+	mem_deref(buf);
+
+	return err;
+}
+
+
+/*
+ * An Annex B stream of random NAL units of 100 to 1500 bytes, with
+ * emulation prevention
+ */
+static size_t annexb_fill(uint8_t *buf, size_t size)
+{
+	size_t pos = 0;
+
+	while (pos + 1500 + 1500 / 2 + 4 <= size) {
+
+		size_t n = 100 + rand() % 1400;
+		unsigned zeros = 0;
+
+		buf[pos++] = 0;
+		buf[pos++] = 0;
+		buf[pos++] = 0;
+		buf[pos++] = 1;
+		buf[pos++] = 0x65;
+
+		while (n--) {
+
+			const uint8_t v = (uint8_t)rand();
+
+			if (zeros >= 2 && v <= 3) {
+				buf[pos++] = 3;
+				zeros = 0;
+			}
+
+			buf[pos++] = v;
+			zeros = v ? 0 : zeros + 1;
+		}
+	}
+
+	return pos;
+}
+
+
+static uint64_t perf_scan(const uint8_t *p, const uint8_t *end,
+			  bool generic, unsigned *nalc)
+{
+	uint64_t t0;
+	unsigned i;
+
+	*nalc = 0;
+
+	t0 = test_nsec();
+
+	for (i=0; i<PERF_ROUNDS; i++) {
+
+		const uint8_t *r = p;
+
+		for (;;) {
+			r = generic ? find_startcode_generic(r, end)
+				: h264_find_startcode(r, end);
+			if (r == end)
+				break;
+
+			++*nalc;
+			r += 3;
+		}
+	}
+
+	return test_nsec() - t0;
+}
+
+
+int test_perf_h264_startcode(void)
+{
+	uint64_t t_gen, t_new;
+	unsigned n_gen, n_new;
+	uint8_t *buf;
+	size_t len;
+	int err = 0;
+
+	buf = mem_alloc(STREAM_SIZE, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	len = annexb_fill(buf, STREAM_SIZE);
+
+	t_gen = perf_scan(buf, buf + len, true, &n_gen);
+	t_new = perf_scan(buf, buf + len, false, &n_new);
+	if (n_gen != n_new || !t_gen || !t_new) {
+		err = EBADMSG;
+		goto out;
+	}
+
+	(void)re_printf("h264: start codes of %u NAL units in %zu bytes"
+			" of Annex B\n", n_new / PERF_ROUNDS, len);
+	(void)re_printf("  word scanner %6llu  vector scanner %6llu MB/s\n",
+			(uint64_t)len * PERF_ROUNDS * 1000 / t_gen,
+			(uint64_t)len * PERF_ROUNDS * 1000 / t_new);
+
+ out:
+	mem_deref(buf);
+
+	return err;
+}
+
+
+static int pkt_handler(bool marker, struct mbuf *mb, void *arg)
+{
+	static const uint8_t sc[] = {0, 0, 0, 1};
+	static const uint8_t tag[TAG_SIZE] = {0xaa};
+	struct rebuild *rb = arg;
+	const uint8_t *p = mbuf_buf(mb);
+	const size_t n = mbuf_get_left(mb);
+	int err = 0;
+
+	++rb->n_pkt;
+
+	if (mb == rb->mb_frag)
+		++rb->n_copy;
+
+	/* one marker, on the last packet */
+	if (!n || n > PKTSIZE || mb->pos < PRESZ || rb->marker) {
+		++rb->n_bad;
+		return 0;
+	}
+
+	rb->marker = marker;
+
+	if ((p[0] & 0x1f) == NAL_FU_A) {
+
+		if (n < 3 || (rb->fu == !!(p[1] & 0x80))) {
+			++rb->n_bad;
+			return 0;
+		}
+
+		if (p[1] & 0x80) {
+			err |= mbuf_write_mem(rb->mb, sc, sizeof(sc));
+			err |= mbuf_write_u8(rb->mb,
+					     (p[0] & 0xe0) | (p[1] & 0x1f));
+		}
+
+		err |= mbuf_write_mem(rb->mb, p + 2, n - 2);
+
+		rb->fu = !(p[1] & 0x40);
+	}
+	else {
+		if (rb->fu)
+			++rb->n_bad;
+
+		err |= mbuf_write_mem(rb->mb, sc, sizeof(sc));
+		err |= mbuf_write_mem(rb->mb, p, n);
+	}
+
+	/* the RTP header goes in the headroom, the tag after the packet */
+	memset(mb->buf + mb->pos - PRESZ, 0xee, PRESZ);
+
+	if (rb->tag) {
+		mb->pos = mb->end;
+		err |= mbuf_write_mem(mb, tag, sizeof(tag));
+	}
+
+	return err;
+}
+
+
+/*
+ * A frame of NAL units of the given sizes, after headroom bytes, with
+ * start codes of three and four bytes. The expected packetizer output
+ * is written to mb_exp.
+ */
+static int frame_build(struct mbuf *mb, struct mbuf *mb_exp, size_t headroom,
+		       const size_t *sizev, size_t n)
+{
+	static const uint8_t sc[] = {0, 0, 0, 1};
+	size_t i, j;
+	int err = 0;
+
+	mbuf_rewind(mb);
+	mbuf_rewind(mb_exp);
+
+	for (i=0; i<headroom; i++)
+		err |= mbuf_write_u8(mb, 0xff);
+
+	for (i=0; i<n; i++) {
+
+		const uint8_t hdr = (i % 2) ? 0x41 : 0x65;
+
+		err |= mbuf_write_mem(mb, &sc[i % 2], sizeof(sc) - i % 2);
+		err |= mbuf_write_u8(mb, hdr);
+
+		err |= mbuf_write_mem(mb_exp, sc, sizeof(sc));
+		err |= mbuf_write_u8(mb_exp, hdr);
+
+		/* no zero bytes, which could make a start code */
+		for (j=1; j<sizev[i]; j++) {
+			const uint8_t v = 1 + rand() % 255;
+
+			err |= mbuf_write_u8(mb, v);
+			err |= mbuf_write_u8(mb_exp, v);
+		}
+	}
+
+	mb->pos = headroom;
+
+	return err;
+}
+
+
+static int check_packetize(const size_t *sizev, size_t n, size_t headroom,
+			   bool tag)
+{
+	struct mbuf *mb, *mb_exp;
+	struct rebuild rb;
+	int err;
+
+	memset(&rb, 0, sizeof(rb));
+
+	mb      = mbuf_alloc(1024);
+	mb_exp  = mbuf_alloc(1024);
+	rb.mb   = mbuf_alloc(1024);
+	rb.mb_frag = mbuf_alloc(PRESZ + PKTSIZE);
+	if (!mb || !mb_exp || !rb.mb || !rb.mb_frag) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	rb.tag = tag;
+
+	err = frame_build(mb, mb_exp, headroom, sizev, n);
+	TEST_ERR(err);
+
+	err = h264_rtp_packetize(mb, PKTSIZE, PRESZ, rb.mb_frag,
+				 pkt_handler, &rb);
+	TEST_ERR(err);
+
+	TEST_EQUALS(headroom, mb->pos);
+	TEST_EQUALS(0, rb.n_bad);
+	TEST_ASSERT(rb.marker);
+	TEST_ASSERT(!rb.fu);
+	TEST_EQUALS(mb_exp->end, rb.mb->end);
+	TEST_ASSERT(0 == memcmp(mb_exp->buf, rb.mb->buf, rb.mb->end));
+
+	/* copied only without headroom before a packet */
+	if (headroom >= PRESZ) {
+		TEST_EQUALS(0, rb.n_copy);
+	}
+	else if (headroom == 0) {
+		TEST_ASSERT(rb.n_copy > 0);
+	}
+
+ out:
+	mem_deref(rb.mb_frag);
+	mem_deref(rb.mb);
+	mem_deref(mb_exp);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * NAL units are rebuilt from the packets of a frame, as a receiver does:
+ * single NAL units up to the packet size, larger ones in FU-A. With no
+ * headroom before the frame, the first packet is copied. A tag appended
+ * by the send handler must not change the next packet.
+ */
+int test_h264_packetize(void)
+{
+	static const size_t sizev[] = {
+		1, 2, PKTSIZE - 1, PKTSIZE, PKTSIZE + 1,
+		2 * (PKTSIZE - 2), 2 * (PKTSIZE - 2) + 1,
+		2 * (PKTSIZE - 2) + 2, 3 * (PKTSIZE - 2) + 1, 1000,
+	};
+	size_t sz[3];
+	unsigned i;
+	int err = 0;
+
+	/* one NAL unit of each size, first and last */
+	for (i=0; i<ARRAY_SIZE(sizev); i++) {
+
+		sz[0] = sizev[i];
+		sz[1] = sizev[(i + 3) % ARRAY_SIZE(sizev)];
+
+		err  = check_packetize(sz, 1, PRESZ, false);
+		err |= check_packetize(sz, 2, PRESZ, true);
+		err |= check_packetize(sz, 1, 0, false);
+		err |= check_packetize(sz, 2, 0, true);
+		TEST_ERR(err);
+	}
+
+	err  = check_packetize(sizev, ARRAY_SIZE(sizev), PRESZ, true);
+	err |= check_packetize(sizev, ARRAY_SIZE(sizev), 0, true);
+	TEST_ERR(err);
+
+	/* random frames */
+	for (i=0; i<200; i++) {
+
+		sz[0] = 1 + rand() % 400;
+		sz[1] = 1 + rand() % 400;
+		sz[2] = 1 + rand() % 400;
+
+		err = check_packetize(sz, 3, rand() % (PRESZ + 4),
+				      rand() % 2);
+		TEST_ERR(err);
+	}
+
+ out:
+	return err;
+}
@@ -0,0 +1,18 @@
+#
+# srcs.mk All selftest source files.
+#
+# Copyright (C) 2010 Creytiv.com
+#
+
+TEST_SRCS	+= aubuf.c
+TEST_SRCS	+= auresamp.c
+TEST_SRCS	+= fir.c
+TEST_SRCS	+= g711.c
+TEST_SRCS	+= h264.c
+TEST_SRCS	+= vidasm.c
+TEST_SRCS	+= vidconv.c
+
+ifneq ($(HAVE_LIBPTHREAD),)
+TEST_SRCS	+= aumix.c
+TEST_SRCS	+= vidmix.c
+endif
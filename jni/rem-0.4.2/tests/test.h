@@ -0,0 +1,63 @@
+/**
+ * @file test.h  Selftest and benchmarks for librem -- internal API
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/** Fail the current test if the expression is false */
+#define TEST_ASSERT(expr)						\
+	if (!(expr)) {							\
+		(void)re_fprintf(stderr, "%s:%u: assertion failed: %s\n",\
+				 __FILE__, __LINE__, #expr);		\
+		err = EINVAL;						\
+		goto out;						\
+	}
+
+/** Fail the current test if two integers differ */
+#define TEST_EQUALS(expected, actual)					\
+	if ((expected) != (actual)) {					\
+		(void)re_fprintf(stderr, "%s:%u: expected %lld, got %lld\n",\
+				 __FILE__, __LINE__,			\
+				 (long long)(expected),			\
+				 (long long)(actual));			\
+		err = EINVAL;						\
+		goto out;						\
+	}
+
+/** Fail the current test on an error code */
+#define TEST_ERR(e)							\
+	if (e) {							\
+		(void)re_fprintf(stderr, "%s:%u: error: %m\n",		\
+				 __FILE__, __LINE__, (e));		\
+		goto out;						\
+	}
+
+
+uint64_t test_nsec(void);
+
+
+/* Tests */
+int test_aubuf_fill(void);
+int test_aubuf_overrun(void);
+int test_aubuf_wrap(void);
+int test_aubuf_flush(void);
+int test_auresamp(void);
+int test_fir(void);
+int test_g711(void);
+int test_h264_packetize(void);
+int test_h264_startcode(void);
+int test_vidasm(void);
+int test_vidconv(void);
+int test_aumix(void);
+int test_vidmix(void);
+
+
+/* Benchmarks */
+int test_perf_aubuf(void);
+int test_perf_auresamp(void);
+int test_perf_fir(void);
+int test_perf_g711(void);
+int test_perf_h264_startcode(void);
+int test_perf_vidconv(void);
+int test_perf_aumix(void);
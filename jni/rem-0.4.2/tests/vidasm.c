@@ -0,0 +1,265 @@
+/**
+ * @file tests/vidasm.c  Video frame assembler -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem_vidasm.h>
+#include "test.h"
+
+
+enum {
+	NUM_FRAMES = 300,
+	MAX_PKTS   = 5,     /* Packets per frame                   */
+	MAX_FRAMES = 4,     /* Pending frames in the assembler     */
+	SEQ_START  = 65000, /* The sequence number wraps in a trace */
+	TS_STEP    = 3000,
+	START_BIT  = 0x01,  /* As the B bit of the VP8 descriptor  */
+};
+
+
+/* A recorded RTP packet of a trace */
+struct tpkt {
+	struct rtp_header hdr;
+	unsigned frame;
+	bool start;               /* First packet of the frame       */
+};
+
+struct trace {
+	struct tpkt pktv[NUM_FRAMES * MAX_PKTS];
+	bool lossv[NUM_FRAMES];   /* Frames with a lost packet       */
+	bool dropv[NUM_FRAMES];   /* Frames which cannot be decoded  */
+	uint16_t rxv[NUM_FRAMES * MAX_PKTS];
+	unsigned n;
+	unsigned n_rx;            /* Packets passed to the decoder   */
+	unsigned n_loss;          /* Calls of the loss handler       */
+};
+
+
+static bool trace_start_handler(const struct rtp_header *hdr,
+				const struct mbuf *mb, void *arg)
+{
+	(void)hdr;
+	(void)arg;
+
+	return mbuf_get_left(mb) && (mbuf_buf(mb)[0] & START_BIT);
+}
+
+
+static void trace_pkt_handler(const struct rtp_header *hdr, struct mbuf *mb,
+			      void *arg)
+{
+	struct trace *tr = arg;
+	(void)mb;
+
+	if (tr->n_rx < ARRAY_SIZE(tr->rxv))
+		tr->rxv[tr->n_rx++] = hdr->seq;
+}
+
+
+static void trace_loss_handler(void *arg)
+{
+	struct trace *tr = arg;
+
+	++tr->n_loss;
+}
+
+
+/* Frames of 1 to MAX_PKTS packets, sent in order */
+static void trace_init(struct trace *tr)
+{
+	uint16_t seq = SEQ_START;
+	unsigned i, j, n;
+
+	memset(tr, 0, sizeof(*tr));
+
+	for (i=0; i<NUM_FRAMES; i++) {
+
+		n = 1 + rand() % MAX_PKTS;
+
+		for (j=0; j<n; j++) {
+
+			struct tpkt *pkt = &tr->pktv[tr->n++];
+
+			pkt->hdr.ver  = RTP_VERSION;
+			pkt->hdr.m    = (j == n - 1);
+			pkt->hdr.pt   = 96;
+			pkt->hdr.seq  = seq++;
+			pkt->hdr.ts   = i * TS_STEP;
+			pkt->hdr.ssrc = 0x12345678;
+			pkt->frame    = i;
+			pkt->start    = (j == 0);
+		}
+	}
+}
+
+
+/*
+ * Lose one packet of every tenth frame: the first, the last or any one.
+ * A frame with a lost packet cannot be decoded. A lost frame of one
+ * packet is not told from a lost first packet by the sequence numbers,
+ * only by the start flag. The last frames are kept, so that all drops
+ * are done.
+ */
+static void trace_lose(struct trace *tr)
+{
+	unsigned i, j, k, n;
+
+	for (i=5; i<NUM_FRAMES - 2 * MAX_FRAMES; i+=10) {
+
+		for (j=0; tr->pktv[j].frame != i; j++)
+			;
+		for (n=0; j+n < tr->n && tr->pktv[j+n].frame == i; n++)
+			;
+
+		switch ((i / 10) % 3) {
+
+		case 0:  k = j;                   break;
+		case 1:  k = j + n - 1;           break;
+		default: k = j + (unsigned)rand() % n; break;
+		}
+
+		memmove(&tr->pktv[k], &tr->pktv[k+1],
+			(tr->n - k - 1) * sizeof(tr->pktv[0]));
+		--tr->n;
+
+		tr->lossv[i] = true;
+		tr->dropv[i] = true;
+	}
+}
+
+
+/*
+ * Swap neighbouring packets, also across frames. The first packet stays
+ * first, as a frame which is complete before any packet of an earlier
+ * frame has come is the first frame of the stream.
+ */
+static void trace_reorder(struct trace *tr)
+{
+	unsigned i;
+
+	for (i=1; i+1<tr->n; i++) {
+
+		if (rand() % 4 == 0) {
+			struct tpkt tmp = tr->pktv[i];
+
+			tr->pktv[i]   = tr->pktv[i+1];
+			tr->pktv[i+1] = tmp;
+			++i;
+		}
+	}
+}
+
+
+static int seq_cmp(const void *a, const void *b)
+{
+	return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+
+/*
+ * Replay a trace, and check that exactly the frames which can be decoded
+ * are, each with all its packets and in sequence number order
+ */
+static int trace_replay(struct trace *tr)
+{
+	uint16_t expv[NUM_FRAMES * MAX_PKTS];
+	struct vidasm *va = NULL;
+	struct mbuf *mb_start, *mb_cont;
+	unsigned i, n_exp = 0, n_lost = 0;
+	int err;
+
+	mb_start = mbuf_alloc(1);
+	mb_cont  = mbuf_alloc(1);
+	if (!mb_start || !mb_cont) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_u8(mb_start, START_BIT);
+	err |= mbuf_write_u8(mb_cont, 0);
+	TEST_ERR(err);
+
+	mb_start->pos = 0;
+	mb_cont->pos  = 0;
+
+	err = vidasm_alloc(&va, MAX_FRAMES, trace_start_handler,
+			   trace_pkt_handler, trace_loss_handler, tr);
+	TEST_ERR(err);
+
+	for (i=0; i<tr->n; i++) {
+		const struct tpkt *pkt = &tr->pktv[i];
+
+		err = vidasm_put(va, &pkt->hdr, pkt->start ? mb_start : mb_cont);
+		TEST_ERR(err);
+	}
+
+	/* counted from the start of the trace, across the wrap */
+	for (i=0; i<tr->n; i++) {
+		if (!tr->dropv[tr->pktv[i].frame])
+			expv[n_exp++] = tr->pktv[i].hdr.seq - SEQ_START;
+	}
+
+	qsort(expv, n_exp, sizeof(expv[0]), seq_cmp);
+
+	for (i=0; i<NUM_FRAMES; i++)
+		n_lost += tr->lossv[i];
+
+	TEST_EQUALS(n_exp, tr->n_rx);
+	TEST_EQUALS(n_lost, tr->n_loss);
+
+	for (i=0; i<n_exp; i++) {
+		TEST_EQUALS(expv[i], (uint16_t)(tr->rxv[i] - SEQ_START));
+	}
+
+ out:
+	mem_deref(va);
+	mem_deref(mb_cont);
+	mem_deref(mb_start);
+
+	return err;
+}
+
+
+int test_vidasm(void)
+{
+	struct trace *tr;
+	int err;
+
+	tr = mem_alloc(sizeof(*tr), NULL);
+	if (!tr)
+		return ENOMEM;
+
+	/* clean */
+	trace_init(tr);
+	err = trace_replay(tr);
+	TEST_ERR(err);
+	TEST_EQUALS(0, tr->n_loss);
+
+	/* reordered */
+	trace_init(tr);
+	trace_reorder(tr);
+	err = trace_replay(tr);
+	TEST_ERR(err);
+	TEST_EQUALS(0, tr->n_loss);
+
+	/* lossy */
+	trace_init(tr);
+	trace_lose(tr);
+	err = trace_replay(tr);
+	TEST_ERR(err);
+
+	/* lossy and reordered */
+	trace_init(tr);
+	trace_lose(tr);
+	trace_reorder(tr);
+	err = trace_replay(tr);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(tr);
+
+	return err;
+}
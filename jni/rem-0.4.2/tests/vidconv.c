@@ -0,0 +1,270 @@
+/**
+ * @file tests/vidconv.c  Video conversion -- tests and benchmark
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem_vid.h>
+#include <rem_dsp.h>
+#include <rem_vidconv.h>
+#include "../src/vidconv/vconv.h"
+#include "test.h"
+
+
+enum {
+	POOL_THREADS = 4,
+	PERF_ROUNDS  = 50,
+};
+
+
+/* Conversions with a same-size fast path */
+static const struct {
+	enum vidfmt src;
+	enum vidfmt dst;
+} fmtv[] = {
+	{VID_FMT_YUV420P, VID_FMT_YUV420P},
+	{VID_FMT_YUYV422, VID_FMT_YUV420P},
+	{VID_FMT_UYVY422, VID_FMT_YUV420P},
+	{VID_FMT_RGB32,   VID_FMT_YUV420P},
+	{VID_FMT_NV12,    VID_FMT_YUV420P},
+	{VID_FMT_YUV420P, VID_FMT_RGB32},
+	{VID_FMT_YUV420P, VID_FMT_RGB565},
+	{VID_FMT_YUV420P, VID_FMT_RGB555},
+};
+
+
+static int frame_rand(struct vidframe **vfp, enum vidfmt fmt,
+		      const struct vidsz *sz)
+{
+	size_t i, n = vidframe_size(fmt, sz);
+	int err;
+
+	err = vidframe_alloc(vfp, fmt, sz);
+	if (err)
+		return err;
+
+	/* the planes are contiguous, starting at data[0] */
+	for (i=0; i<n; i++)
+		(*vfp)->data[0][i] = (uint8_t)rand();
+
+	return 0;
+}
+
+
+static void frame_clear(struct vidframe *vf)
+{
+	memset(vf->data[0], 0, vidframe_size(vf->fmt, &vf->size));
+}
+
+
+/* Convert with the scaling line converters only */
+static void conv_scaling(struct vidframe *dst, const struct vidframe *src)
+{
+	struct vidconv_job job;
+
+	if (!vidconv_job_init(&job, dst, src, NULL))
+		return;
+
+	job.fasth = NULL;
+	vidconv_job_run(&job, 0, job.r.h);
+}
+
+
+static int check_fmt(enum vidfmt sfmt, enum vidfmt dfmt,
+		     const struct vidsz *sz, struct vidconv_pool *pool)
+{
+	struct vidframe *src = NULL, *ref = NULL, *dst = NULL;
+	size_t n;
+	int err;
+
+	err  = frame_rand(&src, sfmt, sz);
+	err |= frame_rand(&ref, dfmt, sz);
+	err |= frame_rand(&dst, dfmt, sz);
+	TEST_ERR(err);
+
+	n = vidframe_size(dfmt, sz);
+
+	frame_clear(ref);
+	conv_scaling(ref, src);
+
+	/* the fast path gives the same output as the scaling path */
+	frame_clear(dst);
+	vidconv(dst, src, NULL);
+	TEST_ASSERT(0 == memcmp(ref->data[0], dst->data[0], n));
+
+	/* and so do the slices of the pool */
+	if (pool) {
+		frame_clear(dst);
+		vidconv_pool(pool, dst, src, NULL);
+		TEST_ASSERT(0 == memcmp(ref->data[0], dst->data[0], n));
+	}
+
+ out:
+	if (err) {
+		(void)re_fprintf(stderr, "vidconv: %s -> %s, %u x %u\n",
+				 vidfmt_name(sfmt), vidfmt_name(dfmt),
+				 sz->w, sz->h);
+	}
+
+	mem_deref(dst);
+	mem_deref(ref);
+	mem_deref(src);
+
+	return err;
+}
+
+
+/* Area averaging falls back to nearest neighbour for large ratios */
+static int check_area(void)
+{
+	const struct vidsz ssz = {1280, 720}, big = {32, 18}, small = {16, 8};
+	struct vidframe *src = NULL, *dst = NULL, *ref = NULL;
+	int err;
+
+	err  = frame_rand(&src, VID_FMT_YUV420P, &ssz);
+	err |= frame_rand(&dst, VID_FMT_YUV420P, &small);
+	err |= frame_rand(&ref, VID_FMT_YUV420P, &small);
+	TEST_ERR(err);
+
+	err  = vidconv_scale(ref, src, NULL, VIDCONV_NEAREST);
+	err |= vidconv_scale(dst, src, NULL, VIDCONV_AREA);
+	TEST_ERR(err);
+
+	TEST_ASSERT(0 == memcmp(ref->data[0], dst->data[0],
+				vidframe_size(VID_FMT_YUV420P, &small)));
+
+	/* 40:1 still uses area averaging */
+	dst = mem_deref(dst);
+	err = frame_rand(&dst, VID_FMT_YUV420P, &big);
+	TEST_ERR(err);
+
+	err = vidconv_scale(dst, src, NULL, VIDCONV_AREA);
+	TEST_ERR(err);
+
+ out:
+	mem_deref(ref);
+	mem_deref(dst);
+	mem_deref(src);
+
+	return err;
+}
+
+
+int test_vidconv(void)
+{
+	static const struct vidsz szv[] = {
+		{2, 2}, {34, 18}, {352, 288}, {640, 480}
+	};
+	struct vidconv_pool *pool = NULL;
+	size_t i, j;
+	int err;
+
+	/* the pool is optional, there are no threads without pthread */
+	err = vidconv_pool_alloc(&pool, POOL_THREADS);
+	if (err == ENOSYS)
+		err = 0;
+	TEST_ERR(err);
+
+	for (i=0; i<ARRAY_SIZE(fmtv); i++) {
+
+		TEST_ASSERT(NULL != vidconv_fast_get(fmtv[i].src,
+						     fmtv[i].dst));
+
+		for (j=0; j<ARRAY_SIZE(szv); j++) {
+
+			err = check_fmt(fmtv[i].src, fmtv[i].dst, &szv[j],
+					pool);
+			if (err)
+				goto out;
+		}
+	}
+
+	err = check_area();
+
+ out:
+	mem_deref(pool);
+
+	return err;
+}
+
+
+static int perf_fmt(enum vidfmt sfmt, enum vidfmt dfmt,
+		    const struct vidsz *sz, struct vidconv_pool *pool)
+{
+	struct vidframe *src = NULL, *dst = NULL;
+	uint64_t t0, t_scale, t_fast, t_pool = 0;
+	unsigned i;
+	int err;
+
+	err  = frame_rand(&src, sfmt, sz);
+	err |= frame_rand(&dst, dfmt, sz);
+	if (err)
+		goto out;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++)
+		conv_scaling(dst, src);
+	t_scale = test_nsec() - t0;
+
+	t0 = test_nsec();
+	for (i=0; i<PERF_ROUNDS; i++)
+		vidconv(dst, src, NULL);
+	t_fast = test_nsec() - t0;
+
+	if (pool) {
+		t0 = test_nsec();
+		for (i=0; i<PERF_ROUNDS; i++)
+			vidconv_pool(pool, dst, src, NULL);
+		t_pool = test_nsec() - t0;
+	}
+
+	(void)re_printf("  %-8s -> %-8s  scaling %5llu  fast %5llu"
+			"  pool %5llu us/frame\n",
+			vidfmt_name(sfmt), vidfmt_name(dfmt),
+			t_scale / PERF_ROUNDS / 1000,
+			t_fast / PERF_ROUNDS / 1000,
+			t_pool / PERF_ROUNDS / 1000);
+
+ out:
+	mem_deref(dst);
+	mem_deref(src);
+
+	return err;
+}
+
+
+int test_perf_vidconv(void)
+{
+	static const struct vidsz szv[] = {{640, 480}, {1280, 720}};
+	struct vidconv_pool *pool = NULL;
+	size_t i, j;
+	int err;
+
+	err = vidconv_pool_alloc(&pool, POOL_THREADS);
+	if (err == ENOSYS)
+		err = 0;
+	else if (err)
+		return err;
+
+	for (j=0; j<ARRAY_SIZE(szv); j++) {
+
+		(void)re_printf("vidconv: %u x %u, same size, pool of %u"
+				" threads\n", szv[j].w, szv[j].h,
+				POOL_THREADS);
+
+		for (i=0; i<ARRAY_SIZE(fmtv); i++) {
+
+			err = perf_fmt(fmtv[i].src, fmtv[i].dst, &szv[j],
+				       pool);
+			if (err)
+				goto out;
+		}
+	}
+
+ out:
+	mem_deref(pool);
+
+	return err;
+}
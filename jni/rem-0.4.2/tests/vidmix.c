@@ -0,0 +1,281 @@
+/**
+ * @file tests/vidmix.c  Video mixer tile cache -- tests
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <pthread.h>
+#include <string.h>
+#include <re.h>
+#include <rem_vid.h>
+#include <rem_vidmix.h>
+#include "test.h"
+
+
+enum {
+	NUM_OUT   = 5,    /* One more tile size than the cache holds */
+	FPS       = 100,
+	WAIT_MS   = 5000,
+	PART_Y    = 200,  /* The participant, a solid colour         */
+	PART_U    = 60,
+	PART_V    = 180,
+};
+
+
+/* An output of the mixer, composing a layout with the participant */
+struct output {
+	struct vidmix_source *src;
+	struct vidsz sz;
+	unsigned n_frames;
+	unsigned n_bad;       /* Frames without the participant's tile */
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool pixel_is(const struct vidframe *vf, unsigned x, unsigned y,
+		     uint8_t py, uint8_t pu, uint8_t pv)
+{
+	const unsigned ly = vf->linesize[0], lu = vf->linesize[1];
+	const unsigned lv = vf->linesize[2];
+
+	return vf->data[0][y * ly + x] == py &&
+		vf->data[1][(y/2) * lu + x/2] == pu &&
+		vf->data[2][(y/2) * lv + x/2] == pv;
+}
+
+
+/*
+ * A single participant is put in the top left quarter of the layout, in
+ * the middle of it, and the rest is clear
+ */
+static void frame_handler(uint32_t ts, const struct vidframe *frame,
+			  void *arg)
+{
+	struct output *out = arg;
+	const unsigned w = frame->size.w, h = frame->size.h;
+	bool ok;
+	(void)ts;
+
+	ok = pixel_is(frame, w / 4, h / 4, PART_Y, PART_U, PART_V) &&
+		!pixel_is(frame, 3 * w / 4, 3 * h / 4,
+			  PART_Y, PART_U, PART_V);
+
+	pthread_mutex_lock(&mutex);
+	++out->n_frames;
+	if (!ok)
+		++out->n_bad;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+static unsigned frames_get(const struct output *out)
+{
+	unsigned n;
+
+	pthread_mutex_lock(&mutex);
+	n = out->n_frames;
+	pthread_mutex_unlock(&mutex);
+
+	return n;
+}
+
+
+/* The cached tiles and the scalings done, from the debug output */
+static int tiles_get(const struct vidmix_source *src, uint32_t *tiles,
+		     uint32_t *scaled)
+{
+	struct pl pl_tiles, pl_scaled;
+	char *str = NULL;
+	int err;
+
+	err = re_sdprintf(&str, "%H", vidmix_source_debug, src);
+	if (err)
+		return err;
+
+	err = re_regex(str, strlen(str), "tiles=[0-9]+/[0-9]+ scaled=[0-9]+",
+		       &pl_tiles, NULL, &pl_scaled);
+	if (!err) {
+		*tiles  = pl_u32(&pl_tiles);
+		*scaled = pl_u32(&pl_scaled);
+	}
+
+	mem_deref(str);
+
+	return err;
+}
+
+
+/* Wait until each running output has composed n more frames */
+static int outputs_wait(struct output *outv, unsigned n)
+{
+	unsigned startv[NUM_OUT], i, t;
+
+	for (i=0; i<NUM_OUT; i++)
+		startv[i] = frames_get(&outv[i]);
+
+	for (i=0; i<NUM_OUT; i++) {
+
+		if (!vidmix_source_isrunning(outv[i].src))
+			continue;
+
+		for (t=0; frames_get(&outv[i]) < startv[i] + n; t++) {
+
+			if (t >= WAIT_MS)
+				return ETIMEDOUT;
+
+			sys_msleep(1);
+		}
+	}
+
+	return 0;
+}
+
+
+static int participant_put(struct vidmix_source *part)
+{
+	struct vidframe *frame;
+	struct vidsz sz = {320, 240};
+	int err;
+
+	err = vidframe_alloc(&frame, VID_FMT_YUV420P, &sz);
+	if (err)
+		return err;
+
+	memset(frame->data[0], PART_Y, frame->linesize[0] * sz.h);
+	memset(frame->data[1], PART_U, frame->linesize[1] * sz.h / 2);
+	memset(frame->data[2], PART_V, frame->linesize[2] * sz.h / 2);
+
+	vidmix_source_put(part, frame);
+
+	mem_deref(frame);
+
+	return 0;
+}
+
+
+/*
+ * The outputs have a tile size each. A tile is scaled once per received
+ * frame, and the cache keeps the tile sizes in use: when a fifth size
+ * comes, the least recently used tile is replaced.
+ */
+int test_vidmix(void)
+{
+	static const struct vidsz szv[NUM_OUT] = {
+		{320, 240}, {640, 480}, {352, 288}, {176, 144}, {800, 600}
+	};
+	struct output outv[NUM_OUT];
+	struct vidmix *mix = NULL;
+	struct vidmix_source *part = NULL;
+	uint32_t tiles = 0, scaled = 0, scaled0;
+	unsigned i;
+	int err;
+
+	memset(outv, 0, sizeof(outv));
+
+	err = vidmix_alloc(&mix);
+	TEST_ERR(err);
+
+	err = vidmix_source_alloc(&part, mix, NULL, FPS, frame_handler, NULL);
+	TEST_ERR(err);
+
+	vidmix_source_enable(part, true);
+
+	err = participant_put(part);
+	TEST_ERR(err);
+
+	/* the outputs only receive, so they are not in the layout */
+	for (i=0; i<NUM_OUT; i++) {
+
+		outv[i].sz = szv[i];
+
+		err = vidmix_source_alloc(&outv[i].src, mix, &szv[i], FPS,
+					  frame_handler, &outv[i]);
+		TEST_ERR(err);
+	}
+
+	/* four sizes, one scaling each */
+	for (i=0; i<NUM_OUT - 1; i++) {
+		err = vidmix_source_start(outv[i].src);
+		TEST_ERR(err);
+	}
+
+	err = outputs_wait(outv, 3);
+	TEST_ERR(err);
+
+	err = tiles_get(part, &tiles, &scaled);
+	TEST_ERR(err);
+	TEST_EQUALS(NUM_OUT - 1, tiles);
+	TEST_EQUALS(NUM_OUT - 1, scaled);
+
+	/* a new frame invalidates every tile */
+	err = participant_put(part);
+	TEST_ERR(err);
+
+	err = outputs_wait(outv, 3);
+	TEST_ERR(err);
+
+	err = tiles_get(part, &tiles, &scaled);
+	TEST_ERR(err);
+	TEST_EQUALS(2 * (NUM_OUT - 1), scaled);
+
+	/* a fifth size replaces the tile of the stopped output, which is
+	 * the least recently used once the others have been composed */
+	vidmix_source_stop(outv[0].src);
+
+	err = outputs_wait(outv, 2);
+	TEST_ERR(err);
+
+	err = vidmix_source_start(outv[NUM_OUT - 1].src);
+	TEST_ERR(err);
+
+	err = outputs_wait(outv, 3);
+	TEST_ERR(err);
+
+	err = tiles_get(part, &tiles, &scaled);
+	TEST_ERR(err);
+	TEST_EQUALS(NUM_OUT - 1, tiles);
+	TEST_EQUALS(2 * (NUM_OUT - 1) + 1, scaled);
+
+	/* and the first size comes back in place of the fifth */
+	vidmix_source_stop(outv[NUM_OUT - 1].src);
+
+	err = outputs_wait(outv, 2);
+	TEST_ERR(err);
+
+	err = vidmix_source_start(outv[0].src);
+	TEST_ERR(err);
+
+	err = outputs_wait(outv, 3);
+	TEST_ERR(err);
+
+	scaled0 = scaled;
+
+	err = tiles_get(part, &tiles, &scaled);
+	TEST_ERR(err);
+	TEST_EQUALS(scaled0 + 1, scaled);
+
+	/* no frame, no scaling */
+	err = outputs_wait(outv, 3);
+	TEST_ERR(err);
+
+	err = tiles_get(part, &tiles, &scaled);
+	TEST_ERR(err);
+	TEST_EQUALS(scaled0 + 1, scaled);
+
+	for (i=0; i<NUM_OUT; i++)
+		vidmix_source_stop(outv[i].src);
+
+	/* the layout, made of plane copies of the cached tiles */
+	for (i=0; i<NUM_OUT; i++) {
+		TEST_ASSERT(outv[i].n_frames > 0);
+		TEST_EQUALS(0, outv[i].n_bad);
+	}
+
+ out:
+	for (i=0; i<NUM_OUT; i++)
+		mem_deref(outv[i].src);
+	mem_deref(part);
+	mem_deref(mix);
+
+	return err;
+}